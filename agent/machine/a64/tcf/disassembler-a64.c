@@ -28,6 +28,8 @@ static size_t buf_pos = 0;
 static DisassemblerParams * params = NULL;
 static uint64_t instr_addr = 0;
 static uint32_t instr = 0;
+static int flow = 0;
+static uint64_t flow_target = 0;
 
 static const char * cond_names[] = {
     "eq", "ne", "cs", "cc", "mi", "pl", "vs", "vc",
@@ -614,6 +616,7 @@ static void branch_exception_system(void) {
         int32_t imm = instr & 0x3ffffff;
         add_str(instr & (1u << 31) ? "bl" : "b");
         add_char(' ');
+        flow = instr & (1u << 31) ? DISASM_FLOW_CALL : DISASM_FLOW_JUMP;
         if (imm & 0x02000000) {
             imm |= 0xfc000000;
             add_char('-');
@@ -623,7 +626,8 @@ static void branch_exception_system(void) {
             add_char('+');
             add_dec_uint32(imm);
         }
-        add_addr(instr_addr + ((int64_t)imm << 2));
+        flow_target = instr_addr + ((int64_t)imm << 2);
+        add_addr(flow_target);
         return;
     }
 
@@ -632,6 +636,7 @@ static void branch_exception_system(void) {
         int sf = (instr & (1u << 31)) != 0;
         int32_t imm = (instr >> 5) & 0x7ffff;
         add_str(instr & (1u << 24) ? "cbnz" : "cbz");
+        flow = DISASM_FLOW_BRANCH;
         add_char(' ');
         add_reg_name(instr & 0x1f, sf, 1);
         add_str(", ");
@@ -644,7 +649,8 @@ static void branch_exception_system(void) {
             add_char('+');
             add_dec_uint32(imm);
         }
-        add_addr(instr_addr + ((int64_t)imm << 2));
+        flow_target = instr_addr + ((int64_t)imm << 2);
+        add_addr(flow_target);
         return;
     }
 
@@ -653,6 +659,7 @@ static void branch_exception_system(void) {
         int sf = (instr & (1u << 31)) != 0;
         int32_t imm = (instr >> 5) & 0x3fff;
         add_str(instr & (1u << 24) ? "tbnz" : "tbz");
+        flow = DISASM_FLOW_BRANCH;
         add_char(' ');
         add_reg_name(instr & 0x1f, sf, 1);
         add_str(", #");
@@ -667,7 +674,8 @@ static void branch_exception_system(void) {
             add_char('+');
             add_dec_uint32(imm);
         }
-        add_addr(instr_addr + ((int64_t)imm << 2));
+        flow_target = instr_addr + ((int64_t)imm << 2);
+        add_addr(flow_target);
         return;
     }
 
@@ -676,6 +684,7 @@ static void branch_exception_system(void) {
         int32_t imm = (instr >> 5) & 0x7ffff;
         add_str("b.");
         add_str(cond_names[instr & 0xf]);
+        flow = DISASM_FLOW_BRANCH;
         add_char(' ');
         if (imm & 0x00040000) {
             imm |= 0xfffc0000;
@@ -686,7 +695,8 @@ static void branch_exception_system(void) {
             add_char('+');
             add_dec_uint32(imm);
         }
-        add_addr(instr_addr + ((int64_t)imm << 2));
+        flow_target = instr_addr + ((int64_t)imm << 2);
+        add_addr(flow_target);
         return;
     }
 
@@ -888,9 +898,9 @@ static void branch_exception_system(void) {
         uint32_t rn = (instr >> 5) & 0x1f;
         if (op2 == 31 && op3 == 0 && op4 == 0) {
             switch (opc) {
-            case 0: add_str("br"); break;
-            case 1: add_str("blr"); break;
-            case 2: add_str("ret"); break;
+            case 0: add_str("br"); flow = DISASM_FLOW_INDIRECT; break;
+            case 1: add_str("blr"); flow = DISASM_FLOW_CALL; break;
+            case 2: add_str("ret"); flow = DISASM_FLOW_INDIRECT; break;
             }
             if (buf_pos > 0) {
                 if (opc == 2 && rn == 30) return;
@@ -899,8 +909,8 @@ static void branch_exception_system(void) {
             }
             else if (rn == 31) {
                 switch (opc) {
-                case 4: add_str("eret"); break;
-                case 5: add_str("drps"); break;
+                case 4: add_str("eret"); flow = DISASM_FLOW_INDIRECT; break;
+                case 5: add_str("drps"); flow = DISASM_FLOW_INDIRECT; break;
                 }
             }
         }
@@ -2890,6 +2900,8 @@ DisassemblyResult * disassemble_a64(uint8_t * code,
     instr_addr = addr;
     for (i = 0; i < 4; i++) instr |= (uint32_t)*code++ << (i * 8);
     params = disass_params;
+    flow = DISASM_FLOW_NEXT;
+    flow_target = 0;
 
     if ((instr & 0x1c000000) == 0x10000000) data_processing_immediate();
     else if ((instr & 0x1c000000) == 0x14000000) branch_exception_system();
@@ -2903,6 +2915,8 @@ DisassemblyResult * disassemble_a64(uint8_t * code,
     }
     else {
         buf[buf_pos] = 0;
+        dr.flow = flow;
+        dr.target = (ContextAddress)flow_target;
     }
     return &dr;
 }
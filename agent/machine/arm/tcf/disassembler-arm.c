@@ -3053,6 +3053,45 @@ static void disassemble_supervisor_and_ext_load_store(uint32_t instr, const char
     }
 }
 
+static void get_flow(uint32_t addr, uint32_t instr, uint8_t cond, DisassemblyResult * dr) {
+    /* Instructions that can write PC, other instructions continue at next instruction */
+    dr->flow = DISASM_FLOW_NEXT;
+    if (cond == 15) {
+        if ((instr & 0x0e000000) == 0x0a000000) {
+            /* BLX (immediate), switches to Thumb state */
+            dr->flow = DISASM_FLOW_CALL;
+        }
+        else if ((instr & 0x0e500000) == 0x08100000) {
+            /* RFE */
+            dr->flow = DISASM_FLOW_INDIRECT;
+        }
+    }
+    else if ((instr & 0x0e000000) == 0x0a000000) {
+        /* B, BL */
+        uint32_t offs = (instr & 0x00ffffff) << 2;
+        if (offs & 0x02000000) offs |= 0xfc000000;
+        dr->target = addr + 8 + offs;
+        if (instr & 0x01000000) dr->flow = DISASM_FLOW_CALL;
+        else dr->flow = cond == 14 ? DISASM_FLOW_JUMP : DISASM_FLOW_BRANCH;
+    }
+    else if ((instr & 0x0ffffff0) == 0x012fff30) {
+        /* BLX (register) */
+        dr->flow = DISASM_FLOW_CALL;
+    }
+    else if ((instr & 0x0fffffc0) == 0x012fff00) {
+        /* BX, BXJ */
+        dr->flow = DISASM_FLOW_INDIRECT;
+    }
+    else if ((instr & 0x0e108000) == 0x08108000) {
+        /* LDM with PC in the register list */
+        dr->flow = DISASM_FLOW_INDIRECT;
+    }
+    else if ((instr & 0x08000000) == 0 && (instr & 0x0000f000) == 0x0000f000) {
+        /* Data processing or load with PC as destination */
+        dr->flow = DISASM_FLOW_INDIRECT;
+    }
+}
+
 DisassemblyResult * disassemble_arm(uint8_t * code,
         ContextAddress addr, ContextAddress size, DisassemblerParams * params) {
     unsigned i;
@@ -3093,6 +3132,7 @@ DisassemblyResult * disassemble_arm(uint8_t * code,
     }
     else {
         buf[buf_pos] = 0;
+        get_flow((uint32_t)addr, instr, cond, &dr);
     }
     return &dr;
 }
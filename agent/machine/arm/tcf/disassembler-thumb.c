@@ -1711,6 +1711,7 @@ static void disassemble_thumb7(void) {
 static DisassemblyResult * disassemble_arm_ti(uint8_t * code, ContextAddress addr, ContextAddress size) {
     const char * p;
     DisassemblyResult * dr = disassemble_arm(code, addr, size, params);
+    if (dr != NULL) dr->flow = DISASM_FLOW_UNKNOWN;
     if (dr == NULL || dr->text == NULL || it_cond_name == NULL) return dr;
     p = dr->text;
     while (*p && *p != ' ') buf[buf_pos++] = *p++;
@@ -14,14 +14,16 @@
  *******************************************************************************/
 
 #include <tcf/config.h>
+#include <machine/x86_64/tcf/disassembler-x86_64.h>
 
-#if SERVICE_Disassembly
+#if ENABLE_DisassemblerX86_64
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <tcf/framework/errors.h>
 #include <tcf/framework/context.h>
 #include <tcf/services/symbols.h>
-#include <machine/x86_64/tcf/disassembler-x86_64.h>
 
 #define PREFIX_LOCK         0x0001
 #define PREFIX_REPNZ        0x0002
@@ -53,6 +55,10 @@ static uint8_t rex = 0;
 static unsigned data_size = 0;
 static unsigned addr_size = 0;
 static int x86_64 = 0;
+static size_t rel_pos = 0;
+static unsigned rel_size = 0;
+static int flow = 0;
+static uint64_t flow_target = 0;
 
 static uint8_t get_code(void) {
     uint8_t c = 0;
@@ -313,7 +319,6 @@ static void add_imm32(void) {
     add_hex_uint32(imm);
 }
 
-#if 0 /* Not used yet */
 static void add_imm64(void) {
     uint64_t imm = get_code();
     imm |= (uint64_t)get_code() << 8;
@@ -326,7 +331,6 @@ static void add_imm64(void) {
     add_str("0x");
     add_hex_uint64(imm);
 }
-#endif
 
 static void add_moffs(int wide) {
     uint64_t addr = 0;
@@ -348,6 +352,8 @@ static void add_rel(unsigned size) {
     uint64_t mask = sign - 1;
     unsigned i = 0;
 
+    rel_pos = code_pos;
+    rel_size = size;
     while (i < size) {
         offs |= (uint64_t)get_code() << (i * 8);
         i++;
@@ -357,13 +363,15 @@ static void add_rel(unsigned size) {
         offs = (offs ^ (sign | mask)) + 1;
         add_str("-0x");
         add_hex_uint64(offs);
-        add_addr(instr_addr + code_pos - offs);
+        flow_target = instr_addr + code_pos - offs;
     }
     else {
         add_str("+0x");
         add_hex_uint64(offs);
-        add_addr(instr_addr + code_pos + offs);
+        flow_target = instr_addr + code_pos + offs;
     }
+    if (!x86_64) flow_target &= 0xffffffff;
+    add_addr(flow_target);
 }
 
 static void add_modrm(unsigned modrm, unsigned size) {
@@ -380,12 +388,8 @@ static void add_modrm(unsigned modrm, unsigned size) {
         case 8: add_str("qword"); break;
         }
         add_char('[');
-        if (addr_size == 4) {
+        if (addr_size >= 4) {
             switch (rm) {
-            case 0: add_str("eax"); break;
-            case 1: add_str("acx"); break;
-            case 2: add_str("edx"); break;
-            case 3: add_str("ebx"); break;
             case 4:
                 {
                     uint8_t sib = get_code();
@@ -394,12 +398,13 @@ static void add_modrm(unsigned modrm, unsigned size) {
                     unsigned scale = (sib >> 6) & 3;
                     int bs = 0;
                     if ((mod == 0 && base != 5) || mod == 1 || mod == 2) {
-                        add_reg(base, 4);
+                        add_reg(base | (rex & REX_B ? 8 : 0), addr_size);
                         bs = 1;
                     }
+                    index |= rex & REX_X ? 8 : 0;
                     if (index != 4) {
                         if (bs) add_char('+');
-                        add_reg(index, 4);
+                        add_reg(index, addr_size);
                         switch (scale) {
                         case 1: add_str("*2"); break;
                         case 2: add_str("*4"); break;
@@ -417,9 +422,13 @@ static void add_modrm(unsigned modrm, unsigned size) {
                     add_char(']');
                 }
                 return;
-            case 5: if (mod != 0) add_str("ebp"); break;
-            case 6: add_str("esi"); break;
-            case 7: add_str("edi"); break;
+            case 5:
+                if (mod != 0) add_reg(rm | (rex & REX_B ? 8 : 0), addr_size);
+                else if (addr_size == 8) add_str("rip+");
+                break;
+            default:
+                add_reg(rm | (rex & REX_B ? 8 : 0), addr_size);
+                break;
             }
         }
         else {
@@ -438,7 +447,12 @@ static void add_modrm(unsigned modrm, unsigned size) {
         case 0:
             if (addr_size == 2 && rm == 6) add_disp16();
             if (addr_size == 4 && rm == 5) add_disp32();
-            if (addr_size == 8 && rm == 5) add_disp32();
+            if (addr_size == 8 && rm == 5) {
+                /* RIP relative addressing */
+                rel_pos = code_pos;
+                rel_size = 4;
+                add_disp32();
+            }
             break;
         case 1:
             add_disp8();
@@ -484,6 +498,20 @@ static void disassemble_0f(void) {
     uint8_t modrm = 0;
 
     switch (opcode) {
+    case 0x1e:
+        if (prefix & PREFIX_REPZ) {
+            switch (get_code()) {
+            case 0xfa:
+                buf_pos = 0;
+                add_str("endbr64");
+                return;
+            case 0xfb:
+                buf_pos = 0;
+                add_str("endbr32");
+                return;
+            }
+        }
+        break;
     case 0x1f:
         modrm = get_code();
         add_str("nop ");
@@ -495,7 +523,7 @@ static void disassemble_0f(void) {
             if (prefix & PREFIX_DATA_SIZE) {
                 modrm = get_code();
                 add_str("adcx ");
-                add_reg((modrm >> 3) & 7, data_size);
+                add_reg((modrm >> 3) & 7, rex & REX_W ? 8 : 4);
                 add_char(',');
                 add_modrm(modrm, 1);
                 return;
@@ -519,6 +547,7 @@ static void disassemble_0f(void) {
     case 0x8d:
     case 0x8e:
     case 0x8f:
+        flow = DISASM_FLOW_BRANCH;
         add_char('j');
         add_ttt(opcode & 0xf);
         add_char(' ');
@@ -774,6 +803,7 @@ static void disassemble_instr(void) {
     case 0x7d:
     case 0x7e:
     case 0x7f:
+        flow = DISASM_FLOW_BRANCH;
         add_char('j');
         add_ttt(opcode & 0xf);
         add_char(' ');
@@ -891,6 +921,7 @@ static void disassemble_instr(void) {
         }
         break;
     case 0x9a:
+        flow = DISASM_FLOW_CALL;
         add_str("call ");
         add_imm16();
         add_char(':');
@@ -954,7 +985,8 @@ static void disassemble_instr(void) {
         add_str("mov ");
         add_reg(opcode & 7, data_size);
         add_char(',');
-        if (addr_size <= 2) add_imm16();
+        if (data_size == 2) add_imm16();
+        else if (data_size == 8) add_imm64();
         else add_imm32();
         return;
     case 0xc0:
@@ -966,10 +998,12 @@ static void disassemble_instr(void) {
         add_imm8();
         return;
     case 0xc2:
+        flow = DISASM_FLOW_INDIRECT;
         add_str("ret ");
         add_imm16();
         return;
     case 0xc3:
+        flow = DISASM_FLOW_INDIRECT;
         add_str("ret");
         return;
     case 0xc6:
@@ -990,7 +1024,7 @@ static void disassemble_instr(void) {
             add_str("mov ");
             add_modrm(modrm, data_size);
             add_char(',');
-            if (addr_size <= 2) add_imm16();
+            if (data_size == 2) add_imm16();
             else add_imm32();
             return;
         }
@@ -1005,10 +1039,12 @@ static void disassemble_instr(void) {
         add_str("leave");
         return;
     case 0xca:
+        flow = DISASM_FLOW_INDIRECT;
         add_str("ret ");
         add_imm16();
         return;
     case 0xcb:
+        flow = DISASM_FLOW_INDIRECT;
         add_str("ret");
         return;
     case 0xd0:
@@ -1026,6 +1062,7 @@ static void disassemble_instr(void) {
         add_str(",cl");
         return;
     case 0xe3:
+        flow = DISASM_FLOW_BRANCH;
         switch (data_size) {
         case 2:
             add_str("jcxz ");
@@ -1042,6 +1079,7 @@ static void disassemble_instr(void) {
         }
         break;
     case 0xe8:
+        flow = DISASM_FLOW_CALL;
         add_str("call ");
         add_rel(addr_size <= 2 ? 2: 4);
         return;
@@ -1062,10 +1100,12 @@ static void disassemble_instr(void) {
         }
         return;
     case 0xe9:
+        flow = DISASM_FLOW_JUMP;
         add_str("jmp ");
         add_rel(4);
         return;
     case 0xeb:
+        flow = DISASM_FLOW_JUMP;
         add_str("jmp ");
         add_rel(1);
         return;
@@ -1117,10 +1157,12 @@ static void disassemble_instr(void) {
             add_modrm(modrm, data_size);
             return;
         case 2:
+            flow = DISASM_FLOW_CALL;
             add_str("call ");
             add_modrm(modrm, data_size);
             return;
         case 4:
+            flow = DISASM_FLOW_INDIRECT;
             add_str("jmp ");
             add_modrm(modrm, data_size);
             return;
@@ -1135,6 +1177,421 @@ static void disassemble_instr(void) {
     buf_pos = 0;
 }
 
+/*
+ * Instruction structure decoder.
+ * Opcode tables give ModRM presence, immediate operand kind and control flow of every opcode,
+ * so length, branch target and memory operand of an instruction are found without formatting text.
+ */
+
+/* Opcode attributes: immediate operand */
+#define OP_I_NONE       0x0000
+#define OP_I_B          0x0001  /* 8-bit */
+#define OP_I_W          0x0002  /* 16-bit */
+#define OP_I_D          0x0003  /* 32-bit */
+#define OP_I_Z          0x0004  /* 16 or 32-bit, depends on operand size */
+#define OP_I_V          0x0005  /* 16, 32 or 64-bit, depends on operand size */
+#define OP_I_WB         0x0006  /* 16-bit and 8-bit, ENTER */
+#define OP_I_MOFFS      0x0007  /* Memory offset, depends on address size */
+#define OP_I_REL8       0x0008  /* 8-bit PC relative */
+#define OP_I_RELZ       0x0009  /* 16 or 32-bit PC relative */
+#define OP_I_PTR        0x000a  /* Far pointer */
+#define OP_I_MASK       0x000f
+/* Opcode attributes: control flow */
+#define OP_F_NEXT       0x0000
+#define OP_F_JUMP       0x0010
+#define OP_F_BRANCH     0x0020
+#define OP_F_CALL       0x0030
+#define OP_F_INDIRECT   0x0040
+#define OP_F_UNKNOWN    0x0050  /* Traps, system calls, etc. */
+#define OP_F_MASK       0x0070
+/* Opcode attributes: other */
+#define OP_M            0x0100  /* ModRM byte */
+#define OP_PFX          0x0200  /* Legacy prefix */
+#define OP_I64          0x0400  /* Invalid in 64-bit mode */
+#define OP_BAD          0x0800  /* Invalid opcode */
+
+/* Shorthands for the opcode tables */
+#define T_N     OP_I_NONE
+#define T_M     OP_M
+#define T_B     OP_I_B
+#define T_Z     OP_I_Z
+#define T_MB    (OP_M | OP_I_B)
+#define T_MZ    (OP_M | OP_I_Z)
+#define T_P     OP_PFX
+#define T_I     OP_I64
+#define T_X     OP_BAD
+#define T_U     OP_F_UNKNOWN
+#define T_JCC   (OP_I_REL8 | OP_F_BRANCH)
+#define T_JCCZ  (OP_I_RELZ | OP_F_BRANCH)
+
+static const uint16_t opcodes_1byte[256] = {
+/*          0/8     1/9     2/a     3/b     4/c     5/d     6/e     7/f */
+/* 00 */    T_M,    T_M,    T_M,    T_M,    T_B,    T_Z,    T_I,    T_I,
+/* 08 */    T_M,    T_M,    T_M,    T_M,    T_B,    T_Z,    T_I,    T_X,
+/* 10 */    T_M,    T_M,    T_M,    T_M,    T_B,    T_Z,    T_I,    T_I,
+/* 18 */    T_M,    T_M,    T_M,    T_M,    T_B,    T_Z,    T_I,    T_I,
+/* 20 */    T_M,    T_M,    T_M,    T_M,    T_B,    T_Z,    T_P,    T_I,
+/* 28 */    T_M,    T_M,    T_M,    T_M,    T_B,    T_Z,    T_P,    T_I,
+/* 30 */    T_M,    T_M,    T_M,    T_M,    T_B,    T_Z,    T_P,    T_I,
+/* 38 */    T_M,    T_M,    T_M,    T_M,    T_B,    T_Z,    T_P,    T_I,
+/* 40 */    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,
+/* 48 */    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,
+/* 50 */    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,
+/* 58 */    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,
+/* 60 */    T_I,    T_I,    T_M|T_I,T_M,    T_P,    T_P,    T_P,    T_P,
+/* 68 */    T_Z,    T_MZ,   T_B,    T_MB,   T_N,    T_N,    T_N,    T_N,
+/* 70 */    T_JCC,  T_JCC,  T_JCC,  T_JCC,  T_JCC,  T_JCC,  T_JCC,  T_JCC,
+/* 78 */    T_JCC,  T_JCC,  T_JCC,  T_JCC,  T_JCC,  T_JCC,  T_JCC,  T_JCC,
+/* 80 */    T_MB,   T_MZ,   T_MB|T_I,T_MB,  T_M,    T_M,    T_M,    T_M,
+/* 88 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* 90 */    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,
+/* 98 */    T_N,    T_N,    OP_I_PTR|OP_F_CALL|T_I, T_N, T_N, T_N, T_N, T_N,
+/* a0 */    OP_I_MOFFS, OP_I_MOFFS, OP_I_MOFFS, OP_I_MOFFS, T_N, T_N, T_N, T_N,
+/* a8 */    T_B,    T_Z,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,
+/* b0 */    T_B,    T_B,    T_B,    T_B,    T_B,    T_B,    T_B,    T_B,
+/* b8 */    OP_I_V, OP_I_V, OP_I_V, OP_I_V, OP_I_V, OP_I_V, OP_I_V, OP_I_V,
+/* c0 */    T_MB,   T_MB,   OP_I_W|OP_F_INDIRECT, OP_F_INDIRECT, T_M|T_I, T_M|T_I, T_MB, T_MZ,
+/* c8 */    OP_I_WB, T_N,   OP_I_W|OP_F_INDIRECT, OP_F_INDIRECT, T_U, T_B|T_U, T_U|T_I, T_U,
+/* d0 */    T_M,    T_M,    T_M,    T_M,    T_B|T_I, T_B|T_I, T_I,  T_N,
+/* d8 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* e0 */    T_JCC,  T_JCC,  T_JCC,  T_JCC,  T_B,    T_B,    T_B,    T_B,
+/* e8 */    OP_I_RELZ|OP_F_CALL, OP_I_RELZ|OP_F_JUMP, OP_I_PTR|OP_F_INDIRECT|T_I, OP_I_REL8|OP_F_JUMP,
+            T_N,    T_N,    T_N,    T_N,
+/* f0 */    T_P,    T_U,    T_P,    T_P,    T_U,    T_N,    T_M,    T_M,
+/* f8 */    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_M,    T_M,
+};
+
+static const uint16_t opcodes_0f[256] = {
+/*          0/8     1/9     2/a     3/b     4/c     5/d     6/e     7/f */
+/* 00 */    T_M,    T_M,    T_M,    T_M,    T_X,    T_U,    T_N,    T_U,
+/* 08 */    T_N,    T_N,    T_X,    T_U,    T_X,    T_M,    T_N,    T_MB,
+/* 10 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* 18 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* 20 */    T_M,    T_M,    T_M,    T_M,    T_X,    T_X,    T_X,    T_X,
+/* 28 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* 30 */    T_N,    T_N,    T_N,    T_N,    T_U,    T_U,    T_X,    T_N,
+/* 38 */    T_X,    T_X,    T_X,    T_X,    T_X,    T_X,    T_X,    T_X,
+/* 40 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* 48 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* 50 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* 58 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* 60 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* 68 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* 70 */    T_MB,   T_MB,   T_MB,   T_MB,   T_M,    T_M,    T_M,    T_N,
+/* 78 */    T_M,    T_M,    T_X,    T_X,    T_M,    T_M,    T_M,    T_M,
+/* 80 */    T_JCCZ, T_JCCZ, T_JCCZ, T_JCCZ, T_JCCZ, T_JCCZ, T_JCCZ, T_JCCZ,
+/* 88 */    T_JCCZ, T_JCCZ, T_JCCZ, T_JCCZ, T_JCCZ, T_JCCZ, T_JCCZ, T_JCCZ,
+/* 90 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* 98 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* a0 */    T_N,    T_N,    T_N,    T_M,    T_MB,   T_M,    T_X,    T_X,
+/* a8 */    T_N,    T_N,    T_N,    T_M,    T_MB,   T_M,    T_M,    T_M,
+/* b0 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* b8 */    T_M,    T_M|T_U, T_MB,  T_M,    T_M,    T_M,    T_M,    T_M,
+/* c0 */    T_M,    T_M,    T_MB,   T_M,    T_MB,   T_MB,   T_MB,   T_M,
+/* c8 */    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,    T_N,
+/* d0 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* d8 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* e0 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* e8 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* f0 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,
+/* f8 */    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M,    T_M|T_U,
+};
+
+#undef T_N
+#undef T_M
+#undef T_B
+#undef T_Z
+#undef T_MB
+#undef T_MZ
+#undef T_P
+#undef T_I
+#undef T_X
+#undef T_U
+#undef T_JCC
+#undef T_JCCZ
+
+#define X86_MAX_INSTR_SIZE 15
+
+static uint8_t struct_code_byte(uint8_t * code, size_t len, size_t pos) {
+    return pos < len ? code[pos] : 0;
+}
+
+static uint64_t struct_code_value(uint8_t * code, size_t len, size_t pos, unsigned size) {
+    uint64_t v = 0;
+    unsigned i;
+    for (i = 0; i < size; i++) v |= (uint64_t)struct_code_byte(code, len, pos + i) << (i * 8);
+    return v;
+}
+
+int decode_x86_instruction_struct(uint8_t * code, ContextAddress addr, ContextAddress size,
+        int i64, InstructionStructX86 * info) {
+    size_t len = size < X86_MAX_INSTR_SIZE ? (size_t)size : X86_MAX_INSTR_SIZE;
+    size_t pos = 0;
+    unsigned map = 0;
+    unsigned attrs = 0;
+    unsigned data16 = 0;
+    unsigned asize = i64 ? 8 : 4;
+    unsigned dsize = 0;
+    unsigned imm_size = 0;
+    unsigned rel_size = 0;
+    unsigned flow_attr = 0;
+    uint8_t rex_bits = 0;
+    uint8_t opcode = 0;
+    uint8_t modrm = 0;
+    uint64_t next = 0;
+
+    memset(info, 0, sizeof(InstructionStructX86));
+    info->mem_base = -1;
+    info->mem_index = -1;
+
+    /* Legacy prefixes and REX */
+    for (;;) {
+        if (pos >= len) {
+            set_errno(ERR_OTHER, "Invalid instruction");
+            return -1;
+        }
+        opcode = code[pos++];
+        if (i64 && (opcode & 0xf0) == 0x40) {
+            rex_bits = opcode;
+            continue;
+        }
+        attrs = opcodes_1byte[opcode];
+        if ((attrs & OP_PFX) == 0) break;
+        if (opcode == 0x66) data16 = 1;
+        else if (opcode == 0x67) asize = i64 ? 4 : 2;
+        /* REX is ignored unless it immediately precedes the opcode */
+        rex_bits = 0;
+    }
+
+    if (opcode == 0x0f) {
+        opcode = struct_code_byte(code, len, pos++);
+        if (opcode == 0x38) {
+            map = 2;
+            opcode = struct_code_byte(code, len, pos++);
+            attrs = OP_M;
+        }
+        else if (opcode == 0x3a) {
+            map = 3;
+            opcode = struct_code_byte(code, len, pos++);
+            attrs = OP_M | OP_I_B;
+        }
+        else {
+            map = 1;
+            attrs = opcodes_0f[opcode];
+        }
+    }
+    else if (((opcode == 0xc4 || opcode == 0xc5 || opcode == 0x62) &&
+                (i64 || (struct_code_byte(code, len, pos) & 0xc0) == 0xc0)) ||
+            (opcode == 0x8f && (struct_code_byte(code, len, pos) & 0x18) != 0)) {
+        /* VEX, EVEX or XOP prefix */
+        uint8_t esc = opcode;
+        uint8_t p0 = struct_code_byte(code, len, pos++);
+        rex_bits = (uint8_t)((~p0 >> 5) & REX_R);
+        map = 1;
+        if (esc != 0xc5) {
+            rex_bits = (uint8_t)((~p0 >> 5) & (REX_R | REX_X | REX_B));
+            if (struct_code_byte(code, len, pos++) & 0x80) rex_bits |= REX_W;
+            map = p0 & (esc == 0x62 ? 0x07 : 0x1f);
+            if (esc == 0x62) pos++;
+        }
+        if (!i64) rex_bits &= REX_W;
+        opcode = struct_code_byte(code, len, pos++);
+        if (esc == 0x8f) {
+            switch (map) {
+            case 8: attrs = OP_M | OP_I_B; break;
+            case 9: attrs = OP_M; break;
+            case 10: attrs = OP_M | OP_I_D; break;
+            default: attrs = OP_BAD; break;
+            }
+        }
+        else {
+            switch (map) {
+            case 1:
+                attrs = opcodes_0f[opcode];
+                if (attrs & OP_F_MASK) attrs = OP_BAD;
+                else if (opcode != 0x77) attrs |= OP_M;
+                break;
+            case 2: attrs = OP_M; break;
+            case 3: attrs = OP_M | OP_I_B; break;
+            case 5: /* AVX-512 FP16 */
+            case 6: attrs = esc == 0x62 ? OP_M : OP_BAD; break;
+            default: attrs = OP_BAD; break;
+            }
+        }
+    }
+
+    info->opcode_map = map;
+    info->opcode_pos = (unsigned)(pos - 1);
+
+    if ((attrs & OP_BAD) || (i64 && (attrs & OP_I64))) {
+        set_errno(ERR_OTHER, "Invalid instruction");
+        return -1;
+    }
+
+    dsize = rex_bits & REX_W ? 8 : data16 ? 2 : 4;
+    flow_attr = attrs & OP_F_MASK;
+
+    if (attrs & OP_M) {
+        unsigned mod = 0;
+        unsigned rm = 0;
+        unsigned disp_size = 0;
+
+        info->modrm_pos = (unsigned)pos;
+        modrm = struct_code_byte(code, len, pos++);
+        mod = (modrm >> 6) & 3;
+        rm = modrm & 7;
+        /* MOV to/from control and debug registers ignore the mod field */
+        if (map == 1 && opcode >= 0x20 && opcode <= 0x23) mod = 3;
+        if (mod != 3) {
+            info->mem = 1;
+            if (asize == 2) {
+                static const int8_t base16[8] = { 3, 3, 5, 5, 6, 7, 5, 3 };
+                static const int8_t index16[8] = { 6, 7, 6, 7, -1, -1, -1, -1 };
+                info->mem_base = base16[rm];
+                info->mem_index = index16[rm];
+                if (info->mem_index >= 0) info->mem_scale = 1;
+                if (mod == 0 && rm == 6) info->mem_base = -1;
+                if ((mod == 0 && rm == 6) || mod == 2) disp_size = 2;
+                else if (mod == 1) disp_size = 1;
+            }
+            else {
+                unsigned base = rm;
+                if (rm == 4) {
+                    uint8_t sib = struct_code_byte(code, len, pos++);
+                    unsigned index = ((sib >> 3) & 7) | (rex_bits & REX_X ? 8 : 0);
+                    base = sib & 7;
+                    if (index != 4) {
+                        info->mem_index = index;
+                        info->mem_scale = 1u << ((sib >> 6) & 3);
+                    }
+                    if (mod == 0 && base == 5) disp_size = 4;
+                    else info->mem_base = base | (rex_bits & REX_B ? 8 : 0);
+                }
+                else if (mod == 0 && rm == 5) {
+                    disp_size = 4;
+                    if (i64) {
+                        info->mem_base = X86_MEM_BASE_RIP;
+                        info->rel_pos = (unsigned)pos;
+                        info->rel_size = 4;
+                    }
+                }
+                else {
+                    info->mem_base = base | (rex_bits & REX_B ? 8 : 0);
+                }
+                if (mod == 1) disp_size = 1;
+                else if (mod == 2) disp_size = 4;
+            }
+            if (disp_size > 0) {
+                info->disp_pos = (unsigned)pos;
+                info->disp_size = disp_size;
+                pos += disp_size;
+            }
+        }
+    }
+
+    if (map == 0) {
+        unsigned reg = (modrm >> 3) & 7;
+        switch (opcode) {
+        case 0xc6:
+            /* XABORT */
+            if (modrm == 0xf8) flow_attr = OP_F_INDIRECT;
+            break;
+        case 0xc7:
+            /* XBEGIN */
+            if (modrm == 0xf8) {
+                attrs = OP_I_RELZ;
+                flow_attr = OP_F_BRANCH;
+            }
+            break;
+        case 0xf6:
+            if (reg < 2) attrs |= OP_I_B;
+            break;
+        case 0xf7:
+            if (reg < 2) attrs |= OP_I_Z;
+            break;
+        case 0xff:
+            if (reg == 2 || reg == 3) flow_attr = OP_F_CALL;
+            else if (reg == 4 || reg == 5) flow_attr = OP_F_INDIRECT;
+            break;
+        }
+    }
+    else if (map == 1 && opcode == 0x01 && (modrm >> 6) == 3) {
+        switch (modrm) {
+        case 0xc1: /* VMCALL */
+        case 0xc2: /* VMLAUNCH */
+        case 0xc3: /* VMRESUME */
+        case 0xc4: /* VMXOFF */
+        case 0xcf: /* ENCLS */
+        case 0xd4: /* VMFUNC */
+        case 0xd7: /* ENCLU */
+        case 0xd8: /* VMRUN */
+        case 0xd9: /* VMMCALL */
+            flow_attr = OP_F_UNKNOWN;
+            break;
+        }
+    }
+
+    switch (attrs & OP_I_MASK) {
+    case OP_I_B: imm_size = 1; break;
+    case OP_I_W: imm_size = 2; break;
+    case OP_I_D: imm_size = 4; break;
+    case OP_I_Z: imm_size = dsize == 2 ? 2 : 4; break;
+    case OP_I_V: imm_size = dsize; break;
+    case OP_I_WB: imm_size = 3; break;
+    case OP_I_PTR: imm_size = (data16 ? 2 : 4) + 2; break;
+    case OP_I_REL8: rel_size = 1; break;
+    case OP_I_RELZ: rel_size = i64 || !data16 ? 4 : 2; break;
+    case OP_I_MOFFS:
+        info->mem = 1;
+        info->disp_pos = (unsigned)pos;
+        info->disp_size = asize;
+        info->mem_addr = struct_code_value(code, len, pos, asize);
+        pos += asize;
+        break;
+    }
+    if (imm_size > 0) {
+        info->imm_pos = (unsigned)pos;
+        info->imm_size = imm_size;
+        pos += imm_size;
+    }
+    if (rel_size > 0) {
+        info->rel_pos = (unsigned)pos;
+        info->rel_size = rel_size;
+        pos += rel_size;
+    }
+
+    if (pos > len) {
+        set_errno(ERR_OTHER, size < pos ? "Incomplete instruction" : "Invalid instruction");
+        return -1;
+    }
+
+    info->size = (unsigned)pos;
+    next = addr + pos;
+    if (info->mem_base == X86_MEM_BASE_RIP) {
+        uint32_t disp = (uint32_t)struct_code_value(code, len, info->disp_pos, 4);
+        info->mem_addr = next + (int64_t)(int32_t)disp;
+        if (asize == 4) info->mem_addr &= 0xffffffff;
+    }
+    else if (info->mem && info->mem_base < 0 && info->mem_index < 0 && info->disp_size != 1) {
+        info->mem_addr = struct_code_value(code, len, info->disp_pos, info->disp_size);
+    }
+    switch (flow_attr) {
+    case OP_F_NEXT: info->flow = DISASM_FLOW_NEXT; break;
+    case OP_F_JUMP: info->flow = DISASM_FLOW_JUMP; break;
+    case OP_F_BRANCH: info->flow = DISASM_FLOW_BRANCH; break;
+    case OP_F_CALL: info->flow = DISASM_FLOW_CALL; break;
+    case OP_F_INDIRECT: info->flow = DISASM_FLOW_INDIRECT; break;
+    default: info->flow = DISASM_FLOW_UNKNOWN; break;
+    }
+    if (rel_size > 0) {
+        uint64_t offs = struct_code_value(code, len, info->rel_pos, rel_size);
+        uint64_t sign = (uint64_t)1 << (rel_size * 8 - 1);
+        info->target = next + ((offs ^ sign) - sign);
+        if (!i64) info->target &= rel_size == 2 ? 0xffff : 0xffffffff;
+    }
+    return 0;
+}
+
 static DisassemblyResult * disassemble_x86(uint8_t * code,
         ContextAddress addr, ContextAddress size, int i64,
         DisassemblerParams * disass_params) {
@@ -1142,6 +1599,18 @@ static DisassemblyResult * disassemble_x86(uint8_t * code,
     static DisassemblyResult dr;
 
     memset(&dr, 0, sizeof(dr));
+    if (disass_params->flow_only) {
+        InstructionStructX86 info;
+        if (decode_x86_instruction_struct(code, addr, size, i64, &info) < 0) {
+            dr.size = 1;
+        }
+        else {
+            dr.size = info.size;
+            dr.flow = info.flow;
+            dr.target = (ContextAddress)info.target;
+        }
+        return &dr;
+    }
     buf_pos = 0;
     code_buf = code;
     code_len = (size_t)size;
@@ -1153,6 +1622,10 @@ static DisassemblyResult * disassemble_x86(uint8_t * code,
     prefix = 0;
     vex = 0;
     rex = 0;
+    rel_pos = 0;
+    rel_size = 0;
+    flow = DISASM_FLOW_NEXT;
+    flow_target = 0;
 
     /* Instruction Prefixes */
     while (code_pos < code_len) {
@@ -1223,10 +1696,12 @@ static DisassemblyResult * disassemble_x86(uint8_t * code,
         }
     }
 
-    data_size = rex & REX_W ? 8 : 4;
+    data_size = rex & REX_W ? 8 : prefix & PREFIX_DATA_SIZE ? 2 : 4;
     addr_size = x86_64 ? 8 : 4;
 
-    disassemble_instr();
+    /* VEX encoded instructions are not supported yet */
+    if (vex == 0) disassemble_instr();
+    else buf_pos = 0;
 
     dr.text = buf;
     if (buf_pos == 0 || code_pos > code_len) {
@@ -1236,6 +1711,8 @@ static DisassemblyResult * disassemble_x86(uint8_t * code,
     else {
         buf[buf_pos] = 0;
         dr.size = code_pos;
+        dr.flow = flow;
+        if (flow != DISASM_FLOW_INDIRECT) dr.target = (ContextAddress)flow_target;
     }
     return &dr;
 }
@@ -1252,4 +1729,4 @@ DisassemblyResult * disassemble_x86_64(uint8_t * code,
     return disassemble_x86(code, addr, size, 1, disass_params);
 }
 
-#endif /* SERVICE_Disassembly */
+#endif /* ENABLE_DisassemblerX86_64 */
@@ -20,10 +20,46 @@
 
 #include <tcf/services/disassembly.h>
 
+#if !defined(ENABLE_DisassemblerX86_64)
+#  define ENABLE_DisassemblerX86_64 SERVICE_Disassembly
+#endif
+
 extern DisassemblyResult * disassemble_x86_32(uint8_t * buf,
         ContextAddress addr, ContextAddress size, DisassemblerParams * params);
 
 extern DisassemblyResult * disassemble_x86_64(uint8_t * buf,
         ContextAddress addr, ContextAddress size, DisassemblerParams * params);
 
+/* Instruction structure, decoded without formatting text */
+typedef struct InstructionStructX86 {
+    unsigned size;          /* Instruction size in bytes */
+    unsigned opcode_map;    /* 0 - one byte opcodes, 1 - 0F, 2 - 0F38, 3 - 0F3A, VEX/EVEX/XOP map number otherwise */
+    unsigned opcode_pos;    /* Offset of the opcode byte in the instruction */
+    unsigned modrm_pos;     /* Offset of ModRM byte, 0 if none */
+    unsigned imm_pos;       /* Offset of immediate operand, 0 if none */
+    unsigned imm_size;      /* Size of immediate operand in bytes */
+    unsigned rel_pos;       /* Offset of PC relative displacement (branch or RIP relative operand), 0 if none */
+    unsigned rel_size;      /* Size of PC relative displacement in bytes */
+    int flow;               /* Control flow type, DISASM_FLOW_* */
+    uint64_t target;        /* Jump, branch or call target, 0 if not known statically */
+    int mem;                /* 1 if the instruction has a memory operand, including LEA address operand */
+    int mem_base;           /* Base register number 0..15, X86_MEM_BASE_RIP, or -1 if none */
+    int mem_index;          /* Index register number 0..15, or -1 if none */
+    unsigned mem_scale;     /* Index scale: 1, 2, 4 or 8 */
+    unsigned disp_pos;      /* Offset of memory operand displacement, 0 if none */
+    unsigned disp_size;     /* Size of memory operand displacement in bytes */
+    uint64_t mem_addr;      /* Memory operand address if it does not depend on registers other than RIP */
+} InstructionStructX86;
+
+#define X86_MEM_BASE_RIP 16
+
+/*
+ * Decode structure of x86 or x86_64 instruction using opcode tables, without formatting text.
+ * Unlike disassemble_x86_64(), knows every opcode of the instruction set, including SSE, AVX and AVX-512.
+ * Instructions like INT, SYSCALL or UD2 are reported as DISASM_FLOW_UNKNOWN.
+ * Return 0 on success, return -1 and set errno if the instruction is invalid or does not fit in 'size' bytes.
+ */
+extern int decode_x86_instruction_struct(uint8_t * buf, ContextAddress addr, ContextAddress size,
+        int x86_64, InstructionStructX86 * info);
+
 #endif /* D_disassembler_x86_64 */
@@ -0,0 +1,527 @@
+/*******************************************************************************
+ * Copyright (c) 2026 Wind River Systems, Inc. and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ * The Eclipse Public License is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ * You may elect to redistribute this code under either of these licenses.
+ *
+ * Contributors:
+ *     Wind River Systems - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * x86_64 fast tracepoint trampolines.
+ *
+ * Trampoline layout:
+ *   skip red zone, save flags, RAX, RCX, RDX
+ *   if tracepoint is disabled goto done
+ *   evaluate condition on the stack, if false goto done
+ *   allocate ring buffer record with 'lock cmpxchg', if the buffer is full count lost record and goto done
+ *   store registers and values of tracepoint expressions, then store tracepoint ID to commit the record
+ * done:
+ *   restore registers and stack pointer
+ *   displaced instructions
+ *   jump back
+ */
+
+#include <tcf/config.h>
+
+#include <tcf/services/fasttrace.h>
+
+#if ENABLE_FastTracepoints
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <tcf/framework/myalloc.h>
+#include <tcf/framework/cpudefs.h>
+#include <tcf/regset.h>
+#include <machine/x86_64/tcf/disassembler-x86_64.h>
+
+#define JMP_SIZE            5
+#define RED_ZONE_SIZE       128
+#define MAX_DISPLACED       8
+
+/* Offsets of saved registers on the trampoline stack */
+#define SAVED_RDX           0
+#define SAVED_RCX           8
+#define SAVED_RAX           16
+#define SAVED_FLAGS         24
+#define SAVED_SIZE          32
+
+#define REG_RAX             0
+#define REG_RCX             1
+#define REG_RDX             2
+#define REG_RSP             4
+
+typedef struct JumpFixup {
+    size_t pos;             /* Offset of rel32 field */
+    unsigned op;            /* Target condition operation index */
+} JumpFixup;
+
+static uint8_t * buf = NULL;
+static size_t buf_pos = 0;
+static size_t buf_max = 0;
+
+static const char * reg_names[FAST_TRACE_REGS] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+
+#define SYS_mmap            9
+
+/* Registers used by mmap() system call, saved and restored by the agent */
+static RegisterDefinition syscall_regs[] = {
+    { "rax",      offsetof(REG_SET, user.regs.rax),      8, -1, -1 },
+    { "rdi",      offsetof(REG_SET, user.regs.rdi),      8, -1, -1 },
+    { "rsi",      offsetof(REG_SET, user.regs.rsi),      8, -1, -1 },
+    { "rdx",      offsetof(REG_SET, user.regs.rdx),      8, -1, -1 },
+    { "r10",      offsetof(REG_SET, user.regs.r10),      8, -1, -1 },
+    { "r8",       offsetof(REG_SET, user.regs.r8),       8, -1, -1 },
+    { "r9",       offsetof(REG_SET, user.regs.r9),       8, -1, -1 },
+    { "orig_rax", offsetof(REG_SET, user.regs.orig_rax), 8, -1, -1 },
+    { "rcx",      offsetof(REG_SET, user.regs.rcx),      8, -1, -1 },
+    { "r11",      offsetof(REG_SET, user.regs.r11),      8, -1, -1 },
+    { "rip",      offsetof(REG_SET, user.regs.rip),      8, -1, -1 },
+    { "eflags",   offsetof(REG_SET, user.regs.eflags),   8, -1, -1 },
+    { NULL }
+};
+
+#define SYSCALL_ARGS_CNT    8   /* rax, arguments and orig_rax */
+
+static void emit_byte(uint8_t b) {
+    assert(buf_pos < buf_max);
+    buf[buf_pos++] = b;
+}
+
+static void emit_u32(uint32_t n) {
+    unsigned i;
+    for (i = 0; i < 4; i++) emit_byte((uint8_t)(n >> (i * 8)));
+}
+
+static void emit_u64(uint64_t n) {
+    unsigned i;
+    for (i = 0; i < 8; i++) emit_byte((uint8_t)(n >> (i * 8)));
+}
+
+static void emit_bytes(const char * s, unsigned n) {
+    while (n-- > 0) emit_byte((uint8_t)*s++);
+}
+
+#define EMIT(s) emit_bytes(s, sizeof(s) - 1)
+
+static void emit_movabs(unsigned reg, uint64_t n) {
+    emit_byte(0x48);
+    emit_byte((uint8_t)(0xb8 + reg));
+    emit_u64(n);
+}
+
+/* Emit 'jcc rel32' or 'jmp rel32' (cc == 0), return offset of rel32 field */
+static size_t emit_jump(uint8_t cc) {
+    size_t pos = 0;
+    if (cc) {
+        emit_byte(0x0f);
+        emit_byte(cc);
+    }
+    else {
+        emit_byte(0xe9);
+    }
+    pos = buf_pos;
+    emit_u32(0);
+    return pos;
+}
+
+static void set_rel32(size_t pos, size_t target) {
+    uint32_t n = (uint32_t)(target - (pos + 4));
+    unsigned i;
+    for (i = 0; i < 4; i++) buf[pos + i] = (uint8_t)(n >> (i * 8));
+}
+
+static int get_rel32(ContextAddress from, ContextAddress to, uint32_t * res) {
+    int64_t offs = (int64_t)(to - from);
+    if (offs != (int64_t)(int32_t)offs) {
+        set_errno(ERR_UNSUPPORTED, "Trampoline is out of jump range");
+        return -1;
+    }
+    *res = (uint32_t)offs;
+    return 0;
+}
+
+static int emit_condition(CompiledExpressionOp * ops, unsigned cnt) {
+    unsigned i;
+    unsigned fixup_cnt = 0;
+    size_t * offs = (size_t *)tmp_alloc(sizeof(size_t) * (cnt + 1));
+    JumpFixup * fixups = (JumpFixup *)tmp_alloc(sizeof(JumpFixup) * cnt);
+
+    /* The expression stack is the thread stack, RAX and RCX hold operands */
+    for (i = 0; i < cnt; i++) {
+        CompiledExpressionOp * o = ops + i;
+        offs[i] = buf_pos;
+        switch (o->op) {
+        case CEX_NUM:
+            emit_movabs(REG_RAX, o->num);
+            EMIT("\x50");                               /* push rax */
+            continue;
+        case CEX_VAR:
+            if (o->big_endian) {
+                set_errno(ERR_UNSUPPORTED, "Big endian variable");
+                return -1;
+            }
+            emit_movabs(REG_RAX, o->addr);
+            switch (o->size) {
+            case 1: if (o->uns) EMIT("\x0f\xb6\x00"); else EMIT("\x48\x0f\xbe\x00"); break;
+            case 2: if (o->uns) EMIT("\x0f\xb7\x00"); else EMIT("\x48\x0f\xbf\x00"); break;
+            case 4: if (o->uns) EMIT("\x8b\x00"); else EMIT("\x48\x63\x00"); break;
+            case 8: EMIT("\x48\x8b\x00"); break;
+            default:
+                set_errno(ERR_UNSUPPORTED, "Invalid variable size");
+                return -1;
+            }
+            EMIT("\x50");
+            continue;
+        case CEX_EXT:
+            EMIT("\x58");                               /* pop rax */
+            switch (o->size) {
+            case 1: if (o->uns) EMIT("\x0f\xb6\xc0"); else EMIT("\x48\x0f\xbe\xc0"); break;
+            case 2: if (o->uns) EMIT("\x0f\xb7\xc0"); else EMIT("\x48\x0f\xbf\xc0"); break;
+            case 4: if (o->uns) EMIT("\x89\xc0"); else EMIT("\x48\x63\xc0"); break;
+            }
+            EMIT("\x50");
+            continue;
+        case CEX_NEG:
+            EMIT("\x48\xf7\x1c\x24");                   /* neg qword [rsp] */
+            continue;
+        case CEX_INV:
+            EMIT("\x48\xf7\x14\x24");                   /* not qword [rsp] */
+            continue;
+        case CEX_NOT:
+            EMIT("\x58\x48\x85\xc0\x0f\x94\xc0\x0f\xb6\xc0\x50");
+            continue;
+        case CEX_LAND:
+        case CEX_LOR:
+            EMIT("\x48\x8b\x04\x24\x48\x85\xc0");       /* mov rax,[rsp]; test rax,rax */
+            fixups[fixup_cnt].pos = emit_jump(o->op == CEX_LAND ? 0x84 : 0x85);
+            fixups[fixup_cnt++].op = o->jump;
+            EMIT("\x58");
+            continue;
+        }
+        EMIT("\x59\x58");                               /* pop rcx; pop rax */
+        switch (o->op) {
+        case CEX_ADD: EMIT("\x48\x01\xc8"); break;
+        case CEX_SUB: EMIT("\x48\x29\xc8"); break;
+        case CEX_MUL: EMIT("\x48\x0f\xaf\xc1"); break;
+        case CEX_DIV:
+        case CEX_MOD:
+            /* The divisor is a non-zero constant, see compile_expression() */
+            if (o->uns) EMIT("\x31\xd2\x48\xf7\xf1");   /* xor edx,edx; div rcx */
+            else EMIT("\x48\x99\x48\xf7\xf9");          /* cqo; idiv rcx */
+            if (o->op == CEX_MOD) EMIT("\x48\x89\xd0");
+            break;
+        case CEX_SHL: EMIT("\x48\xd3\xe0"); break;
+        case CEX_SHR: if (o->uns) EMIT("\x48\xd3\xe8"); else EMIT("\x48\xd3\xf8"); break;
+        case CEX_AND: EMIT("\x48\x21\xc8"); break;
+        case CEX_OR: EMIT("\x48\x09\xc8"); break;
+        case CEX_XOR: EMIT("\x48\x31\xc8"); break;
+        case CEX_EQ:
+        case CEX_NE:
+        case CEX_LT:
+        case CEX_LE:
+        case CEX_GT:
+        case CEX_GE:
+            EMIT("\x48\x39\xc8\x0f");                   /* cmp rax,rcx; setcc al */
+            switch (o->op) {
+            case CEX_EQ: emit_byte(0x94); break;
+            case CEX_NE: emit_byte(0x95); break;
+            case CEX_LT: emit_byte(o->uns ? 0x92 : 0x9c); break;
+            case CEX_LE: emit_byte(o->uns ? 0x96 : 0x9e); break;
+            case CEX_GT: emit_byte(o->uns ? 0x97 : 0x9f); break;
+            case CEX_GE: emit_byte(o->uns ? 0x93 : 0x9d); break;
+            }
+            EMIT("\xc0\x0f\xb6\xc0");                   /* movzx eax,al */
+            break;
+        default:
+            set_errno(ERR_UNSUPPORTED, "Unsupported condition operation");
+            return -1;
+        }
+        EMIT("\x50");
+    }
+    offs[cnt] = buf_pos;
+    for (i = 0; i < fixup_cnt; i++) {
+        assert(fixups[i].op <= cnt);
+        set_rel32(fixups[i].pos, offs[fixups[i].op]);
+    }
+    return 0;
+}
+
+static int emit_record(FastTraceTrampoline * t) {
+    unsigned i;
+    unsigned r;
+    size_t full = 0;
+    size_t retry = 0;
+
+    /* Count condition hits */
+    emit_movabs(REG_RAX, t->ctrl_addr);
+    EMIT("\xf0\x48\xff\x40\x08");                       /* lock inc qword [rax+8] */
+
+    /* Allocate a record: RAX = head, head is advanced only if head - tail < size */
+    emit_movabs(REG_RCX, t->buf_addr);
+    EMIT("\x48\x8b\x01");                               /* mov rax,[rcx] */
+    retry = buf_pos;
+    EMIT("\x48\x89\xc2");                               /* mov rdx,rax */
+    EMIT("\x48\x2b\x51"); emit_byte(FAST_TRACE_TAIL_OFFS);
+    EMIT("\x48\x3b\x51"); emit_byte(FAST_TRACE_SIZE_OFFS);
+    EMIT("\x72\x0a");                                   /* jb +10 */
+    EMIT("\xf0\x48\xff\x41"); emit_byte(FAST_TRACE_LOST_OFFS);
+    full = emit_jump(0);
+    EMIT("\x48\x8d\x50\x01");                           /* lea rdx,[rax+1] */
+    EMIT("\xf0\x48\x0f\xb1\x11");                       /* lock cmpxchg [rcx],rdx */
+    EMIT("\x75");                                       /* jne retry, RAX is reloaded by cmpxchg */
+    emit_byte((uint8_t)(retry - (buf_pos + 1)));
+
+    /* RDX = record address */
+    EMIT("\x48\x23\x41"); emit_byte(FAST_TRACE_MASK_OFFS);
+    EMIT("\x48\x69\xc0"); emit_u32(sizeof(FastTraceRecord));
+    EMIT("\x48\x8d\x94\x01"); emit_u32(FAST_TRACE_DATA_OFFS);
+
+    /* Store registers */
+    EMIT("\x48\x8b\x44\x24"); emit_byte(SAVED_FLAGS);
+    EMIT("\x48\x89\x42"); emit_byte(offsetof(FastTraceRecord, flags));
+    for (r = 0; r < FAST_TRACE_REGS; r++) {
+        unsigned offs = (unsigned)(offsetof(FastTraceRecord, regs) + r * 8);
+        switch (r) {
+        case REG_RAX:
+        case REG_RCX:
+        case REG_RDX:
+            EMIT("\x48\x8b\x44\x24");                   /* mov rax,[rsp+saved] */
+            emit_byte(r == REG_RAX ? SAVED_RAX : r == REG_RCX ? SAVED_RCX : SAVED_RDX);
+            EMIT("\x48\x89\x82");                       /* mov [rdx+offs],rax */
+            break;
+        case REG_RSP:
+            EMIT("\x48\x8d\x84\x24");                   /* lea rax,[rsp+N] */
+            emit_u32(SAVED_SIZE + RED_ZONE_SIZE);
+            EMIT("\x48\x89\x82");
+            break;
+        default:
+            emit_byte(r >= 8 ? 0x4c : 0x48);            /* mov [rdx+offs],reg */
+            emit_byte(0x89);
+            emit_byte((uint8_t)(0x82 | ((r & 7) << 3)));
+            break;
+        }
+        emit_u32(offs);
+    }
+
+    /* Store values, the expression is evaluated on the stack, RDX is saved */
+    for (i = 0; i < t->values_cnt; i++) {
+        EMIT("\x52");                                   /* push rdx */
+        if (emit_condition(t->values[i], t->values_ops[i]) < 0) return -1;
+        EMIT("\x58\x5a");                               /* pop rax; pop rdx */
+        EMIT("\x48\x89\x82");                           /* mov [rdx+offs],rax */
+        emit_u32((uint32_t)(offsetof(FastTraceRecord, values) + i * 8));
+    }
+
+    /* Commit the record */
+    emit_movabs(REG_RAX, t->id);
+    EMIT("\x48\x89\x02");                               /* mov [rdx],rax */
+
+    set_rel32(full, buf_pos);
+    return 0;
+}
+
+int build_fast_trace_trampoline(FastTraceTrampoline * t) {
+    unsigned i;
+    unsigned cnt = 0;
+    size_t pos = 0;
+    size_t done = 0;
+    uint32_t rel = 0;
+    int call = 0;
+    InstructionStructX86 info[MAX_DISPLACED];
+
+    /* Keep indirect branch target marker in place */
+    if (t->code_size >= 4 && memcmp(t->code, "\xf3\x0f\x1e\xfa", 4) == 0) pos = 4;
+    t->patch_addr = t->addr + pos;
+
+    /* Find instructions to be displaced by the jump */
+    while (t->patch_size < JMP_SIZE) {
+        InstructionStructX86 * x = info + cnt;
+        if (cnt >= MAX_DISPLACED || decode_x86_instruction_struct(t->code + pos + t->patch_size,
+                t->patch_addr + t->patch_size, t->code_size - pos - t->patch_size, 1, x) < 0) {
+            set_errno(ERR_UNSUPPORTED, "Cannot decode instructions at tracepoint address");
+            return -1;
+        }
+        if (x->rel_size != 0 && x->rel_size != 4) {
+            set_errno(ERR_UNSUPPORTED, "Short branch at tracepoint address");
+            return -1;
+        }
+        t->patch_size += x->size;
+        if (x->flow != DISASM_FLOW_NEXT && t->patch_size < JMP_SIZE) {
+            set_errno(ERR_UNSUPPORTED, "Branch instruction at tracepoint address");
+            return -1;
+        }
+        if (x->flow == DISASM_FLOW_CALL) {
+            /* A call from the trampoline would leave the trampoline address on the stack */
+            if (x->rel_size != 4) {
+                set_errno(ERR_UNSUPPORTED, "Indirect call at tracepoint address");
+                return -1;
+            }
+            call = 1;
+        }
+        cnt++;
+    }
+    assert(t->patch_size <= sizeof(t->patch));
+
+    buf_max = 512 + t->cond_cnt * 32 + t->patch_size;
+    for (i = 0; i < t->values_cnt; i++) buf_max += 16 + t->values_ops[i] * 32;
+    buf = (uint8_t *)tmp_alloc(buf_max);
+    buf_pos = 0;
+
+    /* Skip red zone, save registers */
+    EMIT("\x48\x8d\x64\x24\x80");                       /* lea rsp,[rsp-128] */
+    EMIT("\x9c\x50\x51\x52");                           /* pushfq; push rax; push rcx; push rdx */
+    emit_movabs(REG_RAX, t->ctrl_addr);
+    EMIT("\x48\x83\x38\x00");                           /* cmp qword [rax],0 */
+    done = emit_jump(0x84);
+    if (t->cond != NULL) {
+        size_t skip = 0;
+        if (emit_condition(t->cond, t->cond_cnt) < 0) return -1;
+        EMIT("\x58\x48\x85\xc0");                       /* pop rax; test rax,rax */
+        skip = emit_jump(0x84);
+        if (emit_record(t) < 0) return -1;
+        set_rel32(skip, buf_pos);
+    }
+    else {
+        if (emit_record(t) < 0) return -1;
+    }
+    set_rel32(done, buf_pos);
+    EMIT("\x5a\x59\x58\x9d");                           /* pop rdx; pop rcx; pop rax; popfq */
+    EMIT("\x48\x8d\xa4\x24\x80\x00\x00\x00");           /* lea rsp,[rsp+128] */
+
+    /* Displaced instructions */
+    for (i = 0; i < cnt; i++) {
+        unsigned j;
+        size_t offs = pos;
+        for (j = 0; j < i; j++) offs += info[j].size;
+        if (info[i].flow == DISASM_FLOW_CALL) {
+            /* Push the original return address and jump to the callee, the trampoline slot can be reused */
+            uint64_t ret = t->addr + offs + info[i].size;
+            EMIT("\x48\x8d\x64\x24\xf8");               /* lea rsp,[rsp-8] */
+            EMIT("\xc7\x04\x24"); emit_u32((uint32_t)ret);  /* mov dword [rsp],ret */
+            EMIT("\xc7\x44\x24\x04"); emit_u32((uint32_t)(ret >> 32));
+            if (get_rel32(t->tramp_addr + buf_pos + JMP_SIZE, (ContextAddress)info[i].target, &rel) < 0) return -1;
+            emit_byte(0xe9);
+            emit_u32(rel);
+            continue;
+        }
+        emit_bytes((char *)t->code + offs, info[i].size);
+        if (info[i].rel_size == 4) {
+            /* Same target address from the new instruction address */
+            uint8_t * p = buf + buf_pos - info[i].size + info[i].rel_pos;
+            ContextAddress next = t->addr + offs + info[i].size;
+            ContextAddress target = next + (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+            if (get_rel32(t->tramp_addr + buf_pos, target, &rel) < 0) return -1;
+            for (j = 0; j < 4; j++) p[j] = (uint8_t)(rel >> (j * 8));
+        }
+    }
+
+    /* Jump back, a displaced call returns to the original code */
+    if (!call) {
+        if (get_rel32(t->tramp_addr + buf_pos + JMP_SIZE, t->patch_addr + t->patch_size, &rel) < 0) return -1;
+        emit_byte(0xe9);
+        emit_u32(rel);
+    }
+
+    /* The jump to the trampoline, rest of displaced bytes are never executed */
+    if (get_rel32(t->patch_addr + JMP_SIZE, t->tramp_addr, &rel) < 0) return -1;
+    memset(t->patch, 0xcc, sizeof(t->patch));
+    t->patch[0] = 0xe9;
+    for (i = 0; i < 4; i++) t->patch[i + 1] = (uint8_t)(rel >> (i * 8));
+
+    t->tramp = buf;
+    t->tramp_size = buf_pos;
+    buf = NULL;
+    return 0;
+}
+
+int read_fast_trace_registers(Context * ctx, FastTraceRecord * rec) {
+    RegisterDefinition * def = get_reg_definitions(ctx);
+
+    if (def == NULL) {
+        errno = ERR_INV_CONTEXT;
+        return -1;
+    }
+    for (; def->name != NULL; def++) {
+        unsigned i;
+        uint64_t * dst = NULL;
+        uint8_t data[8];
+        if (strcmp(def->name, "eflags") == 0) {
+            dst = &rec->flags;
+        }
+        else {
+            for (i = 0; i < FAST_TRACE_REGS; i++) {
+                if (strcmp(def->name, reg_names[i]) == 0) {
+                    dst = rec->regs + i;
+                    break;
+                }
+            }
+        }
+        if (dst == NULL || def->size > sizeof(data)) continue;
+        if (context_read_reg(ctx, def, 0, def->size, data) < 0) return -1;
+        *dst = 0;
+        for (i = def->size; i > 0; i--) *dst = (*dst << 8) | data[i - 1];
+    }
+    return 0;
+}
+
+int start_fast_trace_mmap(Context * ctx, FastTraceSyscall * sc) {
+    unsigned i;
+    uint64_t args[SYSCALL_ARGS_CNT];
+
+    assert(sizeof(syscall_regs) / sizeof(RegisterDefinition) * 8 <= sizeof(sc->regs));
+    for (i = 0; syscall_regs[i].name != NULL; i++) {
+        if (context_read_reg(ctx, syscall_regs + i, 0, 8, sc->regs + i * 8) < 0) return -1;
+    }
+    args[0] = SYS_mmap;
+    args[1] = sc->addr;
+    args[2] = sc->size;
+    args[3] = sc->exec ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE;
+    args[4] = MAP_PRIVATE | MAP_ANONYMOUS;
+    args[5] = (uint64_t)-1;
+    args[6] = 0;
+    /* The thread can be stopped inside an interrupted system call, it must not be restarted instead of mmap() */
+    args[7] = (uint64_t)-1;
+    for (i = 0; i < SYSCALL_ARGS_CNT; i++) {
+        uint8_t data[8];
+        unsigned j;
+        for (j = 0; j < 8; j++) data[j] = (uint8_t)(args[i] >> (j * 8));
+        if (context_write_reg(ctx, syscall_regs + i, 0, 8, data) < 0) return -1;
+    }
+    sc->code[0] = 0x0f;
+    sc->code[1] = 0x05;
+    sc->code_size = 2;
+    return 0;
+}
+
+int finish_fast_trace_mmap(Context * ctx, FastTraceSyscall * sc, ContextAddress * addr) {
+    unsigned i;
+    uint8_t data[8];
+    uint64_t res = 0;
+
+    if (context_read_reg(ctx, syscall_regs, 0, 8, data) < 0) return -1;
+    for (i = 8; i > 0; i--) res = (res << 8) | data[i - 1];
+    for (i = 0; syscall_regs[i].name != NULL; i++) {
+        if (context_write_reg(ctx, syscall_regs + i, 0, 8, sc->regs + i * 8) < 0) return -1;
+    }
+    if (res >= (uint64_t)-4095) {
+        /* The system call returns negated error code */
+        errno = (int)(0 - res);
+        return -1;
+    }
+    *addr = (ContextAddress)res;
+    return 0;
+}
+
+#endif /* ENABLE_FastTracepoints */
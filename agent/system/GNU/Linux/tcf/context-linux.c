@@ -62,6 +62,14 @@
 
 #define USE_PTRACE_SYSCALL      0
 
+/* Use /proc/<pid>/mem for large memory transfers instead of word-by-word PTRACE_PEEKDATA/POKEDATA */
+#if !defined(USE_PROC_PID_MEM)
+#  define USE_PROC_PID_MEM      1
+#endif
+
+/* Minimal size of a memory transfer that is done through /proc/<pid>/mem */
+#define PROC_PID_MEM_MIN_SIZE   32
+
 static const int PTRACE_FLAGS =
 #if USE_PTRACE_SYSCALL
       PTRACE_O_TRACESYSGOOD |
@@ -97,6 +105,10 @@ typedef struct ContextExtensionLinux {
     int                     sigkill_posted;
     int                     detach_req;
     int                     crt0_done;
+#if ENABLE_ContextMemoryFile
+    int                     mem_fd_open;
+    int                     mem_fd;             /* cached read-only /proc/<pid>/mem of a process */
+#endif
 #if ENABLE_ProfilerSST
     int                     prof_armed;
     int                     prof_fired;
@@ -420,6 +432,35 @@ static void free_regs(Context * ctx) {
     ext->regs_dirty = NULL;
 }
 
+#if ENABLE_ContextMemoryFile
+static void close_mem_file(Context * prs) {
+    ContextExtensionLinux * ext = EXT(prs);
+    if (ext->mem_fd_open) {
+        close(ext->mem_fd);
+        ext->mem_fd_open = 0;
+        ext->mem_fd = -1;
+    }
+}
+
+int context_get_mem_file(Context * ctx, int * fd) {
+    Context * prs = ctx->mem;
+    ContextExtensionLinux * ext = EXT(prs);
+    assert(is_dispatch_thread());
+    if (prs->exited) {
+        errno = ERR_ALREADY_EXITED;
+        return -1;
+    }
+    if (!ext->mem_fd_open) {
+        char file_name[FILE_PATH_SIZE];
+        snprintf(file_name, sizeof(file_name), "/proc/%d/mem", ext->pid);
+        if ((ext->mem_fd = open(file_name, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+        ext->mem_fd_open = 1;
+    }
+    *fd = ext->mem_fd;
+    return 0;
+}
+#endif
+
 static void send_process_exited_event(Context * prs) {
     LINK * l = prs->children.next;
     assert(prs->parent == NULL);
@@ -432,6 +473,9 @@ static void send_process_exited_event(Context * prs) {
         l = l->next;
     }
     prs->exiting = 1;
+#if ENABLE_ContextMemoryFile
+    close_mem_file(prs);
+#endif
     send_context_exited_event(prs);
 }
 
@@ -671,6 +715,42 @@ int context_can_resume(Context * ctx, int mode) {
     return 0;
 }
 
+#if USE_PROC_PID_MEM
+/* Transfer whole block of memory with a single system call.
+ * Return 0 if all 'size' bytes were transferred, -1 otherwise.
+ * Caller is expected to fall back to ptrace() on failure, which also provides detailed error info. */
+static int proc_pid_mem_access(Context * ctx, ContextAddress address, void * buf, size_t size, int write_mode) {
+    char file_name[FILE_PATH_SIZE];
+    size_t pos = 0;
+    int fd = -1;
+
+    if ((off_t)address < 0 || (off_t)(address + size) < 0) return -1;
+#if ENABLE_ContextMemoryFile
+    if (!write_mode) {
+        /* Reuse cached file descriptor instead of opening the file on every read */
+        if (context_get_mem_file(ctx, &fd) < 0) return -1;
+        while (pos < size) {
+            ssize_t rd = pread(fd, (char *)buf + pos, size - pos, (off_t)(address + pos));
+            if (rd <= 0) break;
+            pos += rd;
+        }
+        return pos == size ? 0 : -1;
+    }
+#endif
+    snprintf(file_name, sizeof(file_name), "/proc/%d/mem", EXT(ctx)->pid);
+    if ((fd = open(file_name, write_mode ? O_WRONLY : O_RDONLY)) < 0) return -1;
+    while (pos < size) {
+        ssize_t rd = write_mode ?
+            pwrite(fd, (char *)buf + pos, size - pos, (off_t)(address + pos)) :
+            pread(fd, (char *)buf + pos, size - pos, (off_t)(address + pos));
+        if (rd <= 0) break;
+        pos += rd;
+    }
+    close(fd);
+    return pos == size ? 0 : -1;
+}
+#endif
+
 #if ENABLE_MemoryAccessModes
 int context_write_mem_ext(Context * ctx, MemoryAccessMode * mode, ContextAddress address, void * buf, size_t size) {
     return context_write_mem(ctx, address, buf, size);
@@ -699,6 +779,9 @@ int context_write_mem(Context * ctx, ContextAddress address, void * buf, size_t
         return -1;
     }
     if (check_breakpoints_on_memory_write(ctx, address, buf, size) < 0) return -1;
+#if USE_PROC_PID_MEM
+    if (size >= PROC_PID_MEM_MIN_SIZE && proc_pid_mem_access(ctx, address, buf, size, 1) == 0) return 0;
+#endif
     for (word_addr = address & ~((ContextAddress)word_size - 1); word_addr < address + size; word_addr += word_size) {
         unsigned long word = 0;
         if (word_addr < address || word_addr + word_size > address + size) {
@@ -798,6 +881,11 @@ int context_read_mem(Context * ctx, ContextAddress address, void * buf, size_t s
         errno = EFAULT;
         return -1;
     }
+#if USE_PROC_PID_MEM
+    if (size >= PROC_PID_MEM_MIN_SIZE && proc_pid_mem_access(ctx, address, buf, size, 0) == 0) {
+        return check_breakpoints_on_memory_read(ctx, address, buf, size);
+    }
+#endif
     for (word_addr = address & ~((ContextAddress)word_size - 1); word_addr < address + size; word_addr += word_size) {
         unsigned long word = 0;
         errno = 0;
@@ -1544,6 +1632,10 @@ static void event_pid_stopped(pid_t pid, int signal, int event, int syscall) {
         }
         break;
     case PTRACE_EVENT_EXEC:
+#if ENABLE_ContextMemoryFile
+        /* The file refers to the address space that has been replaced by exec */
+        close_mem_file(ctx->mem);
+#endif
         invalidate_breakpoints_on_process_exec(ctx);
         send_context_changed_event(ctx);
         memory_map_event_mapping_changed(ctx->mem);
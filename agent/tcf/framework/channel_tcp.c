@@ -569,6 +569,48 @@ static void tcp_write_block_stream(OutputStream * out, const char * bytes, size_
     }
 }
 
+#if ENABLE_Splice
+#define SPLICE_COPY_BUF_SIZE 0x10000
+static char * splice_copy_buf = NULL;
+
+/* Fallback for files that don't support splice(), e.g. /proc/<pid>/mem: copy the data into the pipe */
+static ssize_t tcp_splice_copy(ChannelTCP * c, int fd, size_t size, int64_t * offset) {
+    ssize_t rd = 0;
+    if (c->out_errno) {
+        errno = c->out_errno;
+        return -1;
+    }
+    if (splice_copy_buf == NULL) splice_copy_buf = (char *)loc_alloc(SPLICE_COPY_BUF_SIZE);
+    if (size > SPLICE_COPY_BUF_SIZE) size = SPLICE_COPY_BUF_SIZE;
+    /* The pipe is empty at this point, don't write more than it can hold, so write() does not block */
+#if defined(F_GETPIPE_SZ)
+    {
+        int pipe_size = fcntl(c->pipefd[1], F_GETPIPE_SZ);
+        if (pipe_size <= 0) pipe_size = PIPE_BUF;
+        if (size > (size_t)pipe_size) size = pipe_size;
+    }
+#else
+    if (size > PIPE_BUF) size = PIPE_BUF;
+#endif
+    if (offset != NULL) {
+        rd = pread(fd, splice_copy_buf, size, (off_t)*offset);
+        if (rd > 0) *offset += rd;
+    }
+    else {
+        rd = read(fd, splice_copy_buf, size);
+    }
+    if (rd > 0) {
+        ssize_t pos = 0;
+        while (pos < rd) {
+            ssize_t wr = write(c->pipefd[1], splice_copy_buf + pos, rd - pos);
+            if (wr < 0) return -1;
+            pos += wr;
+        }
+    }
+    return rd;
+}
+#endif /* ENABLE_Splice */
+
 static ssize_t tcp_splice_block_stream(OutputStream * out, int fd, size_t size, int64_t * offset) {
     assert(is_dispatch_thread());
     if (size == 0) return 0;
@@ -577,6 +619,7 @@ static ssize_t tcp_splice_block_stream(OutputStream * out, int fd, size_t size,
         ChannelTCP * c = channel2tcp(out2channel(out));
         if (!c->ssl && out->supports_zero_copy) {
             ssize_t rd = splice(fd, offset, c->pipefd[1], NULL, size, SPLICE_F_MOVE);
+            if (rd < 0 && errno == EINVAL) rd = tcp_splice_copy(c, fd, size, offset);
             if (rd > 0) {
                 /* Send the binary data escape seq */
                 size_t n = rd;
@@ -328,6 +328,15 @@
 #  define ENABLE_MemoryAccessModes 0
 #endif
 
+#if !defined(ENABLE_ContextMemoryFile)
+/* Context memory can be read directly from a file, e.g. /proc/<pid>/mem */
+#  if defined(__linux__) && ENABLE_DebugContext && !ENABLE_ContextProxy && !ENABLE_ContextMux
+#    define ENABLE_ContextMemoryFile 1
+#  else
+#    define ENABLE_ContextMemoryFile 0
+#  endif
+#endif
+
 #if !defined(ENABLE_ExternalStackcrawl)
 #  define ENABLE_ExternalStackcrawl 0
 #endif
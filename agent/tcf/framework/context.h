@@ -399,6 +399,19 @@ extern int context_write_mem(Context * ctx, ContextAddress address, void * buf,
  */
 extern int context_read_mem(Context * ctx, ContextAddress address, void * buf, size_t size);
 
+/*
+ * Get a file descriptor that allows to read context memory directly, e.g. with pread() or splice().
+ * File offsets are memory addresses. Unlike context_read_mem(), data read from the file
+ * is not adjusted by check_breakpoints_on_memory_read().
+ * The descriptor is owned by the context and must not be closed by the caller.
+ * It stays valid until the context memory is replaced, so it should not be kept across dispatch events.
+ * Return -1 and set errno if the memory cannot be accessed as a file.
+ * Return 0 on success.
+ */
+#if ENABLE_ContextMemoryFile
+extern int context_get_mem_file(Context * ctx, int * fd);
+#endif
+
 /*
  * Retrieve addition information about error reported by last memory access.
  * Return -1 and set errno if the info cannot be read.
@@ -23,6 +23,7 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <tcf/framework/cpudefs.h>
 #include <tcf/framework/errors.h>
@@ -236,6 +237,49 @@ int id2register(const char * id, Context ** ctx, int * frame, RegisterDefinition
     return 0;
 }
 
+#define MEM_CACHE_PAGE_SIZE     0x1000
+#define MEM_CACHE_PAGE_CNT      64
+
+typedef struct MemCachePage {
+    Context * mem;
+    ContextAddress addr;
+    int valid; /* 1 - data is valid, -1 - the page cannot be read as a whole */
+    uint8_t data[MEM_CACHE_PAGE_SIZE];
+} MemCachePage;
+
+static MemCachePage * mem_cache = NULL;
+static int mem_cache_enabled = 0;
+
+void set_location_memory_cache(int enable) {
+    if (enable && mem_cache == NULL) {
+        mem_cache = (MemCachePage *)loc_alloc(sizeof(MemCachePage) * MEM_CACHE_PAGE_CNT);
+    }
+    if (mem_cache != NULL) {
+        unsigned i;
+        for (i = 0; i < MEM_CACHE_PAGE_CNT; i++) mem_cache[i].valid = 0;
+    }
+    mem_cache_enabled = enable;
+}
+
+static int read_location_memory(Context * ctx, ContextAddress addr, void * buf, size_t size) {
+    if (mem_cache_enabled) {
+        ContextAddress page_addr = addr & ~(ContextAddress)(MEM_CACHE_PAGE_SIZE - 1);
+        if (addr + size > addr && addr + size <= page_addr + MEM_CACHE_PAGE_SIZE) {
+            MemCachePage * p = mem_cache + (page_addr / MEM_CACHE_PAGE_SIZE) % MEM_CACHE_PAGE_CNT;
+            if (p->valid == 0 || p->mem != ctx->mem || p->addr != page_addr) {
+                p->mem = ctx->mem;
+                p->addr = page_addr;
+                p->valid = context_read_mem(ctx, page_addr, p->data, MEM_CACHE_PAGE_SIZE) < 0 ? -1 : 1;
+            }
+            if (p->valid > 0) {
+                memcpy(buf, p->data + (addr - page_addr), size);
+                return 0;
+            }
+        }
+    }
+    return context_read_mem(ctx, addr, buf, size);
+}
+
 static void location_expression_error(void) {
     str_exception(ERR_OTHER, "Invalid location expression");
 }
@@ -317,7 +361,7 @@ LocationExpressionState * evaluate_location_expression(Context * ctx, StackFrame
 
                 if (size <= sizeof(n)) {
                     uint8_t buf[8];
-                    if (context_read_mem(ctx, (ContextAddress)stk[stk_pos - 1], buf, size) < 0) exception(errno);
+                    if (read_location_memory(ctx, (ContextAddress)stk[stk_pos - 1], buf, size) < 0) exception(errno);
                     for (j = 0; j < size; j++) {
                         n = (n << 8) | buf[cmd->args.mem.big_endian ? j : size - j - 1];
                     }
@@ -313,6 +313,13 @@ extern uint8_t * get_break_instruction(Context * ctx, size_t * size);
  */
 extern int crawl_stack_frame(StackFrame * frame, StackFrame * down);
 
+/*
+ * Enable or disable caching of target memory pages read by location expressions.
+ * The cache is flushed on every call. It should be enabled only for a short time,
+ * while target memory is not expected to change, e.g. when unwinding stacks of many stopped threads.
+ */
+extern void set_location_memory_cache(int enable);
+
 /* Execute location expression. Throw an exception if error. */
 extern LocationExpressionState * evaluate_location_expression(
             Context * ctx, StackFrame * frame,
@@ -868,6 +868,40 @@ void json_write_binary_end(JsonWriteBinaryState * state) {
     }
 }
 
+size_t json_splice_binary_data(JsonWriteBinaryState * state, int fd, size_t size, int64_t * offset) {
+    size_t done = 0;
+    char * buffer = NULL;
+    size_t buffer_size = 0x10000;
+    int no_splice = state->encoding != ENCODING_BINARY || state->out->splice_block == NULL;
+
+    while (done < size) {
+        ssize_t rd = 0;
+        if (!no_splice) {
+            rd = splice_block_stream(state->out, fd, size - done, offset);
+            if (rd < 0 && errno == EINVAL) {
+                /* The file does not support splice(), copy the data instead */
+                no_splice = 1;
+                continue;
+            }
+            if (rd <= 0) break;
+            state->size_done += rd;
+        }
+        else {
+            size_t n = size - done;
+            if (buffer == NULL) buffer = (char *)loc_alloc(n < buffer_size ? n : buffer_size);
+            if (n > buffer_size) n = buffer_size;
+            rd = pread(fd, buffer, n, (off_t)*offset);
+            if (rd == 0) errno = ERR_EOF;
+            if (rd <= 0) break;
+            *offset += rd;
+            json_write_binary_data(state, buffer, rd);
+        }
+        done += rd;
+    }
+    loc_free(buffer);
+    return done;
+}
+
 void json_write_binary(OutputStream * out, const void * data, size_t size) {
     if (data == NULL) {
         write_string(out, "null");
@@ -120,4 +120,12 @@ extern void json_write_binary_start(JsonWriteBinaryState * state, OutputStream *
 extern void json_write_binary_data(JsonWriteBinaryState * state, const void * data, size_t size);
 extern void json_write_binary_end(JsonWriteBinaryState * state);
 
+/*
+ * Write up to 'size' bytes of binary data read from file 'fd' at '*offset'.
+ * Data is spliced directly into the channel if the stream and the file support it.
+ * Stops at the first read error or end of file, 'errno' tells the reason.
+ * Return number of bytes written, '*offset' is advanced by the same amount.
+ */
+extern size_t json_splice_binary_data(JsonWriteBinaryState * state, int fd, size_t size, int64_t * offset);
+
 #endif /* D_json */
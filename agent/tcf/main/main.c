@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <assert.h>
 #include <signal.h>
@@ -34,6 +35,7 @@
 #include <tcf/framework/channel_tcp.h>
 #include <tcf/framework/plugins.h>
 #include <tcf/services/discovery.h>
+#include <tcf/services/elf-index-cache.h>
 #include <tcf/http/http.h>
 #include <tcf/main/test.h>
 #include <tcf/main/cmdline.h>
@@ -231,6 +233,10 @@ static const char * help_text[] = {
 #if ENABLE_HttpServer
     "  -H<dir>          add HTML directory name",
 #endif
+#if ENABLE_ELF_INDEX_CACHE
+    "  -C<size>         set max size of ELF index cache, e.g. -C64M, -C0 disables the cache",
+    "  -Cpurge          remove all files from ELF index cache",
+#endif
 #if ENABLE_SSL
     "  -c               generate SSL certificate and exit",
 #endif
@@ -360,6 +366,9 @@ int main(int argc, char ** argv) {
 #endif
 #if ENABLE_HttpServer
             case 'H':
+#endif
+#if ENABLE_ELF_INDEX_CACHE
+            case 'C':
 #endif
                 if (*s == '\0') {
                     if (++ind >= argc) {
@@ -417,6 +426,17 @@ int main(int argc, char ** argv) {
                         free(fnm);
                     }
                     break;
+#endif
+#if ENABLE_ELF_INDEX_CACHE
+                case 'C':
+                    if (strcmp(s, "purge") == 0) {
+                        purge_elf_index_cache();
+                    }
+                    else if (set_elf_index_cache_size(s) < 0) {
+                        fprintf(stderr, "%s: invalid option '-C %s': %s\n", progname, s, errno_to_str(errno));
+                        exit(1);
+                    }
+                    break;
 #endif
                 }
                 s = NULL;
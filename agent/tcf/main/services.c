@@ -46,6 +46,7 @@
 #include <tcf/services/disassembly.h>
 #include <tcf/services/profiler.h>
 #include <tcf/services/profiler_sst.h>
+#include <tcf/services/fasttrace.h>
 #include <tcf/services/portforward_proxy.h>
 #include <tcf/services/portforward_service.h>
 #include <tcf/main/services.h>
@@ -136,6 +137,9 @@ void ini_services(Protocol * proto, TCFBroadcastGroup * bcg) {
 #if ENABLE_ProfilerSST
     ini_profiler_sst();
 #endif
+#if ENABLE_FastTracepoints
+    ini_fast_trace();
+#endif
 #if ENABLE_Plugins
     plugins_load(proto, bcg);
 #endif
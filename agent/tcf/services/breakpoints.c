@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 #include <tcf/framework/errors.h>
 #include <tcf/framework/trace.h>
 #include <tcf/framework/myalloc.h>
@@ -44,6 +45,8 @@
 #include <tcf/services/stacktrace.h>
 #include <tcf/services/memorymap.h>
 #include <tcf/services/pathmap.h>
+#include <tcf/services/fasttrace.h>
+#include <tcf/services/dprintf.h>
 
 
 /* ENABLE_SkipPrologueWhenPlanting: select how "skip prologue" is implemented:
@@ -54,6 +57,34 @@
 #  define ENABLE_SkipPrologueWhenPlanting 0
 #endif
 
+/* ENABLE_BreakpointsMapDeps: when memory map changes, re-evaluate locations only of breakpoints
+ * that can be affected by changed modules, instead of all breakpoints.
+ */
+#if !defined(ENABLE_BreakpointsMapDeps)
+#  define ENABLE_BreakpointsMapDeps (SERVICE_MemoryMap && ENABLE_ELF)
+#endif
+
+#if ENABLE_BreakpointsMapDeps
+#  include <tcf/services/tcf_elf.h>
+#endif
+
+/* ENABLE_BreakpointsCompiledConditions: compile breakpoint condition once per breakpoint address,
+ * instead of parsing the condition text and searching symbols every time the breakpoint is hit.
+ */
+#if !defined(ENABLE_BreakpointsCompiledConditions)
+#  define ENABLE_BreakpointsCompiledConditions (ENABLE_Expressions)
+#endif
+
+/* ENABLE_BreakpointsFastTrace: implement dprintf breakpoints that have "FastTrace" attribute as fast tracepoints,
+ * the breakpoint instruction is planted only if the tracepoint jump cannot be planted.
+ */
+#if !defined(ENABLE_BreakpointsFastTrace)
+#  define ENABLE_BreakpointsFastTrace (ENABLE_FastTracepoints && SERVICE_DPrintf)
+#endif
+
+/* Max number of compiled conditions cached per breakpoint */
+#define MAX_COMPILED_CONDITIONS 16
+
 typedef struct BreakpointRef BreakpointRef;
 typedef struct InstructionRef InstructionRef;
 typedef struct BreakInstruction BreakInstruction;
@@ -63,6 +94,9 @@ typedef struct LocationEvaluationRequest LocationEvaluationRequest;
 typedef struct ConditionEvaluationRequest ConditionEvaluationRequest;
 typedef struct ContextExtensionBP ContextExtensionBP;
 typedef struct BreakpointHitCount BreakpointHitCount;
+typedef struct BreakpointsMapRegion BreakpointsMapRegion;
+typedef struct CompiledCondition CompiledCondition;
+typedef struct FastTraceBreakpoint FastTraceBreakpoint;
 
 struct BreakpointRef {
     LINK link_inp;
@@ -71,6 +105,13 @@ struct BreakpointRef {
     BreakpointInfo * bp;
 };
 
+struct CompiledCondition {
+    CompiledCondition * next;
+    Context * ctx;              /* Breakpoint address space, see CONTEXT_GROUP_BREAKPOINT */
+    ContextAddress addr;        /* Code address */
+    CompiledExpression * expr;  /* NULL if the condition cannot be compiled */
+};
+
 struct BreakpointInfo {
     Context * ctx; /* NULL means all contexts */
     LINK link_all;
@@ -93,6 +134,7 @@ struct BreakpointInfo {
     char * client_data;
     int temporary;
     int skip_prologue;
+    int fast_trace;
     int access_mode;
     int access_size;
     int line;
@@ -108,6 +150,16 @@ struct BreakpointInfo {
     int attrs_changed;
     int status_changed;
     LINK link_hit_count;
+
+    /* Position of the breakpoint instruction references in 'status_index' */
+    unsigned status_pos;
+    unsigned status_cnt;
+
+    /* Selection of breakpoints affected by memory map changes, see get_map_change_breakpoints() */
+    unsigned map_mark;
+
+    /* Cache of compiled condition expressions, most recently used first */
+    CompiledCondition * compiled_conditions;
 };
 
 struct BreakpointHitCount {
@@ -125,12 +177,27 @@ struct InstructionRef {
     int line_offs_error;
 };
 
+#if ENABLE_BreakpointsFastTrace
+/* dprintf breakpoint implemented as fast tracepoint */
+struct FastTraceBreakpoint {
+    FastTracepoint * tp;        /* NULL if the condition cannot be recorded by a trampoline */
+    BreakpointInfo * bp;
+    Context * ctx;              /* Breakpoint address space, see CONTEXT_GROUP_BREAKPOINT */
+    char * condition;           /* The breakpoint condition when the tracepoint was created */
+    char * fmt;
+    char * args[FAST_TRACE_VALUES];
+    unsigned args_cnt;
+};
+#endif
+
 #define MAX_BI_SIZE 16
 
 struct BreakInstruction {
     LINK link_all;
     LINK link_adr;
     LINK link_lst;
+    LINK link_ph;
+    unsigned adr_hash;  /* addr2instr hash key, not reduced to table size */
     ContextBreakpoint cb; /* cb.ctx is "canonical" context, see context_get_canonical_addr() */
     char saved_code[MAX_BI_SIZE];
     char planted_code[MAX_BI_SIZE];
@@ -155,8 +222,16 @@ struct BreakInstruction {
     size_t bp_size;         /* Size of breakpoint instruction */
     Context * ph_ctx;
     ContextAddress ph_addr;
+#if ENABLE_BreakpointsFastTrace
+    FastTraceBreakpoint * fast_trace;
+#endif
 };
 
+typedef struct StatusIndexItem {
+    BreakInstruction * bi;
+    unsigned ref;
+} StatusIndexItem;
+
 struct EvaluationArgs {
     BreakpointInfo * bp;
     Context * ctx;
@@ -176,6 +251,7 @@ struct LocationEvaluationRequest {
 #   define LOC_EVALUATION_BP_ALL 9
     BreakpointInfo * bp_arr[LOC_EVALUATION_BP_MAX];
     unsigned bp_cnt; /* bp_cnt > LOC_EVALUATION_BP_MAX means all breakpoints */
+    int map_changed; /* memory map changed, breakpoints that depend on changed modules need evaluation */
 };
 
 struct EvaluationRequest {
@@ -187,6 +263,19 @@ struct EvaluationRequest {
     ConditionEvaluationRequest * bp_arr;
     unsigned bp_cnt;
     unsigned bp_max;
+    /* Breakpoints affected by memory map change */
+    BreakpointInfo ** map_bp_arr;
+    unsigned map_bp_cnt;
+    unsigned map_bp_max;
+    int map_bp_valid;
+};
+
+struct BreakpointsMapRegion {
+    ContextAddress addr;
+    ContextAddress size;
+    uint64_t file_offs;
+    char * file_name;
+    MemoryRegion * region;
 };
 
 struct ContextExtensionBP {
@@ -197,6 +286,10 @@ struct ContextExtensionBP {
     int empty_bp_grp;
     int instruction_cnt;
     LINK link_hit_count;
+    /* Memory map at the time of last evaluation of all breakpoint locations */
+    BreakpointsMapRegion * map_regions;
+    unsigned map_region_cnt;
+    int map_valid;
 };
 
 static const char * BREAKPOINTS = "Breakpoints";
@@ -216,12 +309,17 @@ static unsigned listener_max = 0;
 
 #define is_disabled(bp) (bp->enabled == 0 || bp->client_cnt == 0)
 
+/* Initial size of addr2instr hash table, the table grows with number of break instructions */
 #define ADDR2INSTR_HASH_SIZE (32 * MEM_USAGE_FACTOR - 1)
-#define addr2instr_hash(ctx, addr) ((unsigned)((uintptr_t)(ctx) + (uintptr_t)(addr) + ((uintptr_t)(addr) >> 8)) % ADDR2INSTR_HASH_SIZE)
+#define addr2instr_hash(ctx, addr) ((unsigned)((uintptr_t)(ctx) + (uintptr_t)(addr) + ((uintptr_t)(addr) >> 8)))
+
+/* Software break instructions are written into context memory in batches, one batch per page */
+#define BI_PAGE_SIZE 0x1000
 
 #define link_all2bi(A)  ((BreakInstruction *)((char *)(A) - offsetof(BreakInstruction, link_all)))
 #define link_adr2bi(A)  ((BreakInstruction *)((char *)(A) - offsetof(BreakInstruction, link_adr)))
 #define link_lst2bi(A)  ((BreakInstruction *)((char *)(A) - offsetof(BreakInstruction, link_lst)))
+#define link_ph2bi(A)   ((BreakInstruction *)((char *)(A) - offsetof(BreakInstruction, link_ph)))
 
 #define ID2BP_HASH_SIZE (32 * MEM_USAGE_FACTOR - 1)
 
@@ -250,18 +348,28 @@ static LINK breakpoints = TCF_LIST_INIT(breakpoints);
 static LINK id2bp[ID2BP_HASH_SIZE];
 
 static LINK instructions = TCF_LIST_INIT(instructions);
-static LINK addr2instr[ADDR2INSTR_HASH_SIZE];
+static LINK * addr2instr = NULL;
+static LINK * ph2instr = NULL; /* Virtual address instructions by canonical (physical) address */
+static unsigned addr2instr_size = 0;
+static unsigned addr2instr_cnt = 0;
 
 static LINK inp2br[INP2BR_HASH_SIZE];
 
 static LINK evaluations_posted = TCF_LIST_INIT(evaluations_posted);
 static LINK evaluations_active = TCF_LIST_INIT(evaluations_active);
+static unsigned compiled_conditions_cnt = 0;
 static uintptr_t generation_posted = 0;
 static uintptr_t generation_active = 0;
 static uintptr_t generation_done = 0;
 static int planting_instruction = 0;
 static int cache_enter_cnt = 0;
 static int planted_sw_bp_cnt = 0;
+static BreakpointsStats stats;
+
+/* Breakpoint instruction references sorted by breakpoint, valid while sending status notifications */
+static StatusIndexItem * status_index = NULL;
+static unsigned status_index_max = 0;
+static int status_index_valid = 0;
 
 static int bp_location_error = 0;
 #if ENABLE_LineNumbers
@@ -293,9 +401,10 @@ static int select_sw_breakpoint_isa(BreakInstruction * sw, uint8_t ** bp_encodin
     /* Software breakpoint should be rejected if opcode is unknown or ambiguous */
     size_t size = 0;
     uint8_t * encoding = NULL;
-    LINK * l = instructions.next;
-    while (l != &instructions) {
-        BreakInstruction * bi = link_all2bi(l);
+    LINK * h = ph2instr + addr2instr_hash(sw->cb.ctx, sw->cb.address) % addr2instr_size;
+    LINK * l = h->next;
+    while (l != h) {
+        BreakInstruction * bi = link_ph2bi(l);
         if (bi->ph_ctx == sw->cb.ctx && bi->ph_addr == sw->cb.address) {
             /* Virtual address breakpoint has same canonical address, check opcode */
             int isa_conflict = bi->isa_conflict;
@@ -324,10 +433,20 @@ static int select_sw_breakpoint_isa(BreakInstruction * sw, uint8_t ** bp_encodin
 }
 
 
-static void plant_instruction(BreakInstruction * bi) {
+static uint64_t get_time_usec(void) {
+    struct timespec t;
+    if (clock_gettime(CLOCK_REALTIME, &t) < 0) return 0;
+    return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+/*
+ * First part of planting: check the instruction and try back-end breakpoint API.
+ * If the break instruction needs to be written into context memory,
+ * bi->saved_size and bi->planted_code are set, and the caller is expected to do the writing.
+ * Return error code.
+ */
+static int start_planting(BreakInstruction * bi) {
     int error = 0;
-    size_t saved_size = bi->saved_size;
-    ErrorReport * rp = NULL;
 
     assert(!bi->stepping_over_bp);
     assert(!bi->planted);
@@ -367,6 +486,13 @@ static void plant_instruction(BreakInstruction * bi) {
         size_t bp_size = 0;
         error = 0;
         assert(!list_is_empty(&bi->link_all));
+#if ENABLE_FastTracepoints
+        if (is_fast_trace_patch_address(bi->cb.ctx, bi->cb.address)) {
+            /* Break instruction would overwrite the target address of a fast tracepoint jump */
+            error = set_errno(ERR_OTHER, "Cannot plant breakpoint inside fast tracepoint jump instruction");
+        }
+        else
+#endif
         if (select_sw_breakpoint_isa(bi, &bp_encoding, &bp_size) < 0) {
             error = errno;
         }
@@ -378,22 +504,21 @@ static void plant_instruction(BreakInstruction * bi) {
             assert(bi->saved_size > 0);
             assert(sizeof(bi->saved_code) >= bi->saved_size);
             assert(!bi->virtual_addr);
-            planting_instruction = 1;
             memcpy(bi->planted_code, bp_encoding, bi->saved_size);
-            if (context_read_mem(bi->cb.ctx, bi->cb.address, bi->saved_code, bi->saved_size) < 0) {
-                error = errno;
-            }
-            else if (context_write_mem(bi->cb.ctx, bi->cb.address, bi->planted_code, bi->saved_size) < 0) {
-                error = errno;
-            }
-            planting_instruction = 0;
         }
     }
     else if (error == ERR_UNSUPPORTED) {
         error = set_errno(ERR_OTHER, "Unsupported set of breakpoint attributes");
     }
+    return error;
+}
 
-    rp = get_error_report(error);
+/*
+ * Last part of planting: update instruction status.
+ * 'saved_size' is the value of bi->saved_size before start_planting() was called.
+ */
+static void done_planting(BreakInstruction * bi, size_t saved_size, int error) {
+    ErrorReport * rp = get_error_report(error);
     if (saved_size != bi->saved_size || !compare_error_reports(bi->planting_error, rp)) {
         unsigned i;
         release_error_report(bi->planting_error);
@@ -407,6 +532,35 @@ static void plant_instruction(BreakInstruction * bi) {
     }
     bi->planted = bi->planting_error == NULL;
     if (bi->planted && !bi->virtual_addr) planted_sw_bp_cnt++;
+    if (bi->planted) stats.plant_cnt++;
+}
+
+static void plant_instruction(BreakInstruction * bi) {
+    size_t saved_size = bi->saved_size;
+    int error = start_planting(bi);
+
+    if (error == 0 && bi->saved_size > 0) {
+        planting_instruction = 1;
+        stats.mem_read_cnt++;
+        if (context_read_mem(bi->cb.ctx, bi->cb.address, bi->saved_code, bi->saved_size) < 0) {
+            error = errno;
+        }
+        else {
+            stats.mem_write_cnt++;
+            if (context_write_mem(bi->cb.ctx, bi->cb.address, bi->planted_code, bi->saved_size) < 0) {
+                error = errno;
+            }
+        }
+        planting_instruction = 0;
+    }
+    done_planting(bi, saved_size, error);
+}
+
+static void done_removing(BreakInstruction * bi) {
+    if (!bi->virtual_addr) planted_sw_bp_cnt--;
+    bi->planted = 0;
+    bi->dirty = 0;
+    stats.remove_cnt++;
 }
 
 static int remove_instruction(BreakInstruction * bi) {
@@ -419,8 +573,10 @@ static int remove_instruction(BreakInstruction * bi) {
             int r = 0;
             char buf[MAX_BI_SIZE];
             planting_instruction = 1;
+            stats.mem_read_cnt++;
             r = context_read_mem(bi->cb.ctx, bi->cb.address, buf, bi->saved_size);
             if (r >= 0 && memcmp(buf, bi->planted_code, bi->saved_size) == 0) {
+                stats.mem_write_cnt++;
                 r = context_write_mem(bi->cb.ctx, bi->cb.address, bi->saved_code, bi->saved_size);
             }
             planting_instruction = 0;
@@ -435,12 +591,223 @@ static int remove_instruction(BreakInstruction * bi) {
             while (*p != NULL && (*p = *(p + 1)) != NULL) p++;
         }
     }
-    if (!bi->virtual_addr) planted_sw_bp_cnt--;
-    bi->planted = 0;
-    bi->dirty = 0;
+    done_removing(bi);
     return 0;
 }
 
+typedef struct PageBatchItem {
+    BreakInstruction * bi;
+    size_t saved_size;  /* bi->saved_size before planting */
+    int error;
+} PageBatchItem;
+
+static int cmp_instruction_address(const void * x, const void * y) {
+    BreakInstruction * bx = ((PageBatchItem *)x)->bi;
+    BreakInstruction * by = ((PageBatchItem *)y)->bi;
+    if ((uintptr_t)bx->cb.ctx < (uintptr_t)by->cb.ctx) return -1;
+    if ((uintptr_t)bx->cb.ctx > (uintptr_t)by->cb.ctx) return +1;
+    if (bx->cb.address < by->cb.address) return -1;
+    if (bx->cb.address > by->cb.address) return +1;
+    return 0;
+}
+
+/*
+ * Return number of items, starting from buf[0], that belong to same memory context and page.
+ * 'addr' and 'size' are set to the span of memory that contains the instructions.
+ */
+static unsigned get_page_batch(PageBatchItem * buf, unsigned cnt, ContextAddress * addr, size_t * size) {
+    BreakInstruction * bi = buf[0].bi;
+    ContextAddress page = bi->cb.address & ~(ContextAddress)(BI_PAGE_SIZE - 1);
+    ContextAddress end = bi->cb.address + bi->saved_size;
+    unsigned n = 1;
+    while (n < cnt) {
+        BreakInstruction * nx = buf[n].bi;
+        if (nx->cb.ctx != bi->cb.ctx) break;
+        if ((nx->cb.address & ~(ContextAddress)(BI_PAGE_SIZE - 1)) != page) break;
+        if (nx->cb.address + nx->saved_size > end) end = nx->cb.address + nx->saved_size;
+        n++;
+    }
+    *addr = bi->cb.address;
+    *size = (size_t)(end - bi->cb.address);
+    stats.page_cnt++;
+    return n;
+}
+
+static void write_page_batch(PageBatchItem * buf, unsigned n, ContextAddress addr, size_t size) {
+    unsigned i;
+    Context * mem = buf[0].bi->cb.ctx;
+    uint8_t * data = (uint8_t *)tmp_alloc(size * 3);
+    uint8_t * orig = data + size;
+    uint8_t * check = orig + size;
+    int error = 0;
+
+    stats.mem_read_cnt++;
+    if (context_read_mem(mem, addr, orig, size) < 0) {
+        /* Cannot access whole span, plant one by one to get individual error reports */
+        for (i = 0; i < n; i++) {
+            BreakInstruction * bi = buf[i].bi;
+            stats.mem_read_cnt++;
+            if (context_read_mem(mem, bi->cb.address, bi->saved_code, bi->saved_size) < 0) {
+                buf[i].error = errno;
+                continue;
+            }
+            stats.mem_write_cnt++;
+            if (context_write_mem(mem, bi->cb.address, bi->planted_code, bi->saved_size) < 0) {
+                buf[i].error = errno;
+            }
+        }
+        return;
+    }
+
+    memcpy(data, orig, size);
+    for (i = 0; i < n; i++) {
+        BreakInstruction * bi = buf[i].bi;
+        size_t offs = (size_t)(bi->cb.address - addr);
+        memcpy(bi->saved_code, orig + offs, bi->saved_size);
+        memcpy(data + offs, bi->planted_code, bi->saved_size);
+    }
+    stats.mem_write_cnt++;
+    if (context_write_mem(mem, addr, data, size) < 0) {
+        error = errno;
+        /* Try to restore original memory contents */
+        context_write_mem(mem, addr, orig, size);
+    }
+    else {
+        stats.mem_read_cnt++;
+        if (context_read_mem(mem, addr, check, size) < 0) error = errno;
+    }
+    for (i = 0; i < n; i++) {
+        BreakInstruction * bi = buf[i].bi;
+        size_t offs = (size_t)(bi->cb.address - addr);
+        if (error != 0) {
+            buf[i].error = error;
+        }
+        else if (memcmp(check + offs, bi->planted_code, bi->saved_size) != 0) {
+            buf[i].error = set_errno(ERR_OTHER, "Cannot verify break instruction, memory is not writable");
+        }
+    }
+}
+
+/*
+ * Plant a batch of instructions.
+ * Software breakpoints are written into context memory page by page:
+ * one read, one write and one verification read per page.
+ */
+static void plant_instructions(BreakInstruction ** buf, unsigned cnt) {
+    unsigned i = 0;
+    unsigned mem_cnt = 0;
+    uint64_t time_start = get_time_usec();
+    PageBatchItem * items = (PageBatchItem *)tmp_alloc(sizeof(PageBatchItem) * cnt);
+
+    for (i = 0; i < cnt; i++) {
+        BreakInstruction * bi = buf[i];
+        size_t saved_size = bi->saved_size;
+        int error = start_planting(bi);
+        if (error == 0 && bi->saved_size > 0) {
+            PageBatchItem * item = items + mem_cnt++;
+            item->bi = bi;
+            item->saved_size = saved_size;
+            item->error = 0;
+        }
+        else {
+            done_planting(bi, saved_size, error);
+        }
+    }
+    if (mem_cnt > 1) qsort(items, mem_cnt, sizeof(PageBatchItem), cmp_instruction_address);
+
+    i = 0;
+    planting_instruction = 1;
+    while (i < mem_cnt) {
+        ContextAddress addr = 0;
+        size_t size = 0;
+        unsigned n = get_page_batch(items + i, mem_cnt - i, &addr, &size);
+        write_page_batch(items + i, n, addr, size);
+        i += n;
+    }
+    planting_instruction = 0;
+
+    for (i = 0; i < mem_cnt; i++) {
+        PageBatchItem * item = items + i;
+        done_planting(item->bi, item->saved_size, item->error);
+    }
+    stats.plant_time += get_time_usec() - time_start;
+}
+
+/*
+ * Remove a batch of instructions.
+ * Software breakpoints are removed from context memory page by page: one read and one write per page.
+ * Return -1 and set errno if some of the instructions cannot be removed, such instructions remain planted.
+ */
+static int remove_instructions(BreakInstruction ** buf, unsigned cnt) {
+    unsigned i = 0;
+    unsigned mem_cnt = 0;
+    int error = 0;
+    uint64_t time_start = get_time_usec();
+    PageBatchItem * items = (PageBatchItem *)tmp_alloc(sizeof(PageBatchItem) * cnt);
+
+    for (i = 0; i < cnt; i++) {
+        BreakInstruction * bi = buf[i];
+        assert(bi->planted);
+        if (bi->saved_size == 0 || bi->cb.ctx->exited) {
+            if (remove_instruction(bi) < 0) error = errno;
+        }
+        else {
+            PageBatchItem * item = items + mem_cnt++;
+            assert(bi->planting_error == NULL);
+            assert(bi->address_error == NULL);
+            assert_all_stopped(bi->cb.ctx);
+            item->bi = bi;
+        }
+    }
+    if (mem_cnt > 1) qsort(items, mem_cnt, sizeof(PageBatchItem), cmp_instruction_address);
+
+    i = 0;
+    while (i < mem_cnt) {
+        unsigned j;
+        ContextAddress addr = 0;
+        size_t size = 0;
+        unsigned n = get_page_batch(items + i, mem_cnt - i, &addr, &size);
+        Context * mem = items[i].bi->cb.ctx;
+        uint8_t * data = (uint8_t *)tmp_alloc(size);
+        int ok = 0;
+
+        planting_instruction = 1;
+        stats.mem_read_cnt++;
+        if (context_read_mem(mem, addr, data, size) == 0) {
+            int changed = 0;
+            for (j = i; j < i + n; j++) {
+                BreakInstruction * bi = items[j].bi;
+                size_t offs = (size_t)(bi->cb.address - addr);
+                if (memcmp(data + offs, bi->planted_code, bi->saved_size) == 0) {
+                    memcpy(data + offs, bi->saved_code, bi->saved_size);
+                    changed = 1;
+                }
+            }
+            ok = 1;
+            if (changed) {
+                stats.mem_write_cnt++;
+                ok = context_write_mem(mem, addr, data, size) == 0;
+            }
+        }
+        planting_instruction = 0;
+        for (j = i; j < i + n; j++) {
+            if (ok) done_removing(items[j].bi);
+            /* Remove one by one to find failing instructions */
+            else if (remove_instruction(items[j].bi) < 0) error = errno;
+        }
+        i += n;
+    }
+
+    stats.remove_time += get_time_usec() - time_start;
+    if (!error) return 0;
+    errno = error;
+    return -1;
+}
+
+BreakpointsStats * get_breakpoints_stats(void) {
+    return &stats;
+}
+
 #ifndef NDEBUG
 static int is_canonical_addr(Context * ctx, ContextAddress address) {
     Context * mem = NULL;
@@ -450,12 +817,44 @@ static int is_canonical_addr(Context * ctx, ContextAddress address) {
 }
 #endif
 
+static void rehash_instructions(unsigned size) {
+    unsigned i;
+    LINK * l;
+    loc_free(addr2instr);
+    loc_free(ph2instr);
+    addr2instr = (LINK *)loc_alloc(sizeof(LINK) * size);
+    ph2instr = (LINK *)loc_alloc(sizeof(LINK) * size);
+    addr2instr_size = size;
+    for (i = 0; i < size; i++) {
+        list_init(addr2instr + i);
+        list_init(ph2instr + i);
+    }
+    for (l = instructions.next; l != &instructions; l = l->next) {
+        BreakInstruction * bi = link_all2bi(l);
+        list_add_last(&bi->link_adr, addr2instr + bi->adr_hash % size);
+        if (bi->ph_ctx != NULL) {
+            list_add_last(&bi->link_ph, ph2instr + addr2instr_hash(bi->ph_ctx, bi->ph_addr) % size);
+        }
+    }
+}
+
+static void add_instruction_to_hash(BreakInstruction * bi, unsigned hash) {
+    bi->adr_hash = hash;
+    list_add_last(&bi->link_all, &instructions);
+    if (++addr2instr_cnt > addr2instr_size * 4) {
+        rehash_instructions(addr2instr_size * 4 + 3);
+    }
+    else {
+        list_add_last(&bi->link_adr, addr2instr + hash % addr2instr_size);
+    }
+}
+
 static BreakInstruction * find_instruction(Context * ctx, int virtual_addr,
         ContextAddress address, unsigned access_types, ContextAddress access_size) {
-    int hash = addr2instr_hash(ctx, address);
-    LINK * l = addr2instr[hash].next;
+    LINK * h = addr2instr + addr2instr_hash(ctx, address) % addr2instr_size;
+    LINK * l = h->next;
     assert(virtual_addr || is_canonical_addr(ctx, address));
-    while (l != addr2instr + hash) {
+    while (l != h) {
         BreakInstruction * bi = link_adr2bi(l);
         if (bi->cb.ctx == ctx &&
             bi->cb.address == address &&
@@ -473,11 +872,9 @@ static BreakInstruction * find_instruction(Context * ctx, int virtual_addr,
 
 static BreakInstruction * add_instruction(Context * ctx, int virtual_addr,
         ContextAddress address, unsigned access_types, ContextAddress access_size) {
-    int hash = addr2instr_hash(ctx, address);
     BreakInstruction * bi = (BreakInstruction *)loc_alloc_zero(sizeof(BreakInstruction));
     assert(find_instruction(ctx, virtual_addr, address, access_types, access_size) == NULL);
-    list_add_last(&bi->link_all, &instructions);
-    list_add_last(&bi->link_adr, addr2instr + hash);
+    add_instruction_to_hash(bi, addr2instr_hash(ctx, address));
     context_lock(ctx);
     bi->cb.ctx = ctx;
     bi->cb.address = address;
@@ -504,6 +901,177 @@ static void clear_instruction_refs(Context * ctx, BreakpointInfo * bp) {
     }
 }
 
+#if ENABLE_BreakpointsFastTrace
+
+typedef struct FastTraceHit {
+    FastTraceBreakpoint * ft;
+    uint64_t values[FAST_TRACE_VALUES];
+} FastTraceHit;
+
+static FastTraceHit * fast_trace_hit = NULL;
+
+static void replant_breakpoint(BreakpointInfo * bp);
+static void run_bp_evaluation(CacheClient * client, BreakpointInfo * bp, Context * ctx, int index);
+
+static void free_fast_trace(FastTraceBreakpoint * ft) {
+    unsigned i;
+    if (ft->tp != NULL) destroy_fast_tracepoint(ft->tp);
+    loc_free(ft->condition);
+    loc_free(ft->fmt);
+    for (i = 0; i < ft->args_cnt; i++) loc_free(ft->args[i]);
+    loc_free(ft);
+}
+
+static const char * skip_spaces(const char * s) {
+    while (*s == ' ' || *s == '\t') s++;
+    return s;
+}
+
+static int parse_fast_trace_condition(FastTraceBreakpoint * ft, const char * s) {
+    /* Accept only "$printf(format, args...)" with arguments that can be recorded by a trampoline */
+    char * fmt = (char *)tmp_alloc(strlen(s) + 1);
+    size_t fmt_len = 0;
+    size_t i;
+
+    s = skip_spaces(s);
+    if (strncmp(s, "$printf", 7) != 0) return -1;
+    s = skip_spaces(s + 7);
+    if (*s++ != '(') return -1;
+    s = skip_spaces(s);
+    if (*s++ != '"') return -1;
+    while (*s != '"') {
+        char ch = *s++;
+        if (ch == 0) return -1;
+        if (ch == '\\') {
+            switch (*s++) {
+            case 'n': ch = '\n'; break;
+            case 't': ch = '\t'; break;
+            case '\\': ch = '\\'; break;
+            case '"': ch = '"'; break;
+            default: return -1;
+            }
+        }
+        fmt[fmt_len++] = ch;
+    }
+    fmt[fmt_len] = 0;
+    s++;
+    for (i = 0; i < fmt_len; i++) {
+        /* Strings are read from the target memory when printed, they cannot be recorded */
+        if (fmt[i] != '%') continue;
+        if (fmt[i + 1] == '%') {
+            i++;
+            continue;
+        }
+        while (++i < fmt_len && (fmt[i] < 'A' || strchr("lLhjzt", fmt[i]) != NULL)) {
+            if (fmt[i] == '*') return -1;
+        }
+        if (i < fmt_len && fmt[i] == 's') return -1;
+    }
+    for (;;) {
+        const char * arg = NULL;
+        int level = 0;
+        s = skip_spaces(s);
+        if (*s == ')') break;
+        if (*s++ != ',') return -1;
+        arg = s;
+        while (*s != 0 && (level > 0 || (*s != ',' && *s != ')'))) {
+            if (*s == '"' || *s == '\'') return -1;
+            if (*s == '(' || *s == '[') level++;
+            if (*s == ')' || *s == ']') level--;
+            s++;
+        }
+        if (*s == 0 || s == arg || ft->args_cnt >= FAST_TRACE_VALUES) return -1;
+        ft->args[ft->args_cnt++] = loc_strndup(arg, s - arg);
+    }
+    if (*skip_spaces(s + 1) != 0) return -1;
+    ft->fmt = loc_strdup(fmt);
+    return 0;
+}
+
+static void print_fast_trace_hit(void * args) {
+    EvaluationArgs * e = (EvaluationArgs *)args;
+    FastTraceBreakpoint * ft = fast_trace_hit->ft;
+    Value * values = (Value *)tmp_alloc_zero(sizeof(Value) * FAST_TRACE_VALUES);
+    unsigned i;
+    Trap trap;
+
+    for (i = 0; i < ft->args_cnt; i++) {
+        Value * v = values + i;
+        v->type_class = TYPE_CLASS_INTEGER;
+        v->value = fast_trace_hit->values + i;
+        v->size = sizeof(uint64_t);
+        v->big_endian = big_endian_host();
+        v->ctx = e->ctx;
+    }
+    if (set_trap(&trap)) {
+        dprintf_expression_ctx(e->ctx, ft->fmt, values, ft->args_cnt);
+        clear_trap(&trap);
+    }
+    else {
+        trace(LOG_ALWAYS, "Cannot print breakpoint %s record: %s", ft->bp->id, errno_to_str(trap.error));
+    }
+}
+
+static void fast_trace_hit_cache_client(void * args) {
+    fast_trace_hit = (FastTraceHit *)args;
+    run_bp_evaluation(print_fast_trace_hit, fast_trace_hit->ft->bp, fast_trace_hit->ft->ctx, -1);
+    fast_trace_hit = NULL;
+    cache_exit();
+}
+
+static void fast_trace_record(FastTracepoint * tp, FastTraceRecord * rec, void * args) {
+    FastTraceHit hit;
+    hit.ft = (FastTraceBreakpoint *)args;
+    memcpy(hit.values, rec->values, sizeof(hit.values));
+    cache_enter(fast_trace_hit_cache_client, NULL, &hit, sizeof(hit));
+}
+
+static void fast_trace_mode_changed(FastTracepoint * tp, void * args) {
+    FastTraceBreakpoint * ft = (FastTraceBreakpoint *)args;
+    if (get_fast_tracepoint_mode(tp) == FAST_TRACE_BREAKPOINT) {
+        trace(LOG_CONTEXT, "Breakpoint %s: fast tracepoint falls back to breakpoint: %s", ft->bp->id,
+            errno_to_str(set_error_report_errno(get_fast_tracepoint_error(tp))));
+    }
+    /* Plant the breakpoint instruction if the jump is not planted, update the breakpoint status */
+    ft->bp->status_changed = 1;
+    replant_breakpoint(ft->bp);
+}
+
+/* Return 1 if the break instruction is implemented as fast tracepoint and must not be planted */
+static int update_fast_trace(BreakInstruction * bi) {
+    FastTraceBreakpoint * ft = bi->fast_trace;
+    BreakpointInfo * bp = bi->ref_cnt == 1 ? bi->refs[0].bp : NULL;
+    int enabled = bp != NULL && bp->fast_trace && bp->condition != NULL;
+
+    /* The jump is executed by every thread of the process and records have no thread ID:
+     * breakpoints that select contexts or count hits need the break instruction */
+    if (enabled && (bp->ctx != NULL || bp->context_ids != NULL || bp->context_names != NULL ||
+            bp->context_query != NULL || bp->ignore_count > 0)) enabled = 0;
+
+    if (ft != NULL && (!enabled || ft->bp != bp || ft->ctx != bi->refs[0].ctx || strcmp(ft->condition, bp->condition) != 0)) {
+        free_fast_trace(ft);
+        bi->fast_trace = ft = NULL;
+    }
+    if (!enabled) return 0;
+    if (ft == NULL) {
+        /* The break instruction is replaced by the tracepoint jump only when not planted */
+        if (bi->planted) return 0;
+        ft = (FastTraceBreakpoint *)loc_alloc_zero(sizeof(FastTraceBreakpoint));
+        ft->bp = bp;
+        ft->ctx = bi->refs[0].ctx;
+        ft->condition = loc_strdup(bp->condition);
+        if (parse_fast_trace_condition(ft, bp->condition) == 0) {
+            ft->tp = create_fast_tracepoint_ext(bi->cb.ctx, bi->cb.address, NULL,
+                (const char **)ft->args, ft->args_cnt, fast_trace_record, fast_trace_mode_changed, ft);
+        }
+        bi->fast_trace = ft;
+    }
+    if (ft->tp == NULL) return 0;
+    return get_fast_tracepoint_mode(ft->tp) != FAST_TRACE_BREAKPOINT;
+}
+
+#endif /* ENABLE_BreakpointsFastTrace */
+
 static void free_instruction(BreakInstruction * bi) {
     assert(bi->dirty == 0);
     assert(bi->planted == 0);
@@ -511,10 +1079,15 @@ static void free_instruction(BreakInstruction * bi) {
     assert(bi->stepping_over_bp == 0);
     list_remove(&bi->link_all);
     list_remove(&bi->link_adr);
+    if (bi->ph_ctx != NULL) list_remove(&bi->link_ph);
+    addr2instr_cnt--;
     context_unlock(bi->cb.ctx);
     release_error_report(bi->address_error);
     release_error_report(bi->planting_error);
     release_error_report(bi->condition_error);
+#if ENABLE_BreakpointsFastTrace
+    if (bi->fast_trace != NULL) free_fast_trace(bi->fast_trace);
+#endif
     loc_free(bi->bp_encoding);
     loc_free(bi->refs);
     loc_free(bi);
@@ -547,8 +1120,12 @@ static void validate_bi_refs(BreakInstruction * bi) {
 static void flush_instructions(void) {
     LINK lst;
     LINK * l;
+    BreakInstruction ** buf = NULL;
+    unsigned buf_cnt = 0;
+    uint64_t time_start = get_time_usec();
 
     list_init(&lst);
+    buf = (BreakInstruction **)tmp_alloc(sizeof(BreakInstruction *) * addr2instr_cnt);
 
     /* Validate references */
     l = instructions.next;
@@ -609,10 +1186,10 @@ static void flush_instructions(void) {
         if (bi->planted) {
             assert(!bi->address_error);
             if (bi->dirty) {
-                remove_instruction(bi);
+                buf[buf_cnt++] = bi;
             }
             else if (bi->ref_cnt == 0 && bi->virtual_addr) {
-                remove_instruction(bi);
+                buf[buf_cnt++] = bi;
             }
 #if !defined(_WRS_KERNEL)
             /*
@@ -624,10 +1201,19 @@ static void flush_instructions(void) {
              */
             else if (bi->saved_size == 0 && !bi->hardware) {
                 /* Free space for hardware breakpoints */
-                remove_instruction(bi);
+                buf[buf_cnt++] = bi;
             }
 #endif  /* _WRS_KERNEL */
         }
+    }
+    remove_instructions(buf, buf_cnt);
+    buf_cnt = 0;
+    l = lst.next;
+    while (l != &lst) {
+        BreakInstruction * bi = link_lst2bi(l);
+        l = l->next;
+        if (!bi->valid) continue;
+        if (bi->stepping_over_bp) continue;
         if (bi->planted || bi->ref_cnt == 0 || bi->cb.ctx->exiting || bi->cb.ctx->exited) {
             list_remove(&bi->link_lst);
         }
@@ -670,6 +1256,7 @@ static void flush_instructions(void) {
     }
 
     /* Validate and plant canonical address breakpoints */
+    buf = (BreakInstruction **)tmp_alloc(sizeof(BreakInstruction *) * addr2instr_cnt);
     l = lst.next;
     while (l != &lst) {
         BreakInstruction * bi = link_lst2bi(l);
@@ -680,9 +1267,14 @@ static void flush_instructions(void) {
         if (bi->address_error) continue;
         assert(!bi->no_addr);
         if (bi->stepping_over_bp) continue;
+#if ENABLE_BreakpointsFastTrace
+        if (update_fast_trace(bi)) continue;
+#endif
         if (bi->ref_cnt == 0) continue;
-        if (!bi->planted) plant_instruction(bi);
+        if (!bi->planted) buf[buf_cnt++] = bi;
     }
+    plant_instructions(buf, buf_cnt);
+    buf_cnt = 0;
 
     /* Free unused break instructions */
     l = instructions.next;
@@ -693,9 +1285,20 @@ static void flush_instructions(void) {
         list_init(&bi->link_lst);
         if (bi->ref_cnt > 0) continue;
         if (bi->stepping_over_bp) continue;
-        if (bi->planted && is_all_stopped(bi->cb.ctx)) remove_instruction(bi);
+        if (bi->planted && is_all_stopped(bi->cb.ctx)) buf[buf_cnt++] = bi;
+    }
+    remove_instructions(buf, buf_cnt);
+    l = instructions.next;
+    while (l != &instructions) {
+        BreakInstruction * bi = link_all2bi(l);
+        l = l->next;
+        if (bi->ref_cnt > 0) continue;
+        if (bi->stepping_over_bp) continue;
         if (!bi->planted) free_instruction(bi);
     }
+
+    stats.flush_cnt++;
+    stats.flush_time += get_time_usec() - time_start;
 }
 
 static unsigned get_bp_hit_count(BreakpointInfo * bp, Context * ctx) {
@@ -795,20 +1398,27 @@ void invalidate_breakpoints_on_process_exec(Context * ctx) {
 
 int unplant_breakpoints(Context * ctx) {
     int error = 0;
+    BreakInstruction ** buf = (BreakInstruction **)tmp_alloc(sizeof(BreakInstruction *) * addr2instr_cnt);
+    unsigned buf_cnt = 0;
     LINK * l = instructions.next;
     /* Note: the function can be called for a fork child process
      * that we don't want to attach. All references to such process
      * should be removed immediately, we cannot rely on
      * event_replant_breakpoints() to do that. */
+    while (l != &instructions) {
+        BreakInstruction * bi = link_all2bi(l);
+        l = l->next;
+        if (bi->cb.ctx != ctx) continue;
+        if (bi->planted) buf[buf_cnt++] = bi;
+    }
+    if (remove_instructions(buf, buf_cnt) < 0) error = errno;
+    l = instructions.next;
     while (l != &instructions) {
         unsigned i;
         BreakInstruction * bi = link_all2bi(l);
         l = l->next;
         if (bi->cb.ctx != ctx) continue;
-        if (bi->planted && remove_instruction(bi) < 0) {
-            error = errno;
-            continue;
-        }
+        if (bi->planted) continue;
         for (i = 0; i < bi->ref_cnt; i++) {
             BreakpointInfo * bp = bi->refs[i].bp;
             Context * bx = bi->refs[i].ctx;
@@ -826,8 +1436,46 @@ int unplant_breakpoints(Context * ctx) {
     return -1;
 }
 
+int check_breakpoints_in_memory_range(Context * ctx, ContextAddress address, size_t size) {
+    if (!planting_instruction) {
+#if ENABLE_FastTracepoints
+        if (check_fast_trace_in_memory_range(ctx, address, size)) return 1;
+#endif
+        while (size > 0) {
+            size_t sz = size;
+            LINK * l = instructions.next;
+            Context * mem = NULL;
+            ContextAddress mem_addr = 0;
+            ContextAddress mem_base = 0;
+            ContextAddress mem_size = 0;
+            while (l != &instructions) {
+                BreakInstruction * bi = link_all2bi(l);
+                l = l->next;
+                if (!bi->planted) continue;
+                if (!bi->saved_size) continue;
+                if (mem == NULL) {
+                    if (context_get_canonical_addr(ctx, address, &mem, &mem_addr, &mem_base, &mem_size) < 0) return -1;
+                    if ((size_t)(mem_base + mem_size - mem_addr) < sz) sz = (size_t)(mem_base + mem_size - mem_addr);
+                }
+                if (bi->cb.ctx != mem) continue;
+                if (bi->cb.address + bi->saved_size <= mem_addr) continue;
+                if (bi->cb.address >= mem_addr + sz) continue;
+                return 1;
+            }
+            address += sz;
+            size -= sz;
+        }
+    }
+    return 0;
+}
+
 int check_breakpoints_on_memory_read(Context * ctx, ContextAddress address, void * p, size_t size) {
     if (!planting_instruction) {
+#if ENABLE_FastTracepoints
+        void * buf_start = p;
+        ContextAddress buf_addr = address;
+        size_t buf_size = size;
+#endif
         while (size > 0) {
             size_t sz = size;
             uint8_t * buf = (uint8_t *)p;
@@ -859,6 +1507,10 @@ int check_breakpoints_on_memory_read(Context * ctx, ContextAddress address, void
             address += sz;
             size -= sz;
         }
+#if ENABLE_FastTracepoints
+        /* A break instruction at a jump opcode has saved the jump, restore the original code over it */
+        check_fast_trace_on_memory_read(ctx, buf_addr, buf_start, buf_size);
+#endif
     }
     return 0;
 }
@@ -901,98 +1553,123 @@ int check_breakpoints_on_memory_write(Context * ctx, ContextAddress address, voi
     return 0;
 }
 
+static void write_breakpoint_instance(OutputStream * out, BreakpointInfo * bp, BreakInstruction * bi, unsigned i) {
+    write_stream(out, '{');
+    json_write_string(out, "LocationContext");
+    write_stream(out, ':');
+    json_write_string(out, bi->refs[i].ctx->id);
+    if (bi->address_error != NULL) {
+        write_stream(out, ',');
+        json_write_string(out, "Error");
+        write_stream(out, ':');
+        json_write_string(out, errno_to_str(set_error_report_errno(bi->address_error)));
+    }
+    else {
+        write_stream(out, ',');
+        json_write_string(out, "HitCount");
+        write_stream(out, ':');
+        json_write_ulong(out, get_bp_hit_count(bp, bi->refs[i].ctx));
+        if (!bi->no_addr) {
+            write_stream(out, ',');
+            json_write_string(out, "Address");
+            write_stream(out, ':');
+            json_write_uint64(out, bi->refs[i].addr);
+        }
+        if (bi->cb.length > 0) {
+            write_stream(out, ',');
+            json_write_string(out, "Size");
+            write_stream(out, ':');
+            json_write_uint64(out, bi->cb.length);
+        }
+        if (bi->planting_error != NULL) {
+            write_stream(out, ',');
+            json_write_string(out, "Error");
+            write_stream(out, ':');
+            json_write_string(out, errno_to_str(set_error_report_errno(bi->planting_error)));
+        }
+        else if (bi->planted) {
+            int bp_type_is_set = 0;
+#if ENABLE_ExtendedBreakpointStatus
+            if (bi->saved_size == 0) {
+                /* Back-end context breakpoint status */
+                int st_len = 0;
+                const char ** names = NULL;
+                const char ** values = NULL;
+                if (context_get_breakpoint_status(&bi->cb, &names, &values, &st_len) == 0) {
+                    while (st_len > 0) {
+                        if (*values != NULL) {
+                            if (strcmp (*names, "BreakpointType") == 0) bp_type_is_set = 1;
+                            write_stream(out, ',');
+                            json_write_string(out, *names);
+                            write_stream(out, ':');
+                            write_string(out, *values);
+                        }
+                        names++;
+                        values++;
+                        st_len--;
+                    }
+                }
+            }
+#endif
+            if (bp_type_is_set == 0) {
+                write_stream(out, ',');
+                json_write_string(out, "BreakpointType");
+                write_stream(out, ':');
+                json_write_string(out, bi->saved_size ? "Software" : "Hardware");
+            }
+            if (bi->condition_error != NULL) {
+                write_stream(out, ',');
+                json_write_string(out, "ConditionError");
+                write_stream(out, ':');
+                json_write_string(out, errno_to_str(set_error_report_errno(bi->condition_error)));
+            }
+        }
+#if ENABLE_BreakpointsFastTrace
+        else if (bi->fast_trace != NULL && bi->fast_trace->tp != NULL &&
+                get_fast_tracepoint_mode(bi->fast_trace->tp) == FAST_TRACE_JUMP) {
+            write_stream(out, ',');
+            json_write_string(out, "BreakpointType");
+            write_stream(out, ':');
+            json_write_string(out, "FastTrace");
+        }
+#endif
+    }
+    write_stream(out, '}');
+}
+
 static void write_breakpoint_status(OutputStream * out, BreakpointInfo * bp) {
     write_stream(out, '{');
 
     if (bp->instruction_cnt) {
         int cnt = 0;
-        LINK * l = instructions.next;
         json_write_string(out, "Instances");
         write_stream(out, ':');
         write_stream(out, '[');
-        while (l != &instructions) {
-            unsigned i;
-            BreakInstruction * bi = link_all2bi(l);
-            l = l->next;
-            if (bi->planted_as_sw_bp) continue;
-            for (i = 0; i < bi->ref_cnt; i++) {
-                if (bi->refs[i].bp != bp) continue;
+        if (status_index_valid) {
+            unsigned n;
+            for (n = 0; n < bp->status_cnt; n++) {
+                StatusIndexItem * item = status_index + bp->status_pos + n;
+                if (item->bi->planted_as_sw_bp) continue;
                 if (cnt > 0) write_stream(out, ',');
-                write_stream(out, '{');
-                json_write_string(out, "LocationContext");
-                write_stream(out, ':');
-                json_write_string(out, bi->refs[i].ctx->id);
-                if (bi->address_error != NULL) {
-                    write_stream(out, ',');
-                    json_write_string(out, "Error");
-                    write_stream(out, ':');
-                    json_write_string(out, errno_to_str(set_error_report_errno(bi->address_error)));
-                }
-                else {
-                    write_stream(out, ',');
-                    json_write_string(out, "HitCount");
-                    write_stream(out, ':');
-                    json_write_ulong(out, get_bp_hit_count(bp, bi->refs[i].ctx));
-                    if (!bi->no_addr) {
-                        write_stream(out, ',');
-                        json_write_string(out, "Address");
-                        write_stream(out, ':');
-                        json_write_uint64(out, bi->refs[i].addr);
-                    }
-                    if (bi->cb.length > 0) {
-                        write_stream(out, ',');
-                        json_write_string(out, "Size");
-                        write_stream(out, ':');
-                        json_write_uint64(out, bi->cb.length);
-                    }
-                    if (bi->planting_error != NULL) {
-                        write_stream(out, ',');
-                        json_write_string(out, "Error");
-                        write_stream(out, ':');
-                        json_write_string(out, errno_to_str(set_error_report_errno(bi->planting_error)));
-                    }
-                    else if (bi->planted) {
-                        int bp_type_is_set = 0;
-#if ENABLE_ExtendedBreakpointStatus
-                        if (bi->saved_size == 0) {
-                            /* Back-end context breakpoint status */
-                            int st_len = 0;
-                            const char ** names = NULL;
-                            const char ** values = NULL;
-                            if (context_get_breakpoint_status(&bi->cb, &names, &values, &st_len) == 0) {
-                                while (st_len > 0) {
-                                    if (*values != NULL) {
-                                        if (strcmp (*names, "BreakpointType") == 0) bp_type_is_set = 1;
-                                        write_stream(out, ',');
-                                        json_write_string(out, *names);
-                                        write_stream(out, ':');
-                                        write_string(out, *values);
-                                    }
-                                    names++;
-                                    values++;
-                                    st_len--;
-                                }
-                            }
-                        }
-#endif
-                        if (bp_type_is_set == 0) {
-                            write_stream(out, ',');
-                            json_write_string(out, "BreakpointType");
-                            write_stream(out, ':');
-                            json_write_string(out, bi->saved_size ? "Software" : "Hardware");
-                        }
-                        if (bi->condition_error != NULL) {
-                            write_stream(out, ',');
-                            json_write_string(out, "ConditionError");
-                            write_stream(out, ':');
-                            json_write_string(out, errno_to_str(set_error_report_errno(bi->condition_error)));
-                        }
-                    }
-                }
-                write_stream(out, '}');
+                write_breakpoint_instance(out, bp, item->bi, item->ref);
                 cnt++;
             }
         }
+        else {
+            LINK * l = instructions.next;
+            while (l != &instructions) {
+                unsigned i;
+                BreakInstruction * bi = link_all2bi(l);
+                l = l->next;
+                if (bi->planted_as_sw_bp) continue;
+                for (i = 0; i < bi->ref_cnt; i++) {
+                    if (bi->refs[i].bp != bp) continue;
+                    if (cnt > 0) write_stream(out, ',');
+                    write_breakpoint_instance(out, bp, bi, i);
+                    cnt++;
+                }
+            }
+        }
         write_stream(out, ']');
         assert(generation_done != generation_active || cnt > 0);
     }
@@ -1085,6 +1762,7 @@ static void get_bp_opcodes(void) {
             loc_free(bi->bp_encoding);
             bi->bp_encoding = NULL;
             bi->bp_size = 0;
+            if (bi->ph_ctx != NULL) list_remove(&bi->link_ph);
             bi->ph_ctx = NULL;
             bi->ph_addr = 0;
             if (bi->ref_cnt > 0 && !bi->cb.ctx->exiting && !bi->cb.ctx->exited &&
@@ -1136,6 +1814,7 @@ static void get_bp_opcodes(void) {
                     }
                     bi->ph_ctx = ph_ctx;
                     bi->ph_addr = ph_addr;
+                    list_add_last(&bi->link_ph, ph2instr + addr2instr_hash(ph_ctx, ph_addr) % addr2instr_size);
                 }
             }
         }
@@ -1156,12 +1835,13 @@ static BreakInstruction * link_breakpoint_instruction(
 
     if (mem == NULL) {
         /* Breakpoint does not have an address, e.g. breakpoint on a signal or I/O event */
-        int hash = addr2instr_hash(ctx, bp);
-        LINK * l = addr2instr[hash].next;
+        unsigned hash = addr2instr_hash(ctx, bp);
+        LINK * h = addr2instr + hash % addr2instr_size;
+        LINK * l = h->next;
         assert(ctx_addr == 0);
         assert(mem_addr == 0);
         assert(virtual_addr == 0);
-        while (l != addr2instr + hash) {
+        while (l != h) {
             BreakInstruction * i = link_adr2bi(l);
             if (i->cb.ctx == ctx && i->no_addr && i->ref_cnt == 1 &&
                     i->refs[0].ctx == ctx && i->refs[0].bp == bp &&
@@ -1173,8 +1853,7 @@ static BreakInstruction * link_breakpoint_instruction(
             l = l->next;
         }
         bi = (BreakInstruction *)loc_alloc_zero(sizeof(BreakInstruction));
-        list_add_last(&bi->link_all, &instructions);
-        list_add_last(&bi->link_adr, addr2instr + hash);
+        add_instruction_to_hash(bi, hash);
         context_lock(ctx);
         bi->cb.ctx = ctx;
         bi->no_addr = 1;
@@ -1308,7 +1987,7 @@ static void post_evaluation_request(EvaluationRequest * req) {
 
 static int check_context_ids_location(BreakpointInfo * bp, Context * ctx);
 
-static void post_location_evaluation_request(Context * ctx, BreakpointInfo * bp) {
+static void post_location_evaluation_request_ext(Context * ctx, BreakpointInfo * bp, int map_changed) {
     ContextExtensionBP * ext = EXT(ctx);
     Context * grp = context_get_group(ctx, CONTEXT_GROUP_BREAKPOINT);
 
@@ -1358,6 +2037,9 @@ static void post_location_evaluation_request(Context * ctx, BreakpointInfo * bp)
         if (bp != NULL && req->loc_posted.bp_cnt < LOC_EVALUATION_BP_MAX) {
             req->loc_posted.bp_arr[req->loc_posted.bp_cnt++] = bp;
         }
+        else if (bp == NULL && map_changed) {
+            req->loc_posted.map_changed = 1;
+        }
         else {
             req->loc_posted.bp_cnt = LOC_EVALUATION_BP_ALL;
         }
@@ -1366,6 +2048,10 @@ static void post_location_evaluation_request(Context * ctx, BreakpointInfo * bp)
     }
 }
 
+static void post_location_evaluation_request(Context * ctx, BreakpointInfo * bp) {
+    post_location_evaluation_request_ext(ctx, bp, 0);
+}
+
 static void run_bp_evaluation(CacheClient * client, BreakpointInfo * bp, Context * ctx, int index) {
     int cnt = 0;
     EvaluationArgs args;
@@ -1407,6 +2093,33 @@ static void run_bp_evaluation(CacheClient * client, BreakpointInfo * bp, Context
     if (cnt == 0) client(&args);
 }
 
+/* Dispose compiled conditions of a breakpoint in given breakpoint address space, or all if 'grp' is NULL */
+static void free_compiled_conditions(BreakpointInfo * bp, Context * grp) {
+    CompiledCondition ** p = &bp->compiled_conditions;
+    while (*p != NULL) {
+        CompiledCondition * cc = *p;
+        if (grp == NULL || cc->ctx == grp) {
+            *p = cc->next;
+            if (cc->expr != NULL) free_compiled_expression(cc->expr);
+            assert(compiled_conditions_cnt > 0);
+            compiled_conditions_cnt--;
+            loc_free(cc);
+        }
+        else {
+            p = &cc->next;
+        }
+    }
+}
+
+static void free_group_compiled_conditions(Context * grp) {
+    LINK * l;
+    if (compiled_conditions_cnt == 0) return;
+    for (l = breakpoints.next; l != &breakpoints; l = l->next) {
+        BreakpointInfo * bp = link_all2bp(l);
+        if (bp->compiled_conditions != NULL) free_compiled_conditions(bp, grp);
+    }
+}
+
 static void free_bp(BreakpointInfo * bp) {
     assert(list_is_empty(&evaluations_posted));
     assert(list_is_empty(&evaluations_active));
@@ -1417,6 +2130,7 @@ static void free_bp(BreakpointInfo * bp) {
     list_remove(&bp->link_all);
     if (*bp->id) list_remove(&bp->link_id);
     if (bp->ctx) context_unlock(bp->ctx);
+    free_compiled_conditions(bp, NULL);
     release_error_report(bp->error);
     loc_free(bp->type);
     loc_free(bp->location);
@@ -1440,60 +2154,91 @@ static void free_bp(BreakpointInfo * bp) {
 static void remove_ref(BreakpointRef * br);
 static void send_event_context_removed(BreakpointInfo * bp);
 
-static void notify_breakpoint_status(BreakpointInfo * bp) {
-    assert(generation_done == generation_posted);
 #ifndef NDEBUG
-    {
-        /* Verify breakpoints data structure */
-        LINK * m = NULL;
-        int instruction_cnt = 0;
-        int planted_as_sw_cnt = 0;
-        int planted_cnt = 0;
+static void check_instructions(void) {
+    /* Verify breakpoint instructions data structure */
+    LINK * m = NULL;
+    int planted_cnt = 0;
+    unsigned instruction_cnt = 0;
+    for (m = instructions.next; m != &instructions; m = m->next) {
+        unsigned i;
+        BreakInstruction * bi = link_all2bi(m);
+        assert(bi->valid);
+        assert(bi->ref_cnt <= bi->ref_size);
+        assert(bi->cb.ctx->ref_count > 0);
+        if (bi->planted && !bi->virtual_addr) planted_cnt++;
+        for (i = 0; i < bi->ref_cnt; i++) {
+            assert(bi->refs[i].cnt > 0);
+            assert(bi->refs[i].ctx->ref_count > 0);
+            assert(!bi->refs[i].ctx->exited);
+            assert(!bi->cb.ctx->exited);
+            if (bi->virtual_addr || bi->address_error || bi->no_addr) {
+                assert(bi->refs[i].ctx == bi->cb.ctx);
+            }
+        }
+        instruction_cnt++;
+    }
+    assert(planted_sw_bp_cnt == planted_cnt);
+    assert(addr2instr_cnt == instruction_cnt);
+}
+
+static void check_breakpoint_instruction_ref(BreakpointInfo * bp, BreakInstruction * bi, unsigned i,
+        int * instruction_cnt, int * planted_as_sw_cnt) {
+    assert(bi->refs[i].bp == bp);
+    (*instruction_cnt)++;
+    if (bi->planted_as_sw_bp) {
+        assert(bi->virtual_addr);
+        (*planted_as_sw_cnt)++;
+    }
+    assert(id2ctx(bi->refs[i].ctx->id) == NULL ||
+        check_context_ids_location(bp, bi->refs[i].ctx));
+}
+
+static void check_breakpoint(BreakpointInfo * bp) {
+    /* Verify breakpoint data structure */
+    LINK * m = NULL;
+    int instruction_cnt = 0;
+    int planted_as_sw_cnt = 0;
+    if (status_index_valid) {
+        unsigned n;
+        for (n = 0; n < bp->status_cnt; n++) {
+            StatusIndexItem * item = status_index + bp->status_pos + n;
+            check_breakpoint_instruction_ref(bp, item->bi, item->ref, &instruction_cnt, &planted_as_sw_cnt);
+        }
+    }
+    else {
+        check_instructions();
         for (m = instructions.next; m != &instructions; m = m->next) {
             unsigned i;
             BreakInstruction * bi = link_all2bi(m);
-            assert(bi->valid);
-            assert(bi->ref_cnt <= bi->ref_size);
-            assert(bi->cb.ctx->ref_count > 0);
-            if (bi->planted && !bi->virtual_addr) planted_cnt++;
             for (i = 0; i < bi->ref_cnt; i++) {
-                assert(bi->refs[i].cnt > 0);
-                assert(bi->refs[i].ctx->ref_count > 0);
-                assert(!bi->refs[i].ctx->exited);
-                assert(!bi->cb.ctx->exited);
-                if (bi->virtual_addr || bi->address_error || bi->no_addr) {
-                    assert(bi->refs[i].ctx == bi->cb.ctx);
-                }
-                if (bi->refs[i].bp == bp) {
-                    instruction_cnt++;
-                    if (bi->planted_as_sw_bp) {
-                        assert(bi->virtual_addr);
-                        planted_as_sw_cnt++;
-                    }
-                    assert(id2ctx(bi->refs[i].ctx->id) == NULL ||
-                        check_context_ids_location(bp, bi->refs[i].ctx));
-                }
-            }
-        }
-        assert(bp->enabled || instruction_cnt == 0);
-        assert(bp->instruction_cnt == instruction_cnt);
-        assert(planted_as_sw_cnt == 0 || planted_as_sw_cnt < instruction_cnt);
-        assert(planted_sw_bp_cnt == planted_cnt);
-        if (*bp->id) {
-            int i;
-            int client_cnt = 0;
-            for (i = 0; i < INP2BR_HASH_SIZE; i++) {
-                for (m = inp2br[i].next; m != &inp2br[i]; m = m->next) {
-                    BreakpointRef * br = link_inp2br(m);
-                    if (br->bp == bp) client_cnt++;
-                }
+                if (bi->refs[i].bp != bp) continue;
+                check_breakpoint_instruction_ref(bp, bi, i, &instruction_cnt, &planted_as_sw_cnt);
             }
-            assert(bp->client_cnt == client_cnt);
         }
-        else {
-            assert(list_is_empty(&bp->link_clients));
+    }
+    assert(bp->enabled || instruction_cnt == 0);
+    assert(bp->instruction_cnt == instruction_cnt);
+    assert(planted_as_sw_cnt == 0 || planted_as_sw_cnt < instruction_cnt);
+    if (*bp->id) {
+        int client_cnt = 0;
+        for (m = bp->link_clients.next; m != &bp->link_clients; m = m->next) {
+            BreakpointRef * br = link_bp2br(m);
+            assert(br->bp == bp);
+            client_cnt++;
         }
+        assert(bp->client_cnt == client_cnt);
+    }
+    else {
+        assert(list_is_empty(&bp->link_clients));
     }
+}
+#endif
+
+static void notify_breakpoint_status(BreakpointInfo * bp) {
+    assert(generation_done == generation_posted);
+#ifndef NDEBUG
+    check_breakpoint(bp);
 #endif
     if (bp->client_cnt == 0) {
         if (bp->instruction_cnt == 0) {
@@ -1507,17 +2252,61 @@ static void notify_breakpoint_status(BreakpointInfo * bp) {
     }
 }
 
+static void build_status_index(void) {
+    LINK * l = NULL;
+    unsigned cnt = 0;
+    unsigned pos = 0;
+    for (l = breakpoints.next; l != &breakpoints; l = l->next) {
+        BreakpointInfo * bp = link_all2bp(l);
+        bp->status_cnt = 0;
+    }
+    for (l = instructions.next; l != &instructions; l = l->next) {
+        unsigned i;
+        BreakInstruction * bi = link_all2bi(l);
+        for (i = 0; i < bi->ref_cnt; i++) bi->refs[i].bp->status_cnt++;
+        cnt += bi->ref_cnt;
+    }
+    if (cnt > status_index_max) {
+        status_index_max = cnt;
+        status_index = (StatusIndexItem *)loc_realloc(status_index, sizeof(StatusIndexItem) * status_index_max);
+    }
+    for (l = breakpoints.next; l != &breakpoints; l = l->next) {
+        BreakpointInfo * bp = link_all2bp(l);
+        bp->status_pos = pos;
+        pos += bp->status_cnt;
+        bp->status_cnt = 0;
+    }
+    assert(pos == cnt);
+    for (l = instructions.next; l != &instructions; l = l->next) {
+        unsigned i;
+        BreakInstruction * bi = link_all2bi(l);
+        for (i = 0; i < bi->ref_cnt; i++) {
+            BreakpointInfo * bp = bi->refs[i].bp;
+            StatusIndexItem * item = status_index + bp->status_pos + bp->status_cnt++;
+            item->bi = bi;
+            item->ref = i;
+        }
+    }
+}
+
 static void done_replanting_breakpoints(void) {
     LINK * l = NULL;
     assert(list_is_empty(&evaluations_posted));
     assert(list_is_empty(&evaluations_active));
     assert(generation_done == generation_active);
+#ifndef NDEBUG
+    check_instructions();
+#endif
+    /* Status of every breakpoint is checked, use the index to avoid scanning all instructions for each breakpoint */
+    build_status_index();
+    status_index_valid = 1;
     for (l = breakpoints.next; l != &breakpoints;) {
         BreakpointInfo * bp = link_all2bp(l);
         l = l->next;
         bp->attrs_changed = 0;
         notify_breakpoint_status(bp);
     }
+    status_index_valid = 0;
 }
 
 static void done_condition_evaluation(EvaluationRequest * req) {
@@ -1814,6 +2603,79 @@ static int check_context_ids_condition(BreakpointInfo * bp, Context * ctx) {
     return 1;
 }
 
+#if ENABLE_BreakpointsCompiledConditions
+static CompiledCondition * get_compiled_condition(BreakpointInfo * bp, Context * ctx) {
+    Context * grp = context_get_group(ctx, CONTEXT_GROUP_BREAKPOINT);
+    CompiledCondition ** p = &bp->compiled_conditions;
+    CompiledCondition * cc = NULL;
+    ContextAddress pc = 0;
+    unsigned cnt = 0;
+
+    if (get_PC(ctx, &pc) < 0) return NULL;
+    while ((cc = *p) != NULL) {
+        if (cc->ctx == grp && cc->addr == pc) {
+            /* Move to front */
+            *p = cc->next;
+            cc->next = bp->compiled_conditions;
+            bp->compiled_conditions = cc;
+            return cc;
+        }
+        if (++cnt >= MAX_COMPILED_CONDITIONS - 1 && cc->next != NULL) {
+            /* Drop least recently used entries */
+            CompiledCondition * tail = cc->next;
+            cc->next = NULL;
+            while (tail != NULL) {
+                CompiledCondition * next = tail->next;
+                if (tail->expr != NULL) free_compiled_expression(tail->expr);
+                compiled_conditions_cnt--;
+                loc_free(tail);
+                tail = next;
+            }
+            break;
+        }
+        p = &cc->next;
+    }
+
+    cc = (CompiledCondition *)loc_alloc_zero(sizeof(CompiledCondition));
+    cc->ctx = grp;
+    cc->addr = pc;
+    cc->expr = compile_expression(ctx, STACK_TOP_FRAME, 0, bp->condition);
+    if (cache_miss_count() > 0) {
+        /* Symbols data is not available yet, the evaluation will be restarted */
+        if (cc->expr != NULL) free_compiled_expression(cc->expr);
+        loc_free(cc);
+        return NULL;
+    }
+    if (cc->expr != NULL) stats.cond_compile_cnt++;
+    cc->next = bp->compiled_conditions;
+    bp->compiled_conditions = cc;
+    compiled_conditions_cnt++;
+    return cc;
+}
+#endif /* ENABLE_BreakpointsCompiledConditions */
+
+static int evaluate_condition_expression(BreakpointInfo * bp, Context * ctx, int * res) {
+    Value v;
+#if ENABLE_BreakpointsCompiledConditions
+    CompiledCondition * cc = get_compiled_condition(bp, ctx);
+    if (cc != NULL && cc->expr != NULL) {
+        int64_t n = 0;
+        if (evaluate_compiled_expression(cc->expr, ctx, STACK_TOP_FRAME, &n) == 0) {
+            stats.cond_compiled_cnt++;
+            *res = n != 0;
+            return 0;
+        }
+        if (get_error_code(errno) != ERR_UNSUPPORTED) return -1;
+        /* Value layout is not supported by compiled code, use the interpreter */
+        free_compiled_expression(cc->expr);
+        cc->expr = NULL;
+    }
+#endif
+    if (evaluate_expression(ctx, STACK_TOP_FRAME, 0, bp->condition, 1, &v) < 0) return -1;
+    if (v.size > 0 && value_to_boolean(&v, res) < 0) return -1;
+    return 0;
+}
+
 static void evaluate_condition(void * x) {
     EvaluationArgs * args = (EvaluationArgs *)x;
     EvaluationRequest * req = EXT(args->ctx)->req;
@@ -1835,11 +2697,13 @@ static void evaluate_condition(void * x) {
 
         if (check_context_ids_condition(bp, ctx)) {
             if (bp->condition != NULL) {
-                Value v;
                 int b = 0;
-                if (evaluate_expression(ctx, STACK_TOP_FRAME, 0, bp->condition, 1, &v) < 0 ||
-                        (v.size > 0 && value_to_boolean(&v, &b) < 0)) {
-                    int error = errno;
+                int error = 0;
+                uint64_t time = get_time_usec();
+                if (evaluate_condition_expression(bp, ctx, &b) < 0) error = errno;
+                stats.cond_time += get_time_usec() - time;
+                stats.cond_cnt++;
+                if (error) {
                     Channel * c = cache_channel();
                     if (c == NULL || !is_channel_closed(c)) {
                         condition_error = get_error_report(error);
@@ -1934,11 +2798,289 @@ static void validate_bp_attrs(void) {
     }
 }
 
+#if ENABLE_BreakpointsMapDeps
+
+#define MAP_MARK_REF    1   /* The breakpoint has instructions in the breakpoints group */
+#define MAP_MARK_EVAL   2   /* The breakpoint location needs evaluation */
+
+static int cmp_map_regions(const void * x, const void * y) {
+    const BreakpointsMapRegion * a = (const BreakpointsMapRegion *)x;
+    const BreakpointsMapRegion * b = (const BreakpointsMapRegion *)y;
+    if (a->addr != b->addr) return a->addr < b->addr ? -1 : +1;
+    if (a->size != b->size) return a->size < b->size ? -1 : +1;
+    if (a->file_offs != b->file_offs) return a->file_offs < b->file_offs ? -1 : +1;
+    return strcmp(a->file_name, b->file_name);
+}
+
+static void free_map_regions(ContextExtensionBP * ext) {
+    unsigned i;
+    for (i = 0; i < ext->map_region_cnt; i++) loc_free(ext->map_regions[i].file_name);
+    loc_free(ext->map_regions);
+    ext->map_regions = NULL;
+    ext->map_region_cnt = 0;
+    ext->map_valid = 0;
+}
+
+/* Return sorted array of memory map regions of 'ctx', allocated in tmp memory */
+static BreakpointsMapRegion * get_map_regions(Context * ctx, unsigned * cnt) {
+    static MemoryMap map;
+    unsigned i;
+    BreakpointsMapRegion * arr = NULL;
+    if (elf_get_map(ctx, 0, ~(ContextAddress)0, &map) < 0) return NULL;
+    arr = (BreakpointsMapRegion *)tmp_alloc(sizeof(BreakpointsMapRegion) * (map.region_cnt + 1));
+    for (i = 0; i < map.region_cnt; i++) {
+        MemoryRegion * r = map.regions + i;
+        arr[i].addr = r->addr;
+        arr[i].size = r->size;
+        arr[i].file_offs = r->file_offs;
+        arr[i].file_name = r->file_name;
+        arr[i].region = r;
+    }
+    qsort(arr, map.region_cnt, sizeof(BreakpointsMapRegion), cmp_map_regions);
+    *cnt = map.region_cnt;
+    return arr;
+}
+
+static void set_map_regions(Context * ctx, BreakpointsMapRegion * arr, unsigned cnt) {
+    ContextExtensionBP * ext = EXT(ctx);
+    unsigned i;
+    free_map_regions(ext);
+    ext->map_regions = (BreakpointsMapRegion *)loc_alloc(sizeof(BreakpointsMapRegion) * (cnt + 1));
+    for (i = 0; i < cnt; i++) {
+        BreakpointsMapRegion * r = ext->map_regions + i;
+        *r = arr[i];
+        r->file_name = loc_strdup(arr[i].file_name);
+        r->region = NULL;
+    }
+    ext->map_region_cnt = cnt;
+    ext->map_valid = 1;
+}
+
+static void update_map_regions(Context * ctx) {
+    unsigned cnt = 0;
+    BreakpointsMapRegion * arr = get_map_regions(ctx, &cnt);
+    if (arr == NULL) free_map_regions(EXT(ctx));
+    else set_map_regions(ctx, arr, cnt);
+}
+
+static int is_ident_char(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+/* Return 1 if evaluation of the breakpoint location can use names defined in the file */
+static int location_depends_on_file(BreakpointInfo * bp, ELF_File * file) {
+    if (bp->file != NULL) {
+        const char * name = bp->file;
+        size_t base = 0;
+        size_t i = 0;
+        for (i = 0; name[i]; i++) {
+            if (name[i] == '/' || name[i] == '\\') base = i + 1;
+        }
+        return elf_may_contain_name(file, name + base, i - base);
+    }
+    if (bp->location != NULL) {
+        const char * s = bp->location;
+        while (*s) {
+            const char * e = s;
+            /* Registers, special symbols and quoted names can refer to anything */
+            if (*s == '$' || *s == '"' || *s == '\'') return 1;
+            if (!is_ident_char(*s)) {
+                s++;
+                continue;
+            }
+            while (is_ident_char(*e)) e++;
+            if (*s < '0' || *s > '9') {
+                /* Short names can be stored outside of string tables, e.g. DW_FORM_string */
+                if (e - s < 4) return 1;
+                if (elf_may_contain_name(file, s, e - s)) return 1;
+            }
+            s = e;
+        }
+    }
+    return 0;
+}
+
+static int is_in_changed_regions(BreakpointsMapRegion * arr, unsigned cnt, ContextAddress addr) {
+    /* 'arr' is sorted by address, regions don't overlap */
+    unsigned l = 0;
+    unsigned u = cnt;
+    while (l < u) {
+        unsigned m = (l + u) / 2;
+        BreakpointsMapRegion * r = arr + m;
+        if (addr < r->addr) u = m;
+        else if (addr - r->addr >= r->size) l = m + 1;
+        else return 1;
+    }
+    return 0;
+}
+
+static void add_map_change_breakpoint(EvaluationRequest * req, BreakpointInfo * bp) {
+    if (req->map_bp_cnt >= req->map_bp_max) {
+        req->map_bp_max = req->map_bp_max == 0 ? 16 : req->map_bp_max * 2;
+        req->map_bp_arr = (BreakpointInfo **)loc_realloc(req->map_bp_arr, sizeof(BreakpointInfo *) * req->map_bp_max);
+    }
+    req->map_bp_arr[req->map_bp_cnt++] = bp;
+}
+
+/*
+ * Compare current memory map of the breakpoints group with the map at the time of last evaluation,
+ * and collect breakpoints which locations can be affected by the changes:
+ * breakpoints that have instructions in added or removed regions,
+ * breakpoints that failed to plant,
+ * and breakpoints which location refers to names that can be defined in added modules.
+ * Return -1 if the dependencies cannot be checked, all breakpoints need evaluation in that case.
+ */
+static int get_map_change_breakpoints(EvaluationRequest * req) {
+    Context * ctx = req->ctx;
+    ContextExtensionBP * ext = EXT(ctx);
+    unsigned cnt = 0;
+    unsigned i = 0;
+    unsigned j = 0;
+    unsigned chg_cnt = 0;
+    unsigned file_cnt = 0;
+    int file_error = 0;
+    BreakpointsMapRegion * arr = NULL;
+    BreakpointsMapRegion * chg = NULL;
+    ELF_File ** files = NULL;
+    LINK * l = NULL;
+
+    assert(req->map_bp_cnt == 0);
+    if (!ext->map_valid) return -1;
+    arr = get_map_regions(ctx, &cnt);
+    if (arr == NULL) return -1;
+
+    /* Find added and removed regions, open files of added regions */
+    chg = (BreakpointsMapRegion *)tmp_alloc(sizeof(BreakpointsMapRegion) * (cnt + ext->map_region_cnt + 1));
+    files = (ELF_File **)tmp_alloc(sizeof(ELF_File *) * (cnt + 1));
+    while (i < cnt || j < ext->map_region_cnt) {
+        int d = 0;
+        if (i >= cnt) d = +1;
+        else if (j >= ext->map_region_cnt) d = -1;
+        else d = cmp_map_regions(arr + i, ext->map_regions + j);
+        if (d == 0) {
+            i++;
+            j++;
+        }
+        else if (d < 0) {
+            BreakpointsMapRegion * r = arr + i++;
+            ELF_File * file = elf_open_memory_region_file(r->region, NULL);
+            chg[chg_cnt++] = *r;
+            if (file == NULL) {
+                file_error = 1;
+            }
+            else {
+                unsigned k = 0;
+                while (k < file_cnt && files[k] != file) k++;
+                if (k == file_cnt) files[file_cnt++] = file;
+            }
+        }
+        else {
+            chg[chg_cnt++] = ext->map_regions[j++];
+        }
+    }
+    set_map_regions(ctx, arr, cnt);
+    if (chg_cnt == 0) {
+        for (l = breakpoints.next; l != &breakpoints; l = l->next) stats.eval_skip_cnt++;
+        return 0;
+    }
+
+    /* Merge changed regions into sorted list of non-overlapping address ranges */
+    qsort(chg, chg_cnt, sizeof(BreakpointsMapRegion), cmp_map_regions);
+    for (i = 0, j = 0; i < chg_cnt; i++) {
+        BreakpointsMapRegion * r = chg + i;
+        if (r->size == 0) continue;
+        if (j > 0 && r->addr - chg[j - 1].addr <= chg[j - 1].size) {
+            BreakpointsMapRegion * p = chg + j - 1;
+            if (r->addr + r->size - p->addr > p->size) p->size = r->addr + r->size - p->addr;
+        }
+        else {
+            chg[j++] = *r;
+        }
+    }
+    chg_cnt = j;
+
+    /* Check breakpoint instructions */
+    for (l = instructions.next; l != &instructions; l = l->next) {
+        BreakInstruction * bi = link_all2bi(l);
+        for (i = 0; i < bi->ref_cnt; i++) {
+            InstructionRef * ref = bi->refs + i;
+            if (ref->ctx != ctx) continue;
+            ref->bp->map_mark |= MAP_MARK_REF;
+            if (bi->planting_error != NULL ||
+                    (!bi->no_addr && !bi->address_error && is_in_changed_regions(chg, chg_cnt, ref->addr))) {
+                ref->bp->map_mark |= MAP_MARK_EVAL;
+            }
+        }
+    }
+
+    /* Check breakpoint locations */
+    for (l = breakpoints.next; l != &breakpoints; l = l->next) {
+        BreakpointInfo * bp = link_all2bp(l);
+        unsigned mark = bp->map_mark;
+        bp->map_mark = 0;
+        for (i = 0; i < req->loc_active.bp_cnt; i++) {
+            if (req->loc_active.bp_arr[i] == bp) break;
+        }
+        if (i < req->loc_active.bp_cnt) {
+            /* Already requested */
+            continue;
+        }
+        if ((mark & MAP_MARK_EVAL) == 0 && (file_cnt > 0 || file_error)) {
+            if ((mark & MAP_MARK_REF) == 0) {
+                /* The breakpoint was not evaluated in the context yet */
+                if (!is_disabled(bp) && bp->error == NULL && check_context_ids_location(bp, ctx)) mark |= MAP_MARK_EVAL;
+            }
+            else if (file_error && (bp->file != NULL || bp->location != NULL)) {
+                mark |= MAP_MARK_EVAL;
+            }
+            else {
+                for (i = 0; i < file_cnt; i++) {
+                    if (location_depends_on_file(bp, files[i])) {
+                        mark |= MAP_MARK_EVAL;
+                        break;
+                    }
+                }
+            }
+        }
+        if (mark & MAP_MARK_EVAL) add_map_change_breakpoint(req, bp);
+        else stats.eval_skip_cnt++;
+    }
+    for (i = 0; i < req->map_bp_cnt; i++) req->map_bp_arr[i]->map_mark = MAP_MARK_EVAL;
+    return 0;
+}
+
+static void clear_map_change_instruction_refs(EvaluationRequest * req) {
+    LINK * l = instructions.next;
+    assert_all_stopped(req->ctx);
+    while (l != &instructions) {
+        unsigned i;
+        BreakInstruction * bi = link_all2bi(l);
+        for (i = 0; i < bi->ref_cnt; i++) {
+            InstructionRef * ref = bi->refs + i;
+            if (ref->ctx != req->ctx) continue;
+            if ((ref->bp->map_mark & MAP_MARK_EVAL) == 0) continue;
+            ref->cnt = 0;
+            bi->valid = 0;
+        }
+        l = l->next;
+    }
+}
+
+static void done_map_change_breakpoints(EvaluationRequest * req) {
+    unsigned i;
+    for (i = 0; i < req->map_bp_cnt; i++) req->map_bp_arr[i]->map_mark = 0;
+    req->map_bp_cnt = 0;
+    req->map_bp_valid = 0;
+}
+
+#endif /* ENABLE_BreakpointsMapDeps */
+
 static void replant_breakpoints_cache_client(void * args) {
     EvaluationRequest * req = *(EvaluationRequest **)args;
     Context * ctx = req->ctx;
     unsigned i;
     LINK * l;
+    uint64_t time_start = 0;
 
     assert(!list_is_empty(&req->link_active));
     l = evaluations_active.next;
@@ -1948,25 +3090,53 @@ static void replant_breakpoints_cache_client(void * args) {
         l = l->next;
     }
 
+    time_start = get_time_usec();
+#if ENABLE_BreakpointsMapDeps
+    if (req->loc_active.map_changed && req->loc_active.bp_cnt <= LOC_EVALUATION_BP_MAX && !req->map_bp_valid) {
+        if (get_map_change_breakpoints(req) < 0) req->loc_active.bp_cnt = LOC_EVALUATION_BP_ALL;
+        req->map_bp_valid = 1;
+    }
+#endif
     if (req->loc_active.bp_cnt > LOC_EVALUATION_BP_MAX) {
+#if ENABLE_BreakpointsMapDeps
+        update_map_regions(ctx);
+#endif
         clear_instruction_refs(ctx, NULL);
         if (!ctx->exiting && !ctx->exited && !EXT(ctx)->empty_bp_grp) {
             l = breakpoints.next;
             while (l != &breakpoints) {
                 run_bp_evaluation(evaluate_bp_location, link_all2bp(l), ctx, -1);
+                stats.eval_bp_cnt++;
                 l = l->next;
             }
         }
     }
-    else if (req->loc_active.bp_cnt > 0) {
+    else {
         for (i = 0; i < req->loc_active.bp_cnt; i++) {
             BreakpointInfo * bp = req->loc_active.bp_arr[i];
             clear_instruction_refs(ctx, bp);
             if (!ctx->exiting && !ctx->exited && !EXT(ctx)->empty_bp_grp) {
                 run_bp_evaluation(evaluate_bp_location, bp, ctx, -1);
+                stats.eval_bp_cnt++;
             }
         }
+#if ENABLE_BreakpointsMapDeps
+        if (req->map_bp_cnt > 0) {
+            clear_map_change_instruction_refs(req);
+            if (!ctx->exiting && !ctx->exited && !EXT(ctx)->empty_bp_grp) {
+                for (i = 0; i < req->map_bp_cnt; i++) {
+                    run_bp_evaluation(evaluate_bp_location, req->map_bp_arr[i], ctx, -1);
+                    stats.eval_bp_cnt++;
+                }
+            }
+        }
+#endif
     }
+#if ENABLE_BreakpointsMapDeps
+    if (req->map_bp_valid) done_map_change_breakpoints(req);
+#endif
+    stats.eval_cnt++;
+    stats.eval_time += get_time_usec() - time_start;
 
     if (req->bp_cnt > 0) {
         for (i = 0; i < req->bp_cnt; i++) {
@@ -2086,7 +3256,13 @@ static void replant_breakpoint(BreakpointInfo * bp) {
             post_location_evaluation_request(ctx, bp);
         }
     }
-    if (check_intsructions && bp->instruction_cnt > 0) {
+    if (check_intsructions && bp->instruction_cnt > 0 && bp->ctx != NULL && !bp->ctx->exited &&
+            id2ctx(bp->ctx->id) == bp->ctx && EXT(bp->ctx)->bp_grp == context_get_group(bp->ctx, CONTEXT_GROUP_BREAKPOINT)) {
+        /* Eventpoint: all instruction references are in the breakpoints group of bp->ctx,
+         * no need to search instructions list, which is slow when there are many eventpoints */
+        post_location_evaluation_request(bp->ctx, bp);
+    }
+    else if (check_intsructions && bp->instruction_cnt > 0) {
         LINK * l = instructions.next;
         while (l != &instructions) {
             unsigned i;
@@ -2246,6 +3422,7 @@ static int set_breakpoint_attributes(BreakpointInfo * bp, BreakpointAttribute *
             else if (strcmp(name, BREAKPOINT_CONDITION) == 0) {
                 loc_free(bp->condition);
                 bp->condition = json_read_alloc_string(buf_inp);
+                free_compiled_conditions(bp, NULL);
             }
             else if (strcmp(name, BREAKPOINT_CONTEXTIDS) == 0) {
                 loc_free(bp->context_ids);
@@ -2269,6 +3446,9 @@ static int set_breakpoint_attributes(BreakpointInfo * bp, BreakpointAttribute *
             else if (strcmp(name, BREAKPOINT_SKIP_PROLOGUE) == 0) {
                 bp->skip_prologue = json_read_boolean(buf_inp);
             }
+            else if (strcmp(name, BREAKPOINT_FAST_TRACE) == 0) {
+                bp->fast_trace = json_read_boolean(buf_inp);
+            }
             else if (strcmp(name, BREAKPOINT_LINE_OFFSET) == 0) {
                 bp->line_offs_limit = json_read_long(buf_inp);
                 bp->line_offs_check = 1;
@@ -2326,6 +3506,7 @@ static int set_breakpoint_attributes(BreakpointInfo * bp, BreakpointAttribute *
         else if (strcmp(name, BREAKPOINT_CONDITION) == 0) {
             loc_free(bp->condition);
             bp->condition = NULL;
+            free_compiled_conditions(bp, NULL);
         }
         else if (strcmp(name, BREAKPOINT_CONTEXTIDS) == 0) {
             loc_free(bp->context_ids);
@@ -2349,6 +3530,9 @@ static int set_breakpoint_attributes(BreakpointInfo * bp, BreakpointAttribute *
         else if (strcmp(name, BREAKPOINT_SKIP_PROLOGUE) == 0) {
             bp->skip_prologue = 0;
         }
+        else if (strcmp(name, BREAKPOINT_FAST_TRACE) == 0) {
+            bp->fast_trace = 0;
+        }
         else if (strcmp(name, BREAKPOINT_LINE_OFFSET) == 0) {
             bp->line_offs_limit = 0;
             bp->line_offs_check = 0;
@@ -2820,6 +4004,12 @@ static void command_get_capabilities(char * token, Channel * c) {
         json_write_string(out, "LineOffset");
         write_stream(out, ':');
         json_write_boolean(out, 1);
+#if ENABLE_BreakpointsFastTrace
+        write_stream(out, ',');
+        json_write_string(out, "FastTrace");
+        write_stream(out, ':');
+        json_write_boolean(out, 1);
+#endif
 #if ENABLE_ContextBreakpointCapabilities
         {
             /* Back-end context breakpoint capabilities */
@@ -3199,7 +4389,9 @@ static void event_context_created(Context * ctx, void * args) {
     list_init(&EXT(ctx)->link_hit_count);
 }
 
-static void event_context_changed(Context * ctx, void * args) {
+static void post_context_changed(Context * ctx, int map_changed) {
+    /* Compiled conditions refer to symbols of the changed context */
+    free_group_compiled_conditions(context_get_group(ctx, CONTEXT_GROUP_BREAKPOINT));
     if (ctx->mem_access && context_get_group(ctx, CONTEXT_GROUP_PROCESS) == ctx) {
         /* If the context is a memory space, we need to update
          * breakpoints on all members of the group */
@@ -3209,14 +4401,18 @@ static void event_context_changed(Context * ctx, void * args) {
             l = l->next;
             if (x->exited) continue;
             if (context_get_group(x, CONTEXT_GROUP_PROCESS) != ctx) continue;
-            post_location_evaluation_request(x, NULL);
+            post_location_evaluation_request_ext(x, NULL, map_changed);
         }
     }
     else {
-        post_location_evaluation_request(ctx, NULL);
+        post_location_evaluation_request_ext(ctx, NULL, map_changed);
     }
 }
 
+static void event_context_changed(Context * ctx, void * args) {
+    post_context_changed(ctx, 0);
+}
+
 static void event_context_exited(Context * ctx, void * args) {
     post_location_evaluation_request(ctx, NULL);
 }
@@ -3229,9 +4425,14 @@ static void event_context_disposed(Context * ctx, void * args) {
         assert(list_is_empty(&req->link_posted));
         assert(list_is_empty(&req->link_active));
         loc_free(req->bp_arr);
+        loc_free(req->map_bp_arr);
         loc_free(req);
         ext->req = NULL;
     }
+#if ENABLE_BreakpointsMapDeps
+    free_map_regions(ext);
+#endif
+    free_group_compiled_conditions(ctx);
     l = ext->link_hit_count.next;
     if (l != NULL) { /* link_hit_count can be uninitialized */
         while (l != &ext->link_hit_count) {
@@ -3245,6 +4446,10 @@ static void event_context_disposed(Context * ctx, void * args) {
 }
 
 #if SERVICE_MemoryMap
+static void event_memory_map_changed(Context * ctx, void * args) {
+    post_context_changed(ctx, ENABLE_BreakpointsMapDeps);
+}
+
 static void event_code_unmapped(Context * ctx, ContextAddress addr, ContextAddress size, void * args) {
     /* Unmapping a code section unplants all breakpoint instructions in that section as side effect.
      * This function udates service data structure to reflect that.
@@ -3315,10 +4520,10 @@ void ini_breakpoints_service(Protocol * proto, TCFBroadcastGroup * bcg) {
 #if SERVICE_MemoryMap
     {
         static MemoryMapEventListener listener = {
-            event_context_changed,
+            event_memory_map_changed,
             event_code_unmapped,
-            event_context_changed,
-            event_context_changed,
+            event_memory_map_changed,
+            event_memory_map_changed,
         };
         add_memory_map_event_listener(&listener, NULL);
     }
@@ -3331,7 +4536,7 @@ void ini_breakpoints_service(Protocol * proto, TCFBroadcastGroup * bcg) {
         add_path_map_event_listener(&listener, NULL);
     }
 #endif
-    for (i = 0; i < ADDR2INSTR_HASH_SIZE; i++) list_init(addr2instr + i);
+    rehash_instructions(ADDR2INSTR_HASH_SIZE);
     for (i = 0; i < ID2BP_HASH_SIZE; i++) list_init(id2bp + i);
     for (i = 0; i < INP2BR_HASH_SIZE; i++) list_init(inp2br + i);
     add_channel_close_listener(channel_close_listener);
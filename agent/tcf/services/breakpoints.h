@@ -69,6 +69,7 @@ struct BreakpointAttribute {
 #define BREAKPOINT_SERVICE          "Service"
 #define BREAKPOINT_SKIP_PROLOGUE    "SkipPrologue"
 #define BREAKPOINT_LINE_OFFSET      "LineOffset"
+#define BREAKPOINT_FAST_TRACE       "FastTrace"
 
 
 /* Breakpoints event listener */
@@ -188,6 +189,14 @@ extern int unplant_breakpoints(Context * ctx);
  */
 extern int check_breakpoints_on_memory_read(Context * ctx, ContextAddress address, void * buf, size_t size);
 
+/*
+ * Check if a memory range contains planted break instructions,
+ * that is, if check_breakpoints_on_memory_read() would change data read from the range.
+ * Return 1 if it does, 0 if it does not.
+ * Return -1 and set errno if the check cannot be done.
+ */
+extern int check_breakpoints_in_memory_range(Context * ctx, ContextAddress address, size_t size);
+
 /*
  * Check if data is about to be written over planted break instructions and adjust the data and breakpoint backing storage
  * Return -1 and set errno if the check cannot be done.
@@ -208,6 +217,36 @@ extern BreakpointInfo * create_eventpoint_ext(BreakpointAttribute * attrs, Conte
 /* Unplant and destroy eventpoint */
 extern void destroy_eventpoint(BreakpointInfo * eventpoint);
 
+/*
+ * Breakpoints service performance counters.
+ * Times are in microseconds.
+ */
+typedef struct BreakpointsStats {
+    uint64_t flush_cnt;         /* Number of times break instructions were flushed into targets */
+    uint64_t flush_time;        /* Total time spent flushing break instructions */
+    uint64_t plant_cnt;         /* Number of break instructions planted */
+    uint64_t plant_time;        /* Total time spent planting break instructions in batches */
+    uint64_t remove_cnt;        /* Number of break instructions removed */
+    uint64_t remove_time;       /* Total time spent removing break instructions in batches */
+    uint64_t page_cnt;          /* Number of memory pages accessed to plant or remove software breakpoints */
+    uint64_t mem_read_cnt;      /* Number of context memory reads done to plant or remove software breakpoints */
+    uint64_t mem_write_cnt;     /* Number of context memory writes done to plant or remove software breakpoints */
+    uint64_t eval_cnt;          /* Number of breakpoint location evaluation passes */
+    uint64_t eval_time;         /* Total time spent in breakpoint location evaluation passes */
+    uint64_t eval_bp_cnt;       /* Number of breakpoint location evaluations */
+    uint64_t eval_skip_cnt;     /* Number of breakpoints not evaluated after memory map change because the change did not affect them */
+    uint64_t cond_cnt;          /* Number of breakpoint condition evaluations */
+    uint64_t cond_time;         /* Total time spent evaluating breakpoint conditions */
+    uint64_t cond_compile_cnt;  /* Number of breakpoint conditions compiled */
+    uint64_t cond_compiled_cnt; /* Number of breakpoint condition evaluations done by compiled code */
+} BreakpointsStats;
+
+/*
+ * Get Breakpoints service performance counters.
+ * The counters are accumulated since agent start, clients can reset them with memset().
+ */
+extern BreakpointsStats * get_breakpoints_stats(void);
+
 extern void ini_breakpoints_service(Protocol *, TCFBroadcastGroup *);
 
 #else /* SERVICE_Breakpoints */
@@ -217,6 +256,7 @@ extern void ini_breakpoints_service(Protocol *, TCFBroadcastGroup *);
 #define clone_breakpoints_on_process_fork(parent, child) 0
 #define unplant_breakpoints(ctx) 0
 #define check_breakpoints_on_memory_read(ctx, address, buf, size) 0
+#define check_breakpoints_in_memory_range(ctx, address, size) 0
 #define check_breakpoints_on_memory_write(ctx, address, buf, size) 0
 #define create_eventpoint(location, ctx, callback, callback_args) 0
 
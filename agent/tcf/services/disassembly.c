@@ -24,6 +24,8 @@
 #include <tcf/framework/exceptions.h>
 #include <tcf/framework/myalloc.h>
 #include <tcf/framework/cache.h>
+#include <tcf/framework/events.h>
+#include <tcf/framework/link.h>
 #include <tcf/services/runctrl.h>
 #include <tcf/services/symbols.h>
 #include <tcf/services/linenumbers.h>
@@ -33,6 +35,13 @@
 #define MAX_INSTRUCTION_SIZE 8
 #define DEFAULT_ALIGMENT     16
 
+/* Max size of code disassembled in one dispatch event when results are streamed */
+#define DISASSEMBLY_CHUNK_SIZE 0x2000
+
+#if !defined(ENABLE_DisassemblyCache)
+#  define ENABLE_DisassemblyCache 1
+#endif
+
 typedef struct {
     const char * isa;
     Disassembler * disassembler;
@@ -53,8 +62,17 @@ typedef struct {
     int simplified;
     int pseudo_instr;
     int opcode_value;
+    int progress;
 } DisassembleCmdArgs;
 
+typedef struct DisassembleStreamArgs {
+    DisassembleCmdArgs cmd;
+    Channel * channel;
+    ContextAddress pos;
+    ContextAddress end;
+    int started;
+} DisassembleStreamArgs;
+
 typedef struct {
     char token[256];
     char id[256];
@@ -147,6 +165,150 @@ static void command_get_capabilities(char * token, Channel * c) {
     cache_enter(command_get_capabilities_cache_client, c, &args, sizeof(args));
 }
 
+#if ENABLE_DisassemblyCache
+
+/*
+ * Cache of decoded instructions.
+ * Entries are keyed by memory context, disassembler, parameters and address,
+ * and keep a copy of instruction code bytes, so the cache is validated against current memory contents
+ * and target memory writes don't need explicit invalidation.
+ * Disassembler output can include symbol names, so the cache of a context is flushed on memory map changes.
+ */
+
+#define DISASSEMBLY_CACHE_HASH_SIZE 0x1000
+#define DISASSEMBLY_CACHE_SIZE      (0x80000 * MEM_USAGE_FACTOR)
+
+#define DCF_SIMPLIFIED  0x01
+#define DCF_PSEUDO      0x02
+#define DCF_BIG_ENDIAN  0x04
+
+typedef struct DisassemblyCacheEntry {
+    LINK link_lru;
+    struct DisassemblyCacheEntry * next;
+    Context * mem;
+    Disassembler * disassembler;
+    ContextAddress addr;
+    unsigned flags;
+    size_t alloc_size;
+    DisassemblyResult dr;
+    uint8_t code[1];
+} DisassemblyCacheEntry;
+
+#define lru2entry(A) ((DisassemblyCacheEntry *)((char *)(A) - offsetof(DisassemblyCacheEntry, link_lru)))
+
+static DisassemblyCacheEntry ** cache_hash = NULL;
+static LINK cache_lru = TCF_LIST_INIT(cache_lru);
+static size_t cache_size = 0;
+
+static unsigned cache_hash_index(Context * mem, Disassembler * disassembler, ContextAddress addr) {
+    uintptr_t h = (uintptr_t)addr ^ ((uintptr_t)mem >> 4) ^ ((uintptr_t)disassembler >> 4);
+    return (unsigned)((h ^ (h >> 12)) % DISASSEMBLY_CACHE_HASH_SIZE);
+}
+
+static unsigned get_cache_flags(Context * ctx, DisassemblerParams * params) {
+    unsigned flags = 0;
+    if (params->simplified) flags |= DCF_SIMPLIFIED;
+    if (params->pseudo_instr) flags |= DCF_PSEUDO;
+    if (ctx->big_endian) flags |= DCF_BIG_ENDIAN;
+    return flags;
+}
+
+static void remove_cache_entry(DisassemblyCacheEntry * e) {
+    DisassemblyCacheEntry ** p = cache_hash + cache_hash_index(e->mem, e->disassembler, e->addr);
+    while (*p != e) p = &(*p)->next;
+    *p = e->next;
+    list_remove(&e->link_lru);
+    cache_size -= e->alloc_size;
+    loc_free(e);
+}
+
+static void flush_disassembly_cache(Context * mem) {
+    LINK * l = cache_lru.next;
+    while (l != &cache_lru) {
+        DisassemblyCacheEntry * e = lru2entry(l);
+        l = l->next;
+        if (mem == NULL || e->mem == mem) remove_cache_entry(e);
+    }
+}
+
+static DisassemblyResult * find_cached_instruction(Context * mem, Disassembler * disassembler, unsigned flags,
+                                                   ContextAddress addr, uint8_t * code, ContextAddress size) {
+    DisassemblyCacheEntry * e = NULL;
+    if (cache_hash == NULL) return NULL;
+    e = cache_hash[cache_hash_index(mem, disassembler, addr)];
+    while (e != NULL) {
+        if (e->addr == addr && e->mem == mem && e->disassembler == disassembler && e->flags == flags) {
+            if (e->dr.size > size || memcmp(e->code, code, (size_t)e->dr.size) != 0) {
+                /* Memory contents changed */
+                remove_cache_entry(e);
+                return NULL;
+            }
+            list_remove(&e->link_lru);
+            list_add_first(&e->link_lru, &cache_lru);
+            return &e->dr;
+        }
+        e = e->next;
+    }
+    return NULL;
+}
+
+static void add_cached_instruction(Context * mem, Disassembler * disassembler, unsigned flags,
+                                   ContextAddress addr, uint8_t * code, DisassemblyResult * dr) {
+    DisassemblyCacheEntry * e = NULL;
+    size_t text_size = strlen(dr->text) + 1;
+    size_t alloc_size = offsetof(DisassemblyCacheEntry, code) + (size_t)dr->size + text_size;
+    unsigned h = cache_hash_index(mem, disassembler, addr);
+
+    if (cache_hash == NULL) {
+        cache_hash = (DisassemblyCacheEntry **)loc_alloc_zero(sizeof(DisassemblyCacheEntry *) * DISASSEMBLY_CACHE_HASH_SIZE);
+    }
+    while (cache_size + alloc_size > DISASSEMBLY_CACHE_SIZE && !list_is_empty(&cache_lru)) {
+        remove_cache_entry(lru2entry(cache_lru.prev));
+    }
+    e = (DisassemblyCacheEntry *)loc_alloc(alloc_size);
+    e->mem = mem;
+    e->disassembler = disassembler;
+    e->addr = addr;
+    e->flags = flags;
+    e->alloc_size = alloc_size;
+    e->dr = *dr;
+    memcpy(e->code, code, (size_t)dr->size);
+    e->dr.text = (char *)e->code + (size_t)dr->size;
+    memcpy((char *)e->dr.text, dr->text, text_size);
+    e->next = cache_hash[h];
+    cache_hash[h] = e;
+    list_add_first(&e->link_lru, &cache_lru);
+    cache_size += alloc_size;
+}
+
+static DisassemblyResult * disassemble_cached(Context * ctx, Disassembler * disassembler, uint8_t * code,
+                                              ContextAddress addr, ContextAddress size, DisassemblerParams * params) {
+    Context * mem = context_get_group(ctx, CONTEXT_GROUP_PROCESS);
+    unsigned flags = get_cache_flags(ctx, params);
+    DisassemblyResult * dr = find_cached_instruction(mem, disassembler, flags, addr, code, size);
+    if (dr == NULL) {
+        /* Results of disassemblers that keep decoding state between instructions depend on previous instructions */
+        int stateless = params->state == NULL;
+        unsigned miss_cnt = cache_miss_count();
+        dr = disassembler(code, addr, size, params);
+        if (dr != NULL && dr->size > 0 && dr->size <= size && !dr->incomplete && dr->text != NULL &&
+                stateless && params->state == NULL && cache_miss_count() == miss_cnt) {
+            add_cached_instruction(mem, disassembler, flags, addr, code, dr);
+        }
+    }
+    return dr;
+}
+
+static void disassembly_cache_map_changed(Context * ctx, void * args) {
+    flush_disassembly_cache(context_get_group(ctx, CONTEXT_GROUP_PROCESS));
+}
+
+static void disassembly_cache_context_exited(Context * ctx, void * args) {
+    flush_disassembly_cache(ctx);
+}
+
+#endif /* ENABLE_DisassemblyCache */
+
 static int get_isa(Context * ctx, ContextAddress addr, ContextISA * isa) {
     if (context_get_isa(ctx, addr, isa) < 0) {
         memset(isa, 0, sizeof(ContextISA));
@@ -177,10 +339,37 @@ static int get_isa(Context * ctx, ContextAddress addr, ContextISA * isa) {
     return 0;
 }
 
+DisassemblyResult * disassemble_instruction(Context * ctx, ContextAddress addr, uint8_t * code, ContextAddress size) {
+    ContextISA isa;
+    DisassemblerParams params;
+    Disassembler * disassembler = NULL;
+    DisassemblyResult * dr = NULL;
+    Context * cpu = context_get_group(ctx, CONTEXT_GROUP_CPU);
+
+    if (get_isa(ctx, addr, &isa) < 0) return NULL;
+    if (isa.isa != NULL) disassembler = find_disassembler(cpu, isa.isa);
+    else disassembler = find_disassembler(cpu, isa.def);
+    if (disassembler == NULL) {
+        set_errno(ERR_UNSUPPORTED, "No disassembler for the instruction set");
+        return NULL;
+    }
+    memset(&params, 0, sizeof(DisassemblerParams));
+    params.ctx = ctx;
+    params.big_endian = ctx->big_endian;
+    params.flow_only = 1;
+    dr = disassembler(code, addr, size, &params);
+    loc_free(params.state);
+    if (dr == NULL || dr->size == 0 || dr->size > size) {
+        set_errno(ERR_OTHER, "Invalid instruction");
+        return NULL;
+    }
+    return dr;
+}
+
 static int disassemble_block(Context * ctx, OutputStream * out, uint8_t * mem_buf,
                               ContextAddress buf_addr, ContextAddress buf_size,
                               ContextAddress mem_size, ContextISA * isa,
-                              DisassembleCmdArgs * args) {
+                              DisassembleCmdArgs * args, ContextAddress * done) {
     ContextAddress offs = 0;
     Disassembler * disassembler = NULL;
     Context * cpu = context_get_group(ctx, CONTEXT_GROUP_CPU);
@@ -214,7 +403,11 @@ static int disassemble_block(Context * ctx, OutputStream * out, uint8_t * mem_bu
             else disassembler = find_disassembler(cpu, isa->def);
             disassembler_ok = 1;
         }
+#if ENABLE_DisassemblyCache
+        if (disassembler) dr = disassemble_cached(ctx, disassembler, mem_buf + (size_t)offs, addr, size, &params);
+#else
         if (disassembler) dr = disassembler(mem_buf + (size_t)offs, addr, size, &params);
+#endif
         if (dr == NULL) {
             static char buf[32];
             static DisassemblyResult dd;
@@ -275,6 +468,7 @@ static int disassemble_block(Context * ctx, OutputStream * out, uint8_t * mem_bu
     }
     write_stream(out, ']');
     loc_free(params.state);
+    *done = offs;
     return 0;
 }
 
@@ -288,6 +482,42 @@ static void address_to_line_cb(CodeArea * area, void * args) {
 }
 #endif
 
+/*
+ * Find function symbol or line number area that contains 'addr'.
+ * Start of the area is a safe point to begin decoding of instructions.
+ */
+static void get_code_area(Context * ctx, ContextAddress addr,
+                          ContextAddress * area_addr, int * addr_ok,
+                          ContextAddress * area_size, int * size_ok) {
+    *addr_ok = 0;
+    *size_ok = 0;
+#if SERVICE_Symbols
+    {
+        Symbol * sym = NULL;
+        if (find_symbol_by_addr(ctx, STACK_NO_FRAME, addr, &sym) == 0) {
+            if (get_symbol_address(sym, area_addr) == 0) *addr_ok = 1;
+            if (get_symbol_size(sym, area_size) == 0) *size_ok = 1;
+        }
+        if (*addr_ok && *area_addr <= addr && addr - *area_addr >= 0x1000) {
+            *addr_ok = 0;
+            *size_ok = 0;
+        }
+    }
+#endif
+#if SERVICE_LineNumbers
+    if (!*addr_ok || !*size_ok) {
+        CodeArea * area = NULL;
+        address_to_line(ctx, addr, addr + 1, address_to_line_cb, &area);
+        if (area != NULL) {
+            *area_addr = area->start_address;
+            *area_size = area->end_address - area->start_address;
+            *addr_ok = 1;
+            *size_ok = 1;
+        }
+    }
+#endif
+}
+
 static void disassemble_cache_client(void * x) {
     DisassembleCmdArgs * args = (DisassembleCmdArgs *)x;
 
@@ -302,6 +532,7 @@ static void disassemble_cache_client(void * x) {
     Channel * c = cache_channel();
     char * data = NULL;
     size_t size = 0;
+    ContextAddress done = 0;
     ContextISA isa;
 
     memset(&isa, 0, sizeof(isa));
@@ -317,31 +548,7 @@ static void disassemble_cache_client(void * x) {
         ContextAddress sym_size = 0;
         int sym_addr_ok = 0;
         int sym_size_ok = 0;
-#if SERVICE_Symbols
-        {
-            Symbol * sym = NULL;
-            if (find_symbol_by_addr(ctx, STACK_NO_FRAME, args->addr, &sym) == 0) {
-                if (get_symbol_address(sym, &sym_addr) == 0) sym_addr_ok = 1;
-                if (get_symbol_size(sym, &sym_size) == 0) sym_size_ok = 1;
-            }
-            if (sym_addr_ok && sym_addr <= args->addr && args->addr - sym_addr >= 0x1000) {
-                sym_addr_ok = 0;
-                sym_size_ok = 0;
-            }
-        }
-#endif
-#if SERVICE_LineNumbers
-        if (!sym_addr_ok || !sym_size_ok) {
-            CodeArea * area = NULL;
-            address_to_line(ctx, args->addr, args->addr + 1, address_to_line_cb, &area);
-            if (area != NULL) {
-                sym_addr = area->start_address;
-                sym_size = area->end_address - area->start_address;
-                sym_addr_ok = 1;
-                sym_size_ok = 1;
-            }
-        }
-#endif
+        get_code_area(ctx, args->addr, &sym_addr, &sym_addr_ok, &sym_size, &sym_size_ok);
         if (sym_addr_ok && sym_addr <= args->addr) {
             if (get_isa(ctx, sym_addr, &isa) < 0) {
                 error = errno;
@@ -423,7 +630,7 @@ static void disassemble_cache_client(void * x) {
 
     if (!error && disassemble_block(
             ctx, buf_out, mem_buf, buf_addr, buf_size,
-            mem_size, &isa, args) < 0) error = errno;
+            mem_size, &isa, args, &done) < 0) error = errno;
 
     if (get_error_code(error) == ERR_CACHE_MISS) {
         loc_free(buf.mem);
@@ -454,6 +661,128 @@ static void disassemble_cache_client(void * x) {
     loc_free(data);
 }
 
+static void free_disassemble_stream_args(DisassembleStreamArgs * args) {
+    channel_unlock_with_msg(args->channel, DISASSEMBLY);
+    loc_free(args->cmd.isa);
+    loc_free(args);
+}
+
+/*
+ * Get end of next chunk of a streamed disassembly.
+ * Start of a symbol is a safe synchronization point: the chunk ends there and the next one starts decoding
+ * at a known instruction boundary. Otherwise, the next chunk continues where decoding of this one ended.
+ */
+static ContextAddress get_chunk_end(Context * ctx, ContextAddress pos, ContextAddress end, int * sync) {
+    ContextAddress chunk_end = end;
+    *sync = 0;
+    if (end - pos > DISASSEMBLY_CHUNK_SIZE) {
+        chunk_end = pos + DISASSEMBLY_CHUNK_SIZE;
+#if SERVICE_Symbols
+        {
+            Symbol * sym = NULL;
+            ContextAddress sym_addr = 0;
+            if (find_symbol_by_addr(ctx, STACK_NO_FRAME, chunk_end, &sym) == 0 &&
+                    get_symbol_address(sym, &sym_addr) == 0 && sym_addr > pos && sym_addr <= chunk_end) {
+                chunk_end = sym_addr;
+                *sync = 1;
+            }
+        }
+#endif
+    }
+    return chunk_end;
+}
+
+static void disassemble_stream_next(void * x);
+
+static void disassemble_stream_cache_client(void * x) {
+    DisassembleStreamArgs * args = *(DisassembleStreamArgs **)x;
+    Channel * c = args->channel;
+    ContextAddress pos = args->pos;
+    ContextAddress done = 0;
+    ByteArrayOutputStream buf;
+    OutputStream * buf_out = create_byte_array_output_stream(&buf);
+    char * data = NULL;
+    size_t size = 0;
+    Trap trap;
+
+    if (is_channel_closed(c)) {
+        cache_exit();
+        free_disassemble_stream_args(args);
+        return;
+    }
+
+    if (set_trap(&trap)) {
+        Context * ctx = id2ctx(args->cmd.id);
+        ContextAddress buf_size = 0;
+        size_t mem_size = 0;
+        uint8_t * mem_buf = NULL;
+        int sync = 0;
+        ContextISA isa;
+
+        memset(&isa, 0, sizeof(isa));
+        if (ctx == NULL) exception(ERR_INV_CONTEXT);
+        if (ctx->exited) exception(ERR_ALREADY_EXITED);
+        check_all_stopped(ctx);
+        if (get_isa(ctx, pos, &isa) < 0) exception(errno);
+        if (!args->started) {
+            ContextAddress area_addr = 0;
+            ContextAddress area_size = 0;
+            int addr_ok = 0;
+            int size_ok = 0;
+            get_code_area(ctx, pos, &area_addr, &addr_ok, &area_size, &size_ok);
+            if (addr_ok && area_addr <= pos) pos = area_addr;
+            else pos &= ~(ContextAddress)((isa.alignment > 0 ? isa.alignment : DEFAULT_ALIGMENT) - 1);
+            if (pos != args->pos && get_isa(ctx, pos, &isa) < 0) exception(errno);
+        }
+        buf_size = get_chunk_end(ctx, pos, args->end, &sync) - pos;
+        mem_size = (size_t)buf_size;
+        if (!sync) mem_size += isa.max_instruction_size > 0 ? isa.max_instruction_size : MAX_INSTRUCTION_SIZE;
+        mem_buf = (uint8_t *)tmp_alloc(mem_size);
+        if (context_read_mem(ctx, pos, mem_buf, mem_size) < 0) {
+            /* The range can end at the end of a memory region */
+            if (mem_size == buf_size || context_read_mem(ctx, pos, mem_buf, (size_t)buf_size) < 0) exception(errno);
+            mem_size = (size_t)buf_size;
+        }
+        if (disassemble_block(ctx, buf_out, mem_buf, pos, buf_size, mem_size, &isa, &args->cmd, &done) < 0) {
+            exception(errno);
+        }
+        clear_trap(&trap);
+    }
+
+    if (cache_miss_count() > 0) loc_free(buf.mem);
+    cache_exit();
+
+    get_byte_array_output_stream_data(&buf, &data, &size);
+    args->started = 1;
+    if (trap.error == 0) args->pos = pos + done;
+
+    if (trap.error == 0 && args->pos < args->end) {
+        write_stringz(&c->out, "P");
+        write_stringz(&c->out, args->cmd.token);
+        write_block_stream(&c->out, data, size);
+        write_stream(&c->out, 0);
+        write_stream(&c->out, MARKER_EOM);
+        loc_free(data);
+        post_event(disassemble_stream_next, args);
+        return;
+    }
+
+    write_stringz(&c->out, "R");
+    write_stringz(&c->out, args->cmd.token);
+    write_errno(&c->out, trap.error);
+    if (trap.error) write_string(&c->out, "null");
+    else write_block_stream(&c->out, data, size);
+    write_stream(&c->out, 0);
+    write_stream(&c->out, MARKER_EOM);
+    loc_free(data);
+    free_disassemble_stream_args(args);
+}
+
+static void disassemble_stream_next(void * x) {
+    DisassembleStreamArgs * args = (DisassembleStreamArgs *)x;
+    cache_enter(disassemble_stream_cache_client, args->channel, &args, sizeof(args));
+}
+
 static void read_disassembly_params(InputStream * inp, const char * name, void * x) {
     DisassembleCmdArgs * args = (DisassembleCmdArgs *) x;
 
@@ -469,11 +798,22 @@ static void read_disassembly_params(InputStream * inp, const char * name, void *
     else if (strcmp(name, "OpcodeValue") == 0) {
         args->opcode_value =json_read_boolean(inp);
     }
+    else if (strcmp(name, "Progress") == 0) {
+        args->progress = json_read_boolean(inp);
+    }
     else {
         json_skip_object(inp);
     }
 }
 
+/*
+ * disassemble <context ID> <address> <size> <options>
+ * Options: "ISA", "Simplified", "Pseudo", "OpcodeValue", and "Progress" - enables 'P' messages with partial results.
+ * Without "Progress", disassembly of a range that contains end of a function stops at the function end.
+ * With "Progress", whole range is disassembled in chunks that are split at symbol boundaries and processed
+ * in separate dispatch events, every chunk except the last one is sent in a 'P' message.
+ * Reply data is an array of {"Address", "Size", "Instruction", "OpcodeValue"} objects.
+ */
 static void command_disassemble(char * token, Channel * c) {
     DisassembleCmdArgs args;
 
@@ -489,12 +829,25 @@ static void command_disassemble(char * token, Channel * c) {
     if (read_stream(&c->inp) != MARKER_EOM) exception(ERR_JSON_SYNTAX);
 
     strlcpy(args.token, token, sizeof(args.token));
+    if (args.progress) {
+        DisassembleStreamArgs * stream = (DisassembleStreamArgs *)loc_alloc_zero(sizeof(DisassembleStreamArgs));
+        stream->cmd = args;
+        stream->pos = args.addr;
+        stream->end = args.addr + args.size;
+        if (stream->end < stream->pos) stream->end = ~(ContextAddress)0;
+        channel_lock_with_msg(stream->channel = c, DISASSEMBLY);
+        cache_enter(disassemble_stream_cache_client, c, &stream, sizeof(stream));
+        return;
+    }
     cache_enter(disassemble_cache_client, c, &args, sizeof(DisassembleCmdArgs));
 }
 
 static void event_context_disposed(Context * ctx, void * args) {
     unsigned i;
     ContextExtensionDS * ext = EXT(ctx);
+#if ENABLE_DisassemblyCache
+    flush_disassembly_cache(ctx);
+#endif
     for (i = 0; i < ext->disassemblers_cnt; i++) {
         loc_free(ext->disassemblers[i].isa);
     }
@@ -504,15 +857,33 @@ static void event_context_disposed(Context * ctx, void * args) {
 void ini_disassembly_service(Protocol * proto) {
     static ContextEventListener listener = {
         NULL,
+#if ENABLE_DisassemblyCache
+        disassembly_cache_context_exited,
+        NULL,
         NULL,
+        disassembly_cache_map_changed,
+#else
         NULL,
         NULL,
         NULL,
+        NULL,
+#endif
         event_context_disposed
     };
     if (context_extension_offset == 0) {
         add_context_event_listener(&listener, NULL);
         context_extension_offset = context_extension(sizeof(ContextExtensionDS));
+#if ENABLE_DisassemblyCache && SERVICE_MemoryMap
+        {
+            static MemoryMapEventListener map_listener = {
+                disassembly_cache_map_changed,
+                NULL,
+                disassembly_cache_map_changed,
+                disassembly_cache_map_changed,
+            };
+            add_memory_map_event_listener(&map_listener, NULL);
+        }
+#endif
     }
     add_command_handler(proto, DISASSEMBLY, "getCapabilities", command_get_capabilities);
     add_command_handler(proto, DISASSEMBLY, "disassemble", command_disassemble);
@@ -20,10 +20,23 @@
 #include <tcf/framework/cpudefs.h>
 #include <tcf/framework/protocol.h>
 
+/*
+ * Instruction control flow types.
+ * A disassembler that does not analyze control flow leaves DisassemblyResult.flow 0 (DISASM_FLOW_UNKNOWN).
+ */
+#define DISASM_FLOW_UNKNOWN     0
+#define DISASM_FLOW_NEXT        1   /* Execution continues at next instruction */
+#define DISASM_FLOW_JUMP        2   /* Unconditional jump to 'target' */
+#define DISASM_FLOW_BRANCH      3   /* Conditional jump to 'target' or next instruction */
+#define DISASM_FLOW_CALL        4   /* Subroutine call, 'target' is 0 if the call is indirect */
+#define DISASM_FLOW_INDIRECT    5   /* Jump to an address not known statically, e.g. return */
+
 typedef struct {
     const char * text;
     ContextAddress size;
     int incomplete;
+    int flow;
+    ContextAddress target;
 } DisassemblyResult;
 
 /*
@@ -34,6 +47,7 @@ typedef struct DisassemblerParams {
     int big_endian;     /* 0 - little endian, 1 -  big endian */
     int simplified;     /* If true, simplified mnemonics are specified */
     int pseudo_instr;   /* If true, pseudo-instructions are requested */
+    int flow_only;      /* If true, only size, flow and target are needed, text can be omitted */
     void * state;
 } DisassemblerParams;
 
@@ -44,6 +58,15 @@ typedef DisassemblyResult * Disassembler(uint8_t * /* code */, ContextAddress /*
 
 extern void add_disassembler(Context * ctx, const char * isa, Disassembler disassembler);
 
+/*
+ * Disassemble one instruction using the disassembler registered for the ISA at 'addr'.
+ * 'code' contains 'size' bytes of target memory at 'addr'.
+ * The result is meant for control flow analysis: only size, flow and target are set,
+ * 'text' can be NULL.
+ * Return NULL and set errno if the instruction cannot be decoded.
+ */
+extern DisassemblyResult * disassemble_instruction(Context * ctx, ContextAddress addr, uint8_t * code, ContextAddress size);
+
 extern void ini_disassembly_service(Protocol * proto);
 
 #else /* SERVICE_Disassembly */
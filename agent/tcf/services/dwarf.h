@@ -645,3 +645,11 @@
 #define DW_END_little               0x02
 #define DW_END_lo_user              0x40
 #define DW_END_hi_user              0xff
+
+#define DW_IDX_compile_unit         0x01 /* v5 */
+#define DW_IDX_type_unit            0x02 /* v5 */
+#define DW_IDX_die_offset           0x03 /* v5 */
+#define DW_IDX_parent               0x04 /* v5 */
+#define DW_IDX_type_hash            0x05 /* v5 */
+#define DW_IDX_lo_user              0x2000
+#define DW_IDX_hi_user              0x3fff
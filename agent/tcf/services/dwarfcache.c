@@ -24,28 +24,29 @@
 #if ENABLE_ELF && ENABLE_DebugContext
 
 #include <assert.h>
+#include <stddef.h>
+#include <tcf/framework/events.h>
 #include <tcf/framework/exceptions.h>
 #include <tcf/framework/myalloc.h>
 #include <tcf/framework/trace.h>
 #include <tcf/services/dwarf.h>
 #include <tcf/services/dwarfcache.h>
 #include <tcf/services/dwarfexpr.h>
+#include <tcf/services/dwarfframe.h>
 #include <tcf/services/stacktrace.h>
+#include <tcf/services/elf-index-cache.h>
+#if ENABLE_DWARF_THREADS
+#  include <unistd.h>
+#  include <tcf/framework/mdep-threads.h>
+#endif
 
 #define OBJ_HASH(HashTable,ID) (((U4_T)(ID) + ((U4_T)(ID) >> 8)) % HashTable->mObjectHashSize)
 
-#define OBJECT_ARRAY_SIZE 128
-
 /* Pseudo object IDs for fundamental types */
 #define OBJECT_ID_VOID(CompUnit) (~(CompUnit)->mFundTypeID - 0)
 #define OBJECT_ID_CHAR(CompUnit) (~(CompUnit)->mFundTypeID - 1)
 #define OBJECT_ID_LAST(Cache) (~(Cache)->mFundTypeID)
 
-typedef struct ObjectArray {
-    struct ObjectArray * mNext;
-    ObjectInfo mArray[OBJECT_ARRAY_SIZE];
-} ObjectArray;
-
 typedef struct ObjectReference {
     ObjectInfo * obj;
     ObjectInfo * org;
@@ -63,6 +64,38 @@ static U4_T sObjRefsMax = 0;
 
 static int sCloseListenerOK = 0;
 
+ObjectInfo ** dwarf_object_blocks = NULL;
+static U4_T sObjectBlocksCnt = 0;
+static U4_T sObjectBlocksMax = 0;
+static U4_T * sFreeObjectBlocks = NULL;
+static U4_T sFreeObjectBlocksCnt = 0;
+
+static LINK sLineInfoLRU = TCF_LIST_INIT(sLineInfoLRU);
+static unsigned sLineInfoStatesCnt = 0;
+static LineNumbersState * sStates = NULL;   /* Line number table rows of the unit being loaded */
+static U4_T sStatesCnt = 0;
+static U4_T sStatesMax = 0;
+static U1_T * sStatesBuf = NULL;            /* Delta encoded rows of the unit being loaded */
+static size_t sStatesBufSize = 0;
+static size_t sStatesBufMax = 0;
+
+/* Recently decoded blocks of line number table rows, lookups often alternate between address and text order */
+#define STATES_BLOCK_CACHE_SIZE 4
+
+typedef struct StatesBlockCache {
+    CompUnit * mUnit;
+    U4_T mBlockPos;
+    U4_T mCnt;                  /* Number of decoded rows of the block */
+    U1_T * mData;               /* Encoded data of next row of the block */
+    LineNumbersState mStates[LINE_NUMBERS_BLOCK_SIZE];
+} StatesBlockCache;
+
+static StatesBlockCache sStatesBlockCache[STATES_BLOCK_CACHE_SIZE];
+static unsigned sLineInfoCycle = 0;
+static int sLineInfoCleanupPosted = 0;
+
+#define lru2unit(A) list_item_type(A, CompUnit, mLineInfoLink)
+
 unsigned calc_file_name_hash(const char * s) {
     unsigned h = 0;
     if (s != NULL) {
@@ -80,27 +113,154 @@ unsigned calc_file_name_hash(const char * s) {
     return h;
 }
 
-static ObjectInfo * add_object_info(ContextAddress ID) {
-    ObjectHashTable * HashTable = sCache->mObjectHashTable + sDebugSection->index;
-    U4_T Hash = OBJ_HASH(HashTable, ID);
-    ObjectInfo * Info = HashTable->mObjectHash[Hash];
+#define STRING_POOL_CHUNK_SIZE 0x4000
+
+typedef struct InternedString {
+    struct InternedString * mNext;
+    unsigned mHash;             /* calc_symbol_name_hash() of the string */
+    unsigned mFileNameHash;     /* calc_file_name_hash() of the string */
+    char mStr[1];
+} InternedString;
+
+typedef struct StringPoolChunk {
+    struct StringPoolChunk * mNext;
+    size_t mSize;
+    size_t mPos;
+} StringPoolChunk;
+
+struct StringPool {
+    InternedString ** mHash;
+    unsigned mHashSize;
+    unsigned mCnt;
+    StringPoolChunk * mChunks;
+};
+
+#define str2interned(s) ((InternedString *)((char *)(s) - offsetof(InternedString, mStr)))
+
+const char * intern_dwarf_string(DWARFCache * cache, const char * s) {
+    StringPool * pool = cache->mStringPool;
+    StringPoolChunk * chunk = NULL;
+    InternedString * str = NULL;
+    unsigned h = 0;
+    size_t size = 0;
+
+    if (s == NULL) return NULL;
+    if (pool == NULL) {
+        pool = cache->mStringPool = (StringPool *)loc_alloc_zero(sizeof(StringPool));
+        pool->mHashSize = 256;
+        pool->mHash = (InternedString **)loc_alloc_zero(sizeof(InternedString *) * pool->mHashSize);
+    }
+    h = calc_symbol_name_hash(s);
+    str = pool->mHash[h & (pool->mHashSize - 1)];
+    while (str != NULL) {
+        if (str->mHash == h && strcmp(str->mStr, s) == 0) return str->mStr;
+        str = str->mNext;
+    }
+    if (pool->mCnt >= pool->mHashSize) {
+        unsigned i;
+        unsigned hash_size = pool->mHashSize * 2;
+        InternedString ** hash = (InternedString **)loc_alloc_zero(sizeof(InternedString *) * hash_size);
+        for (i = 0; i < pool->mHashSize; i++) {
+            while (pool->mHash[i] != NULL) {
+                InternedString * x = pool->mHash[i];
+                pool->mHash[i] = x->mNext;
+                x->mNext = hash[x->mHash & (hash_size - 1)];
+                hash[x->mHash & (hash_size - 1)] = x;
+            }
+        }
+        loc_free(pool->mHash);
+        pool->mHash = hash;
+        pool->mHashSize = hash_size;
+    }
+    size = (offsetof(InternedString, mStr) + strlen(s) + 1 + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    chunk = pool->mChunks;
+    if (chunk == NULL || chunk->mPos + size > chunk->mSize) {
+        size_t chunk_size = size > STRING_POOL_CHUNK_SIZE ? size : STRING_POOL_CHUNK_SIZE;
+        chunk = (StringPoolChunk *)loc_alloc(sizeof(StringPoolChunk) + chunk_size);
+        chunk->mSize = chunk_size;
+        chunk->mPos = 0;
+        chunk->mNext = pool->mChunks;
+        pool->mChunks = chunk;
+    }
+    str = (InternedString *)((char *)(chunk + 1) + chunk->mPos);
+    chunk->mPos += size;
+    str->mHash = h;
+    str->mFileNameHash = calc_file_name_hash(s);
+    strcpy(str->mStr, s);
+    str->mNext = pool->mHash[h & (pool->mHashSize - 1)];
+    pool->mHash[h & (pool->mHashSize - 1)] = str;
+    pool->mCnt++;
+    return str->mStr;
+}
+
+unsigned get_interned_file_name_hash(const char * s) {
+    if (s == NULL) return 0;
+    return str2interned(s)->mFileNameHash;
+}
+
+static void free_string_pool(StringPool * pool) {
+    if (pool == NULL) return;
+    while (pool->mChunks != NULL) {
+        StringPoolChunk * chunk = pool->mChunks;
+        pool->mChunks = chunk->mNext;
+        loc_free(chunk);
+    }
+    loc_free(pool->mHash);
+    loc_free(pool);
+}
+
+static ObjectInfo * find_hashed_object(ObjectHashTable * HashTable, ContextAddress ID) {
+    ObjectInfo * Info = dwarf_ref2obj(HashTable->mObjectHash[OBJ_HASH(HashTable, ID)]);
     while (Info != NULL) {
         if (Info->mID == ID) return Info;
-        Info = Info->mHashNext;
+        Info = dwarf_ref2obj(Info->mHashNext);
+    }
+    return NULL;
+}
+
+static void add_object_block(void) {
+    U4_T Block = 0;
+    if (sFreeObjectBlocksCnt > 0) {
+        Block = sFreeObjectBlocks[--sFreeObjectBlocksCnt];
+    }
+    else {
+        if (sObjectBlocksCnt == 0) sObjectBlocksCnt = 1; /* Block 0 is not used, reference 0 is NULL */
+        if (sObjectBlocksCnt >= ((U4_T)1 << (32 - OBJECT_BLOCK_BITS))) {
+            str_exception(ERR_BUFFER_OVERFLOW, "Too many DWARF objects");
+        }
+        if (sObjectBlocksCnt >= sObjectBlocksMax) {
+            sObjectBlocksMax = sObjectBlocksMax == 0 ? 256 : sObjectBlocksMax * 2;
+            dwarf_object_blocks = (ObjectInfo **)loc_realloc(dwarf_object_blocks, sizeof(ObjectInfo *) * sObjectBlocksMax);
+            sFreeObjectBlocks = (U4_T *)loc_realloc(sFreeObjectBlocks, sizeof(U4_T) * sObjectBlocksMax);
+            dwarf_object_blocks[0] = NULL;
+        }
+        Block = sObjectBlocksCnt++;
+    }
+    if (sCache->mObjectBlocksCnt >= sCache->mObjectBlocksMax) {
+        sCache->mObjectBlocksMax = sCache->mObjectBlocksMax == 0 ? 16 : sCache->mObjectBlocksMax * 2;
+        sCache->mObjectBlocks = (U4_T *)loc_realloc(sCache->mObjectBlocks, sizeof(U4_T) * sCache->mObjectBlocksMax);
     }
+    dwarf_object_blocks[Block] = (ObjectInfo *)loc_alloc_zero(sizeof(ObjectInfo) * OBJECT_BLOCK_SIZE);
+    sCache->mObjectBlocks[sCache->mObjectBlocksCnt++] = Block;
+    sCache->mObjectBlockPos = 0;
+}
+
+static ObjectInfo * add_object_info(ContextAddress ID) {
+    ObjectHashTable * HashTable = sCache->mObjectHashTable + sDebugSection->index;
+    U4_T Hash = OBJ_HASH(HashTable, ID);
+    ObjectInfo * Info = find_hashed_object(HashTable, ID);
+    U4_T Block = 0;
+    if (Info != NULL) return Info;
     if (ID < OBJECT_ID_LAST(sCache)) {
         if (ID < sDebugSection->addr) str_exception(ERR_INV_DWARF, "Invalid entry reference");
         if (ID > sDebugSection->addr + sDebugSection->size) str_exception(ERR_INV_DWARF, "Invalid entry reference");
     }
-    if (sCache->mObjectArrayPos >= OBJECT_ARRAY_SIZE) {
-        ObjectArray * Buf = (ObjectArray *)loc_alloc_zero(sizeof(ObjectArray));
-        Buf->mNext = sCache->mObjectList;
-        sCache->mObjectList = Buf;
-        sCache->mObjectArrayPos = 0;
-    }
-    Info = sCache->mObjectList->mArray + sCache->mObjectArrayPos++;
+    if (sCache->mObjectBlockPos >= OBJECT_BLOCK_SIZE) add_object_block();
+    Block = sCache->mObjectBlocks[sCache->mObjectBlocksCnt - 1];
+    Info = dwarf_object_blocks[Block] + sCache->mObjectBlockPos;
+    Info->mRef = (Block << OBJECT_BLOCK_BITS) + sCache->mObjectBlockPos++;
     Info->mHashNext = HashTable->mObjectHash[Hash];
-    HashTable->mObjectHash[Hash] = Info;
+    HashTable->mObjectHash[Hash] = Info->mRef;
     Info->mID = ID;
     return Info;
 }
@@ -194,11 +354,8 @@ static void read_object_refs(ELF_Section * Section);
 ObjectInfo * find_object(ELF_Section * Section, ContextAddress ID) {
     DWARFCache * Cache = get_dwarf_cache(Section->file);
     ObjectHashTable * HashTable = Cache->mObjectHashTable + Section->index;
-    ObjectInfo * Info = HashTable->mObjectHash[OBJ_HASH(HashTable, ID)];
-    while (Info != NULL) {
-        if (Info->mID == ID) return Info;
-        Info = Info->mHashNext;
-    }
+    ObjectInfo * Info = find_hashed_object(HashTable, ID);
+    if (Info != NULL) return Info;
 #if ENABLE_DWARF_LAZY_LOAD
     if (Cache->lazy_loaded) {
         sCache = Cache;
@@ -213,11 +370,7 @@ ObjectInfo * find_object(ELF_Section * Section, ContextAddress ID) {
             dio_EnterSection(&sCompUnit->mDesc, sDebugSection, ID - sDebugSection->addr);
             if (set_trap(&trap)) {
                 dio_ReadEntry(read_object_info, 0);
-                Info = HashTable->mObjectHash[OBJ_HASH(HashTable, ID)];
-                while (Info != NULL) {
-                    if (Info->mID == ID) break;
-                    Info = Info->mHashNext;
-                }
+                Info = find_hashed_object(HashTable, ID);
                 clear_trap(&trap);
             }
             dio_ExitSection();
@@ -233,14 +386,7 @@ ObjectInfo * find_object(ELF_Section * Section, ContextAddress ID) {
 
 static ObjectInfo * find_loaded_object(ELF_Section * Section, ContextAddress ID) {
     DWARFCache * Cache = (DWARFCache *)Section->file->dwarf_dt_cache;
-    if (Cache != NULL) {
-        ObjectHashTable * HashTable = Cache->mObjectHashTable + Section->index;
-        ObjectInfo * Info = HashTable->mObjectHash[OBJ_HASH(HashTable, ID)];
-        while (Info != NULL) {
-            if (Info->mID == ID) return Info;
-            Info = Info->mHashNext;
-        }
-    }
+    if (Cache != NULL) return find_hashed_object(Cache->mObjectHashTable + Section->index, ID);
     return NULL;
 }
 
@@ -350,7 +496,7 @@ static void read_mod_fund_type(U2_T Form, ObjectInfo ** Type) {
         Mod = add_object_info((ContextAddress)(sDebugSection->addr + dio_GetPos() - BufSize + BufPos));
         Mod->mTag = Tag;
         Mod->mCompUnit = sCompUnit;
-        Mod->mType = *Type;
+        Mod->mType = dwarf_obj2ref(*Type);
         *Type = Mod;
     }
 }
@@ -388,7 +534,7 @@ static void read_mod_user_def_type(U2_T Form, ObjectInfo ** Type) {
         Mod = add_object_info((ContextAddress)(sDebugSection->addr + dio_GetPos() - BufSize + BufPos));
         Mod->mTag = Tag;
         Mod->mCompUnit = sCompUnit;
-        Mod->mType = *Type;
+        Mod->mType = dwarf_obj2ref(*Type);
         *Type = Mod;
     }
 }
@@ -407,10 +553,10 @@ static void read_subscr_data(U2_T Form, ObjectInfo * Array) {
     size_t BufSize;
     U8_T BufEnd = 0;
     U8_T OrgPos = dio_GetPos();
-    ObjectInfo ** Children = &Array->mChildren;
+    U4_T * Children = &Array->mChildren;
 
-    assert(Array->mChildren == NULL);
-    assert(Array->mType == NULL);
+    assert(Array->mChildren == 0);
+    assert(Array->mType == 0);
 
     dio_ChkBlock(Form, &Buf, &BufSize);
     dio_SetPos(Buf - (U1_T *)sDebugSection->data);
@@ -438,25 +584,29 @@ static void read_subscr_data(U2_T Form, ObjectInfo * Array) {
             break;
         }
         if (Type != NULL) {
-            ObjectInfo * Range = add_object_info((ContextAddress)(sDebugSection->addr + dio_GetPos()));
-            Range->mTag = TAG_index_range;
-            Range->mCompUnit = sCompUnit;
-            Range->mType = Type;
-            Range->u.mRange.mFmt = Fmt;
+            ObjectInfo * Info = add_object_info((ContextAddress)(sDebugSection->addr + dio_GetPos()));
+            ObjectRange * Range = (ObjectRange *)loc_alloc_zero(sizeof(ObjectRange));
+            Range->mNext = sCache->mRangeList;
+            sCache->mRangeList = Range;
+            Info->mTag = TAG_index_range;
+            Info->mCompUnit = sCompUnit;
+            Info->mType = Type->mRef;
+            Info->u.mRange = Range;
+            Range->mFmt = Fmt;
             switch (Fmt) {
             case FMT_FT_C_C:
             case FMT_FT_C_X:
             case FMT_UT_C_C:
             case FMT_UT_C_X:
-                Range->u.mRange.mLow.mValue = read_long_value();
+                Range->mLow.mValue = read_long_value();
                 break;
             case FMT_FT_X_C:
             case FMT_FT_X_X:
             case FMT_UT_X_C:
             case FMT_UT_X_X:
                 dio_ReadAttribute(0, FORM_BLOCK2);
-                Range->u.mRange.mLow.mExpr.mAddr = (U1_T *)dio_gFormDataAddr;
-                Range->u.mRange.mLow.mExpr.mSize = dio_gFormDataSize;
+                Range->mLow.mExpr.mAddr = (U1_T *)dio_gFormDataAddr;
+                Range->mLow.mExpr.mSize = dio_gFormDataSize;
                 break;
             }
             switch (Fmt) {
@@ -464,19 +614,19 @@ static void read_subscr_data(U2_T Form, ObjectInfo * Array) {
             case FMT_FT_X_C:
             case FMT_UT_C_C:
             case FMT_UT_X_C:
-                Range->u.mRange.mHigh.mValue = read_long_value();
+                Range->mHigh.mValue = read_long_value();
                 break;
             case FMT_FT_C_X:
             case FMT_FT_X_X:
             case FMT_UT_C_X:
             case FMT_UT_X_X:
                 dio_ReadAttribute(0, FORM_BLOCK2);
-                Range->u.mRange.mHigh.mExpr.mAddr = (U1_T *)dio_gFormDataAddr;
-                Range->u.mRange.mHigh.mExpr.mSize = dio_gFormDataSize;
+                Range->mHigh.mExpr.mAddr = (U1_T *)dio_gFormDataAddr;
+                Range->mHigh.mExpr.mSize = dio_gFormDataSize;
                 break;
             }
-            *Children = Range;
-            Children = &Range->mSibling;
+            *Children = Info->mRef;
+            Children = &Info->mSibling;
         }
         else if (Fmt == FMT_ET) {
             U2_T x = dio_ReadU2();
@@ -505,7 +655,7 @@ static void read_subscr_data(U2_T Form, ObjectInfo * Array) {
             default:
                 str_exception(ERR_INV_DWARF, "Invalid array element type format");
             }
-            Array->mType = Type;
+            Array->mType = Type->mRef;
         }
         else {
             str_exception(ERR_INV_DWARF, "Invalid array subscription format");
@@ -539,7 +689,7 @@ static void read_object_info(U2_T Tag, U2_T Attr, U2_T Form) {
                 Info = add_object_info((ContextAddress)(sDebugSection->addr + dio_gEntryPos));
             }
             if (sParentObject) {
-                Info->mParent = sParentObject;
+                Info->mParent = sParentObject->mRef;
                 if (sParentObject->mFlags & DOIF_need_frame) {
                     /* Allow frame in get_symbol_container() */
                     Info->mFlags |= DOIF_need_frame;
@@ -588,46 +738,48 @@ static void read_object_info(U2_T Tag, U2_T Attr, U2_T Form) {
             case TAG_mod_pointer:
             case TAG_const_type:
             case TAG_volatile_type:
-                if (Info->mType == NULL) {
+                if (Info->mType == 0) {
                     /* NULL here means "void" */
-                    Info->mType = add_object_info(OBJECT_ID_VOID(sCompUnit));
-                    if (Info->mType->mTag == 0) {
-                        Info->mType->mTag = TAG_fund_type;
-                        Info->mType->mCompUnit = sCompUnit;
-                        Info->mType->u.mFundType = FT_void;
+                    ObjectInfo * Type = add_object_info(OBJECT_ID_VOID(sCompUnit));
+                    if (Type->mTag == 0) {
+                        Type->mTag = TAG_fund_type;
+                        Type->mCompUnit = sCompUnit;
+                        Type->u.mFundType = FT_void;
                         switch (Info->mCompUnit->mLanguage) {
                         case LANG_C:
                         case LANG_C89:
                         case LANG_C99:
                         case LANG_C_PLUS_PLUS:
-                            Info->mType->mName = "void";
+                            Type->mName = "void";
                             break;
                         }
                     }
+                    Info->mType = Type->mRef;
                 }
                 break;
             case TAG_string_type:
-                if (Info->mType == NULL) {
+                if (Info->mType == 0) {
                     /* NULL here means "char" */
-                    Info->mType = add_object_info(OBJECT_ID_CHAR(sCompUnit));
-                    if (Info->mType->mTag == 0) {
-                        Info->mType->mTag = TAG_fund_type;
-                        Info->mType->mCompUnit = sCompUnit;
-                        Info->mType->u.mFundType = FT_char;
+                    ObjectInfo * Type = add_object_info(OBJECT_ID_CHAR(sCompUnit));
+                    if (Type->mTag == 0) {
+                        Type->mTag = TAG_fund_type;
+                        Type->mCompUnit = sCompUnit;
+                        Type->u.mFundType = FT_char;
                         switch (Info->mCompUnit->mLanguage) {
                         case LANG_C:
                         case LANG_C89:
                         case LANG_C99:
                         case LANG_C_PLUS_PLUS:
-                            Info->mType->mName = "char";
+                            Type->mName = "char";
                             break;
                         }
                     }
+                    Info->mType = Type->mRef;
                 }
                 break;
             }
-            if (sPrevSibling != NULL) sPrevSibling->mSibling = Info;
-            else if (sParentObject != NULL) sParentObject->mChildren = Info;
+            if (sPrevSibling != NULL) sPrevSibling->mSibling = Info->mRef;
+            else if (sParentObject != NULL) sParentObject->mChildren = Info->mRef;
             else if (Tag == TAG_compile_unit) sCache->mObjectHashTable[sDebugSection->index].mCompUnits = Info;
             else if (Tag == TAG_partial_unit) sCache->mObjectHashTable[sDebugSection->index].mCompUnits = Info;
             else if (Tag == TAG_type_unit) sCache->mObjectHashTable[sDebugSection->index].mCompUnits = Info;
@@ -636,10 +788,16 @@ static void read_object_info(U2_T Tag, U2_T Attr, U2_T Form) {
                 dio_SetPos(Sibling);
                 return;
             }
-            if (Tag == TAG_enumerator && Info->mType == NULL) Info->mType = sParentObject;
+            if (Tag == TAG_enumerator && Info->mType == 0) Info->mType = dwarf_obj2ref(sParentObject);
 #if ENABLE_DWARF_LAZY_LOAD
-            if (sCache->mFile->lock_cnt == 0 && Sibling != 0 && sDebugSection->size >= 0x40000) {
+            if (sCache->mFile->lock_cnt == 0 && Sibling != 0 && sDebugSection->size >= DWARF_LAZY_LOAD_MIN_SIZE) {
                 switch (Tag) {
+                case TAG_compile_unit:
+                    /* Unit children are loaded on demand, public names and address ranges are scanned by create_pub_names() */
+                    if (sUnitDesc.mVersion < 2) break;
+                    sCache->lazy_loaded = 1;
+                    dio_SetPos(Sibling);
+                    return;
                 case TAG_union_type:
                 case TAG_array_type:
                 case TAG_class_type:
@@ -677,42 +835,62 @@ static void read_object_info(U2_T Tag, U2_T Attr, U2_T Form) {
         break;
     case AT_type:
         if (Form == FORM_GNU_REF_ALT) {
-            Info->mType = find_alt_object_info((ContextAddress)dio_gFormData);
-            add_object_reference(Info->mType, NULL);
+            ObjectInfo * Type = find_alt_object_info((ContextAddress)dio_gFormData);
+            add_object_reference(Type, NULL);
+            Info->mType = Type->mRef;
             break;
         }
         if (Form == FORM_REF_SIG8) {
+            ObjectInfo * Type = NULL;
             CompUnit * Unit = find_type_unit(dio_gFormData);
             if (Unit != NULL) {
                 ContextAddress ID = (ContextAddress)(Unit->mDesc.mSection->addr +
                     Unit->mDesc.mUnitOffs + Unit->mDesc.mTypeOffset);
-                Info->mType = find_loaded_object(Unit->mDesc.mSection, ID);
+                Type = find_loaded_object(Unit->mDesc.mSection, ID);
             }
-            if (Info->mType == NULL) str_exception(ERR_INV_DWARF, "Invalid type unit reference");
-            add_object_reference(Info->mType, NULL);
+            if (Type == NULL) str_exception(ERR_INV_DWARF, "Invalid type unit reference");
+            add_object_reference(Type, NULL);
+            Info->mType = Type->mRef;
             break;
         }
         dio_ChkRef(Form);
-        Info->mType = add_object_info((ContextAddress)dio_gFormData);
-        add_object_reference(Info->mType, NULL);
+        {
+            ObjectInfo * Type = add_object_info((ContextAddress)dio_gFormData);
+            add_object_reference(Type, NULL);
+            Info->mType = Type->mRef;
+        }
         break;
     case AT_fund_type:
         dio_ChkData(Form);
-        Info->mType = add_object_info((ContextAddress)(sDebugSection->addr + dio_GetPos() - dio_gFormDataSize));
-        Info->mType->mTag = TAG_fund_type;
-        Info->mType->mCompUnit = sCompUnit;
-        Info->mType->u.mFundType = (U2_T)dio_gFormData;
+        {
+            ObjectInfo * Type = add_object_info((ContextAddress)(sDebugSection->addr + dio_GetPos() - dio_gFormDataSize));
+            Type->mTag = TAG_fund_type;
+            Type->mCompUnit = sCompUnit;
+            Type->u.mFundType = (U2_T)dio_gFormData;
+            Info->mType = Type->mRef;
+        }
         break;
     case AT_user_def_type:
         dio_ChkRef(Form);
-        Info->mType = add_object_info((ContextAddress)dio_gFormData);
-        add_object_reference(Info->mType, NULL);
+        {
+            ObjectInfo * Type = add_object_info((ContextAddress)dio_gFormData);
+            add_object_reference(Type, NULL);
+            Info->mType = Type->mRef;
+        }
         break;
     case AT_mod_fund_type:
-        read_mod_fund_type(Form, &Info->mType);
+        {
+            ObjectInfo * Type = NULL;
+            read_mod_fund_type(Form, &Type);
+            Info->mType = dwarf_obj2ref(Type);
+        }
         break;
     case AT_mod_u_d_type:
-        read_mod_user_def_type(Form, &Info->mType);
+        {
+            ObjectInfo * Type = NULL;
+            read_mod_user_def_type(Form, &Type);
+            Info->mType = dwarf_obj2ref(Type);
+        }
         break;
     case AT_encoding:
         if (Tag == TAG_base_type) {
@@ -967,10 +1145,10 @@ static void read_object_refs(ELF_Section * Section) {
                 }
                 else {
                     if (ref.obj->mName == NULL) ref.obj->mName = ref.org->mName;
-                    if (ref.obj->mType == NULL || ref.obj->mType->mID == OBJECT_ID_VOID(ref.obj->mCompUnit)) ref.obj->mType = ref.org->mType;
+                    if (ref.obj->mType == 0 || get_dwarf_type(ref.obj)->mID == OBJECT_ID_VOID(ref.obj->mCompUnit)) ref.obj->mType = ref.org->mType;
                     ref.obj->mFlags |= ref.org->mFlags & ~(DOIF_children_loaded | DOIF_declaration | DOIF_specification);
                     if (ref.obj->mFlags & DOIF_specification) {
-                        ref.org->mDefinition = ref.obj;
+                        ref.org->mDefinition = ref.obj->mRef;
                         if ((ref.obj->mFlags & (DOIF_low_pc | DOIF_ranges | DOIF_location)) == 0) {
                             ref.obj->mFlags |= ref.org->mFlags & DOIF_declaration;
                         }
@@ -978,14 +1156,14 @@ static void read_object_refs(ELF_Section * Section) {
                     if (ref.obj->mFlags & DOIF_abstract_origin) {
                         if ((ref.obj->mTag == TAG_variable && (ref.obj->mFlags & DOIF_external)) ||
                                 ref.obj->mTag == TAG_subprogram ||
-                                (ref.obj->mTag == TAG_formal_parameter && ref.obj->mParent != NULL && ref.obj->mParent->mTag == TAG_subprogram))
-                            ref.org->mDefinition = ref.obj;
+                                (ref.obj->mTag == TAG_formal_parameter && dwarf_ref2obj(ref.obj->mParent) != NULL && dwarf_ref2obj(ref.obj->mParent)->mTag == TAG_subprogram))
+                            ref.org->mDefinition = ref.obj->mRef;
                     }
                     if (ref.obj->mFlags & DOIF_external) {
                         ObjectInfo * cls = ref.org;
-                        while (cls->mParent != NULL &&
-                            (cls->mParent->mTag == TAG_class_type || cls->mParent->mTag == TAG_structure_type)) {
-                            cls = cls->mParent;
+                        while (dwarf_ref2obj(cls->mParent) != NULL &&
+                            (dwarf_ref2obj(cls->mParent)->mTag == TAG_class_type || dwarf_ref2obj(cls->mParent)->mTag == TAG_structure_type)) {
+                            cls = dwarf_ref2obj(cls->mParent);
                         }
                         cls->mFlags |= DOIF_external;
                     }
@@ -1013,6 +1191,61 @@ static int addr_ranges_comparator(const void * x, const void * y) {
     return 0;
 }
 
+static unsigned fill_addr_index(AddrIndexNode * index, unsigned n, const U8_T * keys, unsigned pos, unsigned k) {
+    if (k <= n) {
+        pos = fill_addr_index(index, n, keys, pos, k * 2);
+        index[k].mKey = keys[pos];
+        index[k].mPos = pos++;
+        pos = fill_addr_index(index, n, keys, pos, k * 2 + 1);
+    }
+    return pos;
+}
+
+/* Create Eytzinger layout search index of 'n' sorted keys */
+static AddrIndexNode * create_addr_index(const U8_T * keys, unsigned n) {
+    AddrIndexNode * index = (AddrIndexNode *)loc_alloc(sizeof(AddrIndexNode) * (n + 1));
+    memset(index, 0, sizeof(AddrIndexNode));
+    fill_addr_index(index, n, keys, 0, 1);
+    return index;
+}
+
+/* Return position of first key greater than 'addr', or 'n' if none */
+static unsigned search_addr_index(AddrIndexNode * index, unsigned n, U8_T addr) {
+    unsigned k = 1;
+    while (k <= n) {
+#if defined(__GNUC__)
+        /* Grandchildren of the node are adjacent, prefetch them while comparing */
+        __builtin_prefetch(index + k * 4);
+#endif
+        k = k * 2 + (index[k].mKey <= addr);
+    }
+    /* Drop trailing "go right" steps and the last "go left" step */
+    while (k & 1) k >>= 1;
+    k >>= 1;
+    if (k == 0) return n;
+    return index[k].mPos;
+}
+
+static void create_addr_ranges_index(void) {
+    unsigned i;
+    U8_T * keys = NULL;
+    U8_T max = 0;
+
+    loc_free(sCache->mAddrRangesIndex);
+    sCache->mAddrRangesIndex = NULL;
+    if (sCache->mAddrRangesCnt == 0) return;
+    keys = (U8_T *)loc_alloc(sizeof(U8_T) * sCache->mAddrRangesCnt);
+    for (i = 0; i < sCache->mAddrRangesCnt; i++) {
+        UnitAddressRange * range = sCache->mAddrRanges + i;
+        /* Last address of the range, the range can end at the end of address space */
+        U8_T last = (ContextAddress)(range->mAddr + range->mSize - 1);
+        if (i == 0 || last > max) max = last;
+        keys[i] = max;
+    }
+    sCache->mAddrRangesIndex = create_addr_index(keys, sCache->mAddrRangesCnt);
+    loc_free(keys);
+}
+
 static void add_addr_range(ELF_Section * sec, CompUnit * unit, ContextAddress addr, ContextAddress size) {
     UnitAddressRange * range = NULL;
     if (addr + size <= addr) {
@@ -1156,31 +1389,34 @@ static void load_addr_ranges(ELF_Section * debug_info) {
                 if (set_trap(&trap)) {
                     load_line_numbers(unit);
                     if (unit->mStatesCnt >= 2) {
+                        LineNumbersState x;
+                        LineNumbersState y;
+                        get_line_numbers_state(unit, 0, &y);
                         for (i = 0; i < unit->mStatesCnt - 1; i++) {
-                            LineNumbersState * x = unit->mStates + i;
-                            LineNumbersState * y = unit->mStates + i + 1;
-                            if (x->mSection != y->mSection) continue;
-                            if (x->mAddress == y->mAddress) continue;
-                            if (x->mFlags & LINE_EndSequence) continue;
-                            add_addr_range(unit->mTextSection, unit, x->mAddress, y->mAddress - x->mAddress);
+                            x = y;
+                            get_line_numbers_state(unit, i + 1, &y);
+                            if (x.mSection != y.mSection) continue;
+                            if (x.mAddress == y.mAddress) continue;
+                            if (x.mFlags & LINE_EndSequence) continue;
+                            add_addr_range(unit->mTextSection, unit, x.mAddress, y.mAddress - x.mAddress);
                         }
                     }
                     clear_trap(&trap);
                 }
             }
 
-            {
+            if (info->mFlags & DOIF_children_loaded) {
                 /* Workaround for GCC bug - certain ranges are missing in both ".debug_aranges" and the unit info.
-                 * Add address ranges of the underlying scopes. */
-                ObjectInfo * obj = info->mChildren;
-                assert(info->mFlags & DOIF_children_loaded);
+                 * Add address ranges of the underlying scopes.
+                 * Ranges of lazily loaded units are added by create_pub_names(). */
+                ObjectInfo * obj = dwarf_ref2obj(info->mChildren);
                 while (obj != NULL) {
                     if (obj->mFlags & DOIF_low_pc) add_object_addr_ranges(obj);
-                    obj = obj->mSibling;
+                    obj = get_dwarf_sibling(obj);
                 }
             }
 
-            info = info->mSibling;
+            info = get_dwarf_sibling(info);
         }
     }
     if (sCache->mAddrRangesCnt > 1) {
@@ -1213,6 +1449,7 @@ static void load_addr_ranges(ELF_Section * debug_info) {
             sCache->mAddrRangesCnt = j;
         }
     }
+    create_addr_ranges_index();
 }
 
 static int cmp_pub_objects(ObjectInfo * x, ObjectInfo * y) {
@@ -1238,8 +1475,8 @@ static int cmp_pub_objects(ObjectInfo * x, ObjectInfo * y) {
 
     if ((x->mFlags & flags) != (y->mFlags & flags)) return 0;
     if (x->mParent != y->mParent) {
-        ObjectInfo * px = x->mParent;
-        ObjectInfo * py = y->mParent;
+        ObjectInfo * px = dwarf_ref2obj(x->mParent);
+        ObjectInfo * py = dwarf_ref2obj(y->mParent);
         for (;;) {
             if (px == NULL || py == NULL) return 0;
             if (px->mTag != py->mTag) return 0;
@@ -1248,8 +1485,8 @@ static int cmp_pub_objects(ObjectInfo * x, ObjectInfo * y) {
                 if (px->mName == NULL || py->mName == NULL) return 0;
                 if (strcmp(px->mName, py->mName) != 0) return 0;
             }
-            px = px->mParent;
-            py = py->mParent;
+            px = dwarf_ref2obj(px->mParent);
+            py = dwarf_ref2obj(py->mParent);
         }
     }
     switch (x->mTag) {
@@ -1262,8 +1499,23 @@ static int cmp_pub_objects(ObjectInfo * x, ObjectInfo * y) {
     return 1;
 }
 
-static void add_pub_name(PubNamesTable * tbl, ObjectInfo * obj) {
+static void add_pub_names_entry(PubNamesTable * tbl, unsigned h, ObjectInfo * obj,
+        ELF_Section * sec, ContextAddress id, const char * name) {
     PubNamesInfo * info = NULL;
+    if (tbl->mCnt >= tbl->mMax) {
+        tbl->mMax = tbl->mMax * 3 / 2;
+        tbl->mNext = (PubNamesInfo *)loc_realloc(tbl->mNext, sizeof(PubNamesInfo) * tbl->mMax);
+    }
+    info = tbl->mNext + tbl->mCnt;
+    info->mObject = obj;
+    info->mName = name;
+    info->mSection = sec;
+    info->mID = id;
+    info->mNext = tbl->mHash[h];
+    tbl->mHash[h] = tbl->mCnt++;
+}
+
+static void add_pub_name(PubNamesTable * tbl, ObjectInfo * obj) {
     unsigned h = calc_symbol_name_hash(obj->mName) % tbl->mHashSize;
     obj->mFlags |= DOIF_pub_mark;
     switch (obj->mTag) {
@@ -1281,19 +1533,12 @@ static void add_pub_name(PubNamesTable * tbl, ObjectInfo * obj) {
             unsigned n = tbl->mHash[h];
             while (n != 0) {
                 ObjectInfo * pub = tbl->mNext[n].mObject;
-                if (pub->mTag == obj->mTag && cmp_pub_objects(pub, obj)) return;
+                if (pub != NULL && pub->mTag == obj->mTag && cmp_pub_objects(pub, obj)) return;
                 n = tbl->mNext[n].mNext;
             }
         }
     }
-    if (tbl->mCnt >= tbl->mMax) {
-        tbl->mMax = tbl->mMax * 3 / 2;
-        tbl->mNext = (PubNamesInfo *)loc_realloc(tbl->mNext, sizeof(PubNamesInfo) * tbl->mMax);
-    }
-    info = tbl->mNext + tbl->mCnt;
-    info->mObject = obj;
-    info->mNext = tbl->mHash[h];
-    tbl->mHash[h] = tbl->mCnt++;
+    add_pub_names_entry(tbl, h, obj, obj->mCompUnit->mDesc.mSection, obj->mID, obj->mName);
 }
 
 static void load_pub_names(ELF_Section * debug_info, ELF_Section * pub_names) {
@@ -1341,7 +1586,7 @@ static void load_pub_names(ELF_Section * debug_info, ELF_Section * pub_names) {
 static void add_namespace(PubNamesTable * tbl, ObjectInfo * ns) {
     ObjectInfo * obj = get_dwarf_children(ns);
     while (obj != NULL) {
-        if ((obj->mFlags & DOIF_pub_mark) == 0 && obj->mDefinition == NULL && obj->mName != NULL) {
+        if ((obj->mFlags & DOIF_pub_mark) == 0 && obj->mDefinition == 0 && obj->mName != NULL) {
             add_pub_name(tbl, obj);
         }
         if (obj->mTag == TAG_enumeration_type) {
@@ -1350,114 +1595,1552 @@ static void add_namespace(PubNamesTable * tbl, ObjectInfo * ns) {
                 if ((n->mFlags & DOIF_pub_mark) == 0 && n->mName != NULL) {
                     add_pub_name(tbl, n);
                 }
-                n = n->mSibling;
+                n = get_dwarf_sibling(n);
             }
         }
         if (obj->mTag == TAG_namespace) {
             add_namespace(tbl, obj);
         }
-        obj = obj->mSibling;
+        obj = get_dwarf_sibling(obj);
     }
 }
 
-static void create_pub_names(unsigned idx) {
-    ObjectInfo * unit = sCache->mObjectHashTable[idx].mCompUnits;
-    PubNamesTable * tbl = &sCache->mPubNames;
-    while (unit != NULL) {
-        add_namespace(tbl, unit);
-        if ((unit->mFlags & DOIF_pub_mark) == 0 && unit->mName != NULL) {
-            add_pub_name(tbl, unit);
-        }
-        unit = unit->mSibling;
-    }
-}
+#if ENABLE_DWARF_LAZY_LOAD
 
-static void allocate_obj_hash(ELF_Section * sec) {
-    ObjectHashTable * HashTable = sCache->mObjectHashTable + sec->index;
-    assert(HashTable->mObjectHash == NULL);
-    HashTable->mObjectHashSize = (unsigned)(sec->size / 53);
-    if (HashTable->mObjectHashSize < 251) HashTable->mObjectHashSize = 251;
-    HashTable->mObjectHash = (ObjectInfo **)loc_alloc_zero(sizeof(ObjectInfo *) * HashTable->mObjectHashSize);
-}
+/*
+ * Public names of lazily loaded compilation units are collected by a light weight scan of
+ * the unit debug info entries, without creating ObjectInfo for each entry.
+ * Public names table entries of such units are resolved by get_pub_names_object().
+ */
 
-static int unit_id_comparator(const void * x1, const void * x2) {
-    ObjectInfo * u1 = (*(CompUnit **)x1)->mObject;
-    ObjectInfo * u2 = (*(CompUnit **)x2)->mObject;
-    if (u1->mID < u2->mID) return -1;
-    if (u1->mID > u2->mID) return +1;
-    return 0;
-}
+#define PUB_SCAN_UNIT       0
+#define PUB_SCAN_NAMESPACE  1
+#define PUB_SCAN_ENUM       2
+#define PUB_SCAN_SKIP       3
 
-static void load_debug_info_section(ELF_Section * sec) {
-    ObjectHashTable * HashTable = sCache->mObjectHashTable + sec->index;
-    Trap trap;
+typedef struct PubNameScanEntry {
+    ContextAddress mID;
+    const char * mName;
+    U2_T mTag;
+    U2_T mEncoding;
+    U4_T mFlags;
+    U4_T mScope;            /* Hash of enclosing namespace names */
+    U1_T mLevel;            /* PUB_SCAN_* mode of the parent */
+    U1_T mHasChildren;
+    U1_T mRefAlt;
+    U1_T mHighPCOffs;
+    U1_T mHasDefinition;
+    U1_T mNeedLoad;
+    U8_T mSibling;
+    ContextAddress mRef;    /* Specification or abstract origin */
+    ELF_Section * mSection;
+    ContextAddress mLowPC;
+    U8_T mHighPC;           /* End address or .debug_ranges offset */
+} PubNameScanEntry;
 
-    sObjRefsCnt = 0;
-    sDebugSection = sec;
-    sParentObject = NULL;
-    sPrevSibling = NULL;
-    allocate_obj_hash(sec);
-    dio_EnterSection(NULL, sec, 0);
-    if (set_trap(&trap)) {
-        assert(HashTable->mCompUnitsIndexSize == 0);
-        assert(HashTable->mCompUnitsIndex == NULL);
-        if (strcmp(sec->name, ".debug_types") == 0) {
-            while (dio_GetPos() < sec->size) {
-                dio_ReadUnit(&sUnitDesc, read_type_unit_header);
-            }
-            dio_SetPos(0);
+typedef struct PubNameScanInfo {
+    U2_T mTag;
+    U2_T mEncoding;
+    U4_T mFlags;
+    U4_T mScope;
+} PubNameScanInfo;
+
+/* Unit scan state is thread local: units can be scanned by worker threads, see scan_units_in_threads() */
+static DWARF_THREAD_LOCAL DIO_UnitDescriptor sScanUnit;
+static DWARF_THREAD_LOCAL PubNameScanEntry sScanEntry;
+static DWARF_THREAD_LOCAL PubNameScanEntry * sScanBuf = NULL;
+static DWARF_THREAD_LOCAL unsigned sScanFirst = 0;
+static DWARF_THREAD_LOCAL unsigned sScanCnt = 0;
+static DWARF_THREAD_LOCAL unsigned sScanMax = 0;
+static DWARF_THREAD_LOCAL ContextAddress * sScanDefs = NULL;
+static DWARF_THREAD_LOCAL unsigned sScanDefsCnt = 0;
+static DWARF_THREAD_LOCAL unsigned sScanDefsMax = 0;
+
+static PubNameScanInfo * sScanInfo = NULL;
+static unsigned sScanInfoMax = 0;
+
+/* Address ranges of scanned units can be added only before load_addr_ranges() */
+static int sScanAddrRanges = 1;
+
+static void scan_object_info(U2_T Tag, U2_T Attr, U2_T Form) {
+    PubNameScanEntry * e = &sScanEntry;
+    switch (Attr) {
+    case 0:
+        if (Form) {
+            memset(e, 0, sizeof(PubNameScanEntry));
+            e->mID = (ContextAddress)(sScanUnit.mSection->addr + dio_gEntryPos);
+            e->mTag = Tag;
+            e->mHasChildren = Form == DWARF_ENTRY_HAS_CHILDREN;
         }
-        while (dio_GetPos() < sec->size) {
-            dio_ReadUnit(&sUnitDesc, read_object_info);
+        else if (e->mHighPCOffs && (e->mFlags & (DOIF_low_pc | DOIF_ranges)) == DOIF_low_pc) {
+            e->mHighPC += e->mLowPC;
         }
-        clear_trap(&trap);
-    }
-    dio_ExitSection();
-    assert(sDebugSection == sec);
-    sDebugSection = NULL;
-    sParentObject = NULL;
-    sPrevSibling = NULL;
-    sCompUnit = NULL;
-    if (HashTable->mCompUnitsIndexSize > 0) {
-        unsigned i = 0;
-        ObjectInfo * unit = sCache->mObjectHashTable[sec->index].mCompUnits;
-        HashTable->mCompUnitsIndex = (CompUnit **)loc_alloc(sizeof(CompUnit *) * HashTable->mCompUnitsIndexSize);
-        while (unit != NULL) {
-            assert(unit->mTag == TAG_compile_unit || unit->mTag == TAG_partial_unit || unit->mTag == TAG_type_unit);
-            HashTable->mCompUnitsIndex[i++] = unit->mCompUnit;
-            unit = unit->mSibling;
+        break;
+    case AT_sibling:
+        dio_ChkRef(Form);
+        e->mSibling = dio_gFormData - sScanUnit.mSection->addr;
+        break;
+    case AT_name:
+        dio_ChkString(Form);
+        if (*(char *)dio_gFormDataAddr) e->mName = (char *)dio_gFormDataAddr;
+        break;
+    case AT_specification_v2:
+    case AT_abstract_origin:
+        if (Form == FORM_GNU_REF_ALT) e->mRefAlt = 1;
+        else dio_ChkRef(Form);
+        e->mRef = (ContextAddress)dio_gFormData;
+        e->mFlags |= Attr == AT_abstract_origin ? DOIF_abstract_origin : DOIF_specification;
+        break;
+    case AT_encoding:
+        if (Tag == TAG_base_type) e->mEncoding = (U2_T)dio_gFormData;
+        break;
+    case AT_external:
+        dio_ChkFlag(Form);
+        if (dio_gFormData) e->mFlags |= DOIF_external;
+        break;
+    case AT_artificial:
+        dio_ChkFlag(Form);
+        if (dio_gFormData) e->mFlags |= DOIF_artificial;
+        break;
+    case AT_declaration:
+        dio_ChkFlag(Form);
+        if (dio_gFormData) e->mFlags |= DOIF_declaration;
+        break;
+    case AT_accessibility:
+        dio_ChkData(Form);
+        switch (dio_gFormData) {
+        case DW_ACCESS_private  : e->mFlags |= DOIF_private; break;
+        case DW_ACCESS_protected: e->mFlags |= DOIF_protected; break;
+        case DW_ACCESS_public   : e->mFlags |= DOIF_public; break;
         }
-        assert(HashTable->mCompUnitsIndexSize == i);
-        qsort(HashTable->mCompUnitsIndex, HashTable->mCompUnitsIndexSize, sizeof(CompUnit *), unit_id_comparator);
+        break;
+    case AT_MIPS_linkage_name:
+        e->mFlags |= DOIF_mips_linkage_name;
+        break;
+    case AT_linkage_name:
+        e->mFlags |= DOIF_linkage_name;
+        break;
+    case AT_location:
+        e->mFlags |= DOIF_location;
+        break;
+    case AT_const_value:
+        e->mFlags |= DOIF_const_value;
+        break;
+    case AT_low_pc:
+        dio_ChkAddr(Form);
+        e->mLowPC = (ContextAddress)dio_gFormData;
+        if (dio_gFormSection) e->mSection = dio_gFormSection;
+        e->mFlags |= DOIF_low_pc;
+        break;
+    case AT_high_pc:
+        if (e->mFlags & DOIF_ranges) break;
+        if (Form != FORM_ADDR) {
+            dio_ChkData(Form);
+            e->mHighPCOffs = 1;
+        }
+        else if (dio_gFormSection) {
+            e->mSection = dio_gFormSection;
+        }
+        e->mHighPC = dio_gFormData;
+        break;
+    case AT_ranges:
+        dio_ChkData(Form);
+        e->mHighPC = dio_gFormData;
+        e->mFlags |= DOIF_ranges;
+        break;
     }
-    if (trap.error) exception(trap.error);
-    read_object_refs(sec);
 }
 
-static void load_debug_sections(void) {
-    unsigned idx;
-    ELF_Section * debug_info = NULL;
-    FrameInfoIndex * frame_info_d = NULL;
-    FrameInfoIndex * frame_info_e = NULL;
-    ELF_File * file = sCache->mFile;
-    U8_T debug_types_size = 0;
+static void add_scan_entry(int mode, U4_T scope) {
+    if (sScanCnt >= sScanMax) {
+        sScanMax = sScanMax == 0 ? 256 : sScanMax * 2;
+        sScanBuf = (PubNameScanEntry *)loc_realloc(sScanBuf, sizeof(PubNameScanEntry) * sScanMax);
+    }
+    sScanEntry.mLevel = (U1_T)mode;
+    sScanEntry.mScope = scope;
+    sScanBuf[sScanCnt++] = sScanEntry;
+}
 
-    for (idx = 1; idx < file->section_cnt; idx++) {
-        ELF_Section * sec = file->sections + idx;
-        if (sec->size == 0) continue;
-        if (sec->name == NULL) continue;
-        if (sec->type == SHT_NOBITS) continue;
-        if (strcmp(sec->name, ".debug_types") == 0) {
-            debug_types_size += sec->size;
+static void scan_pub_names(U8_T end_pos, int mode, U4_T scope) {
+    while (dio_GetPos() < end_pos) {
+        U8_T sibling = 0;
+        U2_T tag = 0;
+        const char * name = NULL;
+        if (!dio_ReadEntry(scan_object_info, 0)) break;
+        sibling = sScanEntry.mSibling;
+        tag = sScanEntry.mTag;
+        name = sScanEntry.mName;
+        switch (mode) {
+        case PUB_SCAN_UNIT:
+        case PUB_SCAN_NAMESPACE:
+            if (name != NULL || sScanEntry.mRef != 0 || (sScanEntry.mFlags & DOIF_low_pc) != 0) {
+                add_scan_entry(mode, scope);
+            }
+            break;
+        case PUB_SCAN_ENUM:
+            if (name != NULL && tag == TAG_enumerator) add_scan_entry(mode, scope);
+            break;
+        }
+        if (sScanEntry.mHasChildren) {
+            int child_mode = PUB_SCAN_SKIP;
+            U4_T child_scope = 0;
+            if (mode == PUB_SCAN_UNIT || mode == PUB_SCAN_NAMESPACE) {
+                if (tag == TAG_namespace) {
+                    child_mode = PUB_SCAN_NAMESPACE;
+                    child_scope = scope * 31 + (name == NULL ? 0 : calc_symbol_name_hash(name)) + 1;
+                }
+                else if (tag == TAG_enumeration_type) {
+                    child_mode = PUB_SCAN_ENUM;
+                }
+            }
+            if (child_mode != PUB_SCAN_SKIP || sibling == 0) {
+                scan_pub_names(sibling != 0 ? sibling : end_pos, child_mode, child_scope);
+            }
         }
+        if (sibling > dio_GetPos()) dio_SetPos(sibling);
     }
+}
 
-    if (debug_types_size > 0) {
-        sCache->mTypeUnitHashSize = (unsigned)(debug_types_size / 101);
-        if (sCache->mTypeUnitHashSize < 239) sCache->mTypeUnitHashSize = 239;
-        sCache->mTypeUnitHash = (CompUnit **)loc_alloc_zero(sizeof(CompUnit *) * sCache->mTypeUnitHashSize);
+static PubNameScanEntry * find_scan_entry(ContextAddress id) {
+    unsigned l = sScanFirst;
+    unsigned h = sScanCnt;
+    while (l < h) {
+        unsigned k = (l + h) / 2;
+        PubNameScanEntry * e = sScanBuf + k;
+        if (e->mID > id) h = k;
+        else if (e->mID < id) l = k + 1;
+        else return e;
     }
-
+    return NULL;
+}
+
+static int scan_def_comparator(const void * x, const void * y) {
+    ContextAddress ix = *(ContextAddress *)x;
+    ContextAddress iy = *(ContextAddress *)y;
+    if (ix < iy) return -1;
+    if (ix > iy) return +1;
+    return 0;
+}
+
+static void resolve_scan_entry_name(PubNameScanEntry * e) {
+    /* Find name of an entry that refers to its declaration or abstract origin */
+    ContextAddress unit_id = (ContextAddress)(sScanUnit.mSection->addr + sScanUnit.mUnitOffs);
+    PubNameScanEntry x = *e;
+    unsigned cnt = 0;
+    while (x.mName == NULL && x.mRef != 0) {
+        PubNameScanEntry * y = NULL;
+        if (x.mRefAlt || x.mRef < unit_id || x.mRef >= unit_id + sScanUnit.mUnitSize || cnt++ >= 8) {
+            /* The name will be found by loading the object */
+            e->mNeedLoad = 1;
+            return;
+        }
+        y = find_scan_entry(x.mRef);
+        if (y == NULL) {
+            U8_T pos = dio_GetPos();
+            dio_SetPos(x.mRef - sScanUnit.mSection->addr);
+            dio_ReadEntry(scan_object_info, 0);
+            dio_SetPos(pos);
+            x = sScanEntry;
+        }
+        else {
+            x = *y;
+        }
+    }
+    e->mName = x.mName;
+}
+
+static void add_scan_pub_name(PubNamesTable * tbl, ELF_Section * sec, PubNameScanEntry * e) {
+    PubNameScanInfo * info = NULL;
+    unsigned h = calc_symbol_name_hash(e->mName) % tbl->mHashSize;
+    switch (e->mTag) {
+    case TAG_base_type:
+    case TAG_typedef:
+    case TAG_class_type:
+    case TAG_structure_type:
+    case TAG_union_type:
+    case TAG_interface_type:
+    case TAG_enumeration_type:
+    case TAG_enumerator:
+    case TAG_variable:
+        {
+            /* Check for duplicates, same as cmp_pub_objects(), but without loading the objects */
+            unsigned n = tbl->mHash[h];
+            while (n != 0) {
+                PubNamesInfo * pub = tbl->mNext + n;
+                if (pub->mObject == NULL && n < sScanInfoMax) {
+                    PubNameScanInfo * x = sScanInfo + n;
+                    if (x->mTag == e->mTag && x->mFlags == e->mFlags &&
+                        x->mScope == e->mScope && x->mEncoding == e->mEncoding &&
+                        strcmp(pub->mName, e->mName) == 0) return;
+                }
+                n = pub->mNext;
+            }
+        }
+    }
+    if (tbl->mCnt >= sScanInfoMax) {
+        unsigned max = sScanInfoMax;
+        sScanInfoMax = tbl->mMax > tbl->mCnt ? tbl->mMax : tbl->mCnt + 256;
+        sScanInfo = (PubNameScanInfo *)loc_realloc(sScanInfo, sizeof(PubNameScanInfo) * sScanInfoMax);
+        memset(sScanInfo + max, 0, sizeof(PubNameScanInfo) * (sScanInfoMax - max));
+    }
+    info = sScanInfo + tbl->mCnt;
+    info->mTag = e->mTag;
+    info->mEncoding = e->mEncoding;
+    info->mFlags = e->mFlags;
+    info->mScope = e->mScope;
+    add_pub_names_entry(tbl, h, NULL, sec, e->mID, e->mName);
+}
+
+static void scan_unit(CompUnit * unit) {
+    /* Scan unit entries into sScanBuf, the function is also used by worker threads */
+    unsigned i;
+    ELF_Section * sec = unit->mDesc.mSection;
+
+    sScanUnit = unit->mDesc;
+    sScanFirst = sScanCnt;
+    sScanDefsCnt = 0;
+    dio_EnterSection(&sScanUnit, sec, unit->mObject->mID - sec->addr);
+    dio_ReadEntry(NULL, (U2_T)0xffffu);
+    scan_pub_names(sScanUnit.mUnitOffs + sScanUnit.mUnitSize, PUB_SCAN_UNIT, 0);
+    /* Declarations that have definitions are not included in the table, see add_namespace() */
+    for (i = sScanFirst; i < sScanCnt; i++) {
+        PubNameScanEntry * e = sScanBuf + i;
+        if (e->mRef == 0 || e->mRefAlt) continue;
+        if ((e->mFlags & DOIF_specification) == 0 && e->mTag != TAG_subprogram && e->mTag != TAG_variable) continue;
+        if (sScanDefsCnt >= sScanDefsMax) {
+            sScanDefsMax = sScanDefsMax == 0 ? 64 : sScanDefsMax * 2;
+            sScanDefs = (ContextAddress *)loc_realloc(sScanDefs, sizeof(ContextAddress) * sScanDefsMax);
+        }
+        sScanDefs[sScanDefsCnt++] = e->mRef;
+    }
+    if (sScanDefsCnt > 1) qsort(sScanDefs, sScanDefsCnt, sizeof(ContextAddress), scan_def_comparator);
+    for (i = sScanFirst; i < sScanCnt; i++) {
+        PubNameScanEntry * e = sScanBuf + i;
+        if (e->mLevel != PUB_SCAN_ENUM && sScanDefsCnt > 0 && bsearch(&e->mID, sScanDefs,
+                sScanDefsCnt, sizeof(ContextAddress), scan_def_comparator) != NULL) {
+            e->mHasDefinition = 1;
+            continue;
+        }
+        if (e->mName == NULL) resolve_scan_entry_name(e);
+    }
+    dio_ExitSection();
+}
+
+static void add_unit_pub_names(PubNamesTable * tbl, CompUnit * unit, PubNameScanEntry * buf, unsigned cnt) {
+    unsigned i;
+    DWARFCache * cache = sCache;
+    ELF_Section * sec = unit->mDesc.mSection;
+
+    for (i = 0; i < cnt; i++) {
+        PubNameScanEntry * e = buf + i;
+        if (e->mLevel == PUB_SCAN_UNIT && (e->mFlags & DOIF_low_pc) && sScanAddrRanges) {
+            /* Workaround for GCC bug, see load_addr_ranges() */
+            ObjectInfo obj;
+            memset(&obj, 0, sizeof(obj));
+            obj.mTag = e->mTag;
+            obj.mFlags = e->mFlags;
+            obj.mCompUnit = unit;
+            obj.u.mCode.mSection = e->mSection;
+            obj.u.mCode.mLowPC = e->mLowPC;
+            if (e->mFlags & DOIF_ranges) obj.u.mCode.mHighPC.mRanges = e->mHighPC;
+            else obj.u.mCode.mHighPC.mAddr = (ContextAddress)e->mHighPC;
+            add_object_addr_ranges(&obj);
+        }
+        if (e->mHasDefinition) continue;
+        if (e->mNeedLoad) {
+            ObjectInfo * obj = find_object(sec, e->mID);
+            sCache = cache;
+            if (obj != NULL) e->mName = obj->mName;
+        }
+        if (e->mName == NULL) continue;
+        add_scan_pub_name(tbl, sec, e);
+    }
+}
+
+static void scan_unit_pub_names(PubNamesTable * tbl, CompUnit * unit) {
+    Trap trap;
+    sScanCnt = 0;
+    if (set_trap(&trap)) {
+        scan_unit(unit);
+        clear_trap(&trap);
+    }
+    else {
+        dio_ExitSection();
+        exception(trap.error);
+    }
+    add_unit_pub_names(tbl, unit, sScanBuf, sScanCnt);
+}
+
+#if ENABLE_DWARF_THREADS
+
+typedef struct ScanUnitResult {
+    unsigned mThread;
+    unsigned mPos;
+    unsigned mCnt;
+    int mError;
+} ScanUnitResult;
+
+typedef struct ScanUnitsJob ScanUnitsJob;
+
+typedef struct ScanUnitsThread {
+    ScanUnitsJob * mJob;
+    pthread_t mThread;
+    unsigned mIndex;
+    PubNameScanEntry * mBuf;
+} ScanUnitsThread;
+
+struct ScanUnitsJob {
+    pthread_mutex_t mLock;
+    CompUnit ** mUnits;
+    ScanUnitResult * mResults;
+    unsigned mUnitsCnt;
+    unsigned mUnitsPos;
+    ScanUnitsThread * mThreads;
+    unsigned mThreadsCnt;
+};
+
+static void * scan_units_thread(void * args) {
+    ScanUnitsThread * thread = (ScanUnitsThread *)args;
+    ScanUnitsJob * job = thread->mJob;
+    for (;;) {
+        Trap trap;
+        unsigned i = 0;
+        ScanUnitResult * res = NULL;
+        pthread_mutex_lock(&job->mLock);
+        i = job->mUnitsPos++;
+        pthread_mutex_unlock(&job->mLock);
+        if (i >= job->mUnitsCnt) break;
+        res = job->mResults + i;
+        res->mThread = thread->mIndex;
+        res->mPos = sScanCnt;
+        if (dio_set_worker_trap(&trap)) {
+            scan_unit(job->mUnits[i]);
+            dio_SetWorkerTrap(NULL);
+        }
+        else {
+            /* The unit will be scanned again by the dispatch thread, which reports the error */
+            dio_ExitSection();
+            res->mError = trap.error;
+            sScanCnt = res->mPos;
+        }
+        res->mCnt = sScanCnt - res->mPos;
+    }
+    /* Pass the buffer to the dispatch thread */
+    thread->mBuf = sScanBuf;
+    sScanBuf = NULL;
+    sScanCnt = 0;
+    sScanMax = 0;
+    loc_free(sScanDefs);
+    sScanDefs = NULL;
+    sScanDefsMax = 0;
+    return NULL;
+}
+
+static ScanUnitsJob * scan_units_in_threads(ELF_Section * sec, int name_indexed) {
+    /* Scan lazily loaded units of the section on worker threads */
+    ObjectInfo * unit = sCache->mObjectHashTable[sec->index].mCompUnits;
+    ScanUnitsJob * job = NULL;
+    unsigned units_cnt = 0;
+    unsigned threads_cnt = 0;
+    long cpu_cnt = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned i;
+
+    if (sec->relocate != NULL) return NULL;
+    while (unit != NULL) {
+        if ((unit->mFlags & DOIF_children_loaded) == 0 && unit->mCompUnit->mNameIndexed == name_indexed) units_cnt++;
+        unit = get_dwarf_sibling(unit);
+    }
+    threads_cnt = units_cnt / DWARF_SCAN_UNITS_PER_THREAD;
+    if (cpu_cnt > 0 && threads_cnt > (unsigned)cpu_cnt) threads_cnt = (unsigned)cpu_cnt;
+    if (threads_cnt > DWARF_SCAN_THREADS_MAX) threads_cnt = DWARF_SCAN_THREADS_MAX;
+    if (threads_cnt < 2) return NULL;
+
+    job = (ScanUnitsJob *)loc_alloc_zero(sizeof(ScanUnitsJob));
+    job->mUnits = (CompUnit **)loc_alloc(sizeof(CompUnit *) * units_cnt);
+    job->mResults = (ScanUnitResult *)loc_alloc_zero(sizeof(ScanUnitResult) * units_cnt);
+    job->mThreads = (ScanUnitsThread *)loc_alloc_zero(sizeof(ScanUnitsThread) * threads_cnt);
+    unit = sCache->mObjectHashTable[sec->index].mCompUnits;
+    while (unit != NULL) {
+        if ((unit->mFlags & DOIF_children_loaded) == 0 && unit->mCompUnit->mNameIndexed == name_indexed) {
+            job->mUnits[job->mUnitsCnt++] = unit->mCompUnit;
+        }
+        unit = get_dwarf_sibling(unit);
+    }
+    pthread_mutex_init(&job->mLock, NULL);
+    for (i = 0; i < threads_cnt; i++) {
+        ScanUnitsThread * thread = job->mThreads + job->mThreadsCnt;
+        thread->mJob = job;
+        thread->mIndex = job->mThreadsCnt;
+        if (pthread_create(&thread->mThread, &pthread_create_attr, scan_units_thread, thread) != 0) break;
+        job->mThreadsCnt++;
+    }
+    for (i = 0; i < job->mThreadsCnt; i++) {
+        pthread_join(job->mThreads[i].mThread, NULL);
+    }
+    if (job->mThreadsCnt == 0) {
+        /* Cannot create threads, units are scanned by the dispatch thread */
+        job->mUnitsCnt = 0;
+    }
+    pthread_mutex_destroy(&job->mLock);
+    return job;
+}
+
+static void free_scan_units_job(ScanUnitsJob * job) {
+    unsigned i;
+    for (i = 0; i < job->mThreadsCnt; i++) loc_free(job->mThreads[i].mBuf);
+    loc_free(job->mThreads);
+    loc_free(job->mResults);
+    loc_free(job->mUnits);
+    loc_free(job);
+}
+
+#endif /* ENABLE_DWARF_THREADS */
+
+#endif /* ENABLE_DWARF_LAZY_LOAD */
+
+static void create_pub_names(unsigned idx, int name_indexed) {
+    /* Add public names of units of the section, only units that have mNameIndexed == name_indexed */
+    ObjectInfo * unit = sCache->mObjectHashTable[idx].mCompUnits;
+    PubNamesTable * tbl = &sCache->mPubNames;
+#if ENABLE_DWARF_LAZY_LOAD && ENABLE_DWARF_THREADS
+    ScanUnitsJob * job = NULL;
+    unsigned job_pos = 0;
+    Trap trap;
+    if (unit != NULL) job = scan_units_in_threads(sCache->mFile->sections + idx, name_indexed);
+    if (!set_trap(&trap)) {
+        if (job != NULL) free_scan_units_job(job);
+        exception(trap.error);
+    }
+#endif
+    while (unit != NULL) {
+        if (unit->mCompUnit->mNameIndexed != name_indexed) {
+            /* Names of the unit are added separately, see load_pub_names_by_name() */
+        }
+        else
+#if ENABLE_DWARF_LAZY_LOAD && ENABLE_DWARF_THREADS
+        if ((unit->mFlags & DOIF_children_loaded) == 0 && job != NULL &&
+                job_pos < job->mUnitsCnt && job->mUnits[job_pos] == unit->mCompUnit) {
+            ScanUnitResult * res = job->mResults + job_pos++;
+            if (res->mError == 0) {
+                add_unit_pub_names(tbl, unit->mCompUnit, job->mThreads[res->mThread].mBuf + res->mPos, res->mCnt);
+            }
+            else {
+                scan_unit_pub_names(tbl, unit->mCompUnit);
+            }
+        }
+        else
+#endif
+#if ENABLE_DWARF_LAZY_LOAD
+        if ((unit->mFlags & DOIF_children_loaded) == 0) scan_unit_pub_names(tbl, unit->mCompUnit);
+        else add_namespace(tbl, unit);
+#else
+        add_namespace(tbl, unit);
+#endif
+        if ((unit->mFlags & DOIF_pub_mark) == 0 && unit->mName != NULL) {
+            add_pub_name(tbl, unit);
+        }
+        unit = get_dwarf_sibling(unit);
+    }
+#if ENABLE_DWARF_LAZY_LOAD && ENABLE_DWARF_THREADS
+    clear_trap(&trap);
+    if (job != NULL) free_scan_units_job(job);
+#endif
+}
+
+static void allocate_obj_hash(ELF_Section * sec) {
+    ObjectHashTable * HashTable = sCache->mObjectHashTable + sec->index;
+    assert(HashTable->mObjectHash == NULL);
+    HashTable->mObjectHashSize = (unsigned)(sec->size / 53);
+    if (HashTable->mObjectHashSize < 251) HashTable->mObjectHashSize = 251;
+    HashTable->mObjectHash = (U4_T *)loc_alloc_zero(sizeof(U4_T) * HashTable->mObjectHashSize);
+}
+
+static int unit_id_comparator(const void * x1, const void * x2) {
+    ObjectInfo * u1 = (*(CompUnit **)x1)->mObject;
+    ObjectInfo * u2 = (*(CompUnit **)x2)->mObject;
+    if (u1->mID < u2->mID) return -1;
+    if (u1->mID > u2->mID) return +1;
+    return 0;
+}
+
+static void load_debug_info_section(ELF_Section * sec) {
+    ObjectHashTable * HashTable = sCache->mObjectHashTable + sec->index;
+    Trap trap;
+
+    sObjRefsCnt = 0;
+    sDebugSection = sec;
+    sParentObject = NULL;
+    sPrevSibling = NULL;
+    allocate_obj_hash(sec);
+    dio_EnterSection(NULL, sec, 0);
+    if (set_trap(&trap)) {
+        assert(HashTable->mCompUnitsIndexSize == 0);
+        assert(HashTable->mCompUnitsIndex == NULL);
+        if (strcmp(sec->name, ".debug_types") == 0) {
+            while (dio_GetPos() < sec->size) {
+                dio_ReadUnit(&sUnitDesc, read_type_unit_header);
+            }
+            dio_SetPos(0);
+        }
+        while (dio_GetPos() < sec->size) {
+            dio_ReadUnit(&sUnitDesc, read_object_info);
+        }
+        clear_trap(&trap);
+    }
+    dio_ExitSection();
+    assert(sDebugSection == sec);
+    sDebugSection = NULL;
+    sParentObject = NULL;
+    sPrevSibling = NULL;
+    sCompUnit = NULL;
+    if (HashTable->mCompUnitsIndexSize > 0) {
+        unsigned i = 0;
+        ObjectInfo * unit = sCache->mObjectHashTable[sec->index].mCompUnits;
+        HashTable->mCompUnitsIndex = (CompUnit **)loc_alloc(sizeof(CompUnit *) * HashTable->mCompUnitsIndexSize);
+        while (unit != NULL) {
+            assert(unit->mTag == TAG_compile_unit || unit->mTag == TAG_partial_unit || unit->mTag == TAG_type_unit);
+            HashTable->mCompUnitsIndex[i++] = unit->mCompUnit;
+            unit = get_dwarf_sibling(unit);
+        }
+        assert(HashTable->mCompUnitsIndexSize == i);
+        qsort(HashTable->mCompUnitsIndex, HashTable->mCompUnitsIndexSize, sizeof(CompUnit *), unit_id_comparator);
+    }
+    if (trap.error) exception(trap.error);
+    read_object_refs(sec);
+}
+
+static ObjectInfo * load_pub_object(ELF_Section * sec, ContextAddress id) {
+    CompUnit * unit = NULL;
+    ObjectInfo * obj = NULL;
+    sCache = get_dwarf_cache(sec->file);
+    sCompUnit = NULL;
+    unit = find_comp_unit(sec, id);
+    sCache = NULL;
+    if (unit != NULL) {
+        /* Load the object and its parents */
+        obj = unit->mObject;
+        if (obj->mID != id) obj = get_dwarf_children(obj);
+        while (obj != NULL && obj->mID < id) {
+            if (get_dwarf_sibling(obj) == NULL || get_dwarf_sibling(obj)->mID > id) {
+                obj = get_dwarf_children(obj);
+            }
+            else {
+                obj = get_dwarf_sibling(obj);
+            }
+        }
+        if (obj != NULL && obj->mID != id) obj = NULL;
+    }
+    return obj;
+}
+
+#if ENABLE_DWARF_NAME_INDEX
+
+/*
+ * Accelerator tables: DWARF 5 .debug_names and GDB .gdb_index.
+ * Public names of units that are covered by such table are not collected when the file is loaded.
+ * Instead, load_pub_names_by_name() searches the table, loads only units that define the name,
+ * and adds the objects to the public names table.
+ */
+
+#define NAME_INDEX_DEBUG_NAMES  1
+#define NAME_INDEX_GDB_INDEX    2
+
+typedef struct NameIndexAbbrev {
+    U4_T mCode;
+    U4_T mTag;
+    unsigned mAttrsCnt;
+    unsigned mAttrsMax;
+    U4_T * mAttrs;              /* Pairs of index attribute and form */
+} NameIndexAbbrev;
+
+typedef struct NameIndexUnit {  /* Name index of .debug_names section */
+    unsigned mOffsSize;
+    U4_T mCompUnitCnt;
+    U4_T mBucketCnt;
+    U4_T mNameCnt;
+    U8_T mCompUnits;
+    U8_T mBuckets;
+    U8_T mHashes;
+    U8_T mStrOffsets;
+    U8_T mEntryOffsets;
+    U8_T mEntryPool;
+    U8_T mEnd;
+    unsigned mAbbrevsCnt;
+    unsigned mAbbrevsMax;
+    NameIndexAbbrev * mAbbrevs;
+} NameIndexUnit;
+
+typedef struct NameIndexLookup {
+    struct NameIndexLookup * mNext;
+    char * mName;
+} NameIndexLookup;
+
+struct NameIndex {
+    DWARFCache * mCache;
+    int mFormat;
+    ELF_Section * mSection;
+    ELF_Section * mDebugInfo;
+    ELF_Section * mDebugStr;
+    /* .debug_names */
+    unsigned mUnitsCnt;
+    unsigned mUnitsMax;
+    NameIndexUnit * mUnits;
+    /* .gdb_index */
+    U4_T mVersion;
+    U4_T mCompUnits;
+    U4_T mCompUnitCnt;
+    U4_T mSymbols;
+    U4_T mSymbolCnt;
+    U4_T mConstPool;
+    /* Names that were already searched */
+    unsigned mLookupCnt;
+    unsigned mLookupHashSize;
+    NameIndexLookup ** mLookupHash;
+};
+
+static U8_T name_index_read(NameIndex * index, U8_T pos, unsigned size) {
+    ELF_Section * sec = index->mSection;
+    /* .gdb_index is always little-endian */
+    int big_endian = index->mFormat == NAME_INDEX_DEBUG_NAMES && sec->file->big_endian;
+    U1_T * p = (U1_T *)sec->data + pos;
+    U8_T n = 0;
+    unsigned i;
+    if (pos > sec->size || sec->size - pos < size) {
+        str_fmt_exception(ERR_INV_DWARF, "Invalid %s section: offset out of range", sec->name);
+    }
+    for (i = 0; i < size; i++) {
+        if (big_endian) n = (n << 8) | p[i];
+        else n |= (U8_T)p[i] << (i * 8);
+    }
+    return n;
+}
+
+static U8_T name_index_read_uleb(NameIndex * index, U8_T * pos) {
+    U8_T n = 0;
+    unsigned i = 0;
+    for (;;) {
+        U1_T b = (U1_T)name_index_read(index, (*pos)++, 1);
+        if (i < 64) n |= (U8_T)(b & 0x7f) << i;
+        if ((b & 0x80) == 0) break;
+        i += 7;
+    }
+    return n;
+}
+
+static const char * name_index_string(NameIndex * index, ELF_Section * sec, U8_T offs) {
+    if (offs >= sec->size || memchr((char *)sec->data + offs, 0, (size_t)(sec->size - offs)) == NULL) {
+        str_fmt_exception(ERR_INV_DWARF, "Invalid %s section: invalid string offset", index->mSection->name);
+    }
+    return (char *)sec->data + offs;
+}
+
+static void load_debug_names_abbrevs(NameIndex * index, NameIndexUnit * unit, U8_T pos, U8_T end) {
+    while (pos < end) {
+        NameIndexAbbrev * abbrev = NULL;
+        U4_T code = (U4_T)name_index_read_uleb(index, &pos);
+        if (code == 0) break;
+        if (unit->mAbbrevsCnt >= unit->mAbbrevsMax) {
+            unit->mAbbrevsMax = unit->mAbbrevsMax ? unit->mAbbrevsMax * 2 : 8;
+            unit->mAbbrevs = (NameIndexAbbrev *)loc_realloc(unit->mAbbrevs, sizeof(NameIndexAbbrev) * unit->mAbbrevsMax);
+        }
+        abbrev = unit->mAbbrevs + unit->mAbbrevsCnt++;
+        memset(abbrev, 0, sizeof(NameIndexAbbrev));
+        abbrev->mCode = code;
+        abbrev->mTag = (U4_T)name_index_read_uleb(index, &pos);
+        for (;;) {
+            U4_T attr = (U4_T)name_index_read_uleb(index, &pos);
+            U4_T form = (U4_T)name_index_read_uleb(index, &pos);
+            if (attr == 0 && form == 0) break;
+            if (abbrev->mAttrsCnt + 2 > abbrev->mAttrsMax) {
+                abbrev->mAttrsMax = abbrev->mAttrsMax ? abbrev->mAttrsMax * 2 : 8;
+                abbrev->mAttrs = (U4_T *)loc_realloc(abbrev->mAttrs, sizeof(U4_T) * abbrev->mAttrsMax);
+            }
+            abbrev->mAttrs[abbrev->mAttrsCnt++] = attr;
+            abbrev->mAttrs[abbrev->mAttrsCnt++] = form;
+        }
+    }
+}
+
+static void load_debug_names(NameIndex * index) {
+    ELF_Section * sec = index->mSection;
+    U8_T pos = 0;
+    while (pos < sec->size) {
+        NameIndexUnit * unit = NULL;
+        U8_T size = name_index_read(index, pos, 4);
+        U4_T local_tu_cnt = 0;
+        U4_T foreign_tu_cnt = 0;
+        U4_T abbrev_size = 0;
+        U4_T aug_size = 0;
+        U8_T p = 0;
+        pos += 4;
+        if (size == 0) continue;
+        if (index->mUnitsCnt >= index->mUnitsMax) {
+            index->mUnitsMax = index->mUnitsMax ? index->mUnitsMax * 2 : 8;
+            index->mUnits = (NameIndexUnit *)loc_realloc(index->mUnits, sizeof(NameIndexUnit) * index->mUnitsMax);
+        }
+        unit = index->mUnits + index->mUnitsCnt++;
+        memset(unit, 0, sizeof(NameIndexUnit));
+        unit->mOffsSize = 4;
+        if (size == 0xffffffffu) {
+            size = name_index_read(index, pos, 8);
+            unit->mOffsSize = 8;
+            pos += 8;
+        }
+        if (size > sec->size - pos) str_fmt_exception(ERR_INV_DWARF, "Invalid %s section: invalid unit size", sec->name);
+        unit->mEnd = pos + size;
+        if (name_index_read(index, pos, 2) != 5) str_fmt_exception(ERR_INV_DWARF, "Unsupported version of %s section", sec->name);
+        p = pos + 4;
+        unit->mCompUnitCnt = (U4_T)name_index_read(index, p, 4);
+        local_tu_cnt = (U4_T)name_index_read(index, p + 4, 4);
+        foreign_tu_cnt = (U4_T)name_index_read(index, p + 8, 4);
+        unit->mBucketCnt = (U4_T)name_index_read(index, p + 12, 4);
+        unit->mNameCnt = (U4_T)name_index_read(index, p + 16, 4);
+        abbrev_size = (U4_T)name_index_read(index, p + 20, 4);
+        aug_size = (U4_T)name_index_read(index, p + 24, 4);
+        p += 28 + (((U8_T)aug_size + 3) & ~(U8_T)3);
+        unit->mCompUnits = p;
+        p += (U8_T)unit->mCompUnitCnt * unit->mOffsSize;
+        p += (U8_T)local_tu_cnt * unit->mOffsSize;
+        p += (U8_T)foreign_tu_cnt * 8;
+        unit->mBuckets = p;
+        p += (U8_T)unit->mBucketCnt * 4;
+        unit->mHashes = p;
+        if (unit->mBucketCnt > 0) p += (U8_T)unit->mNameCnt * 4;
+        unit->mStrOffsets = p;
+        p += (U8_T)unit->mNameCnt * unit->mOffsSize;
+        unit->mEntryOffsets = p;
+        p += (U8_T)unit->mNameCnt * unit->mOffsSize;
+        unit->mEntryPool = p + abbrev_size;
+        if (unit->mEntryPool > unit->mEnd) str_fmt_exception(ERR_INV_DWARF, "Invalid %s section: invalid unit header", sec->name);
+        load_debug_names_abbrevs(index, unit, p, unit->mEntryPool);
+        pos = unit->mEnd;
+    }
+}
+
+static void load_gdb_index(NameIndex * index) {
+    ELF_Section * sec = index->mSection;
+    U4_T symbols_end = 0;
+    U4_T types = 0;
+    index->mVersion = (U4_T)name_index_read(index, 0, 4);
+    /* Symbol attributes were added in version 7 */
+    if (index->mVersion < 7 || index->mVersion > 9) str_fmt_exception(ERR_INV_DWARF, "Unsupported version of %s section", sec->name);
+    index->mCompUnits = (U4_T)name_index_read(index, 4, 4);
+    types = (U4_T)name_index_read(index, 8, 4);
+    index->mSymbols = (U4_T)name_index_read(index, 16, 4);
+    if (index->mVersion >= 9) {
+        /* Shortcut table follows the symbol table */
+        symbols_end = (U4_T)name_index_read(index, 20, 4);
+        index->mConstPool = (U4_T)name_index_read(index, 24, 4);
+    }
+    else {
+        index->mConstPool = (U4_T)name_index_read(index, 20, 4);
+        symbols_end = index->mConstPool;
+    }
+    if (types < index->mCompUnits || symbols_end < index->mSymbols || index->mConstPool > sec->size) {
+        str_fmt_exception(ERR_INV_DWARF, "Invalid %s section header", sec->name);
+    }
+    index->mCompUnitCnt = (types - index->mCompUnits) / 16;
+    index->mSymbolCnt = (symbols_end - index->mSymbols) / 8;
+    if (index->mSymbolCnt & (index->mSymbolCnt - 1)) {
+        str_fmt_exception(ERR_INV_DWARF, "Invalid %s section: symbol table size is not a power of 2", sec->name);
+    }
+}
+
+static CompUnit * find_name_index_unit(NameIndex * index, U8_T offs) {
+    /* Find compilation unit by .debug_info offset of its header */
+    CompUnit * unit = NULL;
+    sCache = index->mCache;
+    sCompUnit = NULL;
+    unit = find_comp_unit(index->mDebugInfo, (ContextAddress)(index->mDebugInfo->addr + offs));
+    if (unit != NULL && unit->mDesc.mUnitOffs != offs) unit = NULL;
+    return unit;
+}
+
+static void mark_name_indexed_unit(NameIndex * index, U8_T offs) {
+    CompUnit * unit = find_name_index_unit(index, offs);
+    if (unit == NULL) return;
+    if (unit->mObject->mFlags & DOIF_children_loaded) return;
+    unit->mNameIndexed = 1;
+}
+
+static void free_name_index(NameIndex * index) {
+    unsigned i, j;
+    if (index == NULL) return;
+    for (i = 0; i < index->mUnitsCnt; i++) {
+        NameIndexUnit * unit = index->mUnits + i;
+        for (j = 0; j < unit->mAbbrevsCnt; j++) loc_free(unit->mAbbrevs[j].mAttrs);
+        loc_free(unit->mAbbrevs);
+    }
+    loc_free(index->mUnits);
+    for (i = 0; i < index->mLookupHashSize; i++) {
+        while (index->mLookupHash[i] != NULL) {
+            NameIndexLookup * l = index->mLookupHash[i];
+            index->mLookupHash[i] = l->mNext;
+            loc_free(l->mName);
+            loc_free(l);
+        }
+    }
+    loc_free(index->mLookupHash);
+    loc_free(index);
+}
+
+static void load_name_index(ELF_Section * debug_info) {
+    Trap trap;
+    unsigned idx;
+    ELF_File * file = sCache->mFile;
+    ELF_Section * debug_names = NULL;
+    ELF_Section * gdb_index = NULL;
+    ELF_Section * debug_str = NULL;
+    NameIndex * index = NULL;
+
+    /* Only linked files: the index and the debug info must not need relocation */
+    if (debug_info->relocate != NULL) return;
+    for (idx = 1; idx < file->section_cnt; idx++) {
+        ELF_Section * sec = file->sections + idx;
+        if (sec->size == 0) continue;
+        if (sec->name == NULL) continue;
+        if (sec->type == SHT_NOBITS) continue;
+        if (strcmp(sec->name, ".debug_names") == 0) {
+            if (debug_names != NULL || sec->relocate != NULL) return;
+            debug_names = sec;
+        }
+        else if (strcmp(sec->name, ".gdb_index") == 0) {
+            gdb_index = sec;
+        }
+        else if (strcmp(sec->name, ".debug_str") == 0) {
+            debug_str = sec;
+        }
+    }
+    index = (NameIndex *)loc_alloc_zero(sizeof(NameIndex));
+    index->mCache = sCache;
+    index->mDebugInfo = debug_info;
+    index->mDebugStr = debug_str;
+    if (debug_names != NULL && debug_str != NULL) {
+        index->mFormat = NAME_INDEX_DEBUG_NAMES;
+        index->mSection = debug_names;
+    }
+    else if (gdb_index != NULL) {
+        index->mFormat = NAME_INDEX_GDB_INDEX;
+        index->mSection = gdb_index;
+    }
+    else {
+        loc_free(index);
+        return;
+    }
+    if (set_trap(&trap)) {
+        unsigned i, j;
+        if (elf_load(index->mSection) < 0) exception(errno);
+        if (index->mFormat == NAME_INDEX_DEBUG_NAMES) {
+            if (elf_load(index->mDebugStr) < 0) exception(errno);
+            load_debug_names(index);
+            for (i = 0; i < index->mUnitsCnt; i++) {
+                NameIndexUnit * unit = index->mUnits + i;
+                for (j = 0; j < unit->mCompUnitCnt; j++) {
+                    mark_name_indexed_unit(index, name_index_read(index,
+                        unit->mCompUnits + (U8_T)j * unit->mOffsSize, unit->mOffsSize));
+                }
+            }
+        }
+        else {
+            load_gdb_index(index);
+            for (j = 0; j < index->mCompUnitCnt; j++) {
+                mark_name_indexed_unit(index, name_index_read(index, index->mCompUnits + (U8_T)j * 16, 8));
+            }
+        }
+        clear_trap(&trap);
+    }
+    else {
+        ObjectInfo * unit = sCache->mObjectHashTable[debug_info->index].mCompUnits;
+        trace(LOG_ELF, "Ignoring broken name index section %s: %s.", index->mSection->name, errno_to_str(trap.error));
+        while (unit != NULL) {
+            unit->mCompUnit->mNameIndexed = 0;
+            unit = get_dwarf_sibling(unit);
+        }
+        free_name_index(index);
+        return;
+    }
+    index->mLookupHashSize = 251;
+    index->mLookupHash = (NameIndexLookup **)loc_alloc_zero(sizeof(NameIndexLookup *) * index->mLookupHashSize);
+    sCache->mNameIndex = index;
+}
+
+static void add_name_index_object(PubNamesTable * tbl, ObjectInfo * obj, const char * name) {
+    ObjectInfo * parent = NULL;
+    if (obj == NULL) return;
+    if (obj->mName == NULL) return;
+    if (obj->mFlags & DOIF_pub_mark) return;
+    if (strcmp(obj->mName, name) != 0) return;
+    /* Same objects as add_namespace() adds */
+    parent = get_dwarf_parent(obj);
+    if (parent == NULL) return;
+    switch (parent->mTag) {
+    case TAG_enumeration_type:
+        break;
+    case TAG_compile_unit:
+    case TAG_partial_unit:
+    case TAG_namespace:
+        if (obj->mDefinition != 0) return;
+        break;
+    default:
+        return;
+    }
+    add_pub_name(tbl, obj);
+}
+
+static void add_name_index_children(PubNamesTable * tbl, ObjectInfo * parent, const char * name) {
+    ObjectInfo * obj = get_dwarf_children(parent);
+    while (obj != NULL) {
+        add_name_index_object(tbl, obj, name);
+        if (obj->mTag == TAG_enumeration_type || obj->mTag == TAG_namespace) {
+            add_name_index_children(tbl, obj, name);
+        }
+        obj = get_dwarf_sibling(obj);
+    }
+}
+
+static U8_T read_debug_names_form(NameIndex * index, U8_T * pos, U4_T form) {
+    U8_T n = 0;
+    switch (form) {
+    case FORM_FLAG_PRESENT:
+        return 1;
+    case FORM_DATA1:
+    case FORM_REF1:
+    case FORM_FLAG:
+        n = name_index_read(index, *pos, 1);
+        *pos += 1;
+        return n;
+    case FORM_DATA2:
+    case FORM_REF2:
+        n = name_index_read(index, *pos, 2);
+        *pos += 2;
+        return n;
+    case FORM_DATA4:
+    case FORM_REF4:
+        n = name_index_read(index, *pos, 4);
+        *pos += 4;
+        return n;
+    case FORM_DATA8:
+    case FORM_REF8:
+    case FORM_REF_SIG8:
+        n = name_index_read(index, *pos, 8);
+        *pos += 8;
+        return n;
+    case FORM_UDATA:
+    case FORM_REF_UDATA:
+    case FORM_SDATA:
+        return name_index_read_uleb(index, pos);
+    }
+    str_fmt_exception(ERR_INV_DWARF, "Invalid %s section: unsupported form 0x%x", index->mSection->name, (unsigned)form);
+    return 0;
+}
+
+static U4_T calc_debug_names_hash(const char * name) {
+    /* DJB hash of case folded name */
+    U4_T h = 5381;
+    while (*name) {
+        unsigned ch = (unsigned char)*name++;
+        if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+        h = h * 33 + ch;
+    }
+    return h;
+}
+
+static void add_debug_names_entries(PubNamesTable * tbl, NameIndex * index, NameIndexUnit * unit, U4_T i, const char * name) {
+    U8_T pos = unit->mEntryPool + name_index_read(index, unit->mEntryOffsets + (U8_T)i * unit->mOffsSize, unit->mOffsSize);
+    for (;;) {
+        unsigned j;
+        U8_T cu = 0;
+        U8_T die = 0;
+        int has_die = 0;
+        int type_unit = 0;
+        CompUnit * comp_unit = NULL;
+        NameIndexAbbrev * abbrev = NULL;
+        U4_T code = (U4_T)name_index_read_uleb(index, &pos);
+        if (code == 0) break;
+        for (j = 0; j < unit->mAbbrevsCnt; j++) {
+            if (unit->mAbbrevs[j].mCode == code) {
+                abbrev = unit->mAbbrevs + j;
+                break;
+            }
+        }
+        if (abbrev == NULL) str_fmt_exception(ERR_INV_DWARF, "Invalid %s section: invalid abbreviation code", index->mSection->name);
+        for (j = 0; j < abbrev->mAttrsCnt; j += 2) {
+            U8_T n = read_debug_names_form(index, &pos, abbrev->mAttrs[j + 1]);
+            switch (abbrev->mAttrs[j]) {
+            case DW_IDX_compile_unit:
+                cu = n;
+                break;
+            case DW_IDX_type_unit:
+                type_unit = 1;
+                break;
+            case DW_IDX_die_offset:
+                die = n;
+                has_die = 1;
+                break;
+            }
+        }
+        /* Type unit entries are not supported, type units are loaded up front */
+        if (type_unit || !has_die || cu >= unit->mCompUnitCnt) continue;
+        cu = name_index_read(index, unit->mCompUnits + cu * unit->mOffsSize, unit->mOffsSize);
+        comp_unit = find_name_index_unit(index, cu);
+        sCache = NULL;
+        if (comp_unit == NULL || !comp_unit->mNameIndexed) continue;
+        add_name_index_object(tbl, load_pub_object(index->mDebugInfo, (ContextAddress)(index->mDebugInfo->addr + cu + die)), name);
+    }
+}
+
+static int find_in_debug_names(PubNamesTable * tbl, NameIndex * index, const char * name) {
+    int found = 0;
+    unsigned i;
+    U4_T h = calc_debug_names_hash(name);
+    int ascii = 1;
+    const char * s = name;
+    while (*s) {
+        if ((unsigned char)*s++ >= 0x80) ascii = 0;
+    }
+    for (i = 0; i < index->mUnitsCnt; i++) {
+        NameIndexUnit * unit = index->mUnits + i;
+        U4_T n = 0;
+        U4_T m = unit->mNameCnt;
+        if (unit->mBucketCnt > 0 && ascii) {
+            /* Non-ASCII names are case folded by Unicode rules, the hash is computed only for ASCII names */
+            U4_T b = h % unit->mBucketCnt;
+            n = (U4_T)name_index_read(index, unit->mBuckets + (U8_T)b * 4, 4);
+            if (n == 0) continue;
+            n--;
+        }
+        while (n < m) {
+            const char * str = NULL;
+            if (unit->mBucketCnt > 0 && ascii) {
+                U4_T x = (U4_T)name_index_read(index, unit->mHashes + (U8_T)n * 4, 4);
+                if (x % unit->mBucketCnt != h % unit->mBucketCnt) break;
+                if (x != h) {
+                    n++;
+                    continue;
+                }
+            }
+            str = name_index_string(index, index->mDebugStr,
+                name_index_read(index, unit->mStrOffsets + (U8_T)n * unit->mOffsSize, unit->mOffsSize));
+            if (strcmp(str, name) == 0) {
+                add_debug_names_entries(tbl, index, unit, n, name);
+                found = 1;
+            }
+            n++;
+        }
+    }
+    return found;
+}
+
+static U4_T calc_gdb_index_hash(const char * name) {
+    /* mapped_index_string_hash() of GDB, version 5 or later */
+    U4_T h = 0;
+    while (*name) {
+        unsigned ch = (unsigned char)*name++;
+        if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+        h = h * 67 + ch - 113;
+    }
+    return h;
+}
+
+static int find_in_gdb_index(PubNamesTable * tbl, NameIndex * index, const char * name) {
+    U4_T h = calc_gdb_index_hash(name);
+    U4_T mask = index->mSymbolCnt - 1;
+    U4_T slot = h & mask;
+    U4_T step = ((h * 17) & mask) | 1;
+    U4_T probes = 0;
+    if (index->mSymbolCnt == 0) return 0;
+    while (probes++ < index->mSymbolCnt) {
+        U8_T pos = index->mSymbols + (U8_T)slot * 8;
+        U4_T name_offs = (U4_T)name_index_read(index, pos, 4);
+        U4_T vec_offs = (U4_T)name_index_read(index, pos + 4, 4);
+        if (name_offs == 0 && vec_offs == 0) break;
+        if (strcmp(name_index_string(index, index->mSection, (U8_T)index->mConstPool + name_offs), name) == 0) {
+            U8_T vec = (U8_T)index->mConstPool + vec_offs;
+            U4_T cnt = (U4_T)name_index_read(index, vec, 4);
+            U4_T i;
+            for (i = 0; i < cnt; i++) {
+                /* Bits 0-23: unit index, 24-27: reserved, 28-30: symbol kind, 31: static */
+                U4_T cu = (U4_T)name_index_read(index, vec + 4 + (U8_T)i * 4, 4) & 0xffffff;
+                CompUnit * unit = NULL;
+                if (cu >= index->mCompUnitCnt) continue;
+                unit = find_name_index_unit(index, name_index_read(index, index->mCompUnits + (U8_T)cu * 16, 8));
+                sCache = NULL;
+                if (unit == NULL || !unit->mNameIndexed) continue;
+                add_name_index_children(tbl, unit->mObject, name);
+            }
+            return 1;
+        }
+        slot = (slot + step) & mask;
+    }
+    return 0;
+}
+
+static int has_pub_name(PubNamesTable * tbl, const char * name) {
+    unsigned n = tbl->mHash[calc_symbol_name_hash(name) % tbl->mHashSize];
+    while (n != 0) {
+        PubNamesInfo * info = tbl->mNext + n;
+        if (info->mName != NULL && strcmp(info->mName, name) == 0) return 1;
+        n = info->mNext;
+    }
+    return 0;
+}
+
+static int has_elf_symbol(ELF_File * file, const char * name) {
+    unsigned m;
+    unsigned h = calc_symbol_name_hash(name);
+    for (m = 1; m < file->section_cnt; m++) {
+        ELF_Section * tbl = file->sections + m;
+        unsigned n;
+        if (tbl->sym_names_hash == NULL) continue;
+        n = tbl->sym_names_hash[h % tbl->sym_names_hash_size];
+        while (n) {
+            ELF_SymbolInfo sym_info;
+            unpack_elf_symbol_info(tbl, n, &sym_info);
+            if (sym_info.name != NULL && cmp_symbol_names(sym_info.name, name) == 0) return 1;
+            n = tbl->sym_names_next[n];
+        }
+    }
+    return 0;
+}
+
+static void disable_name_index(DWARFCache * cache) {
+    /*
+     * Indexes don't list everything that is in the public names table, e.g. GNU gold omits declarations.
+     * When an ELF symbol is not in the index, it can be declared in debug info, e.g. a variable defined
+     * in a shared library. Fall back to scanning all units the index covers.
+     */
+    Trap trap;
+    NameIndex * index = cache->mNameIndex;
+    ObjectInfo * unit = cache->mObjectHashTable[index->mDebugInfo->index].mCompUnits;
+    trace(LOG_ELF, "Name index of %s is incomplete, scanning all units.", cache->mFile->name);
+    cache->mNameIndex = NULL;
+    sCache = cache;
+    sCompUnit = NULL;
+    sScanAddrRanges = 0;
+    if (set_trap(&trap)) {
+        create_pub_names(index->mDebugInfo->index, 1);
+        clear_trap(&trap);
+    }
+    sScanAddrRanges = 1;
+    loc_free(sScanInfo);
+    sScanInfo = NULL;
+    sScanInfoMax = 0;
+    sCache = NULL;
+    while (unit != NULL) {
+        unit->mCompUnit->mNameIndexed = 0;
+        unit = get_dwarf_sibling(unit);
+    }
+    free_name_index(index);
+    if (trap.error) exception(trap.error);
+}
+
+void load_pub_names_by_name(DWARFCache * cache, const char * name) {
+    NameIndex * index = cache->mNameIndex;
+    NameIndexLookup * l = NULL;
+    unsigned h = 0;
+    int found = 0;
+    if (index == NULL) return;
+    h = calc_symbol_name_hash(name) % index->mLookupHashSize;
+    for (l = index->mLookupHash[h]; l != NULL; l = l->mNext) {
+        if (strcmp(l->mName, name) == 0) return;
+    }
+    if (index->mFormat == NAME_INDEX_DEBUG_NAMES) found = find_in_debug_names(&cache->mPubNames, index, name);
+    else found = find_in_gdb_index(&cache->mPubNames, index, name);
+    if (!found && !has_pub_name(&cache->mPubNames, name) && has_elf_symbol(cache->mFile, name)) {
+        disable_name_index(cache);
+        return;
+    }
+    if (index->mLookupCnt >= index->mLookupHashSize * 2) {
+        /* Grow the hash table of searched names */
+        unsigned i;
+        unsigned size = index->mLookupHashSize * 4 + 1;
+        NameIndexLookup ** hash = (NameIndexLookup **)loc_alloc_zero(sizeof(NameIndexLookup *) * size);
+        for (i = 0; i < index->mLookupHashSize; i++) {
+            while (index->mLookupHash[i] != NULL) {
+                NameIndexLookup * x = index->mLookupHash[i];
+                unsigned k = calc_symbol_name_hash(x->mName) % size;
+                index->mLookupHash[i] = x->mNext;
+                x->mNext = hash[k];
+                hash[k] = x;
+            }
+        }
+        loc_free(index->mLookupHash);
+        index->mLookupHash = hash;
+        index->mLookupHashSize = size;
+        h = calc_symbol_name_hash(name) % size;
+    }
+    l = (NameIndexLookup *)loc_alloc_zero(sizeof(NameIndexLookup));
+    l->mName = loc_strdup(name);
+    l->mNext = index->mLookupHash[h];
+    index->mLookupHash[h] = l;
+    index->mLookupCnt++;
+}
+
+#else
+
+void load_pub_names_by_name(DWARFCache * cache, const char * name) {
+}
+
+#endif /* ENABLE_DWARF_NAME_INDEX */
+
+#if ENABLE_DWARF_LAZY_LOAD && ENABLE_ELF_INDEX_CACHE
+
+/*
+ * Public names table and address ranges index of a lazily loaded file are saved in
+ * the persistent index cache, see elf-index-cache.h. When the file is loaded again,
+ * the tables are restored from the cache instead of scanning all compilation units.
+ * Restored public names entries are resolved by get_pub_names_object().
+ */
+
+typedef struct PubNamesCacheHeader {
+    U4_T mHashSize;
+    U4_T mCnt;
+    U4_T mPoolSize;
+    U4_T mReserved;
+} PubNamesCacheHeader;
+
+typedef struct PubNamesCacheRecord {
+    U8_T mID;
+    U4_T mNext;
+    U4_T mSection;
+    U4_T mName;         /* Offset of the name in the string pool */
+    U4_T mReserved;
+} PubNamesCacheRecord;
+
+typedef struct AddrRangesCacheHeader {
+    U8_T mMaxSize;
+    U4_T mCnt;
+    U4_T mRelocatable;
+} AddrRangesCacheHeader;
+
+typedef struct AddrRangesCacheRecord {
+    U8_T mUnitID;
+    U8_T mAddr;
+    U8_T mSize;
+    U4_T mSection;
+    U4_T mUnitSection;
+} AddrRangesCacheRecord;
+
+#define PUB_NAMES_CACHE_HASH_SIZE(n) (((size_t)(n) * sizeof(U4_T) + 7) & ~(size_t)7)
+
+static int is_index_cache_usable(ELF_Section * debug_info) {
+    if (!sCache->lazy_loaded) return 0;
+    if (sCache->mFile->type == ET_REL) return 0;
+    if (debug_info->relocate != NULL) return 0;
+    return 1;
+}
+
+static int load_cached_addr_ranges(void) {
+    ELF_File * file = sCache->mFile;
+    size_t size = 0;
+    unsigned i;
+    const AddrRangesCacheRecord * recs = NULL;
+    const AddrRangesCacheHeader * hdr = (const AddrRangesCacheHeader *)elf_index_cache_get(
+        file, ELF_INDEX_ADDR_RANGES, 0, &size);
+
+    if (hdr == NULL || size < sizeof(AddrRangesCacheHeader)) return 0;
+    if (size != sizeof(AddrRangesCacheHeader) + (size_t)hdr->mCnt * sizeof(AddrRangesCacheRecord)) return 0;
+    recs = (const AddrRangesCacheRecord *)(hdr + 1);
+    sCache->mAddrRangesMax = hdr->mCnt > 0 ? hdr->mCnt : 1;
+    sCache->mAddrRanges = (UnitAddressRange *)loc_alloc_zero(sizeof(UnitAddressRange) * sCache->mAddrRangesMax);
+    for (i = 0; i < hdr->mCnt; i++) {
+        const AddrRangesCacheRecord * r = recs + i;
+        UnitAddressRange * range = sCache->mAddrRanges + i;
+        if (r->mSection >= file->section_cnt) break;
+        if (r->mUnitSection == 0 || r->mUnitSection >= file->section_cnt) break;
+        range->mUnit = find_comp_unit(file->sections + r->mUnitSection, (ContextAddress)r->mUnitID);
+        if (range->mUnit == NULL || range->mUnit->mObject->mID != (ContextAddress)r->mUnitID) break;
+        range->mSection = r->mSection;
+        range->mAddr = (ContextAddress)r->mAddr;
+        range->mSize = (ContextAddress)r->mSize;
+    }
+    if (i < hdr->mCnt) {
+        loc_free(sCache->mAddrRanges);
+        sCache->mAddrRanges = NULL;
+        sCache->mAddrRangesMax = 0;
+        return 0;
+    }
+    sCache->mAddrRangesCnt = hdr->mCnt;
+    sCache->mAddrRangesMaxSize = (ContextAddress)hdr->mMaxSize;
+    sCache->mAddrRangesRelocatable = hdr->mRelocatable != 0;
+    create_addr_ranges_index();
+    return 1;
+}
+
+static int load_cached_pub_names(void) {
+    ELF_File * file = sCache->mFile;
+    PubNamesTable * tbl = &sCache->mPubNames;
+    size_t size = 0;
+    size_t hash_size = 0;
+    unsigned i;
+    const U4_T * hash = NULL;
+    const PubNamesCacheRecord * recs = NULL;
+    const char * pool = NULL;
+    const PubNamesCacheHeader * hdr = (const PubNamesCacheHeader *)elf_index_cache_get(
+        file, ELF_INDEX_PUB_NAMES, 0, &size);
+
+    if (hdr == NULL || size < sizeof(PubNamesCacheHeader)) return 0;
+    if (hdr->mHashSize == 0 || hdr->mCnt == 0 || hdr->mPoolSize == 0) return 0;
+    hash_size = PUB_NAMES_CACHE_HASH_SIZE(hdr->mHashSize);
+    if (size != sizeof(PubNamesCacheHeader) + hash_size +
+        (size_t)hdr->mCnt * sizeof(PubNamesCacheRecord) + hdr->mPoolSize) return 0;
+    hash = (const U4_T *)(hdr + 1);
+    recs = (const PubNamesCacheRecord *)((const char *)hash + hash_size);
+    pool = (const char *)(recs + hdr->mCnt);
+    if (pool[hdr->mPoolSize - 1] != 0) return 0;
+    for (i = 0; i < hdr->mHashSize; i++) {
+        if (hash[i] >= hdr->mCnt) return 0;
+    }
+    for (i = 1; i < hdr->mCnt; i++) {
+        const PubNamesCacheRecord * r = recs + i;
+        if (r->mNext >= hdr->mCnt || r->mName >= hdr->mPoolSize) return 0;
+        if (r->mSection == 0 || r->mSection >= file->section_cnt) return 0;
+    }
+    tbl->mHashSize = hdr->mHashSize;
+    tbl->mHash = (unsigned *)loc_alloc(sizeof(unsigned) * tbl->mHashSize);
+    for (i = 0; i < hdr->mHashSize; i++) tbl->mHash[i] = hash[i];
+    tbl->mCnt = hdr->mCnt;
+    tbl->mMax = tbl->mCnt < 16 ? 16 : tbl->mCnt;
+    tbl->mNext = (PubNamesInfo *)loc_alloc(sizeof(PubNamesInfo) * tbl->mMax);
+    memset(tbl->mNext, 0, sizeof(PubNamesInfo));
+    for (i = 1; i < hdr->mCnt; i++) {
+        const PubNamesCacheRecord * r = recs + i;
+        PubNamesInfo * info = tbl->mNext + i;
+        info->mNext = r->mNext;
+        info->mObject = NULL;
+        info->mName = pool + r->mName;
+        info->mSection = file->sections + r->mSection;
+        info->mID = (ContextAddress)r->mID;
+    }
+    return 1;
+}
+
+static int load_cached_indexes(void) {
+    if (!load_cached_addr_ranges()) return 0;
+    if (!load_cached_pub_names()) {
+        loc_free(sCache->mAddrRanges);
+        loc_free(sCache->mAddrRangesIndex);
+        sCache->mAddrRanges = NULL;
+        sCache->mAddrRangesIndex = NULL;
+        sCache->mAddrRangesCnt = 0;
+        sCache->mAddrRangesMax = 0;
+        sCache->mAddrRangesMaxSize = 0;
+        sCache->mAddrRangesRelocatable = 0;
+        return 0;
+    }
+    trace(LOG_ELF, "DWARF indexes of %s loaded from the index cache", sCache->mFile->name);
+    return 1;
+}
+
+static void save_cached_addr_ranges(void) {
+    unsigned i;
+    size_t size = sizeof(AddrRangesCacheHeader) + (size_t)sCache->mAddrRangesCnt * sizeof(AddrRangesCacheRecord);
+    AddrRangesCacheHeader * hdr = (AddrRangesCacheHeader *)loc_alloc_zero(size);
+    AddrRangesCacheRecord * recs = (AddrRangesCacheRecord *)(hdr + 1);
+
+    hdr->mMaxSize = sCache->mAddrRangesMaxSize;
+    hdr->mCnt = sCache->mAddrRangesCnt;
+    hdr->mRelocatable = sCache->mAddrRangesRelocatable;
+    for (i = 0; i < sCache->mAddrRangesCnt; i++) {
+        UnitAddressRange * range = sCache->mAddrRanges + i;
+        AddrRangesCacheRecord * r = recs + i;
+        r->mUnitID = range->mUnit->mObject->mID;
+        r->mUnitSection = range->mUnit->mDesc.mSection->index;
+        r->mSection = range->mSection;
+        r->mAddr = range->mAddr;
+        r->mSize = range->mSize;
+    }
+    elf_index_cache_put(sCache->mFile, ELF_INDEX_ADDR_RANGES, 0, hdr, size);
+    loc_free(hdr);
+}
+
+static void save_cached_pub_names(void) {
+    PubNamesTable * tbl = &sCache->mPubNames;
+    size_t hash_size = PUB_NAMES_CACHE_HASH_SIZE(tbl->mHashSize);
+    size_t pool_size = 1;
+    size_t size = 0;
+    U4_T * names = (U4_T *)loc_alloc_zero(sizeof(U4_T) * tbl->mCnt);
+    PubNamesCacheHeader * hdr = NULL;
+    PubNamesCacheRecord * recs = NULL;
+    U4_T * hash = NULL;
+    char * pool = NULL;
+    unsigned i;
+
+    /* Assign string pool offsets, entries with same name are in same hash chain */
+    for (i = 0; i < tbl->mHashSize; i++) {
+        unsigned n = tbl->mHash[i];
+        while (n != 0) {
+            PubNamesInfo * info = tbl->mNext + n;
+            unsigned m = tbl->mHash[i];
+            if (info->mSection == NULL || info->mSection->file != sCache->mFile) {
+                loc_free(names);
+                return;
+            }
+            while (m != n && strcmp(tbl->mNext[m].mName, info->mName) != 0) m = tbl->mNext[m].mNext;
+            if (m != n) {
+                names[n] = names[m];
+            }
+            else {
+                names[n] = (U4_T)pool_size;
+                pool_size += strlen(info->mName) + 1;
+            }
+            n = info->mNext;
+        }
+    }
+    if (pool_size >= 0xffffffffu) {
+        loc_free(names);
+        return;
+    }
+
+    size = sizeof(PubNamesCacheHeader) + hash_size + (size_t)tbl->mCnt * sizeof(PubNamesCacheRecord) + pool_size;
+    hdr = (PubNamesCacheHeader *)loc_alloc_zero(size);
+    hash = (U4_T *)(hdr + 1);
+    recs = (PubNamesCacheRecord *)((char *)hash + hash_size);
+    pool = (char *)(recs + tbl->mCnt);
+    hdr->mHashSize = tbl->mHashSize;
+    hdr->mCnt = tbl->mCnt;
+    hdr->mPoolSize = (U4_T)pool_size;
+    for (i = 0; i < tbl->mHashSize; i++) hash[i] = tbl->mHash[i];
+    for (i = 1; i < tbl->mCnt; i++) {
+        PubNamesInfo * info = tbl->mNext + i;
+        PubNamesCacheRecord * r = recs + i;
+        r->mID = info->mID;
+        r->mNext = info->mNext;
+        r->mSection = info->mSection->index;
+        r->mName = names[i];
+        if (names[i] != 0) strcpy(pool + names[i], info->mName);
+    }
+    elf_index_cache_put(sCache->mFile, ELF_INDEX_PUB_NAMES, 0, hdr, size);
+    loc_free(hdr);
+    loc_free(names);
+}
+
+#endif /* ENABLE_DWARF_LAZY_LOAD && ENABLE_ELF_INDEX_CACHE */
+
+static void load_debug_sections(void) {
+    unsigned idx;
+    ELF_Section * debug_info = NULL;
+    FrameInfoIndex * frame_info_d = NULL;
+    FrameInfoIndex * frame_info_e = NULL;
+    ELF_File * file = sCache->mFile;
+    U8_T debug_types_size = 0;
+
+    for (idx = 1; idx < file->section_cnt; idx++) {
+        ELF_Section * sec = file->sections + idx;
+        if (sec->size == 0) continue;
+        if (sec->name == NULL) continue;
+        if (sec->type == SHT_NOBITS) continue;
+        if (strcmp(sec->name, ".debug_types") == 0) {
+            debug_types_size += sec->size;
+        }
+    }
+
+    if (debug_types_size > 0) {
+        sCache->mTypeUnitHashSize = (unsigned)(debug_types_size / 101);
+        if (sCache->mTypeUnitHashSize < 239) sCache->mTypeUnitHashSize = 239;
+        sCache->mTypeUnitHash = (CompUnit **)loc_alloc_zero(sizeof(CompUnit *) * sCache->mTypeUnitHashSize);
+    }
+
     for (idx = 1; idx < file->section_cnt; idx++) {
         ELF_Section * sec = file->sections + idx;
         if (sec->size == 0) continue;
@@ -1537,6 +3220,9 @@ static void load_debug_sections(void) {
     if (debug_info != NULL) {
         Trap trap;
         PubNamesTable * tbl = &sCache->mPubNames;
+#if ENABLE_DWARF_LAZY_LOAD && ENABLE_ELF_INDEX_CACHE
+        if (is_index_cache_usable(debug_info) && load_cached_indexes()) return;
+#endif
         tbl->mHashSize = tbl->mMax = (unsigned)(debug_info->size / 151) + 16;
         tbl->mHash = (unsigned *)loc_alloc_zero(sizeof(unsigned) * tbl->mHashSize);
         tbl->mNext = (PubNamesInfo *)loc_alloc(sizeof(PubNamesInfo) * tbl->mMax);
@@ -1558,17 +3244,32 @@ static void load_debug_sections(void) {
             memset(tbl->mHash, 0, sizeof(unsigned) * tbl->mHashSize);
             tbl->mCnt = 1;
         }
+#if ENABLE_DWARF_NAME_INDEX
+        if (sCache->lazy_loaded) load_name_index(debug_info);
+#endif
         for (idx = 1; idx < file->section_cnt; idx++) {
-            create_pub_names(idx);
+            create_pub_names(idx, 0);
         }
+#if ENABLE_DWARF_LAZY_LOAD
+        loc_free(sScanInfo);
+        sScanInfo = NULL;
+        sScanInfoMax = 0;
+#endif
         load_addr_ranges(debug_info);
+#if ENABLE_DWARF_LAZY_LOAD && ENABLE_ELF_INDEX_CACHE
+        /* Tables of files that have a name index are not complete, see load_pub_names_by_name() */
+        if (is_index_cache_usable(debug_info) && sCache->mNameIndex == NULL) {
+            save_cached_addr_ranges();
+            save_cached_pub_names();
+        }
+#endif
     }
 }
 
 #if ENABLE_DWARF_LAZY_LOAD
 ObjectInfo * get_dwarf_children(ObjectInfo * obj) {
     Trap trap;
-    if (obj->mFlags & DOIF_children_loaded) return obj->mChildren;
+    if (obj->mFlags & DOIF_children_loaded) return dwarf_ref2obj(obj->mChildren);
     sObjRefsCnt = 0;
     sCompUnit = obj->mCompUnit;
     sUnitDesc = sCompUnit->mDesc;
@@ -1577,7 +3278,7 @@ ObjectInfo * get_dwarf_children(ObjectInfo * obj) {
     dio_EnterSection(&sCompUnit->mDesc, sDebugSection, obj->mID - sDebugSection->addr);
     if (set_trap(&trap)) {
         U8_T end_pos = sCompUnit->mDesc.mUnitOffs + sCompUnit->mDesc.mUnitSize;
-        if (obj->mSibling != NULL) end_pos = obj->mSibling->mID - sDebugSection->addr;
+        if (get_dwarf_sibling(obj) != NULL) end_pos = get_dwarf_sibling(obj)->mID - sDebugSection->addr;
         dio_ReadEntry(NULL, (U2_T)0xffffu);
         sParentObject = obj;
         sPrevSibling = NULL;
@@ -1589,7 +3290,7 @@ ObjectInfo * get_dwarf_children(ObjectInfo * obj) {
     }
     else {
         /* TODO: dispose obj->mChildren */
-        obj->mChildren = NULL;
+        obj->mChildren = 0;
     }
     dio_ExitSection();
     sDebugSection = NULL;
@@ -1599,28 +3300,37 @@ ObjectInfo * get_dwarf_children(ObjectInfo * obj) {
     if (trap.error) exception(trap.error);
     read_object_refs(obj->mCompUnit->mDesc.mSection);
     assert(obj->mFlags & DOIF_children_loaded);
-    return obj->mChildren;
+    return dwarf_ref2obj(obj->mChildren);
 }
 
 ObjectInfo * get_dwarf_parent(ObjectInfo * obj) {
     ObjectInfo * x;
-    if (obj->mParent != NULL) return obj->mParent;
+    if (obj->mParent != 0) return dwarf_ref2obj(obj->mParent);
     if (obj->mTag == TAG_compile_unit) return NULL;
     if (obj->mTag == TAG_partial_unit) return NULL;
     if (obj->mTag == TAG_type_unit) return NULL;
     x = get_dwarf_children(obj->mCompUnit->mObject);
     while (x != NULL && x->mID < obj->mID) {
-        if (x->mSibling == NULL || x->mSibling->mID > obj->mID) {
+        if (get_dwarf_sibling(x) == NULL || get_dwarf_sibling(x)->mID > obj->mID) {
             x = get_dwarf_children(x);
         }
         else {
-            x = x->mSibling;
+            x = get_dwarf_sibling(x);
         }
     }
-    return obj->mParent;
+    return dwarf_ref2obj(obj->mParent);
 }
 #endif
 
+ObjectInfo * get_pub_names_object(PubNamesInfo * info) {
+    if (info->mObject == NULL && info->mSection != NULL) {
+        ObjectInfo * obj = load_pub_object(info->mSection, info->mID);
+        if (obj == NULL) str_exception(ERR_INV_DWARF, "Invalid public names entry");
+        info->mObject = obj;
+    }
+    return info->mObject;
+}
+
 static U2_T gop_gAttr = 0;
 static U2_T gop_gForm = 0;
 static U8_T gop_gFormData = 0;
@@ -1693,38 +3403,38 @@ void read_dwarf_object_property(Context * Ctx, int Frame, ObjectInfo * Obj, U2_T
         }
         else if (Obj->mTag == TAG_index_range) {
             if (Attr == AT_lower_bound) {
-                switch (Obj->u.mRange.mFmt) {
+                switch (Obj->u.mRange->mFmt) {
                 case FMT_FT_C_C:
                 case FMT_FT_C_X:
                 case FMT_UT_C_C:
                 case FMT_UT_C_X:
-                    Value->mValue = Obj->u.mRange.mLow.mValue;
+                    Value->mValue = Obj->u.mRange->mLow.mValue;
                     return;
                 case FMT_FT_X_C:
                 case FMT_FT_X_X:
                 case FMT_UT_X_C:
                 case FMT_UT_X_X:
                     Value->mForm = FORM_BLOCK2;
-                    Value->mAddr = Obj->u.mRange.mLow.mExpr.mAddr;
-                    Value->mSize = Obj->u.mRange.mLow.mExpr.mSize;
+                    Value->mAddr = Obj->u.mRange->mLow.mExpr.mAddr;
+                    Value->mSize = Obj->u.mRange->mLow.mExpr.mSize;
                     return;
                 }
             }
             if (Attr == AT_upper_bound) {
-                switch (Obj->u.mRange.mFmt) {
+                switch (Obj->u.mRange->mFmt) {
                 case FMT_FT_C_C:
                 case FMT_FT_X_C:
                 case FMT_UT_C_C:
                 case FMT_UT_X_C:
-                    Value->mValue = Obj->u.mRange.mHigh.mValue;
+                    Value->mValue = Obj->u.mRange->mHigh.mValue;
                     return;
                 case FMT_FT_C_X:
                 case FMT_FT_X_X:
                 case FMT_UT_C_X:
                 case FMT_UT_X_X:
                     Value->mForm = FORM_BLOCK2;
-                    Value->mAddr = Obj->u.mRange.mHigh.mExpr.mAddr;
-                    Value->mSize = Obj->u.mRange.mHigh.mExpr.mSize;
+                    Value->mAddr = Obj->u.mRange->mHigh.mExpr.mAddr;
+                    Value->mSize = Obj->u.mRange->mHigh.mExpr.mSize;
                     return;
                 }
             }
@@ -1838,7 +3548,7 @@ void read_dwarf_object_property(Context * Ctx, int Frame, ObjectInfo * Obj, U2_T
         if (errno) str_exception(errno, "Cannot get object run-time address");
         break;
     default:
-        if (Attr == AT_data_member_location && Obj->mTag == TAG_member && Obj->mParent->mTag == TAG_union_type) {
+        if (Attr == AT_data_member_location && Obj->mTag == TAG_member && dwarf_ref2obj(Obj->mParent)->mTag == TAG_union_type) {
             Value->mForm = FORM_UDATA;
             Value->mValue = 0;
             break;
@@ -1888,7 +3598,7 @@ void read_dwarf_object_property(Context * Ctx, int Frame, ObjectInfo * Obj, U2_T
                             ok = 0;
                         }
                     }
-                    c = c->mSibling;
+                    c = get_dwarf_sibling(c);
                 }
                 if (ok) {
                     Value->mForm = FORM_UDATA;
@@ -1971,6 +3681,13 @@ void read_and_evaluate_dwarf_object_property_with_args(
 }
 
 static void free_unit_cache(CompUnit * Unit) {
+    unsigned i;
+    if (Unit->mLineInfoLoaded) {
+        list_remove(&Unit->mLineInfoLink);
+        sLineInfoStatesCnt -= Unit->mStatesCnt;
+        Unit->mLineInfoLoaded = 0;
+    }
+
     Unit->mFilesCnt = 0;
     Unit->mFilesMax = 0;
     loc_free(Unit->mFiles);
@@ -1981,14 +3698,28 @@ static void free_unit_cache(CompUnit * Unit) {
     loc_free(Unit->mDirs);
     Unit->mDirs = NULL;
 
-    while (Unit->mStatesCnt > 0) {
-        loc_free(Unit->mStates[--Unit->mStatesCnt].mFileName);
-    }
-    loc_free(Unit->mStates);
+    loc_free(Unit->mStatesData);
+    loc_free(Unit->mStatesBlocks);
     loc_free(Unit->mStatesIndex);
-    Unit->mStates = NULL;
-    Unit->mStatesMax = 0;
+    loc_free(Unit->mStatesTextPos);
+    Unit->mStatesCnt = 0;
+    Unit->mStatesData = NULL;
+    Unit->mStatesBlocks = NULL;
     Unit->mStatesIndex = NULL;
+    Unit->mStatesTextPos = NULL;
+    for (i = 0; i < STATES_BLOCK_CACHE_SIZE; i++) {
+        if (sStatesBlockCache[i].mUnit == Unit) sStatesBlockCache[i].mUnit = NULL;
+    }
+}
+
+static void free_scope_index(CompUnit * unit) {
+    while (unit->mScopeIndex != NULL) {
+        UnitScopeIndex * index = unit->mScopeIndex;
+        unit->mScopeIndex = index->mNext;
+        loc_free(index->mIndex);
+        loc_free(index->mScopes);
+        loc_free(index);
+    }
 }
 
 static void free_dwarf_cache(ELF_File * file) {
@@ -2001,29 +3732,42 @@ static void free_dwarf_cache(ELF_File * file) {
             ObjectHashTable * Table = Cache->mObjectHashTable + i;
             while (Table->mCompUnits != NULL) {
                 CompUnit * Unit = Table->mCompUnits->mCompUnit;
-                Table->mCompUnits = Table->mCompUnits->mSibling;
+                Table->mCompUnits = get_dwarf_sibling(Table->mCompUnits);
                 free_unit_cache(Unit);
+                free_scope_index(Unit);
                 loc_free(Unit);
             }
             loc_free(Table->mObjectHash);
             loc_free(Table->mCompUnitsIndex);
         }
-        while (Cache->mObjectList != NULL) {
-            ObjectArray * Buf = Cache->mObjectList;
-            Cache->mObjectList = Buf->mNext;
-            loc_free(Buf);
+        for (i = 0; i < Cache->mObjectBlocksCnt; i++) {
+            U4_T Block = Cache->mObjectBlocks[i];
+            loc_free(dwarf_object_blocks[Block]);
+            dwarf_object_blocks[Block] = NULL;
+            sFreeObjectBlocks[sFreeObjectBlocksCnt++] = Block;
+        }
+        loc_free(Cache->mObjectBlocks);
+        while (Cache->mRangeList != NULL) {
+            ObjectRange * Range = Cache->mRangeList;
+            Cache->mRangeList = Range->mNext;
+            loc_free(Range);
         }
         while (Cache->mFrameInfo != NULL) {
             FrameInfoIndex * idx = Cache->mFrameInfo;
             Cache->mFrameInfo = idx->mNext;
-            loc_free(idx->mFrameInfoRanges);
-            loc_free(idx);
+            free_dwarf_frame_info_index(idx);
         }
         loc_free(Cache->mObjectHashTable);
         loc_free(Cache->mAddrRanges);
+        loc_free(Cache->mAddrRangesIndex);
         loc_free(Cache->mPubNames.mHash);
         loc_free(Cache->mPubNames.mNext);
-        loc_free(Cache->mFileInfoHash);
+#if ENABLE_DWARF_NAME_INDEX
+        free_name_index(Cache->mNameIndex);
+#endif
+        loc_free(Cache->mFileRefs);
+        loc_free(Cache->mFileRefsHash);
+        free_string_pool(Cache->mStringPool);
         loc_free(Cache->mTypeUnitHash);
         loc_free(Cache);
         file->dwarf_dt_cache = NULL;
@@ -2049,7 +3793,7 @@ DWARFCache * get_dwarf_cache(ELF_File * file) {
         sCache = Cache = (DWARFCache *)(file->dwarf_dt_cache = loc_alloc_zero(sizeof(DWARFCache)));
         sCache->magic = DWARF_CACHE_MAGIC;
         sCache->mFile = file;
-        sCache->mObjectArrayPos = OBJECT_ARRAY_SIZE;
+        sCache->mObjectBlockPos = OBJECT_BLOCK_SIZE;
         sCache->mObjectHashTable = (ObjectHashTable *)loc_alloc_zero(sizeof(ObjectHashTable) * file->section_cnt);
         if (set_trap(&trap)) {
             dio_LoadAbbrevTable(file);
@@ -2068,19 +3812,21 @@ DWARFCache * get_dwarf_cache(ELF_File * file) {
 static void add_dir(CompUnit * unit, char * name) {
     if (unit->mDirsCnt >= unit->mDirsMax) {
         unit->mDirsMax = unit->mDirsMax == 0 ? 16 : unit->mDirsMax * 2;
-        unit->mDirs = (char **)loc_realloc(unit->mDirs, sizeof(char *) * unit->mDirsMax);
+        unit->mDirs = (const char **)loc_realloc(unit->mDirs, sizeof(char *) * unit->mDirsMax);
     }
-    unit->mDirs[unit->mDirsCnt++] = name;
+    unit->mDirs[unit->mDirsCnt++] = intern_dwarf_string((DWARFCache *)unit->mFile->dwarf_dt_cache, name);
 }
 
 static void add_file(FileInfo * file) {
     CompUnit * unit = file->mCompUnit;
-    file->mNameHash = calc_file_name_hash(file->mName);
+    DWARFCache * cache = (DWARFCache *)unit->mFile->dwarf_dt_cache;
+    file->mName = intern_dwarf_string(cache, file->mName);
+    file->mNameHash = get_interned_file_name_hash(file->mName);
     if (unit->mFilesCnt >= unit->mFilesMax) {
         unit->mFilesMax = unit->mFilesMax == 0 ? 16 : unit->mFilesMax * 2;
         unit->mFiles = (FileInfo *)loc_realloc(unit->mFiles, sizeof(FileInfo) * unit->mFilesMax);
     }
-    if (file->mDir == NULL) file->mDir = unit->mDir;
+    file->mDir = intern_dwarf_string(cache, file->mDir != NULL ? file->mDir : unit->mDir);
     unit->mFiles[unit->mFilesCnt++] = *file;
 }
 
@@ -2102,11 +3848,11 @@ static void add_state(CompUnit * unit, LineNumbersState * state) {
         s.mAddress = state->mAddress;
         add_state(unit, &s);
     }
-    if (unit->mStatesCnt > 0) {
+    if (sStatesCnt > 0) {
         /* Workaround: malformed gnu-8.1.0.0 line info when -gstatement-frontiers is used.
          * See https://bugs.eclipse.org/bugs/show_bug.cgi?id=544359
          */
-        LineNumbersState * last = unit->mStates + unit->mStatesCnt - 1;
+        LineNumbersState * last = sStates + sStatesCnt - 1;
         if (last->mAddress == state->mAddress && last->mSection == state->mSection &&
             last->mFile == state->mFile && last->mLine == state->mLine && last->mColumn == state->mColumn &&
             (last->mFlags & ~(LINE_IsStmt | LINE_BasicBlock)) == state->mFlags) {
@@ -2116,11 +3862,11 @@ static void add_state(CompUnit * unit, LineNumbersState * state) {
             return;
         }
     }
-    if (unit->mStatesCnt >= unit->mStatesMax) {
-        unit->mStatesMax = unit->mStatesMax == 0 ? 128 : unit->mStatesMax * 2;
-        unit->mStates = (LineNumbersState *)loc_realloc(unit->mStates, sizeof(LineNumbersState) * unit->mStatesMax);
+    if (sStatesCnt >= sStatesMax) {
+        sStatesMax = sStatesMax == 0 ? 128 : sStatesMax * 2;
+        sStates = (LineNumbersState *)loc_realloc(sStates, sizeof(LineNumbersState) * sStatesMax);
     }
-    unit->mStates[unit->mStatesCnt++] = *state;
+    sStates[sStatesCnt++] = *state;
 }
 
 static int state_address_comparator(const void * x1, const void * x2) {
@@ -2143,8 +3889,8 @@ static int state_address_comparator(const void * x1, const void * x2) {
 }
 
 static int state_text_pos_comparator(const void * x1, const void * x2) {
-    LineNumbersState * s1 = *(LineNumbersState **)x1;
-    LineNumbersState * s2 = *(LineNumbersState **)x2;
+    LineNumbersState * s1 = sStates + *(U4_T *)x1;
+    LineNumbersState * s2 = sStates + *(U4_T *)x2;
     if (s1->mFile < s2->mFile) return -1;
     if (s1->mFile > s2->mFile) return +1;
     if (s1->mLine < s2->mLine) return -1;
@@ -2158,49 +3904,203 @@ static int state_text_pos_comparator(const void * x1, const void * x2) {
     return 0;
 }
 
-static void compute_reverse_lookup_indices(DWARFCache * Cache, CompUnit * Unit) {
+static void write_states_byte(U1_T x) {
+    if (sStatesBufSize >= sStatesBufMax) {
+        sStatesBufMax = sStatesBufMax == 0 ? 0x1000 : sStatesBufMax * 2;
+        sStatesBuf = (U1_T *)loc_realloc(sStatesBuf, sStatesBufMax);
+    }
+    sStatesBuf[sStatesBufSize++] = x;
+}
+
+static void write_states_uleb(U8_T x) {
+    while (x >= 0x80) {
+        write_states_byte((U1_T)(x | 0x80));
+        x >>= 7;
+    }
+    write_states_byte((U1_T)x);
+}
+
+static void write_states_sleb(I8_T x) {
+    for (;;) {
+        U1_T b = (U1_T)(x & 0x7f);
+        x >>= 7;
+        if ((x == 0 && (b & 0x40) == 0) || (x == -1 && (b & 0x40) != 0)) {
+            write_states_byte(b);
+            break;
+        }
+        write_states_byte((U1_T)(b | 0x80));
+    }
+}
+
+static U8_T read_states_uleb(U1_T ** buf) {
+    U1_T * p = *buf;
+    U8_T res = 0;
+    int i = 0;
+    for (;; i += 7) {
+        U1_T n = *p++;
+        res |= (U8_T)(n & 0x7Fu) << i;
+        if ((n & 0x80) == 0) break;
+    }
+    *buf = p;
+    return res;
+}
+
+static I8_T read_states_sleb(U1_T ** buf) {
+    U1_T * p = *buf;
+    U8_T res = 0;
+    int i = 0;
+    for (;;) {
+        U1_T n = *p++;
+        res |= (U8_T)(n & 0x7Fu) << i;
+        i += 7;
+        if ((n & 0x80) == 0) {
+            if ((n & 0x40) != 0 && i < 64) res |= ~(U8_T)0 << i;
+            break;
+        }
+    }
+    *buf = p;
+    return (I8_T)res;
+}
+
+/* Row encoding: a byte of LINE_* flags and LINE_ENC_* bits, followed by changed fields */
+#define LINE_ENC_FileColumn 0x20
+#define LINE_ENC_Extra      0x40
+
+static void encode_line_numbers(CompUnit * Unit) {
+    U4_T i;
+    LineNumbersState prev;
+    U4_T blocks_cnt = (sStatesCnt + LINE_NUMBERS_BLOCK_SIZE - 1) / LINE_NUMBERS_BLOCK_SIZE;
+
+    memset(&prev, 0, sizeof(prev));
+    sStatesBufSize = 0;
+    Unit->mStatesBlocks = (LineNumbersBlock *)loc_alloc(sizeof(LineNumbersBlock) * (blocks_cnt + 1));
+    for (i = 0; i < sStatesCnt; i++) {
+        LineNumbersState * state = sStates + i;
+        U1_T flags = state->mFlags;
+        assert((flags & (LINE_ENC_FileColumn | LINE_ENC_Extra)) == 0);
+        if (i % LINE_NUMBERS_BLOCK_SIZE == 0) {
+            LineNumbersBlock * block = Unit->mStatesBlocks + i / LINE_NUMBERS_BLOCK_SIZE;
+            block->mAddress = state->mAddress;
+            block->mSection = state->mSection;
+            block->mOffs = (U4_T)sStatesBufSize;
+            memset(&prev, 0, sizeof(prev));
+            prev.mAddress = state->mAddress;
+            prev.mSection = state->mSection;
+        }
+        if (state->mFile != prev.mFile || state->mColumn != prev.mColumn) flags |= LINE_ENC_FileColumn;
+        if (state->mSection != prev.mSection || state->mISA != prev.mISA ||
+            state->mOpIndex != prev.mOpIndex || state->mDiscriminator != prev.mDiscriminator) flags |= LINE_ENC_Extra;
+        write_states_byte(flags);
+        if (flags & LINE_ENC_Extra) {
+            write_states_uleb(state->mSection);
+            write_states_byte(state->mISA);
+            write_states_byte(state->mOpIndex);
+            write_states_byte(state->mDiscriminator);
+        }
+        if (flags & LINE_ENC_FileColumn) {
+            write_states_uleb(state->mFile);
+            write_states_uleb(state->mColumn);
+        }
+        if (state->mSection != prev.mSection) write_states_uleb(state->mAddress);
+        else write_states_uleb(state->mAddress - prev.mAddress);
+        write_states_sleb((I4_T)(state->mLine - prev.mLine));
+        write_states_sleb((I8_T)state->mStatesIndexPos - (I8_T)prev.mStatesIndexPos);
+        prev = *state;
+    }
+    Unit->mStatesData = (U1_T *)loc_alloc(sStatesBufSize + 1);
+    memcpy(Unit->mStatesData, sStatesBuf, sStatesBufSize);
+    Unit->mStatesCnt = sStatesCnt;
+    if (sStatesBufMax > 0x100000) {
+        /* Don't keep large buffers */
+        loc_free(sStatesBuf);
+        sStatesBuf = NULL;
+        sStatesBufMax = 0;
+    }
+}
+
+/* Decode rows of the block up to row 'cnt', rows are decoded only as far as needed */
+static void decode_line_numbers_block(StatesBlockCache * c, U4_T cnt) {
+    U1_T * buf = c->mData;
+    while (c->mCnt < cnt) {
+        U1_T flags = *buf++;
+        LineNumbersState * state = c->mStates + c->mCnt;
+        if (c->mCnt > 0) {
+            *state = *(state - 1);
+        }
+        else {
+            LineNumbersBlock * block = c->mUnit->mStatesBlocks + c->mBlockPos;
+            memset(state, 0, sizeof(LineNumbersState));
+            state->mAddress = block->mAddress;
+            state->mSection = block->mSection;
+        }
+        state->mStatesPos = c->mBlockPos * LINE_NUMBERS_BLOCK_SIZE + c->mCnt;
+        state->mFlags = flags & ~(LINE_ENC_FileColumn | LINE_ENC_Extra);
+        if (flags & LINE_ENC_Extra) {
+            U4_T section = state->mSection;
+            state->mSection = (U4_T)read_states_uleb(&buf);
+            state->mISA = *buf++;
+            state->mOpIndex = *buf++;
+            state->mDiscriminator = *buf++;
+            if (state->mSection != section) state->mAddress = 0;
+        }
+        if (flags & LINE_ENC_FileColumn) {
+            state->mFile = (U4_T)read_states_uleb(&buf);
+            state->mColumn = (U2_T)read_states_uleb(&buf);
+        }
+        state->mAddress += (ContextAddress)read_states_uleb(&buf);
+        state->mLine += (U4_T)read_states_sleb(&buf);
+        state->mStatesIndexPos += (U4_T)read_states_sleb(&buf);
+        c->mCnt++;
+    }
+    c->mData = buf;
+}
+
+void get_line_numbers_state(CompUnit * Unit, U4_T pos, LineNumbersState * state) {
+    U4_T block_pos = pos / LINE_NUMBERS_BLOCK_SIZE;
+    U4_T block_row = pos % LINE_NUMBERS_BLOCK_SIZE;
+    StatesBlockCache * c = sStatesBlockCache + block_pos % STATES_BLOCK_CACHE_SIZE;
+    assert(pos < Unit->mStatesCnt);
+    if (c->mUnit != Unit || c->mBlockPos != block_pos) {
+        c->mUnit = Unit;
+        c->mBlockPos = block_pos;
+        c->mCnt = 0;
+        c->mData = Unit->mStatesData + Unit->mStatesBlocks[block_pos].mOffs;
+    }
+    if (c->mCnt <= block_row) decode_line_numbers_block(c, block_row + 1);
+    *state = c->mStates[block_row];
+}
+
+static void compute_reverse_lookup_indices(CompUnit * Unit) {
     U4_T i;
-    qsort(Unit->mStates, Unit->mStatesCnt, sizeof(LineNumbersState), state_address_comparator);
-    Unit->mStatesIndex = (LineNumbersState **)loc_alloc(sizeof(LineNumbersState *) * Unit->mStatesCnt);
-    for (i = 0; i < Unit->mStatesCnt; i++) {
-        LineNumbersState * s1 = Unit->mStates + i;
-        while (i + 1 < Unit->mStatesCnt) {
+    qsort(sStates, sStatesCnt, sizeof(LineNumbersState), state_address_comparator);
+    Unit->mStatesIndex = (U4_T *)loc_alloc(sizeof(U4_T) * (sStatesCnt + 1));
+    for (i = 0; i < sStatesCnt; i++) {
+        LineNumbersState * s1 = sStates + i;
+        while (i + 1 < sStatesCnt) {
             LineNumbersState * s2 = s1 + 1;
             if (s1->mFile != s2->mFile ||
                 s1->mLine != s2->mLine || s1->mColumn != s2->mColumn ||
                 s1->mFlags != s2->mFlags || s1->mISA != s2->mISA ||
                 s1->mOpIndex != s2->mOpIndex || s1->mDiscriminator != s2->mDiscriminator) break;
-            memmove(s2, s2 + 1, sizeof(LineNumbersState) * (Unit->mStatesCnt - i - 2));
-            Unit->mStatesCnt--;
+            memmove(s2, s2 + 1, sizeof(LineNumbersState) * (sStatesCnt - i - 2));
+            sStatesCnt--;
         }
-        Unit->mStatesIndex[i] = s1;
+        Unit->mStatesIndex[i] = i;
     }
-    qsort(Unit->mStatesIndex, Unit->mStatesCnt, sizeof(LineNumbersState *), state_text_pos_comparator);
-    for (i = 0; i < Unit->mStatesCnt; i++) Unit->mStatesIndex[i]->mStatesIndexPos = i;
-    if (Cache->mFileInfoHash == NULL) {
-        Cache->mFileInfoHashSize = 251;
-        Cache->mFileInfoHash = (FileInfo **)loc_alloc_zero(sizeof(FileInfo *) * Cache->mFileInfoHashSize);
-    }
-    for (i = 0; i < Unit->mFilesCnt; i++) {
-        FileInfo * file = Unit->mFiles + i;
-        unsigned h = file->mNameHash % Cache->mFileInfoHashSize;
-        FileInfo * list = Cache->mFileInfoHash[h];
-        assert(file->mCompUnit == Unit);
-        if (file->mAreaCnt == 0) continue;
-        /* Check for duplicate entries */
-        while (list != NULL) {
-            assert(h == list->mNameHash % Cache->mFileInfoHashSize);
-            if (file->mNameHash == list->mNameHash && file->mCompUnit == list->mCompUnit && strcmp(file->mName, list->mName) == 0) {
-                if (file->mDir && list->mDir && strcmp(file->mDir, list->mDir) == 0) break;
-                if (file->mDir == list->mDir) break;
-            }
-            list = list->mNextInHash;
-        }
-        if (list == NULL) {
-            file->mNextInHash = Cache->mFileInfoHash[h];
-            Cache->mFileInfoHash[h] = file;
+    qsort(Unit->mStatesIndex, sStatesCnt, sizeof(U4_T), state_text_pos_comparator);
+    Unit->mStatesTextPos = (LineNumbersTextPos *)loc_alloc(sizeof(LineNumbersTextPos) *
+        ((sStatesCnt + LINE_NUMBERS_BLOCK_SIZE - 1) / LINE_NUMBERS_BLOCK_SIZE + 1));
+    for (i = 0; i < sStatesCnt; i++) {
+        LineNumbersState * state = sStates + Unit->mStatesIndex[i];
+        state->mStatesIndexPos = i;
+        if (i % LINE_NUMBERS_BLOCK_SIZE == 0) {
+            LineNumbersTextPos * pos = Unit->mStatesTextPos + i / LINE_NUMBERS_BLOCK_SIZE;
+            pos->mFile = state->mFile;
+            pos->mLine = state->mLine;
+            pos->mColumn = state->mColumn;
         }
     }
+    encode_line_numbers(Unit);
 }
 
 static void load_line_numbers_v1(CompUnit * Unit, U4_T unit_size) {
@@ -2387,14 +4287,156 @@ static void load_line_numbers_v2(CompUnit * Unit, U8_T unit_size, int dwarf64) {
     }
 }
 
+static void line_numbers_cleanup_event(void * args) {
+    LINK * l = sLineInfoLRU.prev;
+    int busy = 0;
+    sLineInfoCleanupPosted = 0;
+    while (sLineInfoStatesCnt > DWARF_LINE_INFO_CACHE_SIZE && l != &sLineInfoLRU) {
+        CompUnit * Unit = lru2unit(l);
+        l = l->prev;
+        if (Unit->mLineInfoUsed == sLineInfoCycle) {
+            /* The rest of the list was used since last cleanup */
+            busy = 1;
+            break;
+        }
+        if (Unit->mFile->lock_cnt > 0) continue;
+        free_unit_cache(Unit);
+    }
+    sLineInfoCycle++;
+    if (busy) {
+        post_event_with_delay(line_numbers_cleanup_event, NULL, 1000000);
+        sLineInfoCleanupPosted = 1;
+    }
+}
+
+static void add_file_ref(DWARFCache * Cache, CompUnit * Unit, const char * name, const char * dir) {
+    FileNameRef * ref = NULL;
+    if (Cache->mFileRefsCnt >= Cache->mFileRefsMax) {
+        Cache->mFileRefsMax = Cache->mFileRefsMax == 0 ? 256 : Cache->mFileRefsMax * 2;
+        Cache->mFileRefs = (FileNameRef *)loc_realloc(Cache->mFileRefs, sizeof(FileNameRef) * Cache->mFileRefsMax);
+    }
+    ref = Cache->mFileRefs + Cache->mFileRefsCnt++;
+    memset(ref, 0, sizeof(FileNameRef));
+    /* Same names as add_file() creates, so the index matches line info when it is loaded */
+    ref->mName = intern_dwarf_string(Cache, name);
+    ref->mDir = intern_dwarf_string(Cache, dir != NULL ? dir : Unit->mDir);
+    ref->mNameHash = get_interned_file_name_hash(ref->mName);
+    ref->mCompUnit = Unit;
+    ref->mFile = Unit->mFileRefsCnt++;
+}
+
+static void link_file_ref(DWARFCache * Cache, unsigned pos) {
+    FileNameRef * ref = Cache->mFileRefs + pos;
+    unsigned h = ref->mNameHash % Cache->mFileRefsHashSize;
+    ref->mNext = Cache->mFileRefsHash[h];
+    Cache->mFileRefsHash[h] = pos + 1;
+}
+
+static void load_unit_file_refs(DWARFCache * Cache, CompUnit * Unit) {
+    Trap trap;
+    ELF_Section * LineInfoSection = Unit->mLineInfoSection;
+    if (LineInfoSection == NULL) LineInfoSection = Unit->mDesc.mVersion <= 1 ? Cache->mDebugLineV1 : Cache->mDebugLineV2;
+    if (LineInfoSection == NULL) return;
+    /* File 0 is the unit source file, see load_line_numbers() */
+    add_file_ref(Cache, Unit, Unit->mObject->mName, Unit->mDir);
+    if (Unit->mDesc.mVersion <= 1) return;
+    if (elf_load(LineInfoSection)) exception(errno);
+    dio_EnterSection(&Unit->mDesc, LineInfoSection, Unit->mLineInfoOffs);
+    if (set_trap(&trap)) {
+        static const char ** dirs = NULL;
+        static U4_T dirs_max = 0;
+        U4_T dirs_cnt = 0;
+        U2_T version = 0;
+        U1_T opcode_base = 0;
+        int dwarf64 = 0;
+        if (dio_ReadU4() == 0xffffffffu) {
+            dio_ReadU8();
+            dwarf64 = 1;
+        }
+        version = dio_ReadU2();
+        if (version < 2 || version > 4) str_exception(ERR_INV_DWARF, "Invalid line number info version");
+        if (dwarf64) dio_ReadU8();
+        else dio_ReadU4();
+        /* Skip minimum_instruction_length, maximum_operations_per_instruction, default_is_stmt, line_base, line_range */
+        dio_Skip(version >= 4 ? 5 : 4);
+        opcode_base = dio_ReadU1();
+        if (opcode_base > 1) dio_Skip(opcode_base - 1);
+        for (;;) {
+            char * name = dio_ReadString();
+            if (name == NULL) break;
+            if (dirs_cnt >= dirs_max) {
+                dirs_max = dirs_max == 0 ? 16 : dirs_max * 2;
+                dirs = (const char **)loc_realloc((void *)dirs, sizeof(char *) * dirs_max);
+            }
+            dirs[dirs_cnt++] = name;
+        }
+        for (;;) {
+            U4_T dir = 0;
+            char * name = dio_ReadString();
+            if (name == NULL) break;
+            dir = dio_ReadULEB128();
+            dio_ReadULEB128();
+            dio_ReadULEB128();
+            add_file_ref(Cache, Unit, name, dir > 0 && dir <= dirs_cnt ? dirs[dir - 1] : NULL);
+        }
+        dio_ExitSection();
+        clear_trap(&trap);
+    }
+    else {
+        dio_ExitSection();
+        exception(trap.error);
+    }
+}
+
+void load_file_name_index(DWARFCache * Cache) {
+    Trap trap;
+    unsigned i;
+    if (Cache->mFileRefsHash != NULL) return;
+    if (set_trap(&trap)) {
+        for (i = 0; i < Cache->mFile->section_cnt; i++) {
+            ObjectInfo * info = Cache->mObjectHashTable[i].mCompUnits;
+            while (info != NULL) {
+                CompUnit * Unit = info->mCompUnit;
+                if (Unit->mLineInfoLoaded) {
+                    U4_T j;
+                    for (j = 0; j < Unit->mFilesCnt; j++) {
+                        add_file_ref(Cache, Unit, Unit->mFiles[j].mName, Unit->mFiles[j].mDir);
+                    }
+                }
+                else {
+                    load_unit_file_refs(Cache, Unit);
+                }
+                info = get_dwarf_sibling(info);
+            }
+        }
+        clear_trap(&trap);
+    }
+    else {
+        for (i = 0; i < Cache->mFileRefsCnt; i++) Cache->mFileRefs[i].mCompUnit->mFileRefsCnt = 0;
+        Cache->mFileRefsCnt = 0;
+        exception(trap.error);
+    }
+    Cache->mFileRefsHashSize = Cache->mFileRefsCnt / 2 + 251;
+    Cache->mFileRefsHash = (unsigned *)loc_alloc_zero(sizeof(unsigned) * Cache->mFileRefsHashSize);
+    for (i = 0; i < Cache->mFileRefsCnt; i++) link_file_ref(Cache, i);
+}
+
 void load_line_numbers(CompUnit * Unit) {
     Trap trap;
     DWARFCache * Cache = (DWARFCache *)Unit->mFile->dwarf_dt_cache;
     ELF_Section * LineInfoSection = Unit->mLineInfoSection;
     if (LineInfoSection == NULL) LineInfoSection = Unit->mDesc.mVersion <= 1 ? Cache->mDebugLineV1 : Cache->mDebugLineV2;
     if (LineInfoSection == NULL) return;
-    if (Unit->mLineInfoLoaded) return;
+    Unit->mLineInfoUsed = sLineInfoCycle;
+    if (Unit->mLineInfoLoaded) {
+        if (sLineInfoLRU.next != &Unit->mLineInfoLink) {
+            list_remove(&Unit->mLineInfoLink);
+            list_add_first(&Unit->mLineInfoLink, &sLineInfoLRU);
+        }
+        return;
+    }
     if (elf_load(LineInfoSection)) exception(errno);
+    sStatesCnt = 0;
     dio_EnterSection(&Unit->mDesc, LineInfoSection, Unit->mLineInfoOffs);
     if (set_trap(&trap)) {
         U8_T unit_size = 0;
@@ -2424,8 +4466,23 @@ void load_line_numbers(CompUnit * Unit) {
             load_line_numbers_v2(Unit, unit_size, dwarf64);
         }
         dio_ExitSection();
-        compute_reverse_lookup_indices(Cache, Unit);
+        compute_reverse_lookup_indices(Unit);
+        if (Cache->mFileRefsHash != NULL && Unit->mFilesCnt > Unit->mFileRefsCnt) {
+            /* Files defined by DW_LNE_define_file are not listed in the line info header */
+            U4_T i;
+            for (i = Unit->mFileRefsCnt; i < Unit->mFilesCnt; i++) {
+                FileInfo * file = Unit->mFiles + i;
+                add_file_ref(Cache, Unit, file->mName, file->mDir);
+                link_file_ref(Cache, Cache->mFileRefsCnt - 1);
+            }
+        }
         Unit->mLineInfoLoaded = 1;
+        list_add_first(&Unit->mLineInfoLink, &sLineInfoLRU);
+        sLineInfoStatesCnt += Unit->mStatesCnt;
+        if (sLineInfoStatesCnt > DWARF_LINE_INFO_CACHE_SIZE && !sLineInfoCleanupPosted) {
+            post_event_with_delay(line_numbers_cleanup_event, NULL, 1000000);
+            sLineInfoCleanupPosted = 1;
+        }
         clear_trap(&trap);
     }
     else {
@@ -2437,8 +4494,8 @@ void load_line_numbers(CompUnit * Unit) {
 
 UnitAddressRange * find_comp_unit_addr_range(DWARFCache * cache, ELF_Section * section,
                                              ContextAddress addr_min, ContextAddress addr_max) {
-    unsigned l = 0;
-    unsigned h = cache->mAddrRangesCnt;
+    unsigned k = 0;
+    unsigned n = cache->mAddrRangesCnt;
     U4_T s = 0;
 
     if (cache->mAddrRangesRelocatable && section != NULL) {
@@ -2459,27 +4516,205 @@ UnitAddressRange * find_comp_unit_addr_range(DWARFCache * cache, ELF_Section * s
         }
     }
 
-    while (l < h) {
-        unsigned k = (h + l) / 2;
+    if (n == 0) return NULL;
+
+    /* Ranges before the first one with prefix maximum of last addresses >= 'addr_min' end below 'addr_min' */
+    if (addr_min > 0) k = search_addr_index(cache->mAddrRangesIndex, n, addr_min - 1);
+    for (; k < n; k++) {
         UnitAddressRange * rk = cache->mAddrRanges + k;
-        if (rk->mAddr > addr_max) h = k;
-        else if (rk->mAddr + cache->mAddrRangesMaxSize <= addr_min) l = k + 1;
-        else {
-            for (; k > 0; k--) {
-                rk = cache->mAddrRanges + k - 1;
-                if (rk->mAddr + cache->mAddrRangesMaxSize <= addr_min) break;
-            }
-            for (; k < h; k++) {
-                rk = cache->mAddrRanges + k;
-                if (rk->mAddr > addr_max) break;
-                if (rk->mAddr + rk->mSize <= addr_min) continue;
-                if (rk->mSection && s && rk->mSection != s) continue;
-                return rk;
+        if (rk->mAddr > addr_max) break;
+        if (rk->mAddr + rk->mSize <= addr_min) continue;
+        if (rk->mSection && s && rk->mSection != s) continue;
+        return rk;
+    }
+    return NULL;
+}
+
+typedef struct ScopeRange {
+    U8_T mAddr;
+    U8_T mEnd;
+    ObjectInfo * mObject;
+} ScopeRange;
+
+static ScopeRange * scope_ranges = NULL;
+static unsigned scope_ranges_cnt = 0;
+static unsigned scope_ranges_max = 0;
+
+static void add_scope_range(ObjectInfo * obj, U8_T addr, U8_T end) {
+    ScopeRange * r = NULL;
+    if (addr >= end) return;
+    if (scope_ranges_cnt >= scope_ranges_max) {
+        scope_ranges_max = scope_ranges_max == 0 ? 256 : scope_ranges_max * 2;
+        scope_ranges = (ScopeRange *)loc_realloc(scope_ranges, sizeof(ScopeRange) * scope_ranges_max);
+    }
+    r = scope_ranges + scope_ranges_cnt++;
+    r->mAddr = addr;
+    r->mEnd = end;
+    r->mObject = obj;
+}
+
+static int check_scope_section(CompUnit * unit, ELF_Section * sec_obj, ELF_Section * sec_addr) {
+    if (sec_obj == NULL) sec_obj = unit->mTextSection;
+    if (sec_obj == NULL) return 1;
+    if (sec_addr == NULL) return 1;
+    return sec_obj == sec_addr;
+}
+
+/* Add address ranges of a scope that match section 'sec', same as dwarf_check_in_range() does */
+static void add_scope_ranges(ObjectInfo * obj, ELF_Section * sec) {
+    CompUnit * unit = obj->mCompUnit;
+    if (obj->mFlags & DOIF_ranges) {
+        Trap trap;
+        if (set_trap(&trap)) {
+            DWARFCache * cache = get_dwarf_cache(unit->mFile);
+            ELF_Section * debug_ranges = cache->mDebugRanges;
+            if (debug_ranges != NULL) {
+                ContextAddress base = unit->mObject->u.mCode.mLowPC;
+                dio_EnterSection(&unit->mDesc, debug_ranges, obj->u.mCode.mHighPC.mRanges);
+                for (;;) {
+                    U8_T AddrMax = ~(U8_T)0;
+                    ELF_Section * x_sec = NULL;
+                    ELF_Section * y_sec = NULL;
+                    U8_T x = dio_ReadAddress(&x_sec);
+                    U8_T y = dio_ReadAddress(&y_sec);
+                    if (x == 0 && y == 0) break;
+                    if (unit->mDesc.mAddressSize < 8) AddrMax = ((U8_T)1 << unit->mDesc.mAddressSize * 8) - 1;
+                    if (x == AddrMax) {
+                        base = (ContextAddress)y;
+                    }
+                    else if (check_scope_section(unit, x_sec, sec) && check_scope_section(unit, y_sec, sec)) {
+                        add_scope_range(obj, base + x, base + y);
+                    }
+                }
+                dio_ExitSection();
             }
+            clear_trap(&trap);
+        }
+        return;
+    }
+    if (obj->u.mCode.mHighPC.mAddr > obj->u.mCode.mLowPC && check_scope_section(unit, obj->u.mCode.mSection, sec)) {
+        add_scope_range(obj, obj->u.mCode.mLowPC, obj->u.mCode.mHighPC.mAddr);
+    }
+}
+
+static void add_scope_tree_ranges(ObjectInfo * parent, ELF_Section * sec) {
+    ObjectInfo * obj = get_dwarf_children(parent);
+    while (obj != NULL) {
+        switch (obj->mTag) {
+        case TAG_namespace:
+        case TAG_compile_unit:
+        case TAG_partial_unit:
+        case TAG_module:
+        case TAG_global_subroutine:
+        case TAG_inlined_subroutine:
+        case TAG_lexical_block:
+        case TAG_with_stmt:
+        case TAG_try_block:
+        case TAG_catch_block:
+        case TAG_subroutine:
+        case TAG_subprogram:
+            add_scope_ranges(obj, sec);
+            add_scope_tree_ranges(obj, sec);
             break;
         }
+        obj = get_dwarf_sibling(obj);
     }
-    return NULL;
+}
+
+static int scope_addr_comparator(const void * x, const void * y) {
+    U8_T ax = *(const U8_T *)x;
+    U8_T ay = *(const U8_T *)y;
+    if (ax < ay) return -1;
+    if (ax > ay) return +1;
+    return 0;
+}
+
+static unsigned find_scope_addr(const U8_T * keys, unsigned n, U8_T addr) {
+    unsigned l = 0;
+    unsigned h = n;
+    while (l < h) {
+        unsigned k = (h + l) / 2;
+        if (keys[k] < addr) l = k + 1;
+        else h = k;
+    }
+    assert(l < n && keys[l] == addr);
+    return l;
+}
+
+static unsigned find_unassigned_scope(unsigned * next, unsigned pos) {
+    unsigned res = pos;
+    while (next[res] != res) res = next[res];
+    while (next[pos] != res) {
+        unsigned nxt = next[pos];
+        next[pos] = res;
+        pos = nxt;
+    }
+    return res;
+}
+
+static void create_scope_index(CompUnit * unit, UnitScopeIndex * index) {
+    unsigned i;
+    unsigned n = 0;
+    U8_T * keys = NULL;
+    unsigned * next = NULL;
+
+    scope_ranges_cnt = 0;
+    add_scope_tree_ranges(unit->mObject, index->mSection);
+    if (scope_ranges_cnt == 0) return;
+
+    keys = (U8_T *)loc_alloc(sizeof(U8_T) * scope_ranges_cnt * 2);
+    for (i = 0; i < scope_ranges_cnt; i++) {
+        keys[n++] = scope_ranges[i].mAddr;
+        keys[n++] = scope_ranges[i].mEnd;
+    }
+    qsort(keys, n, sizeof(U8_T), scope_addr_comparator);
+    for (i = 1, index->mCnt = 1; i < n; i++) {
+        if (keys[i] != keys[index->mCnt - 1]) keys[index->mCnt++] = keys[i];
+    }
+
+    /* Scope ranges are in DWARF tree order, first scope that covers an interval between boundaries wins */
+    index->mScopes = (ObjectInfo **)loc_alloc_zero(sizeof(ObjectInfo *) * index->mCnt);
+    next = (unsigned *)loc_alloc(sizeof(unsigned) * index->mCnt);
+    for (i = 0; i < index->mCnt; i++) next[i] = i;
+    for (i = 0; i < scope_ranges_cnt; i++) {
+        ScopeRange * r = scope_ranges + i;
+        unsigned end = find_scope_addr(keys, index->mCnt, r->mEnd);
+        unsigned pos = find_unassigned_scope(next, find_scope_addr(keys, index->mCnt, r->mAddr));
+        while (pos < end) {
+            index->mScopes[pos] = r->mObject;
+            next[pos] = pos + 1;
+            pos = find_unassigned_scope(next, pos + 1);
+        }
+    }
+    index->mIndex = create_addr_index(keys, index->mCnt);
+    loc_free(next);
+    loc_free(keys);
+}
+
+ObjectInfo * find_comp_unit_scope(CompUnit * unit, ELF_Section * section, ContextAddress addr) {
+    unsigned pos = 0;
+    UnitScopeIndex * index = unit->mScopeIndex;
+
+    while (index != NULL && index->mSection != section) index = index->mNext;
+    if (index == NULL) {
+        Trap trap;
+        index = (UnitScopeIndex *)loc_alloc_zero(sizeof(UnitScopeIndex));
+        index->mSection = section;
+        index->mNext = unit->mScopeIndex;
+        unit->mScopeIndex = index;
+        if (set_trap(&trap)) {
+            create_scope_index(unit, index);
+            clear_trap(&trap);
+        }
+        else {
+            /* Leave the index empty, callers fall back to searching the object tree */
+            trace(LOG_ELF, "Cannot create scope index of DWARF unit: %s", errno_to_str(trap.error));
+        }
+    }
+    if (index->mCnt == 0) return NULL;
+    pos = search_addr_index(index->mIndex, index->mCnt, addr);
+    if (pos == 0) return NULL;
+    return index->mScopes[pos - 1];
 }
 
 #endif /* ENABLE_ELF && ENABLE_DebugContext */
@@ -29,6 +29,7 @@
 #if ENABLE_ELF && ENABLE_DebugContext
 
 #include <tcf/framework/errors.h>
+#include <tcf/framework/link.h>
 #include <tcf/services/tcf_elf.h>
 #include <tcf/services/dwarfio.h>
 #include <tcf/services/symbols.h>
@@ -37,19 +38,70 @@
 #  define ENABLE_DWARF_LAZY_LOAD 1
 #endif
 
+#if ENABLE_DWARF_LAZY_LOAD
+/*
+ * Minimal size of a debug info section for lazy loading.
+ * For a section this size or larger, only compilation unit entries, address ranges and
+ * public names index are loaded up front. Other debug info entries are loaded on demand.
+ */
+#  ifndef DWARF_LAZY_LOAD_MIN_SIZE
+#    define DWARF_LAZY_LOAD_MIN_SIZE 0x40000
+#  endif
+#endif
+
+#if ENABLE_DWARF_LAZY_LOAD
+/*
+ * If a file has .debug_names or .gdb_index section, public names of lazily loaded units
+ * that are covered by the index are not collected up front, the index is searched on demand instead.
+ */
+#  ifndef ENABLE_DWARF_NAME_INDEX
+#    define ENABLE_DWARF_NAME_INDEX 1
+#  endif
+#endif
+
+#if ENABLE_DWARF_LAZY_LOAD && ENABLE_DWARF_THREADS
+/*
+ * Public names and address ranges of lazily loaded units are collected by worker threads:
+ * at most DWARF_SCAN_THREADS_MAX threads, no more than number of CPUs,
+ * at least DWARF_SCAN_UNITS_PER_THREAD units per thread.
+ */
+#  ifndef DWARF_SCAN_THREADS_MAX
+#    define DWARF_SCAN_THREADS_MAX 16
+#  endif
+#  ifndef DWARF_SCAN_UNITS_PER_THREAD
+#    define DWARF_SCAN_UNITS_PER_THREAD 16
+#  endif
+#endif
+
+/*
+ * Max number of line number states cached for all compilation units.
+ * When the limit is exceeded, line number tables of least recently used units are disposed.
+ */
+#ifndef DWARF_LINE_INFO_CACHE_SIZE
+#  define DWARF_LINE_INFO_CACHE_SIZE 0x100000
+#endif
+
 typedef struct FileInfo FileInfo;
+typedef struct FileNameRef FileNameRef;
 typedef struct ObjectInfo ObjectInfo;
+typedef struct ObjectRange ObjectRange;
 typedef struct PubNamesInfo PubNamesInfo;
 typedef struct PubNamesTable PubNamesTable;
 typedef struct SymbolInfo SymbolInfo;
 typedef struct PropertyValue PropertyValue;
 typedef struct LineNumbersState LineNumbersState;
+typedef struct LineNumbersBlock LineNumbersBlock;
+typedef struct LineNumbersTextPos LineNumbersTextPos;
 typedef struct CompUnit CompUnit;
 typedef struct SymbolSection SymbolSection;
 typedef struct UnitAddressRange UnitAddressRange;
+typedef struct AddrIndexNode AddrIndexNode;
+typedef struct UnitScopeIndex UnitScopeIndex;
 typedef struct FrameInfoRange FrameInfoRange;
 typedef struct FrameInfoIndex FrameInfoIndex;
 typedef struct ObjectHashTable ObjectHashTable;
+typedef struct NameIndex NameIndex;
+typedef struct StringPool StringPool;
 typedef struct DWARFCache DWARFCache;
 
 struct FileInfo {
@@ -58,9 +110,20 @@ struct FileInfo {
     U4_T mModTime;
     U4_T mSize;
     unsigned mNameHash;
-    FileInfo * mNextInHash;
     CompUnit * mCompUnit;
     unsigned mAreaCnt;
+    const char * mFullName;     /* mDir + mName, created on demand */
+};
+
+/* Entry of source file names index, see load_file_name_index() */
+struct FileNameRef {
+    const char * mName;
+    const char * mDir;
+    unsigned mNameHash;
+    unsigned mNext;             /* Next entry with same hash index, plus one, 0 if none */
+    CompUnit * mCompUnit;
+    U4_T mFile;                 /* Index of the file in mCompUnit->mFiles */
+    const char * mCanonicName;  /* Canonic absolute path name, created on demand */
 };
 
 #define TAG_fund_type           0x2000
@@ -93,6 +156,19 @@ struct FileInfo {
 #define DOIF_data_location      0x400000
 #define DOIF_const_value        0x800000
 
+/*
+ * DWARF objects are allocated in blocks of OBJECT_BLOCK_SIZE objects.
+ * Objects refer to each other by 32-bit object references: block number and object position in the block.
+ * Reference 0 is NULL. Block numbers are global, so an object can refer to an object of another file, e.g. DWZ file.
+ */
+#define OBJECT_BLOCK_BITS 7
+#define OBJECT_BLOCK_SIZE (1u << OBJECT_BLOCK_BITS)
+
+extern ObjectInfo ** dwarf_object_blocks;
+
+#define dwarf_ref2obj(ref) ((ref) != 0 ? dwarf_object_blocks[(ref) >> OBJECT_BLOCK_BITS] + ((ref) & (OBJECT_BLOCK_SIZE - 1)) : (ObjectInfo *)NULL)
+#define dwarf_obj2ref(obj) ((obj) != NULL ? (obj)->mRef : 0)
+
 struct ObjectInfo {
 
     /* 'mID' is link-time debug information entry address:
@@ -100,18 +176,19 @@ struct ObjectInfo {
     /* TODO: adding section address is not necessary, object ID is valid per section only */
     ContextAddress mID;
 
-    ObjectInfo * mHashNext;
-    ObjectInfo * mSibling;
-    ObjectInfo * mChildren;
-    ObjectInfo * mParent;
-    ObjectInfo * mDefinition;
-
-    U2_T mTag;
-    U4_T mFlags;
     CompUnit * mCompUnit;
-    ObjectInfo * mType;
     const char * mName;
 
+    U4_T mRef;              /* Reference to this object */
+    U4_T mHashNext;
+    U4_T mSibling;          /* Use get_dwarf_sibling() */
+    U4_T mChildren;         /* Use get_dwarf_children() */
+    U4_T mParent;           /* Use get_dwarf_parent() */
+    U4_T mDefinition;       /* Use get_dwarf_definition() */
+    U4_T mType;             /* Use get_dwarf_type() */
+    U4_T mFlags;
+    U2_T mTag;
+
     union {
         U2_T mFundType;
         struct {
@@ -122,29 +199,36 @@ struct ObjectInfo {
                 ContextAddress mAddr;
             } mHighPC;
         } mCode;
-        struct {
-            U2_T mFmt;
-            union {
-                I8_T mValue;
-                struct {
-                    U1_T * mAddr;
-                    size_t mSize;
-                } mExpr;
-            } mLow;
-            union {
-                I8_T mValue;
-                struct {
-                    U1_T * mAddr;
-                    size_t mSize;
-                } mExpr;
-            } mHigh;
-        } mRange;
+        ObjectRange * mRange;   /* TAG_index_range bounds */
     } u;
 };
 
+/* DWARF v1 array index range bounds, rarely used, kept out of ObjectInfo to save space */
+struct ObjectRange {
+    ObjectRange * mNext;
+    U2_T mFmt;
+    union {
+        I8_T mValue;
+        struct {
+            U1_T * mAddr;
+            size_t mSize;
+        } mExpr;
+    } mLow;
+    union {
+        I8_T mValue;
+        struct {
+            U1_T * mAddr;
+            size_t mSize;
+        } mExpr;
+    } mHigh;
+};
+
 struct PubNamesInfo {
     unsigned mNext;
-    ObjectInfo * mObject;
+    ObjectInfo * mObject;       /* NULL if the object is not loaded yet, see get_pub_names_object() */
+    const char * mName;
+    ELF_Section * mSection;
+    ContextAddress mID;
 };
 
 struct PubNamesTable {
@@ -176,11 +260,12 @@ struct PropertyValue {
 #define LINE_EpilogueBegin  0x08
 #define LINE_EndSequence    0x10
 
+/* Line number table row, see get_line_numbers_state() */
 struct LineNumbersState {
     ContextAddress mAddress;
-    char * mFileName;
     U4_T mSection;
-    U4_T mStatesIndexPos;
+    U4_T mStatesPos;        /* Position of the row in address order */
+    U4_T mStatesIndexPos;   /* Position of the row in source text order, see CompUnit.mStatesIndex */
     U4_T mFile;
     U4_T mLine;
     U2_T mColumn;
@@ -190,6 +275,25 @@ struct LineNumbersState {
     U1_T mDiscriminator;
 };
 
+/*
+ * Line number table rows are kept in memory delta encoded, in blocks of LINE_NUMBERS_BLOCK_SIZE rows.
+ * A block starts from a full row, and the rest of the rows are encoded as differences from previous row.
+ */
+#define LINE_NUMBERS_BLOCK_SIZE 16
+
+struct LineNumbersBlock {
+    ContextAddress mAddress;    /* Address of first row of the block */
+    U4_T mSection;              /* Section of first row of the block */
+    U4_T mOffs;                 /* Offset of the block in CompUnit.mStatesData */
+};
+
+/* Source text position of every LINE_NUMBERS_BLOCK_SIZE-th row in source text order */
+struct LineNumbersTextPos {
+    U4_T mFile;
+    U4_T mLine;
+    U2_T mColumn;
+};
+
 struct CompUnit {
     ObjectInfo * mObject;
 
@@ -213,17 +317,26 @@ struct CompUnit {
 
     U4_T mDirsCnt;
     U4_T mDirsMax;
-    char ** mDirs;
+    const char ** mDirs;
 
-    U4_T mStatesCnt;
-    U4_T mStatesMax;
-    LineNumbersState * mStates;
-    LineNumbersState ** mStatesIndex;
+    U4_T mFileRefsCnt;          /* Number of unit files in the source file names index */
+
+    U4_T mStatesCnt;                /* Number of line number table rows */
+    U1_T * mStatesData;             /* Delta encoded rows, sorted by address */
+    LineNumbersBlock * mStatesBlocks;
+    U4_T * mStatesIndex;            /* Row positions sorted by source text position */
+    LineNumbersTextPos * mStatesTextPos;
     U1_T mLineInfoLoaded;
+    LINK mLineInfoLink;         /* Line info LRU list */
+    unsigned mLineInfoUsed;     /* Line info cleanup cycle when the line info was used last time */
 
     CompUnit * mBaseTypes;
     CompUnit * mNextTypeUnit;
 
+    U1_T mNameIndexed;          /* Public names of the unit are searched in .debug_names or .gdb_index */
+
+    UnitScopeIndex * mScopeIndex; /* Code scopes address index, created on demand by find_comp_unit_scope() */
+
     ContextAddress mFundTypeID;
 };
 
@@ -235,6 +348,25 @@ struct UnitAddressRange {
     ContextAddress mSize;   /* Size of the range */
 };
 
+/*
+ * Node of an address search index.
+ * Nodes are stored in Eytzinger (breadth-first) order: children of node 'k' are nodes '2k' and '2k+1',
+ * so the first levels of the search tree share a few cache lines.
+ */
+struct AddrIndexNode {
+    U8_T mKey;
+    unsigned mPos;          /* Position of the key in the sorted array of keys */
+};
+
+/* Code scopes of a compilation unit, indexed by address */
+struct UnitScopeIndex {
+    ELF_Section * mSection;     /* Section the index was created for, NULL means any section */
+    unsigned mCnt;              /* Number of scope boundary addresses */
+    AddrIndexNode * mIndex;     /* Sorted scope boundary addresses */
+    ObjectInfo ** mScopes;      /* First scope that contains addresses from a boundary up to next boundary, or NULL */
+    UnitScopeIndex * mNext;
+};
+
 struct FrameInfoIndex {
     int mRelocatable;
     ELF_Section * mSection;
@@ -246,7 +378,7 @@ struct FrameInfoIndex {
 
 struct ObjectHashTable {
     ObjectInfo * mCompUnits;
-    ObjectInfo ** mObjectHash;
+    U4_T * mObjectHash;         /* Object references */
     unsigned mObjectHashSize;
     CompUnit ** mCompUnitsIndex;
     unsigned mCompUnitsIndexSize;
@@ -263,19 +395,27 @@ struct DWARFCache {
     ELF_Section * mDebugLoc;
     ELF_Section * mDebugRanges;
     ObjectHashTable * mObjectHashTable; /* per ELF section */
-    struct ObjectArray * mObjectList;
-    unsigned mObjectArrayPos;
+    U4_T * mObjectBlocks;       /* Numbers of object blocks owned by the cache */
+    unsigned mObjectBlocksCnt;
+    unsigned mObjectBlocksMax;
+    unsigned mObjectBlockPos;   /* Number of used objects in the last block */
+    ObjectRange * mRangeList;
     ContextAddress mFundTypeID;
     UnitAddressRange * mAddrRanges;
+    AddrIndexNode * mAddrRangesIndex;   /* Prefix maximum of end addresses of mAddrRanges */
     ContextAddress mAddrRangesMaxSize;
     unsigned mAddrRangesCnt;
     unsigned mAddrRangesMax;
     int mAddrRangesRelocatable;
     PubNamesTable mPubNames;
+    NameIndex * mNameIndex;
     FrameInfoIndex * mFrameInfo;
-    unsigned mFileInfoHashSize;
-    FileInfo ** mFileInfoHash;
-    int mLineInfoLoaded;
+    FileNameRef * mFileRefs;    /* Source file names index, created on demand by load_file_name_index() */
+    unsigned mFileRefsCnt;
+    unsigned mFileRefsMax;
+    unsigned * mFileRefsHash;   /* Hash table of mFileRefs indices plus one, by calc_file_name_hash() */
+    unsigned mFileRefsHashSize;
+    StringPool * mStringPool;
     CompUnit ** mTypeUnitHash;
     unsigned mTypeUnitHashSize;
     int lazy_loaded;
@@ -290,16 +430,61 @@ extern DWARFCache * get_dwarf_cache(ELF_File * file);
   /* Load parent of DWARF object - if not loaded already. Return obj->mParent */
   extern ObjectInfo * get_dwarf_parent(ObjectInfo * obj);
 #else
-#  define get_dwarf_children(obj) ((obj)->mChildren)
-#  define get_dwarf_parent(obj) ((obj)->mParent)
+#  define get_dwarf_children(obj) dwarf_ref2obj((obj)->mChildren)
+#  define get_dwarf_parent(obj) dwarf_ref2obj((obj)->mParent)
 #endif
 
+#define get_dwarf_sibling(obj) dwarf_ref2obj((obj)->mSibling)
+#define get_dwarf_definition(obj) dwarf_ref2obj((obj)->mDefinition)
+#define get_dwarf_type(obj) dwarf_ref2obj((obj)->mType)
+
 /* Return file name hash. The hash is used to search FileInfo. */
 extern unsigned calc_file_name_hash(const char * s);
 
-/* Load line number information for given compilation unit, throw an exception if error */
+/*
+ * Return interned copy of a string. The copy is owned by the cache and it is disposed with the cache.
+ * Line number tables keep file and directory names interned, so the names are stored once per file,
+ * and two interned strings are equal only if they are same pointer.
+ */
+extern const char * intern_dwarf_string(DWARFCache * cache, const char * s);
+
+/* Return calc_file_name_hash() of an interned string. The hash is computed once per string. */
+extern unsigned get_interned_file_name_hash(const char * s);
+
+/*
+ * Load line number information for given compilation unit, throw an exception if error.
+ * The function must be called every time the line info is accessed:
+ * line number tables of units that are not used for a while can be disposed to save memory.
+ */
 extern void load_line_numbers(CompUnit * unit);
 
+/*
+ * Create source file names index of the cache, if not created already, throw an exception if error.
+ * The index lists files of line number tables of all compilation units, without loading the tables:
+ * only line number table headers are read. mFileRefsHash[hash % mFileRefsHashSize] is first entry for
+ * given calc_file_name_hash() value. Since the hash is computed from file base name, path mapping of
+ * directory names does not change it. The index is kept until the cache is disposed.
+ */
+extern void load_file_name_index(DWARFCache * cache);
+
+/*
+ * Decode line number table row at position 'pos' in address order.
+ * Rows from 0 to unit->mStatesCnt - 1 are sorted by section and address,
+ * unit->mStatesIndex[i] is position of i-th row in source text order.
+ * load_line_numbers() must be called before using this function.
+ */
+extern void get_line_numbers_state(CompUnit * unit, U4_T pos, LineNumbersState * state);
+
+/* Return object of public names table entry, load the object if needed, throw an exception if error */
+extern ObjectInfo * get_pub_names_object(PubNamesInfo * info);
+
+/*
+ * Add objects with given name to the public names table, if the file has .debug_names or .gdb_index section.
+ * Only compilation units that define the name are loaded.
+ * Must be called before searching the public names table for the name. Throw an exception if error.
+ */
+extern void load_pub_names_by_name(DWARFCache * cache, const char * name);
+
 /* Find ObjectInfo by ID */
 extern ObjectInfo * find_object(ELF_Section * sec, ContextAddress ID);
 
@@ -307,6 +492,13 @@ extern ObjectInfo * find_object(ELF_Section * sec, ContextAddress ID);
 extern UnitAddressRange * find_comp_unit_addr_range(DWARFCache * cache, ELF_Section * section,
     ContextAddress addr_min, ContextAddress addr_max);
 
+/*
+ * Search and return first code scope (function, inlined subroutine, lexical block, etc.) of compilation unit 'unit'
+ * that contains link-time address 'addr', nested scopes included, in DWARF tree order.
+ * Return NULL if not found or the unit cannot be indexed.
+ */
+extern ObjectInfo * find_comp_unit_scope(CompUnit * unit, ELF_Section * section, ContextAddress addr);
+
 /*
  * Read a property of a DWARF object, perform ELF relocations if any.
  * FORM_ADDR values are mapped to run-time address space.
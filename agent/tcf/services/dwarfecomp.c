@@ -302,7 +302,7 @@ static ObjectInfo * get_function_by_addr(ObjectInfo * parent, ELF_Section * sec,
             if (dwarf_check_in_range(obj, sec, addr)) return obj;
             break;
         }
-        obj = obj->mSibling;
+        obj = get_dwarf_sibling(obj);
     }
     return NULL;
 }
@@ -494,7 +494,7 @@ static void op_fbreg(void) {
     expr_pos++;
     offs = read_i8leb128();
     memset(&fp, 0, sizeof(fp));
-    if (parent == NULL && expr->object->mTag == TAG_subrange_type && expr->object->mParent != NULL) {
+    if (parent == NULL && expr->object->mTag == TAG_subrange_type && dwarf_ref2obj(expr->object->mParent) != NULL) {
         /* Workaround for invalid DWARF generated by GCC for
          * C99-style dynamic arrays */
         ObjectInfo * obj = get_dwarf_children(expr->object->mCompUnit->mObject);
@@ -503,10 +503,10 @@ static void op_fbreg(void) {
                 ObjectInfo * arg = get_dwarf_children(obj);
                 while (arg != NULL && parent == NULL) {
                     if (arg->mType == expr->object->mParent) parent = obj;
-                    arg = arg->mSibling;
+                    arg = get_dwarf_sibling(arg);
                 }
             }
-            obj = obj->mSibling;
+            obj = get_dwarf_sibling(obj);
         }
     }
     if (parent == NULL) str_exception(ERR_INV_DWARF, "OP_fbreg: no parent function");
@@ -721,12 +721,12 @@ static void add_call_sites(ObjectInfo * obj, U8_T addr, U8_T size) {
             }
             break;
         }
-        obj = obj->mSibling;
+        obj = get_dwarf_sibling(obj);
     }
 }
 
 static void find_call_sites(CompUnit * unit, U8_T addr, U8_T size) {
-    ObjectInfo * obj = unit->mObject->mChildren;
+    ObjectInfo * obj = get_dwarf_children(unit->mObject);
     call_site_cnt = 0;
     call_site_max = 16;
     call_site_buf = (ObjectInfo **)tmp_alloc(sizeof(ObjectInfo *) * call_site_max);
@@ -734,7 +734,7 @@ static void find_call_sites(CompUnit * unit, U8_T addr, U8_T size) {
         if (obj->mTag == TAG_subprogram) {
             add_call_sites(get_dwarf_children(obj), addr, size);
         }
-        obj = obj->mSibling;
+        obj = get_dwarf_sibling(obj);
     }
 }
 
@@ -819,7 +819,7 @@ static void op_parameter_ref(void) {
                     }
                 }
             }
-            args = args->mSibling;
+            args = get_dwarf_sibling(args);
         }
     }
 
@@ -59,11 +59,49 @@
 #define RULE_VAL_OFFSET         5
 #define RULE_VAL_EXPRESSION     6
 
+typedef struct FrameInfoRows FrameInfoRows;
+
 struct FrameInfoRange {
     U4_T mSection;
     ContextAddress mAddr;
     ContextAddress mSize;
     U8_T mOffset;
+    FrameInfoRows * mRows;
+};
+
+/*
+ * Resolved unwind rows of a FDE are cached to avoid re-reading the CIE and
+ * re-executing CFA instructions every time a stack frame is unwound.
+ * A row covers addresses from the end of previous row up to mEnd, which are offsets from the FDE start address.
+ * The rows don't depend on a context, so the cache is shared by all contexts and
+ * is disposed together with the DWARF cache.
+ */
+typedef struct FrameInfoRule {
+    U8_T mExpression;
+    I4_T mOffset;
+    U2_T mReg;
+    U1_T mRule;
+} FrameInfoRule;
+
+typedef struct FrameInfoRow {
+    U8_T mCfaExpression;
+    I4_T mCfaOffset;
+    U4_T mCfaRegister;
+    U4_T mEnd;
+    U4_T mRules;        /* Index of first non-empty register rule */
+    U2_T mRulesCnt;     /* Number of non-empty register rules */
+    U2_T mRegsCnt;      /* Number of register rules, including empty ones */
+    U1_T mCfaRule;
+} FrameInfoRow;
+
+struct FrameInfoRows {
+    U8_T mAddr;
+    U8_T mRange;
+    int mReturnAddressRegister;
+    U1_T mAddressSize;
+    unsigned mRowsCnt;  /* Zero means the FDE cannot be cached */
+    FrameInfoRow * mRows;
+    FrameInfoRule * mRules;
 };
 
 typedef struct RegisterRules {
@@ -128,6 +166,13 @@ static unsigned trace_cmds_max = 0;
 static unsigned trace_cmds_cnt = 0;
 static LocationExpressionCommand * trace_cmds = NULL;
 
+static FrameInfoRow * rows_buf = NULL;
+static unsigned rows_buf_cnt = 0;
+static unsigned rows_buf_max = 0;
+static FrameInfoRule * rules_buf = NULL;
+static unsigned rules_buf_cnt = 0;
+static unsigned rules_buf_max = 0;
+
 static RegisterRules * get_reg(StackFrameRegisters * regs, int reg) {
     int min_reg_cnt = 0;
     while (regs->regs_cnt <= reg || regs->regs_cnt < min_reg_cnt) {
@@ -1109,10 +1154,9 @@ static void read_frame_cie(U8_T fde_pos, U8_T pos) {
     dio_SetPos(saved_pos);
 }
 
-static void read_frame_fde(U8_T IP, U8_T fde_pos) {
+static int read_frame_fde_header(U8_T fde_pos, U8_T * addr, U8_T * range, U8_T * fde_end) {
     int fde_dwarf64 = 0;
     U8_T fde_length = 0;
-    U8_T fde_end = 0;
     U8_T ref_pos = 0;
     U8_T cie_ref = 0;
     int fde_flag = 0;
@@ -1125,29 +1169,37 @@ static void read_frame_fde(U8_T IP, U8_T fde_pos) {
         fde_dwarf64 = 1;
     }
     ref_pos = dio_GetPos();
-    fde_end = ref_pos + fde_length;
+    *fde_end = ref_pos + fde_length;
     cie_ref = fde_dwarf64 ? dio_ReadU8() : dio_ReadU4();
     if (rules.eh_frame) fde_flag = cie_ref != 0;
     else if (fde_dwarf64) fde_flag = cie_ref != ~(U8_T)0;
     else fde_flag = cie_ref != ~(U4_T)0;
     assert(fde_flag);
-    if (fde_flag) {
-        U8_T Addr, Range;
-        if (rules.eh_frame) cie_ref = ref_pos - cie_ref;
-        if (cie_ref != rules.cie_pos) read_frame_cie(fde_pos, cie_ref);
-        Addr = read_frame_data_pointer(rules.addr_encoding, &rules.loc_section, 0);
-        Range = read_frame_data_pointer(rules.addr_encoding, NULL, 0);
+    if (!fde_flag) return 0;
+    if (rules.eh_frame) cie_ref = ref_pos - cie_ref;
+    if (cie_ref != rules.cie_pos) read_frame_cie(fde_pos, cie_ref);
+    *addr = read_frame_data_pointer(rules.addr_encoding, &rules.loc_section, 0);
+    *range = read_frame_data_pointer(rules.addr_encoding, NULL, 0);
+    if (rules.cie_aug != NULL && rules.cie_aug[0] == 'z') {
+        rules.fde_aug_length = dio_ReadULEB128();
+        rules.fde_aug_data = dio_GetDataPtr();
+        dio_Skip(rules.fde_aug_length);
+    }
+    copy_register_rules(&frame_regs, &cie_regs);
+    rules.location = *addr;
+    regs_stack_pos = 0;
+    return 1;
+}
+
+static void read_frame_fde(U8_T IP, U8_T fde_pos) {
+    U8_T Addr = 0;
+    U8_T Range = 0;
+    U8_T fde_end = 0;
+
+    if (read_frame_fde_header(fde_pos, &Addr, &Range, &fde_end)) {
         assert(Addr <= IP && Addr + Range > IP);
         if (Addr <= IP && Addr + Range > IP) {
             U8_T location0 = Addr;
-            if (rules.cie_aug != NULL && rules.cie_aug[0] == 'z') {
-                rules.fde_aug_length = dio_ReadULEB128();
-                rules.fde_aug_data = dio_GetDataPtr();
-                dio_Skip(rules.fde_aug_length);
-            }
-            copy_register_rules(&frame_regs, &cie_regs);
-            rules.location = Addr;
-            regs_stack_pos = 0;
             for (;;) {
                 if (dio_GetPos() >= fde_end) {
                     rules.location = Addr + Range;
@@ -1181,6 +1233,172 @@ static void read_frame_fde(U8_T IP, U8_T fde_pos) {
     dio_ExitSection();
 }
 
+static void add_frame_info_row(U8_T end) {
+    FrameInfoRow * row = NULL;
+    FrameInfoRow * prev = NULL;
+    unsigned rules_pos = rules_buf_cnt;
+    int n;
+
+    if (end > 0xffffffffu || frame_regs.regs_cnt > 0xffff) {
+        str_exception(ERR_OTHER, "Frame info row cannot be cached");
+    }
+    for (n = 0; n < frame_regs.regs_cnt; n++) {
+        RegisterRules * reg = frame_regs.regs + n;
+        FrameInfoRule * r = NULL;
+        if (reg->rule == 0) continue;
+        if (rules_buf_cnt >= rules_buf_max) {
+            rules_buf_max = rules_buf_max == 0 ? 64 : rules_buf_max * 2;
+            rules_buf = (FrameInfoRule *)loc_realloc(rules_buf, sizeof(FrameInfoRule) * rules_buf_max);
+        }
+        r = rules_buf + rules_buf_cnt++;
+        memset(r, 0, sizeof(FrameInfoRule));
+        r->mExpression = reg->expression;
+        r->mOffset = reg->offset;
+        r->mReg = (U2_T)n;
+        r->mRule = (U1_T)reg->rule;
+    }
+    if (rows_buf_cnt >= rows_buf_max) {
+        rows_buf_max = rows_buf_max == 0 ? 16 : rows_buf_max * 2;
+        rows_buf = (FrameInfoRow *)loc_realloc(rows_buf, sizeof(FrameInfoRow) * rows_buf_max);
+    }
+    if (rows_buf_cnt > 0) prev = rows_buf + rows_buf_cnt - 1;
+    row = rows_buf + rows_buf_cnt++;
+    row->mCfaExpression = frame_regs.cfa_expression;
+    row->mCfaOffset = frame_regs.cfa_offset;
+    row->mCfaRegister = frame_regs.cfa_register;
+    row->mEnd = (U4_T)end;
+    row->mRules = rules_pos;
+    row->mRulesCnt = (U2_T)(rules_buf_cnt - rules_pos);
+    row->mRegsCnt = (U2_T)frame_regs.regs_cnt;
+    row->mCfaRule = (U1_T)frame_regs.cfa_rule;
+    if (prev != NULL && prev->mRulesCnt == row->mRulesCnt &&
+            memcmp(rules_buf + prev->mRules, rules_buf + rules_pos, sizeof(FrameInfoRule) * row->mRulesCnt) == 0) {
+        /* Register rules are same as in previous row, share them */
+        row->mRules = prev->mRules;
+        rules_buf_cnt = rules_pos;
+    }
+}
+
+static FrameInfoRows * read_frame_fde_rows(U8_T fde_pos) {
+    FrameInfoRows * rows = NULL;
+    U8_T Addr = 0;
+    U8_T Range = 0;
+    U8_T fde_end = 0;
+    size_t size = 0;
+
+    rows_buf_cnt = 0;
+    rules_buf_cnt = 0;
+    if (read_frame_fde_header(fde_pos, &Addr, &Range, &fde_end)) {
+        U8_T location0 = Addr;
+        for (;;) {
+            if (dio_GetPos() >= fde_end) {
+                add_frame_info_row(Range);
+                break;
+            }
+            exec_stack_frame_instruction(Addr);
+            if (rules.location == location0) continue;
+            if (rules.location < location0) {
+                str_exception(ERR_OTHER, "Frame info row cannot be cached");
+            }
+            add_frame_info_row(rules.location - Addr);
+            if (rules.location >= Addr + Range) break;
+            location0 = rules.location;
+        }
+    }
+    dio_ExitSection();
+
+    size = sizeof(FrameInfoRows) + sizeof(FrameInfoRow) * rows_buf_cnt + sizeof(FrameInfoRule) * rules_buf_cnt;
+    rows = (FrameInfoRows *)loc_alloc(size);
+    rows->mAddr = Addr;
+    rows->mRange = Range;
+    rows->mReturnAddressRegister = rules.return_address_register;
+    rows->mAddressSize = rules.address_size;
+    rows->mRowsCnt = rows_buf_cnt;
+    rows->mRows = (FrameInfoRow *)(rows + 1);
+    rows->mRules = (FrameInfoRule *)(rows->mRows + rows_buf_cnt);
+    memcpy(rows->mRows, rows_buf, sizeof(FrameInfoRow) * rows_buf_cnt);
+    memcpy(rows->mRules, rules_buf, sizeof(FrameInfoRule) * rules_buf_cnt);
+    return rows;
+}
+
+static void read_frame_fde_cached(U8_T IP, FrameInfoRange * range) {
+    FrameInfoRows * rows = range->mRows;
+    FrameInfoRow * row = NULL;
+    U8_T offs = 0;
+    U8_T start = 0;
+    unsigned l, h;
+    int n;
+
+    if (rows == NULL) {
+        Trap trap;
+        if (set_trap(&trap)) {
+            rows = read_frame_fde_rows(range->mOffset);
+            clear_trap(&trap);
+        }
+        else {
+            /* Error or unusual frame info, fall-back to executing CFA instructions for each lookup */
+            rows = (FrameInfoRows *)loc_alloc_zero(sizeof(FrameInfoRows));
+            rules.cie_pos = ~(U8_T)0;
+            dio_ExitSection();
+        }
+        range->mRows = rows;
+    }
+    if (rows->mRowsCnt == 0) {
+        read_frame_fde(IP, range->mOffset);
+        return;
+    }
+    if (IP < rows->mAddr || IP - rows->mAddr >= rows->mRange) return;
+    offs = IP - rows->mAddr;
+    l = 0;
+    h = rows->mRowsCnt - 1;
+    while (l < h) {
+        unsigned k = (l + h) / 2;
+        if (rows->mRows[k].mEnd > offs) h = k;
+        else l = k + 1;
+    }
+    row = rows->mRows + l;
+    if (l > 0) start = rows->mRows[l - 1].mEnd;
+
+    rules.return_address_register = rows->mReturnAddressRegister;
+    rules.address_size = rows->mAddressSize;
+    clear_frame_registers(&frame_regs);
+    frame_regs.cfa_rule = row->mCfaRule;
+    frame_regs.cfa_offset = row->mCfaOffset;
+    frame_regs.cfa_register = row->mCfaRegister;
+    frame_regs.cfa_expression = row->mCfaExpression;
+    if (frame_regs.regs_max < row->mRegsCnt) {
+        frame_regs.regs_max = row->mRegsCnt;
+        frame_regs.regs = (RegisterRules *)loc_realloc(frame_regs.regs, sizeof(RegisterRules) * frame_regs.regs_max);
+    }
+    memset(frame_regs.regs, 0, sizeof(RegisterRules) * row->mRegsCnt);
+    frame_regs.regs_cnt = row->mRegsCnt;
+    for (n = 0; n < row->mRulesCnt; n++) {
+        FrameInfoRule * r = rows->mRules + row->mRules + n;
+        RegisterRules * reg = frame_regs.regs + r->mReg;
+        reg->rule = r->mRule;
+        reg->offset = r->mOffset;
+        reg->expression = r->mExpression;
+    }
+
+    dwarf_stack_trace_addr = rows->mAddr + start;
+    dwarf_stack_trace_size = row->mEnd - start;
+    if (rules.reg_id_scope.machine == EM_ARM && IP + 4 == rows->mAddr + rows->mRange) {
+        /* GCC generates invalid frame info for ARM function epilogue */
+        /* Ignore frame info, fall-back to stack crawl logic */
+        return;
+    }
+    dio_EnterSection(NULL, rules.section, 0);
+    generate_commands();
+    if (dwarf_stack_trace_regs_cnt == 0) {
+        /* GHS generates dummy frame info with all registers marked undefined */
+        /* Ignore frame info, fall-back to stack crawl logic */
+        dwarf_stack_trace_fp->cmds_cnt = 0;
+        dwarf_stack_trace_addr = 0;
+        dwarf_stack_trace_size = 0;
+    }
+    dio_ExitSection();
+}
+
 static int cmp_frame_info_ranges(const void * x, const void * y) {
     FrameInfoRange * rx = (FrameInfoRange *)x;
     FrameInfoRange * ry = (FrameInfoRange *)y;
@@ -1305,19 +1523,28 @@ static void read_frame_info_section(Context * ctx, ELF_Section * text_section,
             h = k;
         }
         else if (range->mAddr + range->mSize < range->mAddr) {
-            read_frame_fde(IP, range->mOffset);
+            read_frame_fde_cached(IP, range);
             return;
         }
         else if (range->mAddr + range->mSize <= IP) {
             l = k + 1;
         }
         else {
-            read_frame_fde(IP, range->mOffset);
+            read_frame_fde_cached(IP, range);
             return;
         }
     }
 }
 
+void free_dwarf_frame_info_index(FrameInfoIndex * index) {
+    unsigned i;
+    for (i = 0; i < index->mFrameInfoRangesCnt; i++) {
+        loc_free(index->mFrameInfoRanges[i].mRows);
+    }
+    loc_free(index->mFrameInfoRanges);
+    loc_free(index);
+}
+
 void get_dwarf_stack_frame_info(Context * ctx, ELF_File * file, ELF_Section * text_section, U8_T addr) {
     DWARFCache * cache = NULL;
     FrameInfoIndex * index = NULL;
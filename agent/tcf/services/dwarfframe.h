@@ -43,6 +43,12 @@
  */
 extern void get_dwarf_stack_frame_info(Context * ctx, ELF_File * file, ELF_Section * sec, U8_T ip);
 
+/*
+ * Dispose frame info search index, including cached unwind rows.
+ * Called when DWARF cache is disposed.
+ */
+extern void free_dwarf_frame_info_index(FrameInfoIndex * index);
+
 extern U8_T dwarf_stack_trace_addr;
 extern U8_T dwarf_stack_trace_size;
 
@@ -61,21 +61,47 @@ struct DIO_Cache {
 
 typedef struct DIO_Cache DIO_Cache;
 
-U8_T dio_gEntryPos = 0;
-
-U8_T dio_gFormData = 0;
-size_t dio_gFormDataSize = 0;
-void * dio_gFormDataAddr = NULL;
-ELF_Section * dio_gFormSection = NULL;
-
-static ELF_Section * sSection;
-static int sBigEndian;
-static int sAddressSize;
-static int sRefAddressSize;
-static U1_T * sData;
-static U8_T sDataPos;
-static U8_T sDataLen;
-static DIO_UnitDescriptor * sUnit;
+DWARF_THREAD_LOCAL U8_T dio_gEntryPos = 0;
+
+DWARF_THREAD_LOCAL U8_T dio_gFormData = 0;
+DWARF_THREAD_LOCAL size_t dio_gFormDataSize = 0;
+DWARF_THREAD_LOCAL void * dio_gFormDataAddr = NULL;
+DWARF_THREAD_LOCAL ELF_Section * dio_gFormSection = NULL;
+
+static DWARF_THREAD_LOCAL ELF_Section * sSection;
+static DWARF_THREAD_LOCAL int sBigEndian;
+static DWARF_THREAD_LOCAL int sAddressSize;
+static DWARF_THREAD_LOCAL int sRefAddressSize;
+static DWARF_THREAD_LOCAL U1_T * sData;
+static DWARF_THREAD_LOCAL U8_T sDataPos;
+static DWARF_THREAD_LOCAL U8_T sDataLen;
+static DWARF_THREAD_LOCAL DIO_UnitDescriptor * sUnit;
+static DWARF_THREAD_LOCAL Trap * sWorkerTrap;
+
+static void dio_Exception(int Error) ATTR_NORETURN;
+static void dio_StrException(int Error, const char * Msg) ATTR_NORETURN;
+
+static void dio_Exception(int Error) {
+    if (sWorkerTrap != NULL) {
+        /* Worker thread: exceptions are not available, jump to the worker trap */
+        Trap * Worker = sWorkerTrap;
+        sWorkerTrap = NULL;
+        Worker->error = Error;
+        longjmp(Worker->env, 1);
+    }
+    exception(Error);
+}
+
+static void dio_StrException(int Error, const char * Msg) {
+    if (sWorkerTrap != NULL) dio_Exception(Error);
+    str_exception(Error, Msg);
+}
+
+int dio_SetWorkerTrap(Trap * Worker) {
+    if (Worker != NULL) memset(Worker, 0, sizeof(Trap));
+    sWorkerTrap = Worker;
+    return 0;
+}
 
 static void dio_CloseELF(ELF_File * File) {
     U4_T n, m;
@@ -110,15 +136,16 @@ static DIO_Cache * dio_GetCache(ELF_File * File) {
         Inited = 1;
     }
     if (Cache == NULL) {
+        if (sWorkerTrap != NULL) dio_Exception(ERR_INV_DWARF);
         Cache = (DIO_Cache *)(File->dwarf_io_cache = loc_alloc_zero(sizeof(DIO_Cache)));
     }
     return Cache;
 }
 
 void dio_EnterSection(DIO_UnitDescriptor * Unit, ELF_Section * Section, U8_T Offset) {
-    if (elf_load(Section)) exception(errno);
+    if (elf_load(Section)) dio_Exception(errno);
     if (Offset > Section->size) {
-        if (Section->name == NULL) exception(ERR_INV_DWARF);
+        if (Section->name == NULL || sWorkerTrap != NULL) dio_Exception(ERR_INV_DWARF);
         str_fmt_exception(ERR_INV_DWARF, "Invalid offset in '%s' section", Section->name);
     }
     sSection = Section;
@@ -162,23 +189,23 @@ U1_T * dio_GetDataPtr(void) {
 }
 
 void dio_Skip(I8_T Bytes) {
-    if (sDataPos + Bytes > sDataLen) exception(ERR_EOF);
+    if (sDataPos + Bytes > sDataLen) dio_Exception(ERR_EOF);
     sDataPos += Bytes;
 }
 
 void dio_SetPos(U8_T Pos) {
-    if (Pos > sDataLen) exception(ERR_EOF);
+    if (Pos > sDataLen) dio_Exception(ERR_EOF);
     sDataPos = Pos;
 }
 
 void dio_Read(U1_T * Buf, U4_T Size) {
-    if (sDataPos + Size > sDataLen) exception(ERR_EOF);
+    if (sDataPos + Size > sDataLen) dio_Exception(ERR_EOF);
     memcpy(Buf, sData + sDataPos, Size);
     sDataPos += Size;
 }
 
 static U1_T dio_ReadU1F(void) {
-    if (sDataPos >= sDataLen) exception(ERR_EOF);
+    if (sDataPos >= sDataLen) dio_Exception(ERR_EOF);
     return sData[sDataPos++];
 }
 
@@ -190,7 +217,7 @@ U1_T dio_ReadU1(void) {
 
 U2_T dio_ReadU2(void) {
     U2_T x0, x1;
-    if (sDataPos + 2 > sDataLen) exception(ERR_EOF);
+    if (sDataPos + 2 > sDataLen) dio_Exception(ERR_EOF);
     x0 = sData[sDataPos++];
     x1 = sData[sDataPos++];
     return sBigEndian ? (x0 << 8) | x1 : x0 | (x1 << 8);
@@ -199,14 +226,14 @@ U2_T dio_ReadU2(void) {
 U4_T dio_ReadU4(void) {
 #if defined(__BYTE_ORDER__)
     U4_T x;
-    if (sDataPos + 4 > sDataLen) exception(ERR_EOF);
+    if (sDataPos + 4 > sDataLen) dio_Exception(ERR_EOF);
     x = *(U4_T *)(sData + sDataPos);
     if ((sBigEndian == 0) != (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)) SWAP(x);
     sDataPos += 4;
     return x;
 #else
     U4_T x0, x1, x2, x3;
-    if (sDataPos + 4 > sDataLen) exception(ERR_EOF);
+    if (sDataPos + 4 > sDataLen) dio_Exception(ERR_EOF);
     x0 = sData[sDataPos++];
     x1 = sData[sDataPos++];
     x2 = sData[sDataPos++];
@@ -220,7 +247,7 @@ U4_T dio_ReadU4(void) {
 U8_T dio_ReadU8(void) {
 #if defined(__BYTE_ORDER__) && !defined(__arm__)
     U8_T x;
-    if (sDataPos + 8 > sDataLen) exception(ERR_EOF);
+    if (sDataPos + 8 > sDataLen) dio_Exception(ERR_EOF);
     x = *(U8_T *)(sData + sDataPos);
     if ((sBigEndian == 0) != (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)) SWAP(x);
     sDataPos += 8;
@@ -301,7 +328,7 @@ U8_T dio_ReadAddressX(ELF_Section ** s, int size) {
         return x;
     }
     default:
-        str_exception(ERR_INV_DWARF, "Invalid data size");
+        dio_StrException(ERR_INV_DWARF, "Invalid data size");
         return 0;
     }
 }
@@ -325,10 +352,13 @@ static U1_T * dio_LoadStringTable(ELF_File * File, U8_T * StringTableAddr, U4_T
         U4_T ID;
         ELF_Section * Section = NULL;
 
+        /* Worker threads don't modify the cache */
+        if (sWorkerTrap != NULL) dio_Exception(ERR_INV_DWARF);
+
         for (ID = 1; ID < File->section_cnt; ID++) {
             if (strcmp(File->sections[ID].name, ".debug_str") == 0) {
                 if (Section != NULL) {
-                    str_exception(ERR_INV_DWARF, "More then one .debug_str section in a file");
+                    dio_StrException(ERR_INV_DWARF, "More then one .debug_str section in a file");
                 }
                 Section = File->sections + ID;
                 assert(Section->file == File);
@@ -336,11 +366,11 @@ static U1_T * dio_LoadStringTable(ELF_File * File, U8_T * StringTableAddr, U4_T
         }
 
         if (Section == NULL) {
-            str_exception(ERR_INV_DWARF, "Section .debug_str not found");
+            dio_StrException(ERR_INV_DWARF, "Section .debug_str not found");
         }
 
         if (elf_load(Section) < 0) {
-            str_exception(errno, "Cannot read .debug_str section");
+            dio_StrException(errno, "Cannot read .debug_str section");
         }
 
         Cache->mStringTableAddr = Section->addr;
@@ -354,7 +384,7 @@ static U1_T * dio_LoadStringTable(ELF_File * File, U8_T * StringTableAddr, U4_T
 }
 
 static U1_T * dio_LoadAltStringTable(ELF_File * File, U8_T * StringTableAddr, U4_T * StringTableSize) {
-    if (File->dwz_file == NULL) str_exception(errno, "Cannot open DWZ file");
+    if (File->dwz_file == NULL) dio_StrException(errno, "Cannot open DWZ file");
     return dio_LoadStringTable(File->dwz_file, StringTableAddr, StringTableSize);
 }
 
@@ -366,7 +396,7 @@ static void dio_ReadFormAddr(void) {
 static void dio_ReadFormBlock(U4_T Size) {
     dio_gFormDataAddr = sData + sDataPos;
     dio_gFormDataSize = Size;
-    if (sDataPos + Size > sDataLen) exception(ERR_EOF);
+    if (sDataPos + Size > sDataLen) dio_Exception(ERR_EOF);
     sDataPos += Size;
 }
 
@@ -396,7 +426,7 @@ static void dio_ReadFormRelRef(U2_T Attr, U8_T Offset) {
         /* OK. This occurs in DWARF 2 for AT_sibling attribute of TAG_compile_unit */
     }
     else if (Offset >= sUnit->mUnitSize) {
-        str_exception(ERR_INV_DWARF, "Invalid REF attribute value");
+        dio_StrException(ERR_INV_DWARF, "Invalid REF attribute value");
     }
     dio_gFormData = sSection->addr + sUnit->mUnitOffs + Offset;
     dio_gFormDataSize = sAddressSize;
@@ -423,7 +453,7 @@ static void dio_ReadFormStringRef(void) {
     dio_gFormDataSize = 1;
     for (;;) {
         if (Offset >= StringTableSize) {
-            str_exception(ERR_INV_DWARF, "Invalid FORM_STRP attribute");
+            dio_StrException(ERR_INV_DWARF, "Invalid FORM_STRP attribute");
         }
         if (StringTable[Offset++] == 0) break;
         dio_gFormDataSize++;
@@ -439,7 +469,7 @@ static void dio_ReadFormAltStringRef(void) {
     dio_gFormDataSize = 1;
     for (;;) {
         if (Offset >= StringTableSize) {
-            str_exception(ERR_INV_DWARF, "Invalid FORM_STRP_ALT attribute");
+            dio_StrException(ERR_INV_DWARF, "Invalid FORM_STRP_ALT attribute");
         }
         if (StringTable[Offset++] == 0) break;
         dio_gFormDataSize++;
@@ -458,7 +488,7 @@ void dio_ReadAttribute(U2_T Attr, U2_T Form) {
         case FORM_DATA4     : Size = 4; break;
         case FORM_DATA8     : Size = 8; break;
         case FORM_SEC_OFFSET: Size = sUnit->m64bit ? 8 : 4; break;
-        default: str_exception(ERR_INV_DWARF, "FORM_DATA or FORM_SEC_OFFSET was expected");
+        default: dio_StrException(ERR_INV_DWARF, "FORM_DATA or FORM_SEC_OFFSET was expected");
         }
         dio_gFormData = dio_ReadAddressX(&dio_gFormSection, Size);
         dio_gFormDataSize = Size;
@@ -494,7 +524,9 @@ void dio_ReadAttribute(U2_T Attr, U2_T Form) {
                             break;
     case FORM_EXPRLOC       : dio_ReadFormBlock(dio_ReadULEB128()); break;
     case FORM_REF_SIG8      : dio_ReadFormData(8, dio_ReadU8()); break;
-    default: str_fmt_exception(ERR_INV_DWARF, "Invalid FORM code 0x%04x", Form);
+    default:
+        if (sWorkerTrap != NULL) dio_Exception(ERR_INV_DWARF);
+        str_fmt_exception(ERR_INV_DWARF, "Invalid FORM code 0x%04x", Form);
     }
 }
 
@@ -510,7 +542,7 @@ int dio_ReadEntry(DIO_EntryCallBack CallBack, U2_T TargetAttr) {
         U4_T AbbrCode = dio_ReadULEB128();
         if (AbbrCode == 0) return 0;
         if (AbbrCode >= sUnit->mAbbrevTableSize || sUnit->mAbbrevTable[AbbrCode] == NULL) {
-            str_exception(ERR_INV_DWARF, "Invalid abbreviation code");
+            dio_StrException(ERR_INV_DWARF, "Invalid abbreviation code");
         }
         Abbr =  sUnit->mAbbrevTable[AbbrCode];
         Tag = Abbr->mTag;
@@ -606,7 +638,7 @@ int dio_ReadEntry(DIO_EntryCallBack CallBack, U2_T TargetAttr) {
                 assert(sUnit->mUnitOffs + sUnit->mUnitSize >= sDataPos);
             }
             else if (Attr == 0 && Form == 0) {
-                if (sUnit->mUnitSize == 0) str_exception(ERR_INV_DWARF, "Missing compilation unit sibling attribute");
+                if (sUnit->mUnitSize == 0) dio_StrException(ERR_INV_DWARF, "Missing compilation unit sibling attribute");
             }
         }
         if (CallBack != NULL) CallBack(Tag, Attr, Form);
@@ -677,7 +709,7 @@ void dio_LoadAbbrevTable(ELF_File * File) {
     for (i = 1; i < File->section_cnt; i++) {
         if (strcmp(File->sections[i].name, ".debug_abbrev") == 0) {
             if (Section != NULL) {
-                str_exception(ERR_INV_DWARF, "More then one .debug_abbrev section in a file");
+                dio_StrException(ERR_INV_DWARF, "More then one .debug_abbrev section in a file");
             }
             Section = File->sections + i;
         }
@@ -706,7 +738,7 @@ void dio_LoadAbbrevTable(ELF_File * File) {
             TableOffset = sDataPos;
             continue;
         }
-        if (ID >= 0x1000000) str_exception(ERR_INV_DWARF, "Invalid abbreviation table");
+        if (ID >= 0x1000000) dio_StrException(ERR_INV_DWARF, "Invalid abbreviation table");
         if (ID >= AbbrevBufPos) {
             U4_T Pos = AbbrevBufPos;
             AbbrevBufPos = ID + 1;
@@ -727,10 +759,10 @@ void dio_LoadAbbrevTable(ELF_File * File) {
         for (;;) {
             U4_T Attr = dio_ReadULEB128();
             U4_T Form = dio_ReadULEB128();
-            if (Attr >= 0x10000 || Form >= 0x10000) str_exception(ERR_INV_DWARF, "Invalid abbreviation table");
+            if (Attr >= 0x10000 || Form >= 0x10000) dio_StrException(ERR_INV_DWARF, "Invalid abbreviation table");
             if (Attr == 0 && Form == 0) {
                 DIO_Abbreviation * Abbr;
-                if (AbbrevBuf[ID] != NULL) str_exception(ERR_INV_DWARF, "Invalid abbreviation table");
+                if (AbbrevBuf[ID] != NULL) dio_StrException(ERR_INV_DWARF, "Invalid abbreviation table");
                 Abbr = (DIO_Abbreviation *)loc_alloc_zero(sizeof(DIO_Abbreviation) - sizeof(U2_T) * 2 + sizeof(U2_T) * AttrPos);
                 Abbr->mTag = Tag;
                 Abbr->mChildren = Children;
@@ -767,7 +799,7 @@ static void dio_FindAbbrevTable(void) {
     }
     sUnit->mAbbrevTable = NULL;
     sUnit->mAbbrevTableSize = 0;
-    str_exception(ERR_INV_DWARF, "Invalid abbreviation table offset");
+    dio_StrException(ERR_INV_DWARF, "Invalid abbreviation table offset");
 }
 
 void dio_ChkFlag(U2_T Form) {
@@ -777,7 +809,7 @@ void dio_ChkFlag(U2_T Form) {
     case FORM_FLAG_PRESENT  :
         return;
     }
-    str_exception(ERR_INV_DWARF, "FORM_FLAG expected");
+    dio_StrException(ERR_INV_DWARF, "FORM_FLAG expected");
 }
 
 void dio_ChkRef(U2_T Form) {
@@ -791,7 +823,7 @@ void dio_ChkRef(U2_T Form) {
     case FORM_REF_UDATA :
         return;
     }
-    str_exception(ERR_INV_DWARF, "FORM_REF expected");
+    dio_StrException(ERR_INV_DWARF, "FORM_REF expected");
 }
 
 void dio_ChkAddr(U2_T Form) {
@@ -799,7 +831,7 @@ void dio_ChkAddr(U2_T Form) {
     case FORM_ADDR      :
         return;
     }
-    str_exception(ERR_INV_DWARF, "FORM_ADDR expected");
+    dio_StrException(ERR_INV_DWARF, "FORM_ADDR expected");
 }
 
 void dio_ChkData(U2_T Form) {
@@ -813,7 +845,7 @@ void dio_ChkData(U2_T Form) {
     case FORM_SEC_OFFSET:
         return;
     }
-    str_exception(ERR_INV_DWARF, "FORM_DATA expected");
+    dio_StrException(ERR_INV_DWARF, "FORM_DATA expected");
 }
 
 void dio_ChkBlock(U2_T Form, U1_T ** Buf, size_t * Size) {
@@ -834,7 +866,7 @@ void dio_ChkBlock(U2_T Form, U1_T ** Buf, size_t * Size) {
         *Buf = (U1_T *)dio_gFormDataAddr;
         break;
     default:
-        str_exception(ERR_INV_DWARF, "FORM_BLOCK expected");
+        dio_StrException(ERR_INV_DWARF, "FORM_BLOCK expected");
     }
 }
 
@@ -842,7 +874,7 @@ void dio_ChkString(U2_T Form) {
     if (Form == FORM_STRING) return;
     if (Form == FORM_STRP) return;
     if (Form == FORM_GNU_STRP_ALT) return;
-    str_exception(ERR_INV_DWARF, "FORM_STRING expected");
+    dio_StrException(ERR_INV_DWARF, "FORM_STRING expected");
 }
 
 #endif /* ENABLE_ELF */
@@ -17,6 +17,9 @@
  * This module implements low-level functions for reading DWARF debug information.
  *
  * Functions in this module use exceptions to report errors, see exceptions.h
+ *
+ * If ENABLE_DWARF_THREADS, reader state is thread local, and the functions can be used by worker threads.
+ * Worker threads cannot use exceptions, see dio_set_worker_trap().
  */
 #ifndef D_dwarfio
 #define D_dwarfio
@@ -25,8 +28,23 @@
 
 #if ENABLE_ELF
 
+#include <tcf/framework/exceptions.h>
 #include <tcf/services/tcf_elf.h>
 
+#ifndef ENABLE_DWARF_THREADS
+#  if defined(__GNUC__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__))
+#    define ENABLE_DWARF_THREADS 1
+#  else
+#    define ENABLE_DWARF_THREADS 0
+#  endif
+#endif
+
+#if ENABLE_DWARF_THREADS
+#  define DWARF_THREAD_LOCAL __thread
+#else
+#  define DWARF_THREAD_LOCAL
+#endif
+
 typedef struct DIO_UnitDescriptor {
     ELF_Section * mSection;
     U2_T mVersion;
@@ -41,16 +59,32 @@ typedef struct DIO_UnitDescriptor {
     U4_T mAbbrevTableSize;
 } DIO_UnitDescriptor;
 
-extern U8_T dio_gEntryPos;
+extern DWARF_THREAD_LOCAL U8_T dio_gEntryPos;
 
-extern U8_T dio_gFormData;
-extern size_t dio_gFormDataSize;
-extern void * dio_gFormDataAddr;
-extern ELF_Section * dio_gFormSection;
+extern DWARF_THREAD_LOCAL U8_T dio_gFormData;
+extern DWARF_THREAD_LOCAL size_t dio_gFormDataSize;
+extern DWARF_THREAD_LOCAL void * dio_gFormDataAddr;
+extern DWARF_THREAD_LOCAL ELF_Section * dio_gFormSection;
 
 extern void dio_EnterSection(DIO_UnitDescriptor * Unit, ELF_Section * Section, U8_T Offset);
 extern void dio_ExitSection(void);
 
+/*
+ * Worker threads cannot use exceptions, a worker thread reports reader errors by jumping to a worker trap:
+ *   Trap trap;
+ *   if (dio_set_worker_trap(&trap)) {
+ *       // Read debug info
+ *       dio_SetWorkerTrap(NULL);
+ *   }
+ *   else {
+ *       // Error handling, error code is in trap.error
+ *   }
+ * Worker threads can only read sections that are already loaded, and don't need relocation.
+ */
+#define dio_set_worker_trap(trap) (dio_SetWorkerTrap(trap), setjmp((trap)->env) == 0)
+
+extern int dio_SetWorkerTrap(Trap * trap);
+
 extern void dio_Skip(I8_T Bytes);
 extern void dio_SetPos(U8_T Pos);
 extern void dio_Read(U1_T * Buf, U4_T Size);
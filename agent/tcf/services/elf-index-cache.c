@@ -0,0 +1,505 @@
+/*******************************************************************************
+ * Copyright (c) 2026 Wind River Systems, Inc. and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ * The Eclipse Public License is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ * You may elect to redistribute this code under either of these licenses.
+ *
+ * Contributors:
+ *     Wind River Systems - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Persistent on-disk cache of ELF and DWARF search indexes.
+ */
+
+#include <tcf/config.h>
+
+#include <tcf/services/elf-index-cache.h>
+
+#if ENABLE_ELF_INDEX_CACHE
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <tcf/framework/mdep-fs.h>
+#include <tcf/framework/myalloc.h>
+#include <tcf/framework/errors.h>
+#include <tcf/framework/events.h>
+#include <tcf/framework/trace.h>
+
+#define INDEX_CACHE_MAGIC       "TCFINDEX"
+#define INDEX_CACHE_VERSION     1
+#define INDEX_CACHE_BYTE_ORDER  0x01020304
+#define INDEX_CACHE_ID_SIZE     128
+
+typedef struct IndexCacheHeader {
+    char magic[8];
+    U4_T version;
+    U4_T byte_order;
+    U4_T addr_size;             /* sizeof(ContextAddress) of the agent that created the file */
+    U4_T chunk_cnt;
+    U8_T file_size;             /* Size of the ELF file */
+    I8_T file_mtime;            /* Modification time of the ELF file */
+    char build_id[INDEX_CACHE_ID_SIZE];
+} IndexCacheHeader;
+
+typedef struct IndexCacheChunk {
+    U4_T tag;
+    U4_T index;
+    U8_T offset;                /* Offset of chunk data in the cache file, 8 bytes aligned */
+    U8_T size;
+} IndexCacheChunk;
+
+typedef struct IndexCacheMapping {
+    struct IndexCacheMapping * next;
+    void * addr;
+    size_t size;
+} IndexCacheMapping;
+
+typedef struct PendingChunk {
+    struct PendingChunk * next;
+    U4_T tag;
+    U4_T index;
+    size_t size;
+    void * data;
+} PendingChunk;
+
+typedef struct IndexCache {
+    ELF_File * file;
+    char * path;                /* NULL if the file cannot be cached */
+    char build_id[INDEX_CACHE_ID_SIZE];
+    /* Current mapping is first, older mappings are kept until the ELF file is disposed */
+    IndexCacheMapping * mappings;
+    PendingChunk * pending;
+    struct IndexCache * next_dirty;
+    int dirty;
+} IndexCache;
+
+typedef struct CacheFileInfo {
+    char * name;
+    int64_t size;
+    int64_t mtime;
+} CacheFileInfo;
+
+static uint64_t cache_size_limit = ELF_INDEX_CACHE_SIZE;
+static char * cache_dir = NULL;
+static int cache_dir_ok = 0;
+static int close_listener_ok = 0;
+static IndexCache * dirty_list = NULL;
+static int flush_posted = 0;
+
+static const char * get_cache_dir(void) {
+    if (!cache_dir_ok) {
+        char dir[FILE_PATH_SIZE];
+        const char * xdg = getenv("XDG_CACHE_HOME");
+        const char * home = getenv("HOME");
+        if (xdg != NULL && *xdg == '/') {
+            snprintf(dir, sizeof(dir), "%s/tcf-agent", xdg);
+            cache_dir = loc_strdup(dir);
+        }
+        else if (home != NULL && *home == '/') {
+            snprintf(dir, sizeof(dir), "%s/.cache/tcf-agent", home);
+            cache_dir = loc_strdup(dir);
+        }
+        cache_dir_ok = 1;
+    }
+    return cache_dir;
+}
+
+static int make_dirs(const char * path) {
+    char buf[FILE_PATH_SIZE];
+    size_t i = 0;
+    size_t l = strlen(path);
+    if (l >= sizeof(buf)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(buf, path);
+    for (i = 1; i <= l; i++) {
+        if (buf[i] == '/' || buf[i] == 0) {
+            char ch = buf[i];
+            buf[i] = 0;
+            if (mkdir(buf, 0755) < 0 && errno != EEXIST) return -1;
+            buf[i] = ch;
+        }
+    }
+    return 0;
+}
+
+static const IndexCacheHeader * get_header(IndexCache * cache) {
+    if (cache->mappings == NULL) return NULL;
+    return (const IndexCacheHeader *)cache->mappings->addr;
+}
+
+static const IndexCacheChunk * get_chunks(IndexCache * cache) {
+    return (const IndexCacheChunk *)(get_header(cache) + 1);
+}
+
+static int validate_cache_file(IndexCache * cache, const void * addr, size_t size) {
+    unsigned i;
+    const IndexCacheHeader * hdr = (const IndexCacheHeader *)addr;
+    const IndexCacheChunk * chunks = (const IndexCacheChunk *)(hdr + 1);
+    if (size < sizeof(IndexCacheHeader)) return 0;
+    if (memcmp(hdr->magic, INDEX_CACHE_MAGIC, sizeof(hdr->magic)) != 0) return 0;
+    if (hdr->version != INDEX_CACHE_VERSION) return 0;
+    if (hdr->byte_order != INDEX_CACHE_BYTE_ORDER) return 0;
+    if (hdr->addr_size != sizeof(ContextAddress)) return 0;
+    if (hdr->file_size != (U8_T)cache->file->size) return 0;
+    if (hdr->file_mtime != (I8_T)cache->file->mtime) return 0;
+    if (strncmp(hdr->build_id, cache->build_id, sizeof(hdr->build_id)) != 0) return 0;
+    if (hdr->chunk_cnt > (size - sizeof(IndexCacheHeader)) / sizeof(IndexCacheChunk)) return 0;
+    for (i = 0; i < hdr->chunk_cnt; i++) {
+        const IndexCacheChunk * c = chunks + i;
+        if (c->offset % 8 != 0) return 0;
+        if (c->offset > size || c->size > size - c->offset) return 0;
+    }
+    return 1;
+}
+
+static void map_cache_file(IndexCache * cache) {
+    struct stat st;
+    void * addr = MAP_FAILED;
+    int fd = open(cache->path, O_RDONLY | O_BINARY, 0);
+    if (fd < 0) return;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(IndexCacheHeader)) {
+        addr = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) return;
+    if (!validate_cache_file(cache, addr, (size_t)st.st_size)) {
+        trace(LOG_ELF, "Ignoring stale or invalid index cache file %s", cache->path);
+        munmap(addr, (size_t)st.st_size);
+    }
+    else {
+        IndexCacheMapping * m = (IndexCacheMapping *)loc_alloc_zero(sizeof(IndexCacheMapping));
+        m->addr = addr;
+        m->size = (size_t)st.st_size;
+        m->next = cache->mappings;
+        cache->mappings = m;
+        /* Modification time of cache files is used as the last use time, see trim_cache_dir() */
+        utime(cache->path, NULL);
+        trace(LOG_ELF, "Index cache file %s: %u chunks", cache->path, (unsigned)get_header(cache)->chunk_cnt);
+    }
+}
+
+static void free_pending_chunks(IndexCache * cache) {
+    while (cache->pending != NULL) {
+        PendingChunk * c = cache->pending;
+        cache->pending = c->next;
+        loc_free(c->data);
+        loc_free(c);
+    }
+}
+
+static int write_chunk_data(FILE * f, const void * data, size_t size, U8_T * pos) {
+    static const char zeros[8] = { 0 };
+    if (size > 0 && fwrite(data, size, 1, f) != 1) return -1;
+    *pos += size;
+    if (*pos % 8 != 0) {
+        size_t n = (size_t)(8 - *pos % 8);
+        if (fwrite(zeros, n, 1, f) != 1) return -1;
+        *pos += n;
+    }
+    return 0;
+}
+
+static int cmp_cache_files(const void * x, const void * y) {
+    const CacheFileInfo * fx = (const CacheFileInfo *)x;
+    const CacheFileInfo * fy = (const CacheFileInfo *)y;
+    if (fx->mtime < fy->mtime) return -1;
+    if (fx->mtime > fy->mtime) return +1;
+    return 0;
+}
+
+static void trim_cache_dir(void) {
+    /* Remove least recently used files until total size is within the limit */
+    DIR * dir = NULL;
+    struct dirent * e = NULL;
+    CacheFileInfo * arr = NULL;
+    unsigned cnt = 0;
+    unsigned max = 0;
+    unsigned i = 0;
+    uint64_t total = 0;
+    char fnm[FILE_PATH_SIZE];
+
+    dir = opendir(cache_dir);
+    if (dir == NULL) return;
+    while ((e = readdir(dir)) != NULL) {
+        struct stat st;
+        size_t l = strlen(e->d_name);
+        if (l < 4 || strcmp(e->d_name + l - 4, ".idx") != 0) continue;
+        snprintf(fnm, sizeof(fnm), "%s/%s", cache_dir, e->d_name);
+        if (stat(fnm, &st) != 0) continue;
+        if (cnt >= max) {
+            max = max == 0 ? 64 : max * 2;
+            arr = (CacheFileInfo *)loc_realloc(arr, sizeof(CacheFileInfo) * max);
+        }
+        arr[cnt].name = loc_strdup(fnm);
+        arr[cnt].size = st.st_size;
+        arr[cnt].mtime = st.st_mtime;
+        total += st.st_size;
+        cnt++;
+    }
+    closedir(dir);
+    if (total > cache_size_limit) {
+        qsort(arr, cnt, sizeof(CacheFileInfo), cmp_cache_files);
+        for (i = 0; i < cnt && total > cache_size_limit; i++) {
+            if (remove(arr[i].name) == 0) {
+                trace(LOG_ELF, "Index cache file %s removed, cache size limit exceeded", arr[i].name);
+                total -= arr[i].size;
+            }
+        }
+    }
+    for (i = 0; i < cnt; i++) loc_free(arr[i].name);
+    loc_free(arr);
+}
+
+static void write_cache_file(IndexCache * cache) {
+    IndexCacheHeader hdr;
+    IndexCacheChunk * dir = NULL;
+    const void ** data = NULL;
+    unsigned cnt = 0;
+    unsigned max = 0;
+    unsigned i = 0;
+    U8_T pos = 0;
+    int error = 0;
+    FILE * f = NULL;
+    PendingChunk * p = NULL;
+    char tmp[FILE_PATH_SIZE];
+
+    assert(cache->path != NULL);
+    if (cache->file->mtime_changed) {
+        free_pending_chunks(cache);
+        return;
+    }
+
+    /* Chunks of the current cache file that are not replaced, followed by new chunks */
+    if (cache->mappings != NULL) max += get_header(cache)->chunk_cnt;
+    for (p = cache->pending; p != NULL; p = p->next) max++;
+    dir = (IndexCacheChunk *)loc_alloc_zero(sizeof(IndexCacheChunk) * (max + 1));
+    data = (const void **)loc_alloc_zero(sizeof(void *) * (max + 1));
+    if (cache->mappings != NULL) {
+        const IndexCacheChunk * chunks = get_chunks(cache);
+        for (i = 0; i < get_header(cache)->chunk_cnt; i++) {
+            const IndexCacheChunk * c = chunks + i;
+            for (p = cache->pending; p != NULL; p = p->next) {
+                if (p->tag == c->tag && p->index == c->index) break;
+            }
+            if (p != NULL) continue;
+            dir[cnt] = *c;
+            data[cnt++] = (const char *)cache->mappings->addr + c->offset;
+        }
+    }
+    for (p = cache->pending; p != NULL; p = p->next) {
+        dir[cnt].tag = p->tag;
+        dir[cnt].index = p->index;
+        dir[cnt].size = p->size;
+        data[cnt++] = p->data;
+    }
+    pos = sizeof(IndexCacheHeader) + sizeof(IndexCacheChunk) * cnt;
+    for (i = 0; i < cnt; i++) {
+        dir[i].offset = pos;
+        pos += (dir[i].size + 7) & ~(U8_T)7;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, INDEX_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = INDEX_CACHE_VERSION;
+    hdr.byte_order = INDEX_CACHE_BYTE_ORDER;
+    hdr.addr_size = sizeof(ContextAddress);
+    hdr.chunk_cnt = cnt;
+    hdr.file_size = cache->file->size;
+    hdr.file_mtime = cache->file->mtime;
+    strlcpy(hdr.build_id, cache->build_id, sizeof(hdr.build_id));
+
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", cache->path, (int)getpid());
+    if (make_dirs(cache_dir) < 0 || (f = fopen(tmp, "wb")) == NULL) {
+        error = errno;
+    }
+    else {
+        pos = 0;
+        if (!error && write_chunk_data(f, &hdr, sizeof(hdr), &pos) < 0) error = errno;
+        if (!error && write_chunk_data(f, dir, sizeof(IndexCacheChunk) * cnt, &pos) < 0) error = errno;
+        for (i = 0; i < cnt && !error; i++) {
+            assert(pos == dir[i].offset);
+            if (write_chunk_data(f, data[i], (size_t)dir[i].size, &pos) < 0) error = errno;
+        }
+        if (fclose(f) != 0 && !error) error = errno;
+        if (!error && rename(tmp, cache->path) < 0) error = errno;
+        if (error) remove(tmp);
+    }
+    loc_free(data);
+    loc_free(dir);
+    free_pending_chunks(cache);
+
+    if (error) {
+        trace(LOG_ELF, "Cannot write index cache file %s: %s", cache->path, errno_to_str(error));
+        return;
+    }
+    trace(LOG_ELF, "Index cache file %s written: %u chunks", cache->path, cnt);
+    /* Pointers into older mappings can be in use, so the new file is mapped in addition to them */
+    map_cache_file(cache);
+    trim_cache_dir();
+}
+
+static void flush_event(void * args) {
+    flush_posted = 0;
+    while (dirty_list != NULL) {
+        IndexCache * cache = dirty_list;
+        dirty_list = cache->next_dirty;
+        cache->next_dirty = NULL;
+        cache->dirty = 0;
+        write_cache_file(cache);
+    }
+}
+
+static void dispose_index_cache(ELF_File * file) {
+    IndexCache * cache = (IndexCache *)file->index_cache;
+    if (cache == NULL) return;
+    if (cache->dirty) {
+        IndexCache ** p = &dirty_list;
+        while (*p != cache) p = &(*p)->next_dirty;
+        *p = cache->next_dirty;
+        write_cache_file(cache);
+    }
+    while (cache->mappings != NULL) {
+        IndexCacheMapping * m = cache->mappings;
+        cache->mappings = m->next;
+        munmap(m->addr, m->size);
+        loc_free(m);
+    }
+    loc_free(cache->path);
+    loc_free(cache);
+    file->index_cache = NULL;
+}
+
+static IndexCache * get_index_cache(ELF_File * file) {
+    IndexCache * cache = (IndexCache *)file->index_cache;
+    if (cache == NULL) {
+        if (!close_listener_ok) {
+            elf_add_close_listener(dispose_index_cache);
+            close_listener_ok = 1;
+        }
+        cache = (IndexCache *)loc_alloc_zero(sizeof(IndexCache));
+        cache->file = file;
+        file->index_cache = cache;
+        if (cache_size_limit > 0 && get_cache_dir() != NULL &&
+                elf_get_build_id(file, cache->build_id, sizeof(cache->build_id)) > 0) {
+            char fnm[FILE_PATH_SIZE];
+            /* Separate debug info file has same build ID as the executable */
+            snprintf(fnm, sizeof(fnm), "%s/%s%s.idx", cache_dir, cache->build_id,
+                file->debug_info_file ? ".debug" : "");
+            cache->path = loc_strdup(fnm);
+            map_cache_file(cache);
+        }
+    }
+    return cache;
+}
+
+const void * elf_index_cache_get(ELF_File * file, unsigned tag, unsigned index, size_t * size) {
+    unsigned i;
+    PendingChunk * p = NULL;
+    const IndexCacheChunk * chunks = NULL;
+    IndexCache * cache = get_index_cache(file);
+    if (cache->path == NULL) return NULL;
+    for (p = cache->pending; p != NULL; p = p->next) {
+        if (p->tag == tag && p->index == index) {
+            *size = p->size;
+            return p->data;
+        }
+    }
+    if (cache->mappings == NULL) return NULL;
+    chunks = get_chunks(cache);
+    for (i = 0; i < get_header(cache)->chunk_cnt; i++) {
+        const IndexCacheChunk * c = chunks + i;
+        if (c->tag == tag && c->index == index) {
+            *size = (size_t)c->size;
+            return (const char *)cache->mappings->addr + c->offset;
+        }
+    }
+    return NULL;
+}
+
+void elf_index_cache_put(ELF_File * file, unsigned tag, unsigned index, const void * data, size_t size) {
+    PendingChunk * p = NULL;
+    IndexCache * cache = get_index_cache(file);
+    if (cache->path == NULL) return;
+    if (file->mtime_changed) return;
+    for (p = cache->pending; p != NULL; p = p->next) {
+        if (p->tag == tag && p->index == index) break;
+    }
+    if (p == NULL) {
+        p = (PendingChunk *)loc_alloc_zero(sizeof(PendingChunk));
+        p->tag = tag;
+        p->index = index;
+        p->next = cache->pending;
+        cache->pending = p;
+    }
+    loc_free(p->data);
+    p->data = loc_alloc(size > 0 ? size : 1);
+    memcpy(p->data, data, size);
+    p->size = size;
+    if (!cache->dirty) {
+        cache->dirty = 1;
+        cache->next_dirty = dirty_list;
+        dirty_list = cache;
+    }
+    if (!flush_posted) {
+        post_event(flush_event, NULL);
+        flush_posted = 1;
+    }
+}
+
+int set_elf_index_cache_size(const char * size) {
+    char * end = NULL;
+    uint64_t n = 0;
+    errno = 0;
+    n = strtoull(size, &end, 10);
+    if (errno != 0) return -1;
+    if (end == size) {
+        errno = ERR_INV_NUMBER;
+        return -1;
+    }
+    switch (*end) {
+    case 'K': case 'k': n <<= 10; end++; break;
+    case 'M': case 'm': n <<= 20; end++; break;
+    case 'G': case 'g': n <<= 30; end++; break;
+    }
+    if (*end != 0) {
+        errno = ERR_INV_NUMBER;
+        return -1;
+    }
+    cache_size_limit = n;
+    return 0;
+}
+
+void purge_elf_index_cache(void) {
+    DIR * dir = NULL;
+    struct dirent * e = NULL;
+    char fnm[FILE_PATH_SIZE];
+
+    if (get_cache_dir() == NULL) return;
+    dir = opendir(cache_dir);
+    if (dir == NULL) return;
+    while ((e = readdir(dir)) != NULL) {
+        size_t l = strlen(e->d_name);
+        if ((l > 4 && strcmp(e->d_name + l - 4, ".idx") == 0) ||
+                (l > 4 && strcmp(e->d_name + l - 4, ".tmp") == 0)) {
+            snprintf(fnm, sizeof(fnm), "%s/%s", cache_dir, e->d_name);
+            remove(fnm);
+        }
+    }
+    closedir(dir);
+}
+
+#endif /* ENABLE_ELF_INDEX_CACHE */
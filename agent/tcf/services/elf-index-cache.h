@@ -0,0 +1,82 @@
+/*******************************************************************************
+ * Copyright (c) 2026 Wind River Systems, Inc. and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ * The Eclipse Public License is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ * You may elect to redistribute this code under either of these licenses.
+ *
+ * Contributors:
+ *     Wind River Systems - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Persistent on-disk cache of ELF and DWARF search indexes.
+ *
+ * Indexes that are expensive to build, like the ELF symbol address search index,
+ * the DWARF public names table and the DWARF address ranges index, are saved in a cache file
+ * after the first load and reused by subsequent agent runs.
+ * A cache file is named after GNU build ID of the ELF file, for example
+ * ~/.cache/tcf-agent/<build-id>.idx, and it is valid only if the build ID, file size and
+ * modification time match. Files without build ID are not cached.
+ *
+ * The cache file contains a header, a directory and a number of chunks.
+ * Chunks are arrays of fixed size records in the host byte order, the file is memory mapped and
+ * the records are read in place. A cache file is never modified: new chunks are written into
+ * a temporary file, which then atomically replaces the cache file.
+ */
+
+#ifndef D_elf_index_cache
+#define D_elf_index_cache
+
+#include <tcf/config.h>
+#include <tcf/services/tcf_elf.h>
+
+#if !defined(ENABLE_ELF_INDEX_CACHE)
+#  if ENABLE_ELF && !defined(_WIN32) && !defined(__CYGWIN__) && !defined(_WRS_KERNEL)
+#    define ENABLE_ELF_INDEX_CACHE 1
+#  else
+#    define ENABLE_ELF_INDEX_CACHE 0
+#  endif
+#endif
+
+#if ENABLE_ELF_INDEX_CACHE
+
+/* Default max total size of cache files */
+#define ELF_INDEX_CACHE_SIZE    (256 * 1024 * 1024)
+
+/* Chunk tags */
+#define ELF_INDEX_SYM_ADDR      1   /* ELF symbol address search index, chunk index is section index */
+#define ELF_INDEX_PUB_NAMES     2   /* DWARF public names table */
+#define ELF_INDEX_ADDR_RANGES   3   /* DWARF compilation units address ranges */
+
+/*
+ * Get a chunk of the cache file of the ELF file.
+ * Return pointer to the chunk data and set *size, or NULL if the chunk is not cached.
+ * The data is read only and it remains valid until the ELF file is disposed.
+ */
+extern const void * elf_index_cache_get(ELF_File * file, unsigned tag, unsigned index, size_t * size);
+
+/*
+ * Add a chunk to the cache file of the ELF file. The data is copied.
+ * The cache file is written by a separate event, after the current event is done.
+ */
+extern void elf_index_cache_put(ELF_File * file, unsigned tag, unsigned index, const void * data, size_t size);
+
+/*
+ * Set max total size of cache files, e.g. "64M". Size 0 disables the cache.
+ * If error, sets errno and returns -1.
+ */
+extern int set_elf_index_cache_size(const char * size);
+
+/*
+ * Remove all cache files.
+ */
+extern void purge_elf_index_cache(void);
+
+#endif /* ENABLE_ELF_INDEX_CACHE */
+
+#endif /* D_elf_index_cache */
@@ -47,8 +47,11 @@
 #include <tcf/services/funccall.h>
 #include <tcf/services/stacktrace.h>
 #include <tcf/services/memoryservice.h>
+#include <tcf/services/memorymap.h>
 #include <tcf/services/breakpoints.h>
 #include <tcf/services/registers.h>
+#include <tcf/services/dwarf.h>
+#include <tcf/services/vm.h>
 #include <tcf/services/expressions.h>
 #include <tcf/main/test.h>
 
@@ -163,6 +166,40 @@ static LINK func_call_state = TCF_LIST_INIT(func_call_state);
 
 #endif /* ENABLE_FuncCallInjection */
 
+#ifndef ENABLE_ExpressionSymbolsCache
+#  define ENABLE_ExpressionSymbolsCache (ENABLE_Symbols && ENABLE_DebugContext && SERVICE_Expressions)
+#endif
+
+typedef struct ExpressionSymbols ExpressionSymbols;
+
+#if ENABLE_ExpressionSymbolsCache
+/*
+ * Identifier resolution cache of a prepared expression.
+ * Symbol lookup results depend only on the code scope of the expression,
+ * so symbol IDs found by name are reused as long as the scope stays the same.
+ * Values of the symbols are not cached, they are loaded on every evaluation.
+ */
+typedef struct ExpressionSymbol {
+    char * name;
+    SYM_FLAGS flags;
+    unsigned pos;           /* Index of best match in the symbol list */
+    unsigned cnt;
+    char ** ids;
+} ExpressionSymbol;
+
+struct ExpressionSymbols {
+    char * scope;           /* Context ID, frame number and scope symbol ID */
+    unsigned generation;
+    ExpressionSymbol * buf;
+    unsigned cnt;
+    unsigned max;
+};
+
+static ExpressionSymbols * expression_symbols = NULL;
+static int expression_symbols_state = 0;    /* 0 - scope not checked, 1 - cache valid, -1 - cache not used */
+static unsigned expression_symbols_generation = 0;
+#endif /* ENABLE_ExpressionSymbolsCache */
+
 static ExpressionIdentifierCallBack ** id_callbacks = NULL;
 static int id_callback_max = 0;
 static int id_callback_cnt = 0;
@@ -1171,6 +1208,137 @@ static unsigned flag_count(SYM_FLAGS flags) {
 }
 #endif /* ENABLE_Symbols */
 
+#if ENABLE_ExpressionSymbolsCache
+static void clear_expression_symbols(ExpressionSymbols * s) {
+    unsigned i, j;
+    for (i = 0; i < s->cnt; i++) {
+        ExpressionSymbol * e = s->buf + i;
+        for (j = 0; j < e->cnt; j++) loc_free(e->ids[j]);
+        loc_free(e->ids);
+        loc_free(e->name);
+    }
+    s->cnt = 0;
+    loc_free(s->scope);
+    s->scope = NULL;
+}
+
+static void free_expression_symbols(ExpressionSymbols * s) {
+    if (s == NULL) return;
+    clear_expression_symbols(s);
+    loc_free(s->buf);
+    loc_free(s);
+}
+
+static char * get_expression_scope(void) {
+    Context * ctx = expression_context;
+    ContextAddress ip = expression_addr;
+    Symbol * sym = NULL;
+    const char * sym_id = NULL;
+    char addr_buf[32];
+    char * scope = NULL;
+    size_t len = 0;
+
+    if (expression_frame != STACK_NO_FRAME) {
+        StackFrame * info = NULL;
+        RegisterDefinition * reg_pc = get_PC_definition(ctx);
+        uint64_t pc = 0;
+        if (reg_pc == NULL) exception(ERR_UNSUPPORTED);
+        if (get_frame_info(ctx, expression_frame, &info) < 0) exception(errno);
+        if (read_reg_value(info, reg_pc, &pc) < 0) exception(errno);
+        if (!info->is_top_frame && pc > 0) pc--;
+        ip = (ContextAddress)pc;
+    }
+    if (find_symbol_by_addr(ctx, STACK_NO_FRAME, ip, &sym) == 0) {
+        sym_id = symbol2id(sym);
+    }
+    else if (get_error_code(errno) == ERR_SYM_NOT_FOUND) {
+        /* No symbols at the address, symbol lookup depends only on the address itself */
+        snprintf(addr_buf, sizeof(addr_buf), "@%#" PRIx64, (uint64_t)ip);
+        sym_id = addr_buf;
+    }
+    else {
+        exception(errno);
+    }
+    len = strlen(ctx->id) + strlen(sym_id) + 16;
+    scope = (char *)tmp_alloc(len);
+    snprintf(scope, len, "%s.%d.%s", ctx->id, expression_frame, sym_id);
+    return scope;
+}
+
+/* Check code scope of current prepared expression, return 1 if the cache can be used */
+static int check_expression_symbols(void) {
+    ExpressionSymbols * s = expression_symbols;
+    if (s == NULL) return 0;
+    if (expression_symbols_state == 0) {
+        Trap trap;
+        expression_symbols_state = -1;
+        if (set_trap(&trap)) {
+            char * scope = get_expression_scope();
+            if (s->scope == NULL || s->generation != expression_symbols_generation || strcmp(s->scope, scope) != 0) {
+                clear_expression_symbols(s);
+                s->scope = loc_strdup(scope);
+                s->generation = expression_symbols_generation;
+            }
+            expression_symbols_state = 1;
+            clear_trap(&trap);
+        }
+        else if (get_error_code(trap.error) == ERR_CACHE_MISS) {
+            expression_symbols_state = 0;
+            exception(trap.error);
+        }
+    }
+    return expression_symbols_state > 0;
+}
+
+static ExpressionSymbol * find_expression_symbol(const char * name, SYM_FLAGS flags) {
+    unsigned i;
+    ExpressionSymbols * s = expression_symbols;
+    for (i = 0; i < s->cnt; i++) {
+        ExpressionSymbol * e = s->buf + i;
+        if (e->flags == flags && strcmp(e->name, name) == 0) return e;
+    }
+    return NULL;
+}
+
+/* Re-create symbol list of a cached identifier, return NULL if any of the symbols is not valid anymore */
+static Symbol ** get_expression_symbol_list(ExpressionSymbol * e) {
+    unsigned i;
+    Symbol ** list = (Symbol **)tmp_alloc(sizeof(Symbol *) * (e->cnt + 1));
+    for (i = 0; i < e->cnt; i++) {
+        if (id2symbol(e->ids[i], list + i) < 0) return NULL;
+    }
+    list[e->cnt] = NULL;
+    return list;
+}
+
+static void add_expression_symbol(const char * name, SYM_FLAGS flags, Symbol ** list, unsigned cnt, unsigned pos) {
+    unsigned i;
+    ExpressionSymbols * s = expression_symbols;
+    ExpressionSymbol * e = find_expression_symbol(name, flags);
+    if (e == NULL) {
+        if (s->cnt >= s->max) {
+            s->max = s->max ? s->max * 2 : 8;
+            s->buf = (ExpressionSymbol *)loc_realloc(s->buf, sizeof(ExpressionSymbol) * s->max);
+        }
+        e = s->buf + s->cnt++;
+        e->name = loc_strdup(name);
+        e->flags = flags;
+    }
+    else {
+        for (i = 0; i < e->cnt; i++) loc_free(e->ids[i]);
+        loc_free(e->ids);
+    }
+    e->pos = pos;
+    e->cnt = cnt;
+    e->ids = (char **)loc_alloc(sizeof(char *) * cnt);
+    for (i = 0; i < cnt; i++) e->ids[i] = loc_strdup(symbol2id(list[i]));
+}
+
+static void expression_symbols_changed(Context * ctx, void * args) {
+    expression_symbols_generation++;
+}
+#endif /* ENABLE_ExpressionSymbolsCache */
+
 static int identifier(int mode, Value * scope, char * name, SYM_FLAGS flags, Value * v) {
     ini_value(v);
     if (scope == NULL) {
@@ -1210,6 +1378,19 @@ static int identifier(int mode, Value * scope, char * name, SYM_FLAGS flags, Val
     {
         Symbol * sym = NULL;
         int n = 0;
+#if ENABLE_ExpressionSymbolsCache
+        int cache = scope == NULL && check_expression_symbols();
+
+        if (cache) {
+            ExpressionSymbol * e = find_expression_symbol(name, flags);
+            Symbol ** list = e != NULL ? get_expression_symbol_list(e) : NULL;
+            if (list != NULL) {
+                int sym_class = sym2value(mode, list[e->pos], v);
+                if (e->cnt > 1) v->sym_list = list;
+                return sym_class;
+            }
+        }
+#endif
 
         if (scope != NULL) {
             int scope_class = 0;
@@ -1240,6 +1421,7 @@ static int identifier(int mode, Value * scope, char * name, SYM_FLAGS flags, Val
             const SYM_FLAGS flag_mask = SYM_FLAG_TYPE | SYM_FLAG_CONST_TYPE | SYM_FLAG_VOLATILE_TYPE | cmx_type;
             SYM_FLAGS sym_flags;
             int sym_class;
+            unsigned pos = 0;
             unsigned i;
 
             list[cnt++] = sym;
@@ -1263,7 +1445,11 @@ static int identifier(int mode, Value * scope, char * name, SYM_FLAGS flags, Val
                 if (flag_count(nxt_flags) >= flag_count(sym_flags)) continue;
                 sym_flags = nxt_flags;
                 sym = list[i];
+                pos = i;
             }
+#if ENABLE_ExpressionSymbolsCache
+            if (cache) add_expression_symbol(name, flags, list, cnt, pos);
+#endif
             sym_class = sym2value(mode, sym, v);
             if (cnt > 1) v->sym_list = list;
             return sym_class;
@@ -2014,6 +2200,67 @@ static void set_complex_type(Value * v) {
 
 static void expression(int mode, Value * v);
 
+#if ENABLE_Symbols
+static void set_int_literal_type(Value * v, int flags) {
+    size_t size = 0;
+    uint64_t n = to_uns(MODE_NORMAL, v);
+    if (flags & VAL_FLAG_C) {
+        Symbol * type = NULL;
+        if (get_std_type(flags & VAL_FLAG_L ? "wchar_t" : "char", TYPE_CLASS_UNKNOWN, &type, &size)) {
+            uint64_t m = ((uint64_t)1 << (size * 8 - 1)) - 1;
+            if (n <= m) {
+                v->type = type;
+                get_symbol_type_class(type, &v->type_class);
+            }
+        }
+    }
+    else {
+        if ((flags & (VAL_FLAG_L | VAL_FLAG_U)) == 0) {
+            Symbol * type = NULL;
+            if (get_std_type("int", TYPE_CLASS_INTEGER, &type, &size)) {
+                uint64_t m = ((uint64_t)1 << (size * 8 - 1)) - 1;
+                if (n <= m) {
+                    v->type = type;
+                    v->type_class = TYPE_CLASS_INTEGER;
+                }
+            }
+        }
+        if (v->type == NULL && (flags & VAL_FLAG_L) == 0 &&
+                (flags & (VAL_FLAG_X | VAL_FLAG_U)) != 0) {
+            Symbol * type = NULL;
+            if (get_std_type("unsigned int", TYPE_CLASS_CARDINAL, &type, &size)) {
+                uint64_t m = ((uint64_t)1 << (size * 8)) - 1;
+                if (n <= m) {
+                    v->type = type;
+                    v->type_class = TYPE_CLASS_CARDINAL;
+                }
+            }
+        }
+        if (v->type == NULL && (flags & VAL_FLAG_U) == 0) {
+            Symbol * type = NULL;
+            if (get_std_type("long int", TYPE_CLASS_INTEGER, &type, &size)) {
+                uint64_t m = ((uint64_t)1 << (size * 8 - 1)) - 1;
+                if (n <= m) {
+                    v->type = type;
+                    v->type_class = TYPE_CLASS_INTEGER;
+                }
+            }
+        }
+        if (v->type == NULL) {
+            Symbol * type = NULL;
+            if (get_std_type("long unsigned int", TYPE_CLASS_CARDINAL, &type, &size)) {
+                uint64_t m = ((uint64_t)1 << (size * 8)) - 1;
+                if (n <= m) {
+                    v->type = type;
+                    v->type_class = TYPE_CLASS_CARDINAL;
+                }
+            }
+        }
+    }
+    if (v->type != NULL && size != v->size) set_int_value(v, size, n);
+}
+#endif
+
 static void primary_expression(int mode, Value * v) {
     if (text_sy == '(') {
         next_sy();
@@ -2031,62 +2278,7 @@ static void primary_expression(int mode, Value * v) {
         next_sy();
 #if ENABLE_Symbols
         if (v->type_class == TYPE_CLASS_INTEGER || v->type_class == TYPE_CLASS_CARDINAL) {
-            size_t size = 0;
-            uint64_t n = to_uns(MODE_NORMAL, v);
-            if (flags & VAL_FLAG_C) {
-                Symbol * type = NULL;
-                if (get_std_type(flags & VAL_FLAG_L ? "wchar_t" : "char", TYPE_CLASS_UNKNOWN, &type, &size)) {
-                    uint64_t m = ((uint64_t)1 << (size * 8 - 1)) - 1;
-                    if (n <= m) {
-                        v->type = type;
-                        get_symbol_type_class(type, &v->type_class);
-                    }
-                }
-            }
-            else {
-                if ((flags & (VAL_FLAG_L | VAL_FLAG_U)) == 0) {
-                    Symbol * type = NULL;
-                    if (get_std_type("int", TYPE_CLASS_INTEGER, &type, &size)) {
-                        uint64_t m = ((uint64_t)1 << (size * 8 - 1)) - 1;
-                        if (n <= m) {
-                            v->type = type;
-                            v->type_class = TYPE_CLASS_INTEGER;
-                        }
-                    }
-                }
-                if (v->type == NULL && (flags & VAL_FLAG_L) == 0 &&
-                        (flags & (VAL_FLAG_X | VAL_FLAG_U)) != 0) {
-                    Symbol * type = NULL;
-                    if (get_std_type("unsigned int", TYPE_CLASS_CARDINAL, &type, &size)) {
-                        uint64_t m = ((uint64_t)1 << (size * 8)) - 1;
-                        if (n <= m) {
-                            v->type = type;
-                            v->type_class = TYPE_CLASS_CARDINAL;
-                        }
-                    }
-                }
-                if (v->type == NULL && (flags & VAL_FLAG_U) == 0) {
-                    Symbol * type = NULL;
-                    if (get_std_type("long int", TYPE_CLASS_INTEGER, &type, &size)) {
-                        uint64_t m = ((uint64_t)1 << (size * 8 - 1)) - 1;
-                        if (n <= m) {
-                            v->type = type;
-                            v->type_class = TYPE_CLASS_INTEGER;
-                        }
-                    }
-                }
-                if (v->type == NULL) {
-                    Symbol * type = NULL;
-                    if (get_std_type("long unsigned int", TYPE_CLASS_CARDINAL, &type, &size)) {
-                        uint64_t m = ((uint64_t)1 << (size * 8)) - 1;
-                        if (n <= m) {
-                            v->type = type;
-                            v->type_class = TYPE_CLASS_CARDINAL;
-                        }
-                    }
-                }
-            }
-            if (v->type != NULL && size != v->size) set_int_value(v, size, n);
+            set_int_literal_type(v, flags);
         }
         else if (v->type_class == TYPE_CLASS_REAL) {
             size_t size = 0;
@@ -3910,6 +4102,853 @@ int value_to_double(Value * v, double *res) {
     return 0;
 }
 
+/********************** Compiled expressions **************************/
+
+/* Max size of a DWARF location expression that is evaluated in preallocated buffers */
+#define CEX_MAX_LOC_CODE 256
+
+typedef struct CompiledVariable {
+    LocationExpressionCommand * cmds;
+    unsigned cmds_cnt;
+    int type_class;
+    size_t size;
+    int big_endian;
+    int fixed_vm;       /* DWARF code cannot grow VM buffers, preallocated buffers can be used */
+} CompiledVariable;
+
+typedef struct CompiledOp {
+    int op;
+    int uns;            /* 1 if operands are unsigned */
+    size_t size;        /* CEX_EXT: value size */
+    unsigned jump;      /* CEX_LAND, CEX_LOR: jump target */
+    uint64_t num;       /* CEX_NUM: the constant */
+    CompiledVariable * var;
+} CompiledOp;
+
+struct CompiledExpression {
+    CompiledOp * ops;
+    unsigned ops_cnt;
+    unsigned ops_max;
+    unsigned stk_pos;
+    unsigned stk_max;
+    uint64_t * stk;
+    int has_vars;
+    /* Location expressions evaluation buffers */
+    unsigned loc_max;
+    uint64_t * loc_stk;
+    uint8_t * loc_type_stk;
+    LocationPiece * loc_pieces;
+};
+
+/* Compile time type of a value on the evaluation stack */
+typedef struct CompiledType {
+    int type_class;     /* TYPE_CLASS_INTEGER, TYPE_CLASS_CARDINAL or TYPE_CLASS_ENUMERATION */
+    size_t size;
+    int constant;       /* 1 if the value is a constant */
+    uint64_t value;     /* the constant value */
+} CompiledType;
+
+static CompiledExpression * comp_expr = NULL;
+
+static void comp_conditional(CompiledType * t);
+
+static void not_compilable(const char * msg) {
+    error(ERR_UNSUPPORTED, "Cannot compile expression: %s", msg);
+}
+
+static CompiledOp * add_op(int op) {
+    CompiledExpression * e = comp_expr;
+    CompiledOp * o = NULL;
+    if (e->ops_cnt >= e->ops_max) {
+        e->ops_max += 16;
+        e->ops = (CompiledOp *)loc_realloc(e->ops, sizeof(CompiledOp) * e->ops_max);
+    }
+    o = e->ops + e->ops_cnt++;
+    memset(o, 0, sizeof(CompiledOp));
+    o->op = op;
+    switch (op) {
+    case CEX_NUM:
+    case CEX_VAR:
+        if (++e->stk_pos > e->stk_max) e->stk_max = e->stk_pos;
+        break;
+    case CEX_EXT:
+    case CEX_NEG:
+    case CEX_NOT:
+    case CEX_INV:
+        break;
+    default:
+        /* Binary operators, CEX_LAND and CEX_LOR pop the left operand when the right one is evaluated */
+        assert(e->stk_pos >= 2 || op == CEX_LAND || op == CEX_LOR);
+        e->stk_pos--;
+        break;
+    }
+    return o;
+}
+
+static void add_ext_op(CompiledType * t) {
+    CompiledOp * o = NULL;
+    if (t->size >= 8) return;
+    o = add_op(CEX_EXT);
+    o->size = t->size;
+    o->uns = t->type_class == TYPE_CLASS_CARDINAL;
+}
+
+static void set_bool_type(CompiledType * t) {
+    Value v;
+    ini_value(&v);
+    set_bool_value(&v, 0);
+    memset(t, 0, sizeof(CompiledType));
+    t->type_class = v.type_class;
+    t->size = (size_t)v.size;
+}
+
+static void set_arith_type(CompiledType * t, CompiledType * x) {
+    int uns = t->type_class == TYPE_CLASS_CARDINAL || x->type_class == TYPE_CLASS_CARDINAL;
+    memset(t, 0, sizeof(CompiledType));
+    t->type_class = uns ? TYPE_CLASS_CARDINAL : TYPE_CLASS_INTEGER;
+    t->size = sizeof(uint64_t);
+}
+
+static void comp_number(Value * v, CompiledType * t) {
+    CompiledOp * o = NULL;
+    if (v->type_class != TYPE_CLASS_INTEGER && v->type_class != TYPE_CLASS_CARDINAL &&
+            v->type_class != TYPE_CLASS_ENUMERATION) not_compilable("integer value expected");
+    if (v->size != 1 && v->size != 2 && v->size != 4 && v->size != 8) not_compilable("invalid value size");
+    memset(t, 0, sizeof(CompiledType));
+    t->type_class = v->type_class;
+    t->size = (size_t)v->size;
+    t->constant = 1;
+    t->value = v->type_class == TYPE_CLASS_CARDINAL ? to_uns(MODE_NORMAL, v) : (uint64_t)to_int(MODE_NORMAL, v);
+    o = add_op(CEX_NUM);
+    o->num = t->value;
+}
+
+#if ENABLE_Symbols
+static void check_compiled_type(Symbol * type, int type_class) {
+    /* Reject types that need special handling in the expression interpreter */
+    while (type != NULL) {
+        SymbolProperties props;
+        SYM_FLAGS flags = 0;
+        Symbol * next = NULL;
+        if (get_symbol_flags(type, &flags) < 0) error(errno, "Cannot retrieve symbol flags");
+        if (flags & SYM_FLAG_INDIRECT) not_compilable("indirect value");
+        if (type_class != TYPE_CLASS_ENUMERATION) {
+            if (get_symbol_props(type, &props) < 0) error(errno, "Cannot get symbol properties");
+            if (props.binary_scale || props.decimal_scale) not_compilable("fixed point value");
+        }
+        if (get_symbol_type(type, &next) < 0) error(errno, "Cannot retrieve symbol type");
+        if (next == type) break;
+        type = next;
+    }
+}
+
+static void comp_variable(Symbol * sym, CompiledType * t) {
+    unsigned i;
+    unsigned code_size = 0;
+    LocationInfo * loc_info = NULL;
+    CompiledVariable * var = NULL;
+    CompiledOp * o = NULL;
+
+    if (get_location_info(sym, &loc_info) < 0) error(errno, "Cannot get symbol location information");
+    if (loc_info->args_cnt > 0) not_compilable("location expression arguments");
+    var = (CompiledVariable *)loc_alloc_zero(sizeof(CompiledVariable));
+    var->type_class = t->type_class;
+    var->size = t->size;
+    var->big_endian = loc_info->big_endian;
+    var->fixed_vm = 1;
+    var->cmds_cnt = loc_info->value_cmds.cnt;
+    var->cmds = (LocationExpressionCommand *)loc_alloc_zero(sizeof(LocationExpressionCommand) * (var->cmds_cnt + 1));
+    o = add_op(CEX_VAR);
+    o->var = var;
+    for (i = 0; i < var->cmds_cnt; i++) {
+        LocationExpressionCommand * src = loc_info->value_cmds.cmds + i;
+        LocationExpressionCommand * cmd = var->cmds + i;
+        switch (src->cmd) {
+        case SFT_CMD_NUMBER:
+        case SFT_CMD_RD_REG:
+        case SFT_CMD_FP:
+        case SFT_CMD_ADD:
+        case SFT_CMD_SUB:
+        case SFT_CMD_MUL:
+        case SFT_CMD_AND:
+        case SFT_CMD_OR:
+        case SFT_CMD_XOR:
+        case SFT_CMD_GE:
+        case SFT_CMD_GT:
+        case SFT_CMD_LE:
+        case SFT_CMD_LT:
+        case SFT_CMD_SHL:
+        case SFT_CMD_SHR:
+            break;
+        case SFT_CMD_RD_MEM:
+            if (src->args.mem.size > sizeof(uint64_t)) not_compilable("unsupported location expression");
+            break;
+        case SFT_CMD_PIECE:
+            if (src->args.piece.value != NULL) not_compilable("unsupported location expression");
+            break;
+        case SFT_CMD_LOCATION:
+            {
+                size_t j;
+                uint8_t * code = src->args.loc.code_addr;
+                size_t size = src->args.loc.code_size;
+                if (size > CEX_MAX_LOC_CODE) not_compilable("location expression is too long");
+                if (src->args.loc.func != evaluate_vm_expression) var->fixed_vm = 0;
+                for (j = 0; j < size; j++) {
+                    /* Branches can make the VM stack grow without limit */
+                    if (code[j] == OP_bra || code[j] == OP_skip) var->fixed_vm = 0;
+                }
+                code_size += (unsigned)size;
+            }
+            break;
+        default:
+            not_compilable("unsupported location expression");
+            break;
+        }
+        *cmd = *src;
+        if (cmd->cmd == SFT_CMD_LOCATION) {
+            cmd->args.loc.code_addr = (uint8_t *)loc_alloc(src->args.loc.code_size);
+            memcpy(cmd->args.loc.code_addr, src->args.loc.code_addr, src->args.loc.code_size);
+        }
+    }
+    if (var->fixed_vm && comp_expr->loc_max < var->cmds_cnt + code_size + 8) {
+        CompiledExpression * e = comp_expr;
+        e->loc_max = var->cmds_cnt + code_size + 8;
+        e->loc_stk = (uint64_t *)loc_realloc(e->loc_stk, sizeof(uint64_t) * e->loc_max);
+        e->loc_type_stk = (uint8_t *)loc_realloc(e->loc_type_stk, e->loc_max);
+        e->loc_pieces = (LocationPiece *)loc_realloc(e->loc_pieces, sizeof(LocationPiece) * e->loc_max);
+    }
+    comp_expr->has_vars = 1;
+}
+
+static void comp_symbol(Symbol * sym, CompiledType * t) {
+    int sym_class = 0;
+    Symbol * type = NULL;
+    ContextAddress size = 0;
+
+    memset(t, 0, sizeof(CompiledType));
+    if (get_symbol_class(sym, &sym_class) < 0) error(errno, "Cannot retrieve symbol class");
+    if (get_symbol_type(sym, &type) < 0) error(errno, "Cannot retrieve symbol type");
+    if (get_symbol_type_class(sym, &t->type_class) < 0) error(errno, "Cannot retrieve symbol type class");
+    if (get_symbol_size(sym, &size) < 0) error(errno, "Cannot retrieve symbol size");
+    if (t->type_class != TYPE_CLASS_INTEGER && t->type_class != TYPE_CLASS_CARDINAL &&
+            t->type_class != TYPE_CLASS_ENUMERATION) not_compilable("integer value expected");
+    if (size != 1 && size != 2 && size != 4 && size != 8) not_compilable("invalid value size");
+    check_compiled_type(type, t->type_class);
+    t->size = (size_t)size;
+    if (sym_class == SYM_CLASS_VALUE) {
+        Value v;
+        void * value = NULL;
+        size_t value_size = 0;
+        int value_be = 0;
+        if (get_symbol_value(sym, &value, &value_size, &value_be) < 0) error(errno, "Cannot retrieve symbol value");
+        if (value_size != t->size) not_compilable("invalid value size");
+        ini_value(&v);
+        set_value(&v, value, value_size, value_be);
+        v.type_class = t->type_class;
+        comp_number(&v, t);
+    }
+    else if (sym_class == SYM_CLASS_REFERENCE) {
+        comp_variable(sym, t);
+    }
+    else {
+        not_compilable("variable or constant expected");
+    }
+}
+#endif /* ENABLE_Symbols */
+
+static void comp_identifier(char * name, CompiledType * t) {
+    Value v;
+    int i;
+    for (i = 0; i < id_callback_cnt; i++) {
+        ini_value(&v);
+        if (id_callbacks[i](expression_context, expression_frame, name, &v)) not_compilable("identifier callback");
+    }
+    if (name[0] == '$') not_compilable("registers and special identifiers");
+#if ENABLE_Symbols
+    {
+        Symbol * sym = NULL;
+        Symbol * nxt = NULL;
+        if (find_symbol_by_name(expression_context, expression_frame, expression_addr, name, &sym) < 0) {
+            if (get_error_code(errno) != ERR_SYM_NOT_FOUND) error(errno, "Cannot read symbol data");
+            not_compilable("undefined identifier");
+        }
+        nxt = sym;
+        if (find_next_symbol(&nxt) == 0) not_compilable("ambiguous identifier");
+        comp_symbol(sym, t);
+    }
+#else
+    not_compilable("symbols not available");
+#endif
+}
+
+static void comp_primary(CompiledType * t) {
+    if (text_sy == '(') {
+        next_sy();
+        comp_conditional(t);
+        if (text_sy != ')') error(ERR_INV_EXPRESSION, "Missing ')'");
+        next_sy();
+    }
+    else if (text_sy == SY_VAL) {
+        Value v = text_val;
+        int flags = text_val_flags;
+        next_sy();
+#if ENABLE_Symbols
+        if (v.type_class == TYPE_CLASS_INTEGER || v.type_class == TYPE_CLASS_CARDINAL) {
+            set_int_literal_type(&v, flags);
+        }
+#endif
+        comp_number(&v, t);
+    }
+    else if (text_sy == SY_NAME) {
+        char * name = (char *)text_val.value;
+        next_sy();
+        if (text_sy == SY_SCOPE) not_compilable("qualified names");
+        comp_identifier(name, t);
+    }
+    else {
+        not_compilable("unsupported operand");
+    }
+    switch (text_sy) {
+    case '(':
+    case '[':
+    case '.':
+    case SY_REF:
+    case SY_INC:
+    case SY_DEC:
+        not_compilable("unsupported postfix operator");
+        break;
+    }
+}
+
+static void comp_unary(CompiledType * t) {
+    int sy = text_sy;
+    switch (sy) {
+    case '+':
+        next_sy();
+        comp_unary(t);
+        break;
+    case '-':
+        next_sy();
+        comp_unary(t);
+        if (t->type_class != TYPE_CLASS_CARDINAL) {
+            add_op(CEX_NEG);
+            if (t->type_class != TYPE_CLASS_INTEGER) {
+                t->type_class = TYPE_CLASS_INTEGER;
+                t->size = context_word_size(expression_context);
+            }
+            add_ext_op(t);
+        }
+        t->constant = 0;
+        break;
+    case '!':
+        next_sy();
+        comp_unary(t);
+        add_op(CEX_NOT);
+        set_bool_type(t);
+        break;
+    case '~':
+        next_sy();
+        comp_unary(t);
+        add_op(CEX_INV);
+        add_ext_op(t);
+        t->constant = 0;
+        break;
+    case '*':
+    case '&':
+    case SY_SIZEOF:
+    case SY_INC:
+    case SY_DEC:
+        not_compilable("unsupported unary operator");
+        break;
+    default:
+        comp_primary(t);
+        break;
+    }
+}
+
+static void comp_multiplicative(CompiledType * t) {
+    comp_unary(t);
+    while (text_sy == '*' || text_sy == '/' || text_sy == '%') {
+        CompiledType x;
+        int sy = text_sy;
+        CompiledOp * o = NULL;
+        next_sy();
+        comp_unary(&x);
+        set_arith_type(t, &x);
+        if (sy != '*') {
+            /* Only constant divisors: division by zero must be reported by the interpreter */
+            if (!x.constant || x.value == 0) not_compilable("non-constant divisor");
+            if (t->type_class != TYPE_CLASS_CARDINAL && (int64_t)x.value == -1) not_compilable("invalid divisor");
+        }
+        o = add_op(sy == '*' ? CEX_MUL : sy == '/' ? CEX_DIV : CEX_MOD);
+        o->uns = t->type_class == TYPE_CLASS_CARDINAL;
+    }
+}
+
+static void comp_additive(CompiledType * t) {
+    comp_multiplicative(t);
+    while (text_sy == '+' || text_sy == '-') {
+        CompiledType x;
+        int sy = text_sy;
+        next_sy();
+        comp_multiplicative(&x);
+        set_arith_type(t, &x);
+        add_op(sy == '+' ? CEX_ADD : CEX_SUB);
+    }
+}
+
+static void comp_shift(CompiledType * t) {
+    comp_additive(t);
+    while (text_sy == SY_SHL || text_sy == SY_SHR) {
+        CompiledType x;
+        int sy = text_sy;
+        int uns = t->type_class == TYPE_CLASS_CARDINAL;
+        CompiledOp * o = NULL;
+        next_sy();
+        comp_additive(&x);
+        if (!x.constant || x.value >= 64) not_compilable("non-constant shift count");
+        o = add_op(sy == SY_SHL ? CEX_SHL : CEX_SHR);
+        o->uns = uns;
+        memset(t, 0, sizeof(CompiledType));
+        t->type_class = uns ? TYPE_CLASS_CARDINAL : TYPE_CLASS_INTEGER;
+        t->size = sizeof(uint64_t);
+    }
+}
+
+static void comp_relational(CompiledType * t) {
+    comp_shift(t);
+    while (text_sy == '<' || text_sy == '>' || text_sy == SY_LEQ || text_sy == SY_GEQ) {
+        CompiledType x;
+        int sy = text_sy;
+        CompiledOp * o = NULL;
+        next_sy();
+        comp_shift(&x);
+        switch (sy) {
+        case '<': o = add_op(CEX_LT); break;
+        case '>': o = add_op(CEX_GT); break;
+        case SY_LEQ: o = add_op(CEX_LE); break;
+        default: o = add_op(CEX_GE); break;
+        }
+        o->uns = t->type_class == TYPE_CLASS_CARDINAL || x.type_class == TYPE_CLASS_CARDINAL;
+        set_bool_type(t);
+    }
+}
+
+static void comp_equality(CompiledType * t) {
+    comp_relational(t);
+    while (text_sy == SY_EQU || text_sy == SY_NEQ) {
+        CompiledType x;
+        int sy = text_sy;
+        next_sy();
+        comp_relational(&x);
+        add_op(sy == SY_EQU ? CEX_EQ : CEX_NE);
+        set_bool_type(t);
+    }
+}
+
+static void comp_bitwise(CompiledType * t, int sy) {
+    switch (sy) {
+    case '&': comp_equality(t); break;
+    case '^': comp_bitwise(t, '&'); break;
+    case '|': comp_bitwise(t, '^'); break;
+    }
+    while (text_sy == sy) {
+        CompiledType x;
+        next_sy();
+        switch (sy) {
+        case '&': comp_equality(&x); break;
+        case '^': comp_bitwise(&x, '&'); break;
+        case '|': comp_bitwise(&x, '^'); break;
+        }
+        set_arith_type(t, &x);
+        add_op(sy == '&' ? CEX_AND : sy == '^' ? CEX_XOR : CEX_OR);
+    }
+}
+
+static void comp_logical(CompiledType * t, int sy) {
+    if (sy == SY_OR) comp_logical(t, SY_AND);
+    else comp_bitwise(t, '|');
+    while (text_sy == sy) {
+        CompiledType x;
+        unsigned pos = comp_expr->ops_cnt;
+        add_op(sy == SY_AND ? CEX_LAND : CEX_LOR);
+        next_sy();
+        if (sy == SY_OR) comp_logical(&x, SY_AND);
+        else comp_bitwise(&x, '|');
+        /* Result is one of the operands, both must have same type */
+        if (x.type_class != t->type_class || x.size != t->size) not_compilable("logical operands of different types");
+        comp_expr->ops[pos].jump = comp_expr->ops_cnt;
+        t->constant = 0;
+    }
+}
+
+static void comp_conditional(CompiledType * t) {
+    comp_logical(t, SY_OR);
+    if (text_sy == '?') not_compilable("conditional operator");
+}
+
+void free_compiled_expression(CompiledExpression * e) {
+    unsigned i;
+    if (e == NULL) return;
+    for (i = 0; i < e->ops_cnt; i++) {
+        CompiledVariable * var = e->ops[i].var;
+        if (var != NULL) {
+            unsigned j;
+            for (j = 0; j < var->cmds_cnt; j++) {
+                if (var->cmds[j].cmd == SFT_CMD_LOCATION) loc_free(var->cmds[j].args.loc.code_addr);
+            }
+            loc_free(var->cmds);
+            loc_free(var);
+        }
+    }
+    loc_free(e->ops);
+    loc_free(e->stk);
+    loc_free(e->loc_stk);
+    loc_free(e->loc_type_stk);
+    loc_free(e->loc_pieces);
+    loc_free(e);
+}
+
+CompiledExpression * compile_expression(Context * ctx, int frame, ContextAddress addr, char * s) {
+    Trap trap;
+    CompiledExpression * e = (CompiledExpression *)loc_alloc_zero(sizeof(CompiledExpression));
+
+#if !defined(SERVICE_Expressions)
+    big_endian = big_endian_host();
+#endif
+    expression_context = ctx;
+    expression_frame = frame;
+    expression_addr = addr;
+    comp_expr = e;
+    if (set_trap(&trap)) {
+        CompiledType t;
+        if (s == NULL || *s == 0) str_exception(ERR_INV_EXPRESSION, "Empty expression");
+        text = s;
+        text_pos = 0;
+        text_len = strlen(s) + 1;
+        next_ch();
+        next_sy();
+        comp_conditional(&t);
+        if (text_sy != 0) not_compilable("unsupported operator");
+        assert(e->stk_pos == 1);
+        e->stk = (uint64_t *)loc_alloc(sizeof(uint64_t) * e->stk_max);
+        clear_trap(&trap);
+    }
+    comp_expr = NULL;
+    if (trap.error) {
+        free_compiled_expression(e);
+        errno = trap.error;
+        return NULL;
+    }
+    return e;
+}
+
+#if ENABLE_Symbols
+static uint64_t read_compiled_variable(CompiledExpression * e, CompiledVariable * var, Context * ctx, StackFrame * frame) {
+    unsigned i;
+    unsigned bits = 0;
+    uint64_t n = 0;
+    LocationExpressionState * state = NULL;
+    LocationExpressionState loc;
+
+    if (var->fixed_vm) {
+        /* Same as evaluate_location_expression(), but does not use temporary buffers */
+        uint64_t * stk = e->loc_stk;
+        memset(&loc, 0, sizeof(loc));
+        state = &loc;
+        state->ctx = ctx;
+        state->stack_frame = frame;
+        state->pieces = e->loc_pieces;
+        state->pieces_max = e->loc_max;
+        for (i = 0; i < var->cmds_cnt; i++) {
+            LocationExpressionCommand * cmd = var->cmds + i;
+            unsigned pos = state->stk_pos;
+            switch (cmd->cmd) {
+            case SFT_CMD_NUMBER:
+                stk[state->stk_pos++] = cmd->args.num;
+                break;
+            case SFT_CMD_RD_REG:
+                if (read_reg_value(frame, cmd->args.reg, stk + pos) < 0) exception(errno);
+                state->stk_pos++;
+                break;
+            case SFT_CMD_FP:
+                if (frame == NULL) str_exception(ERR_INV_CONTEXT, "Invalid stack frame");
+                stk[state->stk_pos++] = frame->fp;
+                break;
+            case SFT_CMD_RD_MEM:
+                {
+                    size_t j;
+                    uint8_t buf[8];
+                    size_t size = cmd->args.mem.size;
+                    if (pos < 1) str_exception(ERR_OTHER, "Invalid location expression");
+                    if (context_read_mem(ctx, (ContextAddress)stk[pos - 1], buf, size) < 0) exception(errno);
+                    n = 0;
+                    for (j = 0; j < size; j++) {
+                        n = (n << 8) | buf[cmd->args.mem.big_endian ? j : size - j - 1];
+                    }
+                    stk[pos - 1] = n;
+                }
+                break;
+            case SFT_CMD_LOCATION:
+                state->stk = stk;
+                state->type_stk = e->loc_type_stk;
+                state->stk_max = e->loc_max;
+                state->reg_id_scope = cmd->args.loc.reg_id_scope;
+                state->code = cmd->args.loc.code_addr;
+                state->code_len = cmd->args.loc.code_size;
+                state->code_pos = 0;
+                state->addr_size = cmd->args.loc.addr_size;
+                if (cmd->args.loc.func(state) < 0) exception(errno);
+                assert(state->stk == stk && state->pieces == e->loc_pieces);
+                break;
+            case SFT_CMD_PIECE:
+                {
+                    LocationPiece * piece = NULL;
+                    if (state->pieces_cnt >= state->pieces_max) str_exception(ERR_OTHER, "Invalid location expression");
+                    piece = state->pieces + state->pieces_cnt++;
+                    memset(piece, 0, sizeof(LocationPiece));
+                    if (cmd->args.piece.bit_offs == 0 && cmd->args.piece.bit_size % 8 == 0) {
+                        piece->size = cmd->args.piece.bit_size / 8;
+                    }
+                    else {
+                        piece->bit_offs = cmd->args.piece.bit_offs;
+                        piece->bit_size = cmd->args.piece.bit_size;
+                    }
+                    if (cmd->args.piece.reg != NULL) piece->reg = cmd->args.piece.reg;
+                    else if (pos == 0) str_exception(ERR_OTHER, "Invalid location expression");
+                    else piece->addr = (ContextAddress)stk[--state->stk_pos];
+                }
+                break;
+            default:
+                if (pos < 2) str_exception(ERR_OTHER, "Invalid location expression");
+                switch (cmd->cmd) {
+                case SFT_CMD_ADD: stk[pos - 2] = stk[pos - 2] + stk[pos - 1]; break;
+                case SFT_CMD_SUB: stk[pos - 2] = stk[pos - 2] - stk[pos - 1]; break;
+                case SFT_CMD_MUL: stk[pos - 2] = stk[pos - 2] * stk[pos - 1]; break;
+                case SFT_CMD_AND: stk[pos - 2] = stk[pos - 2] & stk[pos - 1]; break;
+                case SFT_CMD_OR:  stk[pos - 2] = stk[pos - 2] | stk[pos - 1]; break;
+                case SFT_CMD_XOR: stk[pos - 2] = stk[pos - 2] ^ stk[pos - 1]; break;
+                case SFT_CMD_GE:  stk[pos - 2] = stk[pos - 2] >= stk[pos - 1]; break;
+                case SFT_CMD_GT:  stk[pos - 2] = stk[pos - 2] > stk[pos - 1]; break;
+                case SFT_CMD_LE:  stk[pos - 2] = stk[pos - 2] <= stk[pos - 1]; break;
+                case SFT_CMD_LT:  stk[pos - 2] = stk[pos - 2] < stk[pos - 1]; break;
+                case SFT_CMD_SHL: stk[pos - 2] <<= stk[pos - 1]; break;
+                case SFT_CMD_SHR: stk[pos - 2] >>= stk[pos - 1]; break;
+                }
+                state->stk_pos--;
+                break;
+            }
+        }
+        state->stk = stk;
+    }
+    else {
+        state = evaluate_location_expression(ctx, frame, var->cmds, var->cmds_cnt, NULL, 0);
+    }
+    if (state->stk_pos == 2) {
+        /* Same as in evaluate_location_expression() */
+        state->stk[0] += state->stk[1];
+        state->stk_pos = 1;
+    }
+    if (state->pieces_cnt == 0 && state->stk_pos == 1) {
+        size_t j;
+        uint8_t buf[8];
+        if (context_read_mem(ctx, (ContextAddress)state->stk[0], buf, var->size) < 0) {
+            str_exception(errno, "Can't read variable value");
+        }
+        for (j = 0; j < var->size; j++) {
+            n = (n << 8) | buf[var->big_endian ? j : var->size - j - 1];
+        }
+        bits = (unsigned)var->size * 8;
+    }
+    else if (state->pieces_cnt == 1) {
+        /* Single piece values, other cases are handled by the expression interpreter */
+        size_t j;
+        LocationPiece * piece = state->pieces;
+        if (piece->optimized_away || piece->implicit_pointer || piece->bit_size) exception(ERR_UNSUPPORTED);
+        if (piece->size != 1 && piece->size != 2 && piece->size != 4 && piece->size != 8) exception(ERR_UNSUPPORTED);
+        if (piece->reg != NULL) {
+            if (read_reg_value(frame, piece->reg, &n) < 0) exception(errno);
+        }
+        else {
+            uint8_t buf[8];
+            uint8_t * data = buf;
+            if (piece->value != NULL) data = (uint8_t *)piece->value;
+            else if (context_read_mem(ctx, piece->addr, buf, piece->size) < 0) exception(errno);
+            for (j = 0; j < piece->size; j++) {
+                n = (n << 8) | data[var->big_endian ? j : piece->size - j - 1];
+            }
+        }
+        bits = (unsigned)piece->size * 8;
+        if (var->type_class == TYPE_CLASS_ENUMERATION && piece->size < var->size) bits = 0;
+    }
+    else {
+        exception(ERR_UNSUPPORTED);
+    }
+    if (bits > 0 && bits < 64) {
+        n &= ((uint64_t)1 << bits) - 1;
+        if (var->type_class != TYPE_CLASS_CARDINAL && (n >> (bits - 1)) != 0) n |= ~(uint64_t)0 << bits;
+    }
+    return n;
+}
+#endif /* ENABLE_Symbols */
+
+int evaluate_compiled_expression(CompiledExpression * e, Context * ctx, int frame, int64_t * res) {
+    Trap trap;
+
+    if (set_trap(&trap)) {
+        unsigned pc = 0;
+        unsigned pos = 0;
+        uint64_t * stk = e->stk;
+        StackFrame * frame_info = NULL;
+#if ENABLE_Symbols
+        if (e->has_vars && frame != STACK_NO_FRAME && get_frame_info(ctx, frame, &frame_info) < 0) {
+            str_exception(errno, "Cannot get stack frame info");
+        }
+#endif
+        while (pc < e->ops_cnt) {
+            CompiledOp * o = e->ops + pc++;
+            uint64_t x = 0;
+            switch (o->op) {
+            case CEX_NUM:
+                stk[pos++] = o->num;
+                continue;
+#if ENABLE_Symbols
+            case CEX_VAR:
+                stk[pos++] = read_compiled_variable(e, o->var, ctx, frame_info);
+                continue;
+#endif
+            case CEX_EXT:
+                x = stk[pos - 1] & (((uint64_t)1 << (o->size * 8)) - 1);
+                if (!o->uns && (x >> (o->size * 8 - 1)) != 0) x |= ~(uint64_t)0 << (o->size * 8);
+                stk[pos - 1] = x;
+                continue;
+            case CEX_NEG:
+                stk[pos - 1] = (uint64_t)-(int64_t)stk[pos - 1];
+                continue;
+            case CEX_NOT:
+                stk[pos - 1] = stk[pos - 1] == 0;
+                continue;
+            case CEX_INV:
+                stk[pos - 1] = ~stk[pos - 1];
+                continue;
+            case CEX_LAND:
+                if (stk[pos - 1] == 0) pc = o->jump;
+                else pos--;
+                continue;
+            case CEX_LOR:
+                if (stk[pos - 1] != 0) pc = o->jump;
+                else pos--;
+                continue;
+            }
+            assert(pos >= 2);
+            x = stk[--pos];
+            switch (o->op) {
+            case CEX_ADD: stk[pos - 1] += x; break;
+            case CEX_SUB: stk[pos - 1] -= x; break;
+            case CEX_MUL: stk[pos - 1] *= x; break;
+            case CEX_DIV:
+                if (o->uns) stk[pos - 1] /= x;
+                else stk[pos - 1] = (uint64_t)((int64_t)stk[pos - 1] / (int64_t)x);
+                break;
+            case CEX_MOD:
+                if (o->uns) stk[pos - 1] %= x;
+                else stk[pos - 1] = (uint64_t)((int64_t)stk[pos - 1] % (int64_t)x);
+                break;
+            case CEX_SHL: stk[pos - 1] <<= x; break;
+            case CEX_SHR:
+                if (o->uns) stk[pos - 1] >>= x;
+                else stk[pos - 1] = (uint64_t)((int64_t)stk[pos - 1] >> x);
+                break;
+            case CEX_AND: stk[pos - 1] &= x; break;
+            case CEX_OR: stk[pos - 1] |= x; break;
+            case CEX_XOR: stk[pos - 1] ^= x; break;
+            case CEX_EQ: stk[pos - 1] = stk[pos - 1] == x; break;
+            case CEX_NE: stk[pos - 1] = stk[pos - 1] != x; break;
+            case CEX_LT: stk[pos - 1] = o->uns ? stk[pos - 1] < x : (int64_t)stk[pos - 1] < (int64_t)x; break;
+            case CEX_LE: stk[pos - 1] = o->uns ? stk[pos - 1] <= x : (int64_t)stk[pos - 1] <= (int64_t)x; break;
+            case CEX_GT: stk[pos - 1] = o->uns ? stk[pos - 1] > x : (int64_t)stk[pos - 1] > (int64_t)x; break;
+            case CEX_GE: stk[pos - 1] = o->uns ? stk[pos - 1] >= x : (int64_t)stk[pos - 1] >= (int64_t)x; break;
+            default: assert(0); break;
+            }
+        }
+        assert(pos == 1);
+        *res = (int64_t)stk[0];
+        clear_trap(&trap);
+        return 0;
+    }
+    errno = trap.error;
+    return -1;
+}
+
+#if ENABLE_Symbols
+static int is_constant_location(LocationExpressionCommand * cmd) {
+    /* Single DWARF operation that pushes a constant address */
+    size_t size = cmd->args.loc.code_size;
+    uint8_t * code = cmd->args.loc.code_addr;
+    if (size == 0) return 0;
+    switch (code[0]) {
+    case OP_addr: return size == 1 + cmd->args.loc.addr_size;
+    case OP_const4u: return size == 5;
+    case OP_const8u: return size == 9;
+    case OP_constu:
+        {
+            size_t i = 1;
+            while (i < size && (code[i] & 0x80) != 0) i++;
+            return i + 1 == size;
+        }
+    }
+    return 0;
+}
+#endif
+
+int get_compiled_expression_ops(CompiledExpression * e, Context * ctx, CompiledExpressionOp ** ops, unsigned * cnt) {
+    Trap trap;
+    CompiledExpressionOp * buf = (CompiledExpressionOp *)tmp_alloc_zero(sizeof(CompiledExpressionOp) * e->ops_cnt);
+
+    if (set_trap(&trap)) {
+        unsigned i;
+        for (i = 0; i < e->ops_cnt; i++) {
+            CompiledOp * o = e->ops + i;
+            CompiledExpressionOp * x = buf + i;
+            x->op = o->op;
+            x->uns = o->uns;
+            x->size = (unsigned)o->size;
+            x->jump = o->jump;
+            x->num = o->num;
+#if ENABLE_Symbols
+            if (o->op == CEX_VAR) {
+                unsigned j;
+                CompiledVariable * var = o->var;
+                LocationExpressionState * state = NULL;
+                /* Only static variables: the address must not depend on registers or memory contents */
+                for (j = 0; j < var->cmds_cnt; j++) {
+                    LocationExpressionCommand * cmd = var->cmds + j;
+                    if (cmd->cmd == SFT_CMD_NUMBER) continue;
+                    if (cmd->cmd == SFT_CMD_LOCATION && is_constant_location(cmd)) continue;
+                    str_exception(ERR_UNSUPPORTED, "Variable address is not fixed");
+                }
+                state = evaluate_location_expression(ctx, NULL, var->cmds, var->cmds_cnt, NULL, 0);
+                if (state->stk_pos == 2) {
+                    state->stk[0] += state->stk[1];
+                    state->stk_pos = 1;
+                }
+                if (state->pieces_cnt > 0 || state->stk_pos != 1) str_exception(ERR_UNSUPPORTED, "Variable address is not fixed");
+                x->addr = (ContextAddress)state->stk[0];
+                x->size = (unsigned)var->size;
+                x->uns = var->type_class == TYPE_CLASS_CARDINAL;
+                x->big_endian = var->big_endian;
+            }
+#endif
+        }
+        clear_trap(&trap);
+        *ops = buf;
+        *cnt = e->ops_cnt;
+        return 0;
+    }
+    errno = trap.error;
+    return -1;
+}
+
 #if SERVICE_Expressions
 
 /********************** Commands **************************/
@@ -3951,6 +4990,7 @@ typedef struct Expression {
     ContextAddress size;
     int type_class;
     char type[256];
+    ExpressionSymbols * symbols;
 } Expression;
 
 #define link_all2exp(A)  ((Expression *)((char *)(A) - offsetof(Expression, link_all)))
@@ -4070,6 +5110,27 @@ static int symbol_to_expression(char * expr_id, char * parent, char * sym_id, Ex
 #endif
 }
 
+static void set_expression_symbols(Expression * e) {
+#if ENABLE_ExpressionSymbolsCache
+    expression_symbols = NULL;
+    expression_symbols_state = 0;
+    if (e != NULL && find_expression(e->id) == e) {
+        if (e->symbols == NULL) e->symbols = (ExpressionSymbols *)loc_alloc_zero(sizeof(ExpressionSymbols));
+        expression_symbols = e->symbols;
+    }
+#endif
+}
+
+static void free_expression(Expression * e) {
+    list_remove(&e->link_all);
+    list_remove(&e->link_id);
+#if ENABLE_ExpressionSymbolsCache
+    free_expression_symbols(e->symbols);
+#endif
+    loc_free(e->script);
+    loc_free(e);
+}
+
 static int expression_context_id(char * id, Context ** ctx, int * frame, Expression ** expr) {
     int err = 0;
     Expression * e = NULL;
@@ -4442,8 +5503,10 @@ static void command_evaluate_cache_client(void * x) {
         expression_context = ctx;
         expression_frame = frame;
         expression_addr = e->addr;
+        set_expression_symbols(e);
         if (evaluate_script(MODE_NORMAL, e->script, 0, &value) < 0) err = errno;
         else value_ok = 1;
+        set_expression_symbols(NULL);
     }
     if (!err && value.remote && value.size <= 0x10000) {
         buf = tmp_alloc_zero((size_t)value.size);
@@ -4662,7 +5725,9 @@ static void command_assign_cache_client(void * x) {
         expression_context = ctx;
         expression_frame = frame;
         expression_addr = e->addr;
+        set_expression_symbols(e);
         if (evaluate_script(MODE_NORMAL, e->script, 0, &value) < 0) err = errno;
+        set_expression_symbols(NULL);
     }
     if (!err) {
         if (value.remote) {
@@ -4743,10 +5808,7 @@ static void command_dispose_cache_client(void * x) {
     cache_exit();
 
     if (e != NULL) {
-        list_remove(&e->link_all);
-        list_remove(&e->link_id);
-        loc_free(e->script);
-        loc_free(e);
+        free_expression(e);
     }
     else {
         err = ERR_INV_CONTEXT;
@@ -4776,10 +5838,7 @@ static void on_channel_close(Channel * c) {
         Expression * e = link_all2exp(l);
         l = l->next;
         if (e->channel == c) {
-            list_remove(&e->link_all);
-            list_remove(&e->link_id);
-            loc_free(e->script);
-            loc_free(e);
+            free_expression(e);
         }
     }
 }
@@ -4825,6 +5884,29 @@ void ini_expressions_service(Protocol * proto) {
 #endif
 #if ENABLE_ExpressionSerialization
         list_init(&cmd_queue);
+#endif
+#if ENABLE_ExpressionSymbolsCache
+        {
+            static ContextEventListener listener = {
+                NULL,
+                expression_symbols_changed,
+                NULL,
+                NULL,
+                expression_symbols_changed
+            };
+            add_context_event_listener(&listener, NULL);
+        }
+#if SERVICE_MemoryMap
+        {
+            static MemoryMapEventListener listener = {
+                expression_symbols_changed,
+                NULL,
+                expression_symbols_changed,
+                expression_symbols_changed,
+            };
+            add_memory_map_event_listener(&listener, NULL);
+        }
+#endif
 #endif
         for (i = 0; i < ID2EXP_HASH_SIZE; i++) list_init(id2exp + i);
         add_channel_close_listener(on_channel_close);
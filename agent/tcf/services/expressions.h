@@ -114,6 +114,85 @@ int value_to_double(Value * v, double * res);
  */
 extern void set_value(Value * v, void * data, size_t size, int big_endian);
 
+/*
+ * Compiled expression is a simple integer expression translated into a compact program,
+ * which can be evaluated many times without parsing the text and searching symbols.
+ */
+typedef struct CompiledExpression CompiledExpression;
+
+/*
+ * Compile given expression in given context.
+ * 'ctx', 'frame' and 'addr' are used for symbols lookup, same as in evaluate_expression().
+ * The compiler supports integer constants, integer and enumeration variables and constants,
+ * and C unary, arithmetic, bitwise, comparison and logical operators.
+ * The result is valid only for same code address and until memory map of the context changes.
+ * Return NULL and set errno if the expression cannot be compiled,
+ * errno is ERR_UNSUPPORTED if the expression is valid, but should be evaluated by evaluate_expression().
+ */
+extern CompiledExpression * compile_expression(Context * ctx, int frame, ContextAddress addr, char * s);
+
+/*
+ * Evaluate compiled expression in given context and stack frame.
+ * Return 0 and set '*res' to the expression value if no errors, otherwise return -1 and set errno.
+ * errno is ERR_UNSUPPORTED if the value layout cannot be handled by compiled code,
+ * in that case, the expression should be evaluated by evaluate_expression().
+ */
+extern int evaluate_compiled_expression(CompiledExpression * e, Context * ctx, int frame, int64_t * res);
+
+/*
+ * Dispose compiled expression.
+ */
+extern void free_compiled_expression(CompiledExpression * e);
+
+/*
+ * Compiled expression operation codes.
+ * A compiled expression is a program for a stack machine with 64-bit stack slots,
+ * the program leaves the expression value on top of the stack.
+ */
+#define CEX_NUM     1   /* Push constant */
+#define CEX_VAR     2   /* Push variable value */
+#define CEX_EXT     3   /* Truncate to 'size' bytes, then extend, signed if !uns */
+#define CEX_NEG     4
+#define CEX_NOT     5
+#define CEX_INV     6
+#define CEX_ADD     7
+#define CEX_SUB     8
+#define CEX_MUL     9
+#define CEX_DIV    10
+#define CEX_MOD    11
+#define CEX_SHL    12
+#define CEX_SHR    13
+#define CEX_AND    14
+#define CEX_OR     15
+#define CEX_XOR    16
+#define CEX_EQ     17
+#define CEX_NE     18
+#define CEX_LT     19
+#define CEX_LE     20
+#define CEX_GT     21
+#define CEX_GE     22
+#define CEX_LAND   23   /* If top of stack is 0 jump, else pop */
+#define CEX_LOR    24   /* If top of stack is not 0 jump, else pop */
+
+typedef struct CompiledExpressionOp {
+    int op;
+    int uns;                /* 1 if operands are unsigned, CEX_VAR: 1 if the value is zero extended */
+    unsigned size;          /* CEX_EXT, CEX_VAR: value size */
+    unsigned jump;          /* CEX_LAND, CEX_LOR: index of jump target operation */
+    uint64_t num;           /* CEX_NUM: the constant */
+    ContextAddress addr;    /* CEX_VAR: variable address */
+    int big_endian;         /* CEX_VAR: 1 if the variable is big endian */
+} CompiledExpressionOp;
+
+/*
+ * Get compiled expression program, with every variable resolved to a fixed memory address.
+ * It allows to translate the expression into target code, e.g. to evaluate it in the target.
+ * The returned array is allocated with tmp_alloc().
+ * Return 0 on success, otherwise return -1 and set errno,
+ * errno is ERR_UNSUPPORTED if a variable location is not a fixed address.
+ */
+extern int get_compiled_expression_ops(CompiledExpression * e, Context * ctx, CompiledExpressionOp ** ops, unsigned * cnt);
+
 /*
  * Add identifier callback to the list of expression callbacks.
  * The callbacks are called for each identifier found in an expression during evaluation.
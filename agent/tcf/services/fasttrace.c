@@ -0,0 +1,982 @@
+/*******************************************************************************
+ * Copyright (c) 2026 Wind River Systems, Inc. and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ * The Eclipse Public License is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ * You may elect to redistribute this code under either of these licenses.
+ *
+ * Contributors:
+ *     Wind River Systems - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Fast tracepoints: target side tracepoint evaluation with jump-patch trampolines.
+ */
+
+#include <tcf/config.h>
+
+#include <tcf/services/fasttrace.h>
+
+#if ENABLE_FastTracepoints
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <tcf/framework/errors.h>
+#include <tcf/framework/trace.h>
+#include <tcf/framework/myalloc.h>
+#include <tcf/framework/exceptions.h>
+#include <tcf/framework/events.h>
+#include <tcf/framework/cache.h>
+#include <tcf/framework/json.h>
+#include <tcf/framework/streams.h>
+#include <tcf/framework/cpudefs.h>
+#include <tcf/services/symbols.h>
+#include <tcf/services/linenumbers.h>
+#include <tcf/services/breakpoints.h>
+#include <tcf/services/runctrl.h>
+
+/* Ring buffer polling period, microseconds */
+#define FAST_TRACE_POLL_PERIOD  10000
+
+/* Max number of records read from the target at once */
+#define FAST_TRACE_READ_MAX     64
+
+/* Number of code bytes examined at tracepoint address */
+#define FAST_TRACE_CODE_SIZE    32
+
+/* Min number of records in a ring buffer */
+#define FAST_TRACE_MIN_RECORDS  16
+
+/* Trampoline slot size, the tracepoint that uses control block N uses trampoline slot N of a code area */
+#define FAST_TRACE_TRAMP_SIZE   2048
+
+/* Size of code area allocated in the target */
+#define FAST_TRACE_CODE_AREA    (FAST_TRACE_TRAMP_SIZE * FAST_TRACE_CTRL_CNT)
+
+/* Number of records in ring buffer allocated in the target */
+#define FAST_TRACE_BUF_RECORDS  4096
+
+/* Max distance between a tracepoint and its trampoline, rel32 jump range */
+#define FAST_TRACE_JUMP_RANGE   0x7fff0000
+
+/* Lowest address used as mmap() hint */
+#define FAST_TRACE_MIN_ADDR     0x10000
+
+/* Max number of attempts to single step a thread over mmap() system call */
+#define FAST_TRACE_MMAP_RETRY   100
+
+/* Trampolines memory */
+typedef struct FastTraceCode {
+    ContextAddress addr;
+    ContextAddress size;
+} FastTraceCode;
+
+typedef struct MmapRequest MmapRequest;
+
+/* Per process fast trace memory */
+typedef struct FastTraceArea {
+    FastTraceCode * code;
+    unsigned code_cnt;
+    unsigned code_max;
+    ContextAddress buf_addr;
+    ContextAddress buf_size;
+    uint64_t size;              /* Number of records */
+    uint64_t tail;
+    uint64_t lost;
+    int initialized;            /* The buffer header is written into the target */
+    int poll_posted;
+    unsigned jump_cnt;
+    unsigned disposed_cnt;      /* Number of disposed tracepoints waiting for the code to be restored */
+    FastTracepoint * ctrl[FAST_TRACE_CTRL_CNT];
+    MmapRequest * mmap;         /* Memory allocation in progress */
+    ErrorReport * mmap_error;   /* Allocation error, reported to tracepoint 'mmap_error_id' */
+    uint64_t mmap_error_id;
+    AbstractCache cache;        /* Install cache clients waiting for memory allocation */
+} FastTraceArea;
+
+/* Memory allocation: a stopped thread of the process executes mmap() */
+struct MmapRequest {
+    Context * prs;
+    FastTraceArea * area;       /* NULL if the process has exited */
+    Context * ctx;              /* The thread that executes the system call */
+    uint64_t id;                /* ID of the tracepoint that needs the memory */
+    ContextAddress addr;        /* The tracepoint address */
+    ContextAddress pc;
+    uint8_t saved_code[16];
+    FastTraceSyscall sc;
+    unsigned step_cnt;
+    int posted;                 /* Safe event is posted, otherwise waiting for a thread to be resumed */
+    int error;
+};
+
+typedef struct ContextExtensionFT {
+    FastTraceArea * area;
+    unsigned max_records;       /* Ring buffer size requested by set_fast_trace_buffer_size() */
+} ContextExtensionFT;
+
+struct FastTracepoint {
+    Context * ctx;
+    ContextAddress addr;
+    char * condition;
+    char * values[FAST_TRACE_VALUES];
+    unsigned values_cnt;
+    FastTraceCallBack * callback;
+    FastTraceModeCallBack * mode_callback;
+    void * args;
+    uint64_t id;
+    int mode;
+    int disposed;
+    ErrorReport * error;
+    BreakpointInfo * bp;
+    int ctrl;
+    ContextAddress patch_addr;
+    size_t patch_size;
+    uint8_t saved_code[16];
+    ContextAddress tramp_addr;
+    size_t tramp_size;
+};
+
+/* Data collected by the install cache client */
+typedef struct InstallData {
+    FastTraceArea * area;
+    FastTraceCode * code_area;  /* Trampolines memory within jump range */
+    uint8_t * code;
+    CompiledExpressionOp * cond;
+    unsigned cond_cnt;
+    CompiledExpressionOp * values[FAST_TRACE_VALUES];
+    unsigned values_ops[FAST_TRACE_VALUES];
+    ContextAddress * lines;     /* Statement addresses near the tracepoint */
+    unsigned lines_cnt;
+    unsigned lines_max;
+} InstallData;
+
+static size_t context_extension_offset = 0;
+
+#define EXT(ctx) ((ContextExtensionFT *)((char *)(ctx) + context_extension_offset))
+
+static FastTraceStats stats;
+static uint64_t tracepoint_id_cnt = 0;
+
+static uint64_t get_time_usec(void) {
+    struct timespec t;
+    if (clock_gettime(CLOCK_REALTIME, &t) < 0) return 0;
+    return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static uint64_t get_u64(uint8_t * p) {
+    unsigned i;
+    uint64_t n = 0;
+    for (i = 8; i > 0; i--) n = (n << 8) | p[i - 1];
+    return n;
+}
+
+static void set_u64(uint8_t * p, uint64_t n) {
+    unsigned i;
+    for (i = 0; i < 8; i++) p[i] = (uint8_t)(n >> (i * 8));
+}
+
+static void free_tracepoint(FastTracepoint * tp) {
+    unsigned i;
+    context_unlock(tp->ctx);
+    release_error_report(tp->error);
+    loc_free(tp->condition);
+    for (i = 0; i < tp->values_cnt; i++) loc_free(tp->values[i]);
+    loc_free(tp);
+}
+
+static int find_area_symbol(Context * prs, const char * name, ContextAddress * addr, ContextAddress * size) {
+    Symbol * sym = NULL;
+    if (find_symbol_by_name(prs, STACK_NO_FRAME, 0, name, &sym) < 0) {
+        if (get_error_code(errno) == ERR_SYM_NOT_FOUND) return 0;
+        exception(errno);
+    }
+    if (get_symbol_address(sym, addr) < 0) exception(errno);
+    if (get_symbol_size(sym, size) < 0) exception(errno);
+    return 1;
+}
+
+static void add_code_area(FastTraceArea * area, ContextAddress addr, ContextAddress size) {
+    FastTraceCode * c = NULL;
+    if (area->code_cnt >= area->code_max) {
+        area->code_max += 8;
+        area->code = (FastTraceCode *)loc_realloc(area->code, sizeof(FastTraceCode) * area->code_max);
+    }
+    c = area->code + area->code_cnt++;
+    c->addr = addr;
+    c->size = size;
+}
+
+static FastTraceArea * get_area(Context * prs) {
+    ContextExtensionFT * ext = EXT(prs);
+    if (ext->area == NULL) {
+        /* Memory provided by the target is used first, more memory is allocated with mmap() */
+        FastTraceArea * area = NULL;
+        ContextAddress code_addr = 0;
+        ContextAddress code_size = 0;
+        ContextAddress buf_addr = 0;
+        ContextAddress buf_size = 0;
+        int code_ok = find_area_symbol(prs, FAST_TRACE_CODE_SYMBOL, &code_addr, &code_size);
+        int buf_ok = find_area_symbol(prs, FAST_TRACE_BUFFER_SYMBOL, &buf_addr, &buf_size);
+        if (buf_ok && buf_size < FAST_TRACE_DATA_OFFS + FAST_TRACE_MIN_RECORDS * sizeof(FastTraceRecord)) {
+            str_exception(ERR_UNSUPPORTED, "Fast trace buffer is too small");
+        }
+        area = (FastTraceArea *)loc_alloc_zero(sizeof(FastTraceArea));
+        if (code_ok) add_code_area(area, code_addr, code_size);
+        if (buf_ok) {
+            area->buf_addr = buf_addr;
+            area->buf_size = buf_size;
+        }
+        ext->area = area;
+    }
+    return ext->area;
+}
+
+static int is_reachable(ContextAddress addr, FastTraceCode * c) {
+    if (c->addr >= addr) return c->addr + c->size - addr <= FAST_TRACE_JUMP_RANGE;
+    return addr - c->addr <= FAST_TRACE_JUMP_RANGE;
+}
+
+static ContextAddress get_mmap_hint(Context * prs, ContextAddress addr, ContextAddress size) {
+    /* Find unmapped range nearest to 'addr'. The memory map does not include all anonymous regions,
+     * so the result is only a hint, the kernel ignores it if the range is not free */
+    unsigned i;
+    MemoryMap map;
+    ContextAddress hint = 0;
+    ContextAddress dist = FAST_TRACE_JUMP_RANGE;
+    ContextAddress lo = FAST_TRACE_MIN_ADDR;
+
+    memset(&map, 0, sizeof(map));
+    if (context_get_memory_map(prs, &map) == 0) {
+        for (i = 0; i < map.region_cnt; i++) {
+            MemoryRegion * r = map.regions + i;
+            if (r->addr >= lo + size) {
+                /* Top of a gap below the tracepoint or bottom of a gap above it */
+                ContextAddress x = r->addr <= addr ? (r->addr - size) & ~(ContextAddress)0xfff : lo;
+                ContextAddress d = x < addr ? addr - x : x + size - addr;
+                if (d <= dist) {
+                    hint = x;
+                    dist = d;
+                }
+            }
+            if (r->addr + r->size > lo) lo = r->addr + r->size;
+        }
+    }
+    context_clear_memory_map(&map);
+    loc_free(map.regions);
+    return hint;
+}
+
+static void mmap_done(MmapRequest * req, int error, ContextAddress addr) {
+    FastTraceArea * area = req->area;
+    if (req->ctx != NULL) context_unlock(req->ctx);
+    if (area != NULL) {
+        assert(area->mmap == req);
+        area->mmap = NULL;
+        if (!error) {
+            trace(LOG_CONTEXT, "fast trace: allocated %s memory at %#" PRIx64 ", size %#" PRIx64,
+                req->sc.exec ? "code" : "buffer", (uint64_t)addr, (uint64_t)req->sc.size);
+            if (req->sc.exec) {
+                add_code_area(area, addr, req->sc.size);
+                if (!is_reachable(req->addr, area->code + area->code_cnt - 1)) {
+                    /* The memory is kept, other tracepoints can reach it */
+                    error = set_errno(ERR_UNSUPPORTED, "Cannot allocate trampoline memory within jump range");
+                }
+            }
+            else {
+                area->buf_addr = addr;
+                area->buf_size = req->sc.size;
+            }
+        }
+        if (error) {
+            area->mmap_error = get_error_report(error);
+            area->mmap_error_id = req->id;
+        }
+        cache_notify_later(&area->cache);
+    }
+    loc_free(req);
+}
+
+static void mmap_step_done_event(void * args);
+
+static void mmap_step(MmapRequest * req) {
+    req->posted = 1;
+    post_safe_event(req->prs, mmap_step_done_event, req);
+    if (safe_context_single_step(req->ctx) < 0) req->error = errno;
+}
+
+static void mmap_step_done_event(void * args) {
+    MmapRequest * req = (MmapRequest *)args;
+    Context * ctx = req->ctx;
+    ContextAddress pc = 0;
+    ContextAddress addr = 0;
+    int error = req->error;
+
+    req->posted = 0;
+    if (req->area == NULL) {
+        mmap_done(req, ERR_ALREADY_EXITED, 0);
+        return;
+    }
+    if (!error && ctx->exited) error = ERR_ALREADY_EXITED;
+    if (!error && get_PC(ctx, &pc) < 0) error = errno;
+    if (!error && pc == req->pc && ++req->step_cnt < FAST_TRACE_MMAP_RETRY) {
+        /* The step is interrupted before the instruction is executed, try again */
+        mmap_step(req);
+        return;
+    }
+    if (!error && pc != req->pc + req->sc.code_size) error = set_errno(ERR_OTHER, "Cannot execute mmap() system call");
+    if (!ctx->exited && finish_fast_trace_mmap(ctx, &req->sc, &addr) < 0 && !error) error = errno;
+    if (context_write_mem(req->prs, req->pc, req->saved_code, req->sc.code_size) < 0 && !error) error = errno;
+    mmap_done(req, error, addr);
+}
+
+static FastTracepoint * find_patch(Context * prs, ContextAddress addr) {
+    unsigned i;
+    FastTraceArea * area = prs->exited ? NULL : EXT(prs)->area;
+    if (area == NULL) return NULL;
+    for (i = 0; i < FAST_TRACE_CTRL_CNT; i++) {
+        /* Including disposed tracepoints, their jumps are removed when all threads are stopped */
+        FastTracepoint * tp = area->ctrl[i];
+        if (tp != NULL && addr >= tp->patch_addr && addr < tp->patch_addr + tp->patch_size) return tp;
+    }
+    return NULL;
+}
+
+static Context * get_syscall_thread(Context * prs) {
+    /* Stepping would resume an intercepted thread, only threads stopped by the safe event can be used */
+    LINK * l;
+    for (l = prs->children.next; l != &prs->children; l = l->next) {
+        Context * ctx = cldl2ctxp(l);
+        ContextAddress pc = 0;
+        unsigned i;
+        if (ctx->exited || ctx->exiting || !ctx->stopped || is_intercepted(ctx)) continue;
+        if (is_skipping_breakpoint(ctx)) continue;
+        if (get_PC(ctx, &pc) < 0) continue;
+        for (i = 0; i < sizeof(((MmapRequest *)0)->saved_code); i++) {
+            /* The system call instruction and the restored code must not overwrite a jump */
+            if (is_breakpoint_address(prs, pc + i)) break;
+            if (find_patch(prs, pc + i) != NULL) break;
+        }
+        if (i < sizeof(((MmapRequest *)0)->saved_code)) continue;
+        return ctx;
+    }
+    return NULL;
+}
+
+static void mmap_start_event(void * args) {
+    MmapRequest * req = (MmapRequest *)args;
+    Context * prs = req->prs;
+    Context * ctx = NULL;
+
+    req->posted = 0;
+    if (req->area == NULL) {
+        mmap_done(req, ERR_ALREADY_EXITED, 0);
+        return;
+    }
+    /* If no thread can be used, wait until a thread is resumed, see event_context_started() */
+    if ((ctx = get_syscall_thread(prs)) == NULL) return;
+    context_lock(req->ctx = ctx);
+    if (get_PC(ctx, &req->pc) < 0 ||
+            context_read_mem(prs, req->pc, req->saved_code, sizeof(req->saved_code)) < 0 ||
+            start_fast_trace_mmap(ctx, &req->sc) < 0) {
+        mmap_done(req, errno, 0);
+        return;
+    }
+    assert(req->sc.code_size <= sizeof(req->saved_code));
+    if (context_write_mem(prs, req->pc, req->sc.code, req->sc.code_size) < 0) {
+        int error = errno;
+        ContextAddress addr = 0;
+        finish_fast_trace_mmap(ctx, &req->sc, &addr);
+        mmap_done(req, error, 0);
+        return;
+    }
+    mmap_step(req);
+}
+
+static void alloc_memory(FastTracepoint * tp, FastTraceArea * area, int exec) {
+    MmapRequest * req = (MmapRequest *)loc_alloc_zero(sizeof(MmapRequest));
+    req->prs = tp->ctx;
+    req->area = area;
+    req->id = tp->id;
+    req->addr = tp->addr;
+    req->sc.exec = exec;
+    if (exec) {
+        req->sc.size = FAST_TRACE_CODE_AREA;
+        req->sc.addr = get_mmap_hint(tp->ctx, tp->addr, req->sc.size);
+    }
+    else {
+        req->sc.size = FAST_TRACE_DATA_OFFS + FAST_TRACE_BUF_RECORDS * sizeof(FastTraceRecord);
+    }
+    release_error_report(area->mmap_error);
+    area->mmap_error = NULL;
+    area->mmap = req;
+    req->posted = 1;
+    post_safe_event(tp->ctx, mmap_start_event, req);
+    cache_wait(&area->cache);
+}
+
+static void get_memory(FastTracepoint * tp, InstallData * data) {
+    unsigned i;
+    FastTraceArea * area = data->area;
+
+    if (area->mmap != NULL) cache_wait(&area->cache);
+    if (area->mmap_error != NULL && area->mmap_error_id == tp->id) {
+        int error = set_error_report_errno(area->mmap_error);
+        release_error_report(area->mmap_error);
+        area->mmap_error = NULL;
+        exception(error);
+    }
+    if (area->buf_addr == 0) alloc_memory(tp, area, 0);
+    for (i = 0; i < area->code_cnt; i++) {
+        if (is_reachable(tp->addr, area->code + i)) {
+            data->code_area = area->code + i;
+            return;
+        }
+    }
+    alloc_memory(tp, area, 1);
+}
+
+static void line_numbers_callback(CodeArea * area, void * args) {
+    InstallData * data = (InstallData *)args;
+    if (data->lines_cnt >= data->lines_max) {
+        data->lines_max += 16;
+        data->lines = (ContextAddress *)tmp_realloc(data->lines, sizeof(ContextAddress) * data->lines_max);
+    }
+    data->lines[data->lines_cnt++] = area->start_address;
+}
+
+static void compile_tracepoint_expression(FastTracepoint * tp, char * s,
+        CompiledExpressionOp ** ops, unsigned * cnt) {
+    int error = 0;
+    CompiledExpression * e = compile_expression(tp->ctx, STACK_NO_FRAME, tp->addr, s);
+    if (e == NULL) exception(errno);
+    if (get_compiled_expression_ops(e, tp->ctx, ops, cnt) < 0) error = errno;
+    free_compiled_expression(e);
+    if (error) exception(error);
+}
+
+static void get_install_data(FastTracepoint * tp, InstallData * data) {
+    unsigned i;
+    Context * prs = tp->ctx;
+
+    memset(data, 0, sizeof(InstallData));
+    data->area = get_area(prs);
+    if (tp->condition != NULL) compile_tracepoint_expression(tp, tp->condition, &data->cond, &data->cond_cnt);
+    for (i = 0; i < tp->values_cnt; i++) {
+        compile_tracepoint_expression(tp, tp->values[i], data->values + i, data->values_ops + i);
+    }
+    /* Planted jumps are replaced with the original code by context_read_mem(), see check_fast_trace_on_memory_read() */
+    data->code = (uint8_t *)tmp_alloc(FAST_TRACE_CODE_SIZE);
+    if (context_read_mem(prs, tp->addr, data->code, FAST_TRACE_CODE_SIZE) < 0) exception(errno);
+#if ENABLE_LineNumbers
+    /* Statement addresses can be branch targets, the jump must not cover them */
+    if (address_to_line(prs, tp->addr, tp->addr + FAST_TRACE_CODE_SIZE, line_numbers_callback, data) < 0) {
+        if (get_error_code(errno) == ERR_CACHE_MISS) exception(errno);
+        data->lines_cnt = 0;
+    }
+#endif
+    get_memory(tp, data);
+}
+
+static int is_patch_address(FastTracepoint * tp, ContextAddress addr) {
+    return addr > tp->patch_addr && addr < tp->patch_addr + tp->patch_size;
+}
+
+static int is_trampoline_address(FastTracepoint * tp, ContextAddress addr) {
+    return addr >= tp->tramp_addr && addr < tp->tramp_addr + tp->tramp_size;
+}
+
+static int check_threads(FastTracepoint * tp) {
+    /* The code can be patched only when no thread can execute it */
+    LINK * l;
+    Context * prs = tp->ctx;
+    for (l = prs->children.next; l != &prs->children; l = l->next) {
+        Context * ctx = cldl2ctxp(l);
+        ContextAddress pc = 0;
+        if (ctx->exited) continue;
+        if (!ctx->stopped) {
+            set_errno(ERR_IS_RUNNING, "Process is running");
+            return -1;
+        }
+        if (get_PC(ctx, &pc) < 0) return -1;
+        if (is_patch_address(tp, pc) || is_trampoline_address(tp, pc)) {
+            set_errno(ERR_UNSUPPORTED, "Thread is stopped in patched code");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int write_area_header(Context * prs, FastTraceArea * area) {
+    uint8_t buf[FAST_TRACE_CTRL_OFFS + FAST_TRACE_CTRL_SIZE * FAST_TRACE_CTRL_CNT];
+    unsigned max = EXT(prs)->max_records;
+    uint64_t size = FAST_TRACE_MIN_RECORDS;
+
+    while (FAST_TRACE_DATA_OFFS + size * 2 * sizeof(FastTraceRecord) <= area->buf_size &&
+        (max == 0 || size * 2 <= max)) size *= 2;
+    memset(buf, 0, sizeof(buf));
+    set_u64(buf + FAST_TRACE_SIZE_OFFS, size);
+    set_u64(buf + FAST_TRACE_MASK_OFFS, size - 1);
+    if (context_write_mem(prs, area->buf_addr, buf, sizeof(buf)) < 0) return -1;
+    area->size = size;
+    area->tail = 0;
+    area->lost = 0;
+    area->initialized = 1;
+    return 0;
+}
+
+static int write_ctrl_block(FastTracepoint * tp, FastTraceArea * area, int enabled) {
+    uint8_t buf[FAST_TRACE_CTRL_SIZE];
+    memset(buf, 0, sizeof(buf));
+    set_u64(buf, enabled);
+    return context_write_mem(tp->ctx, area->buf_addr + FAST_TRACE_CTRL_OFFS +
+        (ContextAddress)tp->ctrl * FAST_TRACE_CTRL_SIZE, buf, sizeof(buf));
+}
+
+static void release_tracepoints(Context * prs, FastTraceArea * area) {
+    /* Restore code of disposed tracepoints, then release control blocks and trampoline slots */
+    unsigned i;
+    for (i = 0; i < FAST_TRACE_CTRL_CNT && area->disposed_cnt > 0; i++) {
+        FastTracepoint * tp = area->ctrl[i];
+        uint8_t buf[sizeof(tp->saved_code)];
+        if (tp == NULL || !tp->disposed) continue;
+        if (check_threads(tp) < 0) {
+            if (get_error_code(errno) == ERR_IS_RUNNING) return;
+            continue;
+        }
+        /* context_write_mem() keeps breakpoints planted over the restored code */
+        memcpy(buf, tp->saved_code, tp->patch_size);
+        if (context_write_mem(prs, tp->patch_addr, buf, tp->patch_size) < 0) {
+            trace(LOG_ALWAYS, "Cannot remove fast tracepoint: %s", errno_to_str(errno));
+            continue;
+        }
+        area->ctrl[i] = NULL;
+        area->disposed_cnt--;
+        free_tracepoint(tp);
+    }
+}
+
+static void poll_event(void * args);
+
+static int plant_jump(FastTracepoint * tp, InstallData * data) {
+    unsigned i;
+    Context * prs = tp->ctx;
+    FastTraceArea * area = data->area;
+    FastTraceTrampoline t;
+    int slot = -1;
+
+    release_tracepoints(prs, area);
+    for (i = 0; i < FAST_TRACE_CTRL_CNT && slot < 0; i++) {
+        if ((ContextAddress)(i + 1) * FAST_TRACE_TRAMP_SIZE > data->code_area->size) break;
+        if (area->ctrl[i] == NULL) slot = (int)i;
+    }
+    if (slot < 0) {
+        set_errno(ERR_UNSUPPORTED, "Too many fast tracepoints");
+        return -1;
+    }
+
+    memset(&t, 0, sizeof(t));
+    t.addr = tp->addr;
+    t.code = data->code;
+    t.code_size = FAST_TRACE_CODE_SIZE;
+    t.tramp_addr = data->code_area->addr + (ContextAddress)slot * FAST_TRACE_TRAMP_SIZE;
+    t.buf_addr = area->buf_addr;
+    t.ctrl_addr = area->buf_addr + FAST_TRACE_CTRL_OFFS + (ContextAddress)slot * FAST_TRACE_CTRL_SIZE;
+    t.id = tp->id;
+    t.cond = data->cond;
+    t.cond_cnt = data->cond_cnt;
+    for (i = 0; i < tp->values_cnt; i++) {
+        t.values[i] = data->values[i];
+        t.values_ops[i] = data->values_ops[i];
+    }
+    t.values_cnt = tp->values_cnt;
+    if (build_fast_trace_trampoline(&t) < 0) return -1;
+    if (t.tramp_size > FAST_TRACE_TRAMP_SIZE) {
+        set_errno(ERR_UNSUPPORTED, "Tracepoint condition is too complex");
+        return -1;
+    }
+    for (i = 0; i < data->lines_cnt; i++) {
+        if (data->lines[i] > t.patch_addr && data->lines[i] < t.patch_addr + t.patch_size) {
+            set_errno(ERR_UNSUPPORTED, "Tracepoint instructions cross statement boundary");
+            return -1;
+        }
+    }
+    for (i = 0; i < t.patch_size; i++) {
+        if (is_breakpoint_address(prs, t.patch_addr + i)) {
+            set_errno(ERR_UNSUPPORTED, "Breakpoint at tracepoint address");
+            return -1;
+        }
+    }
+    for (i = 0; i < FAST_TRACE_CTRL_CNT; i++) {
+        /* Including disposed tracepoints, their code is not restored yet */
+        FastTracepoint * x = area->ctrl[i];
+        if (x != NULL && x->patch_addr < t.patch_addr + t.patch_size && t.patch_addr < x->patch_addr + x->patch_size) {
+            set_errno(ERR_UNSUPPORTED, "Another fast tracepoint at tracepoint address");
+            return -1;
+        }
+    }
+    tp->ctrl = slot;
+    tp->patch_addr = t.patch_addr;
+    tp->patch_size = t.patch_size;
+    tp->tramp_addr = t.tramp_addr;
+    tp->tramp_size = t.tramp_size;
+    memcpy(tp->saved_code, data->code + (t.patch_addr - tp->addr), t.patch_size);
+    if (check_threads(tp) < 0) return -1;
+
+    /* No other jumps are enabled, the buffer can be reinitialized */
+    if ((!area->initialized || area->jump_cnt == 0) && write_area_header(prs, area) < 0) return -1;
+    if (context_write_mem(prs, t.tramp_addr, t.tramp, t.tramp_size) < 0) return -1;
+    if (write_ctrl_block(tp, area, 1) < 0) return -1;
+    if (context_write_mem(prs, t.patch_addr, t.patch, t.patch_size) < 0) return -1;
+
+    area->ctrl[slot] = tp;
+    area->jump_cnt++;
+    if (!area->poll_posted) {
+        area->poll_posted = 1;
+        context_lock(prs);
+        post_event_with_delay(poll_event, prs, FAST_TRACE_POLL_PERIOD);
+    }
+    return 0;
+}
+
+static void remove_jump(FastTracepoint * tp, FastTraceArea * area) {
+    assert(area->ctrl[tp->ctrl] == tp);
+    area->jump_cnt--;
+    area->disposed_cnt++;
+    if (write_ctrl_block(tp, area, 0) < 0) {
+        trace(LOG_ALWAYS, "Cannot disable fast tracepoint: %s", errno_to_str(errno));
+    }
+    /* Disabled trampoline only executes displaced instructions, the jump stays until all threads are stopped */
+    release_tracepoints(tp->ctx, area);
+}
+
+static void add_attribute(BreakpointAttribute *** ref, const char * name, const char * value, int array) {
+    ByteArrayOutputStream buf;
+    OutputStream * out = create_byte_array_output_stream(&buf);
+    BreakpointAttribute * attr = (BreakpointAttribute *)loc_alloc_zero(sizeof(BreakpointAttribute));
+
+    attr->name = loc_strdup(name);
+    if (value == NULL) {
+        json_write_boolean(out, 1);
+    }
+    else {
+        if (array) write_stream(out, '[');
+        json_write_string(out, value);
+        if (array) write_stream(out, ']');
+    }
+    write_stream(out, 0);
+    get_byte_array_output_stream_data(&buf, &attr->value, NULL);
+    **ref = attr;
+    *ref = &attr->next;
+}
+
+static void breakpoint_hit(Context * ctx, void * args) {
+    FastTracepoint * tp = (FastTracepoint *)args;
+    FastTraceRecord rec;
+
+    memset(&rec, 0, sizeof(rec));
+    if (read_fast_trace_registers(ctx, &rec) < 0) {
+        trace(LOG_ALWAYS, "Cannot read tracepoint registers: %s", errno_to_str(errno));
+        return;
+    }
+    rec.id = tp->id;
+    stats.record_cnt++;
+    tp->callback(tp, &rec, tp->args);
+}
+
+static void fall_back(FastTracepoint * tp, int error) {
+    char location[64];
+    BreakpointAttribute * attrs = NULL;
+    BreakpointAttribute ** ref = &attrs;
+
+    tp->mode = FAST_TRACE_BREAKPOINT;
+    tp->error = get_error_report(error);
+    stats.fallback_cnt++;
+    /* The client plants its own breakpoint */
+    if (tp->mode_callback != NULL) return;
+    if (tp->ctx->exited) return;
+    snprintf(location, sizeof(location), "%#" PRIx64, (uint64_t)tp->addr);
+    add_attribute(&ref, BREAKPOINT_ENABLED, NULL, 0);
+    add_attribute(&ref, BREAKPOINT_LOCATION, location, 0);
+    add_attribute(&ref, BREAKPOINT_CONTEXTIDS, tp->ctx->id, 1);
+    if (tp->condition != NULL) add_attribute(&ref, BREAKPOINT_CONDITION, tp->condition, 0);
+    tp->bp = create_eventpoint_ext(attrs, NULL, breakpoint_hit, tp);
+}
+
+static void install_cache_client(void * args) {
+    FastTracepoint * tp = *(FastTracepoint **)args;
+    InstallData data;
+    Trap trap;
+    int error = 0;
+
+    if (!tp->disposed && !tp->ctx->exited) {
+        if (set_trap(&trap)) {
+            get_install_data(tp, &data);
+            check_all_stopped(tp->ctx);
+            clear_trap(&trap);
+        }
+        else {
+            if (get_error_code(trap.error) == ERR_CACHE_MISS && cache_miss_count() > 0) exception(trap.error);
+            error = trap.error;
+        }
+    }
+    cache_exit();
+
+    if (tp->disposed) {
+        free_tracepoint(tp);
+        return;
+    }
+    if (!error && tp->ctx->exited) error = ERR_ALREADY_EXITED;
+    if (!error && plant_jump(tp, &data) < 0) error = errno;
+    if (error) {
+        trace(LOG_CONTEXT, "fast trace: tracepoint at %#" PRIx64 " falls back to breakpoint: %s",
+            (uint64_t)tp->addr, errno_to_str(error));
+        fall_back(tp, error);
+    }
+    else {
+        tp->mode = FAST_TRACE_JUMP;
+        stats.jump_cnt++;
+    }
+    if (tp->mode_callback != NULL) tp->mode_callback(tp, tp->args);
+}
+
+static void install_event(void * args) {
+    FastTracepoint * tp = (FastTracepoint *)args;
+    cache_enter(install_cache_client, NULL, &tp, sizeof(tp));
+}
+
+static void read_records(Context * prs, FastTraceArea * area) {
+    uint8_t hdr[FAST_TRACE_TAIL_OFFS];
+    uint64_t time = get_time_usec();
+    uint64_t tail = area->tail;
+    uint64_t head = 0;
+    uint64_t lost = 0;
+    FastTraceRecord * recs = NULL;
+
+    if (context_read_mem(prs, area->buf_addr, hdr, sizeof(hdr)) < 0) {
+        trace(LOG_ALWAYS, "Cannot read fast trace buffer: %s", errno_to_str(errno));
+        return;
+    }
+    head = get_u64(hdr + FAST_TRACE_HEAD_OFFS);
+    lost = get_u64(hdr + FAST_TRACE_LOST_OFFS);
+    stats.lost_cnt += lost - area->lost;
+    area->lost = lost;
+    if (tail != head) recs = (FastTraceRecord *)tmp_alloc(sizeof(FastTraceRecord) * FAST_TRACE_READ_MAX);
+    while (tail != head) {
+        unsigned i;
+        unsigned cnt = 0;
+        uint64_t pos = tail & (area->size - 1);
+        uint64_t max = head - tail;
+        ContextAddress addr = area->buf_addr + FAST_TRACE_DATA_OFFS + (ContextAddress)pos * sizeof(FastTraceRecord);
+        if (max > area->size - pos) max = area->size - pos;
+        if (max > FAST_TRACE_READ_MAX) max = FAST_TRACE_READ_MAX;
+        if (context_read_mem(prs, addr, recs, (size_t)max * sizeof(FastTraceRecord)) < 0) break;
+        /* Records are committed by writing the ID, a record can be allocated but not written yet */
+        while (cnt < max && recs[cnt].id != 0) cnt++;
+        if (cnt == 0) break;
+        for (i = 0; i < cnt; i++) {
+            unsigned j;
+            for (j = 0; j < FAST_TRACE_CTRL_CNT; j++) {
+                FastTracepoint * tp = area->ctrl[j];
+                if (tp != NULL && !tp->disposed && tp->id == recs[i].id) {
+                    stats.record_cnt++;
+                    tp->callback(tp, recs + i, tp->args);
+                    break;
+                }
+            }
+        }
+        memset(recs, 0, sizeof(FastTraceRecord) * cnt);
+        if (context_write_mem(prs, addr, recs, sizeof(FastTraceRecord) * cnt) < 0) break;
+        tail += cnt;
+        if (cnt < max) break;
+    }
+    if (tail != area->tail) {
+        uint8_t buf[FAST_TRACE_CTRL_OFFS - FAST_TRACE_TAIL_OFFS];
+        memset(buf, 0, sizeof(buf));
+        set_u64(buf, tail);
+        if (context_write_mem(prs, area->buf_addr + FAST_TRACE_TAIL_OFFS, buf, sizeof(buf)) < 0) {
+            trace(LOG_ALWAYS, "Cannot write fast trace buffer: %s", errno_to_str(errno));
+        }
+        else {
+            area->tail = tail;
+        }
+    }
+    stats.drain_cnt++;
+    stats.drain_time += get_time_usec() - time;
+}
+
+static void poll_event(void * args) {
+    Context * prs = (Context *)args;
+    FastTraceArea * area = prs->exited ? NULL : EXT(prs)->area;
+
+    if (area != NULL) {
+        assert(area->poll_posted);
+        area->poll_posted = 0;
+        read_records(prs, area);
+        if (area->jump_cnt > 0 && !prs->exited) {
+            area->poll_posted = 1;
+            post_event_with_delay(poll_event, prs, FAST_TRACE_POLL_PERIOD);
+            return;
+        }
+    }
+    context_unlock(prs);
+}
+
+FastTracepoint * create_fast_tracepoint(Context * ctx, ContextAddress addr,
+        const char * condition, FastTraceCallBack * callback, void * args) {
+    return create_fast_tracepoint_ext(ctx, addr, condition, NULL, 0, callback, NULL, args);
+}
+
+FastTracepoint * create_fast_tracepoint_ext(Context * ctx, ContextAddress addr,
+        const char * condition, const char ** values, unsigned values_cnt,
+        FastTraceCallBack * callback, FastTraceModeCallBack * mode_callback, void * args) {
+    unsigned i;
+    FastTracepoint * tp = (FastTracepoint *)loc_alloc_zero(sizeof(FastTracepoint));
+
+    assert(values_cnt <= FAST_TRACE_VALUES);
+    context_lock(tp->ctx = context_get_group(ctx, CONTEXT_GROUP_PROCESS));
+    tp->addr = addr;
+    if (condition != NULL) tp->condition = loc_strdup(condition);
+    for (i = 0; i < values_cnt; i++) tp->values[i] = loc_strdup(values[i]);
+    tp->values_cnt = values_cnt;
+    tp->callback = callback;
+    tp->mode_callback = mode_callback;
+    tp->args = args;
+    tp->id = ++tracepoint_id_cnt;
+    tp->mode = FAST_TRACE_PENDING;
+    tp->ctrl = -1;
+    /* The installation is started by an event: the caller can be inside a cache client */
+    post_event(install_event, tp);
+    return tp;
+}
+
+void destroy_fast_tracepoint(FastTracepoint * tp) {
+    assert(!tp->disposed);
+    tp->disposed = 1;
+    /* Pending tracepoint is disposed by the install cache client */
+    if (tp->mode == FAST_TRACE_PENDING) return;
+    if (tp->bp != NULL) destroy_eventpoint(tp->bp);
+    if (tp->mode == FAST_TRACE_JUMP) {
+        /* The tracepoint is disposed when the code is restored, see release_tracepoints(),
+         * or when the process exits */
+        FastTraceArea * area = EXT(tp->ctx)->area;
+        if (area != NULL) {
+            if (!tp->ctx->exited) remove_jump(tp, area);
+            return;
+        }
+    }
+    free_tracepoint(tp);
+}
+
+void set_fast_trace_buffer_size(Context * ctx, unsigned size) {
+    EXT(context_get_group(ctx, CONTEXT_GROUP_PROCESS))->max_records = size;
+}
+
+int get_fast_tracepoint_mode(FastTracepoint * tp) {
+    return tp->mode;
+}
+
+ErrorReport * get_fast_tracepoint_error(FastTracepoint * tp) {
+    return tp->error;
+}
+
+int is_fast_trace_patch_address(Context * ctx, ContextAddress addr) {
+    FastTracepoint * tp = find_patch(context_get_group(ctx, CONTEXT_GROUP_PROCESS), addr);
+    /* A break instruction at the jump opcode is safe: stepping over it executes the jump */
+    return tp != NULL && addr > tp->patch_addr;
+}
+
+int check_fast_trace_in_memory_range(Context * ctx, ContextAddress addr, size_t size) {
+    unsigned i;
+    Context * prs = context_get_group(ctx, CONTEXT_GROUP_PROCESS);
+    FastTraceArea * area = prs->exited ? NULL : EXT(prs)->area;
+    if (area == NULL) return 0;
+    for (i = 0; i < FAST_TRACE_CTRL_CNT; i++) {
+        FastTracepoint * tp = area->ctrl[i];
+        if (tp == NULL) continue;
+        if (tp->patch_addr + tp->patch_size <= addr) continue;
+        if (tp->patch_addr >= addr + size) continue;
+        return 1;
+    }
+    return 0;
+}
+
+void check_fast_trace_on_memory_read(Context * ctx, ContextAddress addr, void * buf, size_t size) {
+    unsigned i;
+    Context * prs = context_get_group(ctx, CONTEXT_GROUP_PROCESS);
+    FastTraceArea * area = prs->exited ? NULL : EXT(prs)->area;
+    if (area == NULL) return;
+    for (i = 0; i < FAST_TRACE_CTRL_CNT; i++) {
+        size_t j;
+        FastTracepoint * tp = area->ctrl[i];
+        if (tp == NULL) continue;
+        for (j = 0; j < tp->patch_size; j++) {
+            ContextAddress a = tp->patch_addr + j;
+            if (a >= addr && a < addr + size) ((uint8_t *)buf)[a - addr] = tp->saved_code[j];
+        }
+    }
+}
+
+FastTraceStats * get_fast_trace_stats(void) {
+    return &stats;
+}
+
+static void event_context_exited(Context * ctx, void * args) {
+    ContextExtensionFT * ext = EXT(ctx);
+    FastTraceArea * area = ext->area;
+    if (area != NULL) {
+        unsigned i;
+        MmapRequest * req = area->mmap;
+        if (req != NULL) {
+            /* Posted request is disposed by the safe event */
+            req->area = NULL;
+            if (!req->posted) mmap_done(req, ERR_ALREADY_EXITED, 0);
+        }
+        for (i = 0; i < FAST_TRACE_CTRL_CNT; i++) {
+            FastTracepoint * tp = area->ctrl[i];
+            if (tp != NULL && tp->disposed) free_tracepoint(tp);
+        }
+        cache_notify_later(&area->cache);
+        cache_dispose(&area->cache);
+        release_error_report(area->mmap_error);
+        loc_free(area->code);
+        loc_free(area);
+        ext->area = NULL;
+    }
+}
+
+static void event_context_stopped(Context * ctx, void * args) {
+    Context * prs = context_get_group(ctx, CONTEXT_GROUP_PROCESS);
+    FastTraceArea * area = EXT(prs)->area;
+    if (area != NULL && area->disposed_cnt > 0 && !prs->exited) release_tracepoints(prs, area);
+}
+
+static void event_context_started(Context * ctx, void * args) {
+    Context * prs = context_get_group(ctx, CONTEXT_GROUP_PROCESS);
+    FastTraceArea * area = EXT(prs)->area;
+    if (area != NULL && area->mmap != NULL && !area->mmap->posted) {
+        /* The memory allocation is waiting for a thread that can execute the system call */
+        area->mmap->posted = 1;
+        post_safe_event(prs, mmap_start_event, area->mmap);
+    }
+}
+
+void ini_fast_trace(void) {
+    static ContextEventListener listener = {
+        NULL,
+        event_context_exited,
+        event_context_stopped,
+        event_context_started,
+        NULL,
+        event_context_exited
+    };
+    add_context_event_listener(&listener, NULL);
+    context_extension_offset = context_extension(sizeof(ContextExtensionFT));
+}
+
+#endif /* ENABLE_FastTracepoints */
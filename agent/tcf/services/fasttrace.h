@@ -0,0 +1,238 @@
+/*******************************************************************************
+ * Copyright (c) 2026 Wind River Systems, Inc. and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ * The Eclipse Public License is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ * You may elect to redistribute this code under either of these licenses.
+ *
+ * Contributors:
+ *     Wind River Systems - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Fast tracepoints.
+ *
+ * A fast tracepoint replaces instructions at the tracepoint address with a jump to a trampoline.
+ * The trampoline is executed by the traced thread: it evaluates the tracepoint condition,
+ * stores a record into a ring buffer, executes the displaced instructions and jumps back.
+ * The thread is never stopped, the agent reads the ring buffer periodically and passes
+ * the records to the tracepoint client.
+ *
+ * Trampolines and the ring buffer are allocated in the target: a stopped thread of the process
+ * is made to execute mmap() system call, trampoline memory is requested near the traced code,
+ * it must be within +/- 2GB of the tracepoint address.
+ * The target can provide the memory instead: executable area FAST_TRACE_CODE_SYMBOL and
+ * writable area FAST_TRACE_BUFFER_SYMBOL, if defined, are used before allocating any memory.
+ *
+ * If the memory cannot be allocated, the displaced instructions cannot be relocated,
+ * or the condition cannot be evaluated by the trampoline,
+ * the tracepoint falls back to a breakpoint with same condition.
+ *
+ * Breakpoints service uses fast tracepoints for dprintf breakpoints with "FastTrace" attribute,
+ * see BREAKPOINT_FAST_TRACE.
+ */
+
+#ifndef D_fasttrace
+#define D_fasttrace
+
+#include <tcf/config.h>
+#include <tcf/framework/context.h>
+#include <tcf/framework/errors.h>
+#include <tcf/services/expressions.h>
+
+#if !defined(ENABLE_FastTracepoints)
+#  if defined(__linux__) && defined(__x86_64__)
+#    define ENABLE_FastTracepoints (!ENABLE_ContextProxy && SERVICE_Breakpoints && SERVICE_Disassembly && \
+        ENABLE_Expressions && ENABLE_Symbols)
+#  else
+#    define ENABLE_FastTracepoints 0
+#  endif
+#endif
+
+#if ENABLE_FastTracepoints
+
+#define FAST_TRACE_CODE_SYMBOL      "tcf_fast_trace_code"
+#define FAST_TRACE_BUFFER_SYMBOL    "tcf_fast_trace_buffer"
+
+/* Fast tracepoint modes */
+#define FAST_TRACE_PENDING      0   /* The tracepoint is being installed */
+#define FAST_TRACE_JUMP         1   /* Jump to trampoline is planted */
+#define FAST_TRACE_BREAKPOINT   2   /* The tracepoint is implemented as a breakpoint */
+
+#define FAST_TRACE_REGS         16
+#define FAST_TRACE_VALUES       8
+
+/* Tracepoint hit record */
+typedef struct FastTraceRecord {
+    uint64_t id;                    /* Tracepoint ID, 0 if the record is not written yet */
+    uint64_t flags;                 /* Flags register */
+    uint64_t regs[FAST_TRACE_REGS]; /* General purpose registers, in instruction encoding order */
+    uint64_t values[FAST_TRACE_VALUES]; /* Values of tracepoint expressions, see create_fast_tracepoint_ext() */
+} FastTraceRecord;
+
+/*
+ * Ring buffer layout in the target memory.
+ * Fields are 64-bit, the target updates 'head' and 'lost', the agent updates 'tail'.
+ * The agent fields are in a separate 32 bytes block, so they can be written while the target is running.
+ */
+#define FAST_TRACE_HEAD_OFFS    0   /* Number of records allocated by the target */
+#define FAST_TRACE_LOST_OFFS    8   /* Number of records dropped because the buffer was full */
+#define FAST_TRACE_SIZE_OFFS    16  /* Number of records in the buffer, power of 2 */
+#define FAST_TRACE_MASK_OFFS    24  /* Number of records in the buffer minus 1 */
+#define FAST_TRACE_TAIL_OFFS    32  /* Number of records read by the agent */
+#define FAST_TRACE_CTRL_OFFS    64  /* Tracepoint control blocks */
+#define FAST_TRACE_CTRL_SIZE    32  /* Control block: 'enabled' flag and hit count */
+#define FAST_TRACE_CTRL_CNT     64  /* Max number of tracepoints per process */
+#define FAST_TRACE_DATA_OFFS    4096
+
+typedef struct FastTracepoint FastTracepoint;
+
+/* Tracepoint hit callback */
+typedef void FastTraceCallBack(FastTracepoint *, FastTraceRecord *, void *);
+
+/* Tracepoint mode change callback */
+typedef void FastTraceModeCallBack(FastTracepoint *, void *);
+
+/*
+ * Create fast tracepoint at address 'addr' in process 'ctx'.
+ * 'condition' is expression text, NULL if the tracepoint is unconditional.
+ * 'callback' is called for every tracepoint hit when the condition is true.
+ * The tracepoint is installed asynchronously: threads of the process are stopped for a short time
+ * to allocate the memory and plant the jump. If all threads are suspended by the debugger and
+ * the memory is not allocated yet, the tracepoint stays pending until a thread is resumed.
+ */
+extern FastTracepoint * create_fast_tracepoint(Context * ctx, ContextAddress addr,
+        const char * condition, FastTraceCallBack * callback, void * args);
+
+/*
+ * Same as create_fast_tracepoint(), with additional arguments:
+ * 'values' - up to FAST_TRACE_VALUES expressions, the trampoline stores their values in FastTraceRecord.values,
+ * the values are recorded only in FAST_TRACE_JUMP mode;
+ * 'mode_callback' - called when the tracepoint leaves FAST_TRACE_PENDING mode.
+ * If 'mode_callback' is not NULL, the tracepoint does not fall back to a breakpoint:
+ * when the jump cannot be planted, the mode is set to FAST_TRACE_BREAKPOINT and the client is expected
+ * to use a breakpoint instead.
+ */
+extern FastTracepoint * create_fast_tracepoint_ext(Context * ctx, ContextAddress addr,
+        const char * condition, const char ** values, unsigned values_cnt,
+        FastTraceCallBack * callback, FastTraceModeCallBack * mode_callback, void * args);
+
+/*
+ * Remove and dispose fast tracepoint.
+ * The trampoline is disabled immediately. The jump is removed and the trampoline memory is released
+ * next time all threads of the process are stopped outside of the tracepoint code.
+ */
+extern void destroy_fast_tracepoint(FastTracepoint * tp);
+
+/*
+ * Set max number of records in the ring buffer of process 'ctx', 0 means as many as the buffer memory can hold.
+ * The size is rounded down to a power of 2. The ring buffer is reinitialized with the new size
+ * next time a jump is planted while the process has no other fast tracepoint jumps.
+ */
+extern void set_fast_trace_buffer_size(Context * ctx, unsigned size);
+
+/* Return tracepoint mode, see FAST_TRACE_* */
+extern int get_fast_tracepoint_mode(FastTracepoint * tp);
+
+/* Return the reason of falling back to a breakpoint, NULL if none */
+extern ErrorReport * get_fast_tracepoint_error(FastTracepoint * tp);
+
+/*
+ * Return 1 if 'addr' is inside a planted jump after the jump opcode.
+ * A break instruction written there would corrupt the jump target.
+ */
+extern int is_fast_trace_patch_address(Context * ctx, ContextAddress addr);
+
+/* Return 1 if a memory range contains planted jumps */
+extern int check_fast_trace_in_memory_range(Context * ctx, ContextAddress addr, size_t size);
+
+/* Replace planted jumps in data read from target memory with the original code */
+extern void check_fast_trace_on_memory_read(Context * ctx, ContextAddress addr, void * buf, size_t size);
+
+/*
+ * Fast tracepoints performance counters.
+ * Times are in microseconds.
+ */
+typedef struct FastTraceStats {
+    uint64_t jump_cnt;          /* Number of tracepoints installed as jumps */
+    uint64_t fallback_cnt;      /* Number of tracepoints implemented as breakpoints */
+    uint64_t record_cnt;        /* Number of tracepoint records passed to clients */
+    uint64_t lost_cnt;          /* Number of records dropped by targets because ring buffers were full */
+    uint64_t drain_cnt;         /* Number of ring buffer reads */
+    uint64_t drain_time;        /* Total time spent reading ring buffers */
+} FastTraceStats;
+
+/*
+ * Get fast tracepoints performance counters.
+ * The counters are accumulated since agent start, clients can reset them with memset().
+ */
+extern FastTraceStats * get_fast_trace_stats(void);
+
+/*
+ * Machine dependent part of fast tracepoints, implemented in machine/<cpu>/tcf/fasttrace-<cpu>.c
+ */
+typedef struct FastTraceTrampoline {
+    /* Input */
+    ContextAddress addr;        /* Tracepoint address */
+    uint8_t * code;             /* Target code at the tracepoint address */
+    size_t code_size;
+    ContextAddress tramp_addr;  /* Trampoline address */
+    ContextAddress buf_addr;    /* Ring buffer address */
+    ContextAddress ctrl_addr;   /* Tracepoint control block address */
+    uint64_t id;                /* Tracepoint ID */
+    CompiledExpressionOp * cond;/* Condition program, NULL if none */
+    unsigned cond_cnt;
+    CompiledExpressionOp * values[FAST_TRACE_VALUES]; /* Programs of recorded values */
+    unsigned values_ops[FAST_TRACE_VALUES];
+    unsigned values_cnt;
+    /* Output */
+    ContextAddress patch_addr;  /* Address of the jump to trampoline */
+    size_t patch_size;          /* Size of displaced instructions */
+    uint8_t patch[16];          /* Jump to trampoline and padding */
+    uint8_t * tramp;            /* Trampoline code, allocated with tmp_alloc() */
+    size_t tramp_size;
+} FastTraceTrampoline;
+
+/*
+ * Build trampoline code for a tracepoint.
+ * Return 0 on success, otherwise return -1 and set errno,
+ * errno is ERR_UNSUPPORTED if the tracepoint cannot be implemented as a jump.
+ */
+extern int build_fast_trace_trampoline(FastTraceTrampoline * t);
+
+/* Read registers of a thread stopped at a tracepoint into a tracepoint record */
+extern int read_fast_trace_registers(Context * ctx, FastTraceRecord * rec);
+
+/* mmap() system call executed by a thread of the target process */
+typedef struct FastTraceSyscall {
+    /* Input */
+    ContextAddress addr;        /* Address hint, 0 if any */
+    ContextAddress size;
+    int exec;                   /* 1 - executable memory, 0 - writable memory */
+    /* Output */
+    uint8_t code[16];           /* System call instruction */
+    size_t code_size;
+    uint8_t regs[128];          /* Saved thread registers */
+} FastTraceSyscall;
+
+/*
+ * Set registers of stopped thread 'ctx' for mmap() system call, the registers are saved in 'sc'.
+ * The caller writes the system call instruction at the thread PC and single steps the thread.
+ */
+extern int start_fast_trace_mmap(Context * ctx, FastTraceSyscall * sc);
+
+/*
+ * Restore registers of thread 'ctx' and return the system call result in 'addr'.
+ * If the system call has failed, return -1 and set errno.
+ */
+extern int finish_fast_trace_mmap(Context * ctx, FastTraceSyscall * sc, ContextAddress * addr);
+
+extern void ini_fast_trace(void);
+
+#endif /* ENABLE_FastTracepoints */
+
+#endif /* D_fasttrace */
@@ -47,10 +47,12 @@
 #endif
 #include <tcf/services/linenumbers_elf-ext.h>
 
-static int compare_path(Channel * chnl, Context * ctx, const char * file, const char * pwd, const char * dir, const char * name) {
+static int compare_path(Channel * chnl, Context * ctx, const char * file, FileNameRef * info) {
     int i, j;
-    char buf[FILE_PATH_SIZE];
-    char * full_name = NULL;
+    const char * pwd = info->mCompUnit->mDir;
+    const char * dir = info->mDir;
+    const char * name = info->mName;
+    const char * full_name = NULL;
 
     if (file == NULL) return 0;
     if (name == NULL) return 0;
@@ -62,27 +64,35 @@ static int compare_path(Channel * chnl, Context * ctx, const char * file, const
     }
     i = strlen(file);
 
-    if (is_absolute_path(name)) {
-        full_name = (char *)name;
-    }
-    else if (dir != NULL && is_absolute_path(dir)) {
-        snprintf(full_name = buf, sizeof(buf), "%s/%s", dir, name);
-    }
-    else if (dir != NULL && pwd != NULL) {
-        snprintf(full_name = buf, sizeof(buf), "%s/%s/%s", pwd, dir, name);
-    }
-    else if (pwd != NULL) {
-        snprintf(full_name = buf, sizeof(buf), "%s/%s", pwd, name);
-    }
-    else {
-        full_name = (char *)name;
+    if (info->mCanonicName == NULL) {
+        char buf[FILE_PATH_SIZE];
+        if (is_absolute_path(name)) {
+            full_name = name;
+        }
+        else if (dir != NULL && is_absolute_path(dir)) {
+            snprintf(buf, sizeof(buf), "%s/%s", dir, name);
+            full_name = buf;
+        }
+        else if (dir != NULL && pwd != NULL) {
+            snprintf(buf, sizeof(buf), "%s/%s/%s", pwd, dir, name);
+            full_name = buf;
+        }
+        else if (pwd != NULL) {
+            snprintf(buf, sizeof(buf), "%s/%s", pwd, name);
+            full_name = buf;
+        }
+        else {
+            full_name = name;
+        }
+        info->mCanonicName = intern_dwarf_string(get_dwarf_cache(info->mCompUnit->mFile),
+            canonic_path_map_file_name(full_name));
     }
-    full_name = canonic_path_map_file_name(full_name);
+    full_name = info->mCanonicName;
     j = strlen(full_name);
     if (i <= j && strcmp(file, full_name + j - i) == 0) return 1;
 #if SERVICE_PathMap
     {
-        char * s = apply_path_map(chnl, ctx, full_name, PATH_MAP_TO_CLIENT);
+        char * s = apply_path_map(chnl, ctx, (char *)full_name, PATH_MAP_TO_CLIENT);
         if (s != full_name) {
             full_name = canonic_path_map_file_name(s);
             j = strlen(full_name);
@@ -93,25 +103,24 @@ static int compare_path(Channel * chnl, Context * ctx, const char * file, const
     return 0;
 }
 
-static LineNumbersState * get_next_in_text(CompUnit * unit, LineNumbersState * state) {
-    LineNumbersState * next = NULL;
+static LineNumbersState * get_next_in_text(CompUnit * unit, LineNumbersState * state, LineNumbersState * next) {
     U4_T index = state->mStatesIndexPos + 1;
     if (index >= unit->mStatesCnt) return NULL;
-    next = unit->mStatesIndex[index++];
+    get_line_numbers_state(unit, unit->mStatesIndex[index++], next);
     while (next->mLine == state->mLine && next->mColumn == state->mColumn) {
         if (index >= unit->mStatesCnt) return NULL;
-        next = unit->mStatesIndex[index++];
+        get_line_numbers_state(unit, unit->mStatesIndex[index++], next);
     }
     if (state->mFile != next->mFile) return NULL;
     return next;
 }
 
-static LineNumbersState * get_next_in_code(CompUnit * unit, LineNumbersState * state) {
-    LineNumbersState * next = state;
+static LineNumbersState * get_next_in_code(CompUnit * unit, LineNumbersState * state, LineNumbersState * next) {
+    U4_T pos = state->mStatesPos;
     if (state->mFlags & LINE_EndSequence) return NULL;
-    if (state + 1 >= unit->mStates + unit->mStatesCnt) return NULL;
+    if (pos + 1 >= unit->mStatesCnt) return NULL;
     for (;;) {
-        next++;
+        get_line_numbers_state(unit, ++pos, next);
         if (next->mFile != state->mFile) break;
         if (next->mLine != state->mLine) break;
         if (next->mColumn != state->mColumn) break;
@@ -120,12 +129,12 @@ static LineNumbersState * get_next_in_code(CompUnit * unit, LineNumbersState * s
         if (next->mISA != state->mISA) break;
         if (next->mOpIndex != state->mOpIndex) break;
         if (next->mDiscriminator != state->mDiscriminator) break;
-        if (next + 1 >= unit->mStates + unit->mStatesCnt) break;
+        if (pos + 1 >= unit->mStatesCnt) break;
     }
     return next;
 }
 
-static LineNumbersState * get_next_statement(CompUnit * unit, LineNumbersState * state) {
+static LineNumbersState * get_next_statement(CompUnit * unit, LineNumbersState * state, LineNumbersState * next) {
     /* Select addreess most suitable for breakpoint planting.
      * DWARF 3 standard says:
      * "is_stmt: A boolean indicating that the current instruction is a recommended
@@ -133,13 +142,13 @@ static LineNumbersState * get_next_statement(CompUnit * unit, LineNumbersState *
      * "represent" a line, a statement and/or a semantically distinct subpart of a
      * statement."
      */
-    LineNumbersState * next = state;
-    if (next == NULL) return NULL;
-    if (next->mFlags & LINE_IsStmt) return next;
+    U4_T index = 0;
+    if (state == NULL) return NULL;
+    if (state->mFlags & LINE_IsStmt) return state;
+    index = state->mStatesIndexPos;
     for (;;) {
-        U4_T index = next->mStatesIndexPos + 1;
-        if (index >= unit->mStatesCnt) break;
-        next = unit->mStatesIndex[index];
+        if (++index >= unit->mStatesCnt) break;
+        get_line_numbers_state(unit, unit->mStatesIndex[index], next);
         if (next->mFile != state->mFile) break;
         if (next->mLine != state->mLine) break;
         if (next->mFlags & LINE_IsStmt) return next;
@@ -152,7 +161,8 @@ static void call_client(Context * ctx, CompUnit * unit, LineNumbersState * state
                         ContextAddress state_addr, LineNumbersCallBack * client, void * args) {
     CodeArea area;
     FileInfo * file_info = unit->mFiles + state->mFile;
-    LineNumbersState * text_next_stmt = get_next_statement(unit, text_next);
+    LineNumbersState stmt_buf;
+    LineNumbersState * text_next_stmt = get_next_statement(unit, text_next, &stmt_buf);
 
     if (code_next == NULL) return;
     assert(state->mSection == code_next->mSection);
@@ -164,8 +174,8 @@ static void call_client(Context * ctx, CompUnit * unit, LineNumbersState * state
     area.end_column = text_next ? text_next->mColumn : 0;
 
     area.directory = unit->mDir;
-    if (state->mFileName != NULL) {
-        area.file = state->mFileName;
+    if (file_info->mFullName != NULL) {
+        area.file = file_info->mFullName;
     }
     else if (is_absolute_path(file_info->mName) || file_info->mDir == NULL) {
         area.file = file_info->mName;
@@ -177,7 +187,7 @@ static void call_client(Context * ctx, CompUnit * unit, LineNumbersState * state
     else {
         char buf[FILE_PATH_SIZE];
         snprintf(buf, sizeof(buf), "%s/%s", file_info->mDir, file_info->mName);
-        area.file = state->mFileName = loc_strdup(buf);
+        area.file = file_info->mFullName = intern_dwarf_string(get_dwarf_cache(unit->mFile), buf);
     }
 
     area.file_mtime = file_info->mModTime;
@@ -214,15 +224,52 @@ static void call_client(Context * ctx, CompUnit * unit, LineNumbersState * state
     client(&area, args);
 }
 
+static int is_text_pos_after(LineNumbersTextPos * pos, unsigned file, unsigned line, unsigned column) {
+    if (pos->mFile != file) return pos->mFile > file;
+    if (pos->mLine != line) return pos->mLine > line;
+    return column && pos->mColumn > column;
+}
+
+/* Narrow source text order search range using every LINE_NUMBERS_BLOCK_SIZE-th row, which doesn't need decoding */
+static void find_text_pos_range(CompUnit * unit, unsigned file, unsigned line, unsigned column, unsigned * l, unsigned * h) {
+    LineNumbersTextPos * pos = NULL;
+    unsigned i = 0;
+    unsigned j = (unit->mStatesCnt + LINE_NUMBERS_BLOCK_SIZE - 1) / LINE_NUMBERS_BLOCK_SIZE;
+    while (i < j) {
+        unsigned k = (i + j) / 2;
+        if (is_text_pos_after(unit->mStatesTextPos + k, file, line, column)) j = k;
+        else i = k + 1;
+    }
+    /* Rows from i-th sample are after the text position */
+    if (i * LINE_NUMBERS_BLOCK_SIZE < *h) *h = i * LINE_NUMBERS_BLOCK_SIZE;
+    if (i == 0) return;
+    pos = unit->mStatesTextPos + i - 1;
+    if (pos->mFile < file) {
+        *l = (i - 1) * LINE_NUMBERS_BLOCK_SIZE + 1;
+    }
+    else if (i >= 2 && (pos->mLine < line || (column && pos->mLine == line && pos->mColumn <= column))) {
+        /* Next text position of the previous sample is not after the sample, so it is before the searched position */
+        LineNumbersTextPos * prev = pos - 1;
+        if (prev->mFile < file || prev->mLine != pos->mLine || prev->mColumn != pos->mColumn) {
+            *l = (i - 2) * LINE_NUMBERS_BLOCK_SIZE + 1;
+        }
+    }
+}
+
 static void unit_line_to_address(Context * ctx, MemoryRegion * mem, CompUnit * unit,
                                  unsigned file, unsigned line, unsigned column,
                                  LineNumbersCallBack * client, void * args) {
     if (unit->mStatesCnt >= 2) {
         unsigned l = 0;
         unsigned h = unit->mStatesCnt;
+        LineNumbersState state_buf;
+        LineNumbersState next_buf;
+        LineNumbersState prev_buf;
+        LineNumbersState * state = &state_buf;
+        find_text_pos_range(unit, file, line, column, &l, &h);
         while (l < h) {
             unsigned k = (h + l) / 2;
-            LineNumbersState * state = unit->mStatesIndex[k];
+            get_line_numbers_state(unit, unit->mStatesIndex[k], state);
             if (state->mFile < file) {
                 l = k + 1;
             }
@@ -230,7 +277,7 @@ static void unit_line_to_address(Context * ctx, MemoryRegion * mem, CompUnit * u
                 h = k;
             }
             else {
-                LineNumbersState * next = get_next_in_text(unit, state);
+                LineNumbersState * next = get_next_in_text(unit, state, &next_buf);
                 U4_T next_line = next ? next->mLine : state->mLine + 1;
                 U4_T next_column = next ? next->mColumn : 0;
                 if (next_line < line || (column && next_line == line && next_column <= column)) {
@@ -239,21 +286,22 @@ static void unit_line_to_address(Context * ctx, MemoryRegion * mem, CompUnit * u
                 else {
                     assert(state->mFile == file);
                     while (k > 0) {
-                        LineNumbersState * prev = unit->mStatesIndex[k - 1];
+                        LineNumbersState * prev = &prev_buf;
+                        get_line_numbers_state(unit, unit->mStatesIndex[k - 1], prev);
                         if (prev->mFile != state->mFile) break;
                         if (prev->mLine != state->mLine) break;
                         if (column && prev->mColumn != state->mColumn) break;
-                        state = prev;
+                        *state = *prev;
                         k--;
                     }
                     for (;;) {
                         ELF_Section * sec = state->mSection ? unit->mFile->sections + state->mSection : NULL;
                         ContextAddress addr = elf_run_time_address_in_region(ctx, mem, unit->mFile, sec, state->mAddress);
                         if (errno == 0) {
-                            LineNumbersState * code_next = get_next_in_code(unit, state);
+                            LineNumbersState * code_next = get_next_in_code(unit, state, &next_buf);
                             /* Note: area code size 0 is OK as long as it has valid next statement address */
                             if (code_next != NULL && state->mAddress <= code_next->mAddress) {
-                                LineNumbersState * text_next = get_next_in_text(unit, state);
+                                LineNumbersState * text_next = get_next_in_text(unit, state, &prev_buf);
                                 U4_T next_line = text_next ? text_next->mLine : state->mLine + 1;
                                 U4_T next_column = text_next ? text_next->mColumn : 0;
                                 if (next_line > line || (next_line == line && next_column > column)) {
@@ -267,7 +315,7 @@ static void unit_line_to_address(Context * ctx, MemoryRegion * mem, CompUnit * u
                             }
                         }
                         if (++k >= unit->mStatesCnt) break;
-                        state = unit->mStatesIndex[k];
+                        get_line_numbers_state(unit, unit->mStatesIndex[k], state);
                         if (state->mFile > file) break;
                         if (state->mLine > line) break;
                         if (column && state->mColumn > column) break;
@@ -279,6 +327,20 @@ static void unit_line_to_address(Context * ctx, MemoryRegion * mem, CompUnit * u
     }
 }
 
+static int is_unit_file_used(CompUnit * unit, unsigned file) {
+    unsigned i;
+    FileInfo * info = NULL;
+    if (file >= unit->mFilesCnt) return 0;
+    info = unit->mFiles + file;
+    if (info->mAreaCnt == 0) return 0;
+    /* Duplicate entries: only first one is searched. File and directory names are interned. */
+    for (i = 0; i < file; i++) {
+        FileInfo * prev = unit->mFiles + i;
+        if (prev->mAreaCnt > 0 && prev->mName == info->mName && prev->mDir == info->mDir) return 0;
+    }
+    return 1;
+}
+
 int line_to_address(Context * ctx, const char * file_name, int line, int column,
                     LineNumbersCallBack * client, void * args) {
     int err = 0;
@@ -292,7 +354,7 @@ int line_to_address(Context * ctx, const char * file_name, int line, int column,
     if (err == 0 && elf_get_map(ctx, 0, ~(ContextAddress)0, &map) < 0) err = errno;
 
     if (err == 0) {
-        unsigned i, j;
+        unsigned i;
         unsigned h = 0;
         char * fnm = NULL;
         for (i = 0; i < map.region_cnt; i++) {
@@ -302,34 +364,29 @@ int line_to_address(Context * ctx, const char * file_name, int line, int column,
             if (file == NULL) continue;
             if (set_trap(&trap)) {
                 DWARFCache * cache = get_dwarf_cache(get_dwarf_file(file));
-                if (!cache->mLineInfoLoaded) {
-                    for (j = 0; j < file->section_cnt; j++) {
-                        ObjectInfo * info = cache->mObjectHashTable[j].mCompUnits;
-                        while (info != NULL) {
-                            CompUnit * unit = info->mCompUnit;
-                            if (!unit->mLineInfoLoaded) load_line_numbers(unit);
-                            info = info->mSibling;
-                        }
-                    }
-                    cache->mLineInfoLoaded = 1;
-                }
-                if (cache->mFileInfoHash) {
-                    FileInfo * f = NULL;
+                load_file_name_index(cache);
+                if (cache->mFileRefsCnt > 0) {
+                    unsigned n = 0;
                     if (fnm == NULL) {
                         fnm = canonic_path_map_file_name(file_name);
                         LINE_TO_ADDR_HOOK_1
                         h = calc_file_name_hash(fnm);
                     }
                     LINE_TO_ADDR_HOOK_BP
-                    f = cache->mFileInfoHash[h % cache->mFileInfoHashSize];
-                    while (f != NULL) {
-                        if (f->mNameHash == h && compare_path(chnl, ctx, fnm, f->mCompUnit->mDir, f->mDir, f->mName)) {
-                            CompUnit * unit = f->mCompUnit;
-                            unsigned j = f - unit->mFiles;
-                            LINE_TO_ADDR_HOOK_2
-                            unit_line_to_address(ctx, r, unit, j, line, column, client, args);
+                    n = cache->mFileRefsHash[h % cache->mFileRefsHashSize];
+                    while (n != 0) {
+                        /* load_line_numbers() can add entries to the index, don't keep pointers across the call */
+                        FileNameRef * ref = cache->mFileRefs + n - 1;
+                        n = ref->mNext;
+                        if (ref->mNameHash == h && compare_path(chnl, ctx, fnm, ref)) {
+                            CompUnit * unit = ref->mCompUnit;
+                            unsigned j = ref->mFile;
+                            load_line_numbers(unit);
+                            if (is_unit_file_used(unit, j)) {
+                                LINE_TO_ADDR_HOOK_2
+                                unit_line_to_address(ctx, r, unit, j, line, column, client, args);
+                            }
                         }
-                        f = f->mNextInHash;
                     }
                 }
                 clear_trap(&trap);
@@ -349,6 +406,19 @@ int line_to_address(Context * ctx, const char * file_name, int line, int column,
     return 0;
 }
 
+/* Return position of first block of line number table rows that starts after given section and address */
+static unsigned find_states_block(CompUnit * unit, U4_T section, ContextAddress addr) {
+    unsigned l = 0;
+    unsigned h = (unit->mStatesCnt + LINE_NUMBERS_BLOCK_SIZE - 1) / LINE_NUMBERS_BLOCK_SIZE;
+    while (l < h) {
+        unsigned k = (h + l) / 2;
+        LineNumbersBlock * block = unit->mStatesBlocks + k;
+        if (block->mSection > section || (block->mSection == section && block->mAddress > addr)) h = k;
+        else l = k + 1;
+    }
+    return l;
+}
+
 int address_to_line(Context * ctx, ContextAddress addr0, ContextAddress addr1, LineNumbersCallBack * client, void * args) {
     Trap trap;
 
@@ -368,20 +438,30 @@ int address_to_line(Context * ctx, ContextAddress addr0, ContextAddress addr1, L
         assert(range_rt_addr + range->mSize > range_rt_addr || range_rt_addr + range->mSize == 0);
         assert(addr1 >= range_rt_addr);
         assert(addr0 <= range_rt_addr + range->mSize - 1);
-        if (!range->mUnit->mLineInfoLoaded) load_line_numbers(range->mUnit);
+        load_line_numbers(range->mUnit);
         if (range->mUnit->mStatesCnt >= 2) {
             CompUnit * unit = range->mUnit;
+            unsigned k = 0;
             unsigned l = 0;
             unsigned h = unit->mStatesCnt;
             ContextAddress addr_min = range->mAddr;
             ContextAddress addr_max = range->mAddr + range->mSize - 1;
             if (addr0 > range_rt_addr) addr_min = addr0 - range_rt_addr + range->mAddr;
             if (addr1 < range_rt_addr + range->mSize - 1) addr_max = addr1 - range_rt_addr + range->mAddr;
+            LineNumbersState state_buf;
+            LineNumbersState next_buf;
+            LineNumbersState text_buf;
+            LineNumbersState * state = &state_buf;
             assert(addr_min >= range->mAddr);
             assert(addr_max <= range->mAddr + range->mSize - 1);
+            /* Narrow the search using first rows of the blocks, they don't need decoding */
+            k = find_states_block(unit, range->mSection, addr_min);
+            if (k > 0) l = (k - 1) * LINE_NUMBERS_BLOCK_SIZE;
+            k = find_states_block(unit, range->mSection, addr_max);
+            if (k * LINE_NUMBERS_BLOCK_SIZE < h) h = k * LINE_NUMBERS_BLOCK_SIZE;
             while (l < h) {
-                unsigned k = (h + l) / 2;
-                LineNumbersState * state = unit->mStates + k;
+                k = (h + l) / 2;
+                get_line_numbers_state(unit, k, state);
                 if (state->mSection > range->mSection) {
                     h = k;
                 }
@@ -392,36 +472,37 @@ int address_to_line(Context * ctx, ContextAddress addr0, ContextAddress addr1, L
                     h = k;
                 }
                 else {
-                    LineNumbersState * next = get_next_in_code(unit, state);
+                    LineNumbersState * next = get_next_in_code(unit, state, &next_buf);
                     if (next == NULL || next->mAddress <= addr_min) {
                         l = k + 1;
                     }
                     else {
                         while (k > 0) {
-                            LineNumbersState * prev = unit->mStates + k - 1;
+                            LineNumbersState * prev = &next_buf;
                             if (state->mAddress <= addr_min) break;
+                            get_line_numbers_state(unit, k - 1, prev);
                             if (prev->mAddress > addr_max) break;
-                            state = prev;
+                            *state = *prev;
                             k--;
                         }
                         for (;;) {
-                            LineNumbersState * code_next = get_next_in_code(unit, state);
+                            LineNumbersState * code_next = get_next_in_code(unit, state, &next_buf);
                             if (code_next != NULL) {
                                 if (state->mAddress < code_next->mAddress) {
-                                    LineNumbersState * text_next = get_next_in_text(unit, state);
+                                    LineNumbersState * text_next = get_next_in_text(unit, state, &text_buf);
                                     ADDR_TO_LINE_HOOK
                                     {
                                     call_client(ctx, unit, state, code_next, text_next, state->mAddress - range->mAddr + range_rt_addr, client, args);
                                     }
                                 }
-                                assert(code_next > state);
-                                k = code_next - unit->mStates;
+                                assert(code_next->mStatesPos > state->mStatesPos);
+                                k = code_next->mStatesPos;
                             }
                             else {
                                 k++;
                             }
                             if (k >= unit->mStatesCnt) break;
-                            state = unit->mStates + k;
+                            get_line_numbers_state(unit, k, state);
                             if (state->mAddress > addr_max) break;
                         }
                         break;
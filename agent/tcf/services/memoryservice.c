@@ -30,9 +30,20 @@
 #include <tcf/framework/channel.h>
 #include <tcf/framework/trace.h>
 #include <tcf/framework/cache.h>
+#include <tcf/framework/asyncreq.h>
+#include <tcf/services/breakpoints.h>
 #include <tcf/services/memoryservice.h>
+#include <tcf/services/memorymap.h>
 #include <tcf/services/runctrl.h>
 
+#if !defined(ENABLE_MemorySearch)
+#  define ENABLE_MemorySearch 1
+#endif
+
+#if !defined(ENABLE_MemoryTracking)
+#  define ENABLE_MemoryTracking 1
+#endif
+
 static const char * MEMORY = "Memory";
 
 static TCFBroadcastGroup * broadcast_group = NULL;
@@ -49,6 +60,12 @@ static TCFBroadcastGroup * broadcast_group = NULL;
 
 #define BUF_SIZE    (512 * MEM_USAGE_FACTOR)
 
+#if ENABLE_ContextMemoryFile
+/* Large reads are streamed directly from context memory file into the channel */
+#define MEM_FILE_MIN_SIZE   0x1000
+#define MEM_FILE_BLOCK_SIZE 0x100000
+#endif
+
 typedef struct MemoryCommandArgs {
     char token[256];
     char ctx_id[256];
@@ -361,9 +378,7 @@ static MemoryCommandArgs * read_command_args(char * token, Channel * c, int cmd)
     return &buf;
 }
 
-void send_event_memory_changed(Context * ctx, ContextAddress addr, unsigned long size) {
-    OutputStream * out = &broadcast_group->out;
-
+static void write_event_memory_changed_start(OutputStream * out, Context * ctx) {
     write_stringz(out, "E");
     write_stringz(out, MEMORY);
     write_stringz(out, "memoryChanged");
@@ -373,6 +388,9 @@ void send_event_memory_changed(Context * ctx, ContextAddress addr, unsigned long
 
     /* <array of addres ranges> */
     write_stream(out, '[');
+}
+
+static void write_event_memory_changed_range(OutputStream * out, ContextAddress addr, unsigned long size) {
     write_stream(out, '{');
 
     json_write_string(out, "addr");
@@ -386,12 +404,23 @@ void send_event_memory_changed(Context * ctx, ContextAddress addr, unsigned long
     json_write_ulong(out, size);
 
     write_stream(out, '}');
+}
+
+static void write_event_memory_changed_end(OutputStream * out) {
     write_stream(out, ']');
     write_stream(out, 0);
 
     write_stream(out, MARKER_EOM);
 }
 
+void send_event_memory_changed(Context * ctx, ContextAddress addr, unsigned long size) {
+    OutputStream * out = &broadcast_group->out;
+
+    write_event_memory_changed_start(out, ctx);
+    write_event_memory_changed_range(out, addr, size);
+    write_event_memory_changed_end(out);
+}
+
 static void memory_set_cache_client(void * parm) {
     MemoryCommandArgs * args = (MemoryCommandArgs *)parm;
     Channel * c = cache_channel();
@@ -490,6 +519,10 @@ static void memory_get_cache_client(void * parm) {
     int err = 0;
     MemoryErrorInfo err_info;
     JsonWriteBinaryState state;
+#if ENABLE_ContextMemoryFile
+    int use_file = 1;
+    size_t file_skip = 0;
+#endif
 
     memset(&err_info, 0, sizeof(err_info));
 
@@ -533,7 +566,33 @@ static void memory_get_cache_client(void * parm) {
         json_write_binary_data(&state, args->buf, pos);
         while (pos < size) {
             size_t rd = size - pos;
+#if ENABLE_ContextMemoryFile
+            if (err == 0 && use_file && file_skip == 0 && rd >= MEM_FILE_MIN_SIZE) {
+                int fd = -1;
+                size_t n = rd > MEM_FILE_BLOCK_SIZE ? MEM_FILE_BLOCK_SIZE : rd;
+                int bps = check_breakpoints_in_memory_range(ctx, addr, n);
+                if (bps < 0 || context_get_mem_file(ctx, &fd) < 0) {
+                    use_file = 0;
+                }
+                else if (bps > 0) {
+                    /* Planted breakpoints must be hidden, use context_read_mem() for the block */
+                    file_skip = n;
+                }
+                else {
+                    int64_t offs = (int64_t)addr;
+                    size_t done = json_splice_binary_data(&state, fd, n, &offs);
+                    addr += done;
+                    pos += done;
+                    /* Partially readable block: let context_read_mem() report the error */
+                    if (done < n) use_file = 0;
+                    continue;
+                }
+            }
+#endif
             if (rd > args->max) rd = args->max;
+#if ENABLE_ContextMemoryFile
+            file_skip = file_skip > rd ? file_skip - rd : 0;
+#endif
             /* TODO: word size, mode */
             memset(args->buf, 0, rd);
             if (err == 0) {
@@ -650,6 +709,849 @@ static void command_fill(char * token, Channel * c) {
     cache_enter(memory_fill_cache_client, c, args, sizeof(MemoryCommandArgs));
 }
 
+#if ENABLE_MemorySearch
+
+/*
+ * Memory search.
+ * Target memory is read by the dispatch thread in large chunks, while previous chunk is
+ * matched against the pattern by a worker thread. Two chunk buffers are used, so reading and
+ * matching overlap. Last bytes of a chunk are copied in front of the next chunk of same range,
+ * so matches that cross chunk boundaries are found.
+ */
+
+/* Size of target memory chunk read and searched in one step */
+#define SEARCH_CHUNK_SIZE   (512 * 1024 * MEM_USAGE_FACTOR)
+#define SEARCH_MAX_PATTERN  0x1000
+#define SEARCH_MAX_MATCHES  0x1000
+#define SEARCH_MAX_MATCHES_LIMIT 0x100000
+#define SEARCH_PAGE_SIZE    0x1000
+
+typedef struct SearchRange {
+    ContextAddress addr;
+    ContextAddress size;
+} SearchRange;
+
+typedef struct SearchChunk {
+    uint8_t * buf;
+    ContextAddress addr;        /* Address of first byte in the buffer */
+    size_t size;
+    int ready;                  /* The chunk is read and waits for the matcher */
+} SearchChunk;
+
+typedef struct MemorySearchArgs {
+    LINK link;
+    char token[256];
+    char ctx_id[256];
+    Channel * channel;
+    SearchRange * ranges;
+    unsigned range_cnt;
+    unsigned range_max;
+    unsigned range_pos;
+    ContextAddress addr;        /* Next address to read */
+    ContextAddress page_mode_end;
+    uint8_t * pattern;
+    uint8_t * mask;
+    size_t pattern_size;
+    size_t mask_size;
+    int anchor;                 /* Index of pattern byte used to find match candidates, -1 if none */
+    ContextAddress align;
+    unsigned max_matches;
+    int progress;
+    int cancelled;
+    int stop;
+    int err;
+    int read_posted;
+    int map_done;
+    uint64_t total;
+    uint64_t done;
+    SearchChunk chunks[2];
+    SearchChunk * tail;         /* Chunk that ends where next chunk starts, its tail is copied into the next chunk */
+    SearchChunk * busy;         /* Chunk that is being matched by the worker thread */
+    AsyncReqInfo req;
+    ContextAddress * found;     /* Worker output */
+    unsigned found_cnt;
+    ContextAddress * matches;
+    unsigned match_cnt;
+} MemorySearchArgs;
+
+#define link2search(A) ((MemorySearchArgs *)((char *)(A) - offsetof(MemorySearchArgs, link)))
+
+static LINK searches = TCF_LIST_INIT(searches);
+
+static void search_step(MemorySearchArgs * args);
+
+static void read_search_range(InputStream * inp, const char * name, void * x) {
+    SearchRange * r = (SearchRange *)x;
+    if (strcmp(name, "addr") == 0) r->addr = (ContextAddress)json_read_uint64(inp);
+    else if (strcmp(name, "size") == 0) r->size = (ContextAddress)json_read_uint64(inp);
+    else json_skip_object(inp);
+}
+
+static void add_search_range(MemorySearchArgs * args, ContextAddress addr, ContextAddress size) {
+    SearchRange * r = NULL;
+    if (size == 0) return;
+    if (args->range_cnt >= args->range_max) {
+        args->range_max = args->range_max == 0 ? 16 : args->range_max * 2;
+        args->ranges = (SearchRange *)loc_realloc(args->ranges, sizeof(SearchRange) * args->range_max);
+    }
+    r = args->ranges + args->range_cnt++;
+    r->addr = addr;
+    r->size = size;
+    args->total += size;
+}
+
+static void read_search_range_array_cb(InputStream * inp, void * x) {
+    MemorySearchArgs * args = (MemorySearchArgs *)x;
+    SearchRange r;
+    memset(&r, 0, sizeof(r));
+    json_read_struct(inp, read_search_range, &r);
+    add_search_range(args, r.addr, r.size);
+}
+
+static void read_search_option(InputStream * inp, const char * name, void * x) {
+    MemorySearchArgs * args = (MemorySearchArgs *)x;
+
+    if (strcmp(name, "Ranges") == 0) {
+        json_read_array(inp, read_search_range_array_cb, args);
+    }
+    else if (strcmp(name, "Pattern") == 0) {
+        loc_free(args->pattern);
+        args->pattern = (uint8_t *)json_read_alloc_binary(inp, &args->pattern_size);
+    }
+    else if (strcmp(name, "Mask") == 0) {
+        loc_free(args->mask);
+        args->mask = (uint8_t *)json_read_alloc_binary(inp, &args->mask_size);
+    }
+    else if (strcmp(name, "Align") == 0) {
+        args->align = (ContextAddress)json_read_uint64(inp);
+    }
+    else if (strcmp(name, "MaxMatches") == 0) {
+        args->max_matches = json_read_ulong(inp);
+    }
+    else if (strcmp(name, "Progress") == 0) {
+        args->progress = json_read_boolean(inp);
+    }
+    else {
+        json_skip_object(inp);
+    }
+}
+
+static int get_search_anchor(MemorySearchArgs * args) {
+    /* Select a pattern byte that must match exactly, preferably not zero, since zeros are common in memory */
+    int anchor = -1;
+    size_t i;
+    for (i = 0; i < args->pattern_size; i++) {
+        if (args->mask != NULL && args->mask[i] != 0xff) continue;
+        anchor = (int)i;
+        if (args->pattern[i] != 0) break;
+    }
+    return anchor;
+}
+
+static int search_match(MemorySearchArgs * args, const uint8_t * p) {
+    size_t i;
+    if (args->mask == NULL) return memcmp(p, args->pattern, args->pattern_size) == 0;
+    for (i = 0; i < args->pattern_size; i++) {
+        if ((p[i] & args->mask[i]) != args->pattern[i]) return 0;
+    }
+    return 1;
+}
+
+static int search_chunk(void * x) {
+    /* Called by a worker thread */
+    MemorySearchArgs * args = (MemorySearchArgs *)x;
+    SearchChunk * chunk = args->busy;
+    const uint8_t * buf = chunk->buf;
+    size_t psize = args->pattern_size;
+    unsigned max = args->max_matches - args->match_cnt;
+    ContextAddress addr = chunk->addr;
+    size_t pos = 0;
+
+    args->found_cnt = 0;
+    if (chunk->size < psize) return 0;
+    while (pos <= chunk->size - psize && args->found_cnt < max) {
+        if (args->anchor >= 0) {
+            /* memchr() is vectorized by C runtime library, it quickly skips bytes that cannot match */
+            const uint8_t * p = buf + pos + args->anchor;
+            p = (const uint8_t *)memchr(p, args->pattern[args->anchor], chunk->size - psize + 1 - pos);
+            if (p == NULL) break;
+            pos = p - buf - args->anchor;
+        }
+        if ((args->align <= 1 || (addr + pos) % args->align == 0) && search_match(args, buf + pos)) {
+            args->found[args->found_cnt++] = addr + pos;
+        }
+        pos++;
+    }
+    return 0;
+}
+
+static void search_chunk_done(void * x) {
+    AsyncReqInfo * req = (AsyncReqInfo *)x;
+    MemorySearchArgs * args = (MemorySearchArgs *)req->client_data;
+    SearchChunk * chunk = args->busy;
+    unsigned i;
+
+    args->busy = NULL;
+    chunk->ready = 0;
+    for (i = 0; i < args->found_cnt && args->match_cnt < args->max_matches; i++) {
+        args->matches[args->match_cnt++] = args->found[i];
+    }
+    if (args->match_cnt >= args->max_matches) args->stop = 1;
+    if (args->progress && !args->stop && !is_channel_closed(args->channel)) {
+        OutputStream * out = &args->channel->out;
+        write_stringz(out, "P");
+        write_stringz(out, args->token);
+        write_stream(out, '{');
+        json_write_string(out, "Done");
+        write_stream(out, ':');
+        json_write_uint64(out, args->done);
+        write_stream(out, ',');
+        json_write_string(out, "Total");
+        write_stream(out, ':');
+        json_write_uint64(out, args->total);
+        write_stream(out, ',');
+        json_write_string(out, "Matches");
+        write_stream(out, ':');
+        json_write_ulong(out, args->match_cnt);
+        write_stream(out, '}');
+        write_stream(out, 0);
+        write_stream(out, MARKER_EOM);
+    }
+    search_step(args);
+}
+
+static void get_search_memory_map(MemorySearchArgs * args, Context * ctx) {
+#if SERVICE_MemoryMap
+    MemoryMap * client_map = NULL;
+    MemoryMap * target_map = NULL;
+    unsigned i;
+
+    if (memory_map_get(ctx, &client_map, &target_map) < 0) exception(errno);
+    for (i = 0; i < target_map->region_cnt; i++) {
+        MemoryRegion * r = target_map->regions + i;
+        if ((r->flags & MM_FLAG_R) == 0) continue;
+        add_search_range(args, r->addr, r->size);
+    }
+#else
+    str_exception(ERR_UNSUPPORTED, "Memory search requires address ranges");
+#endif
+}
+
+/* Read next chunk of target memory, return 0 if a read error */
+static int read_search_chunk(MemorySearchArgs * args, Context * ctx, SearchChunk * chunk) {
+    SearchRange * r = args->ranges + args->range_pos;
+    ContextAddress rem = r->size - (args->addr - r->addr);
+    size_t tail = 0;
+    size_t size = 0;
+
+    if (args->tail != NULL && args->tail->addr + args->tail->size == args->addr && args->pattern_size > 1) {
+        tail = args->pattern_size - 1;
+        if (tail > args->tail->size) tail = args->tail->size;
+        memmove(chunk->buf, args->tail->buf + args->tail->size - tail, tail);
+    }
+    size = SEARCH_CHUNK_SIZE;
+    if (args->addr < args->page_mode_end) {
+        /* After a read error, memory is read page by page to find readable pages */
+        size = SEARCH_PAGE_SIZE - (size_t)(args->addr % SEARCH_PAGE_SIZE);
+    }
+    if (size > rem) size = (size_t)rem;
+
+    if (context_read_mem(ctx, args->addr, chunk->buf + tail, size) < 0) {
+        if (args->addr >= args->page_mode_end && size > SEARCH_PAGE_SIZE) {
+            args->page_mode_end = args->addr + size;
+            return 0;
+        }
+        chunk->size = 0;
+        args->tail = NULL;
+    }
+    else {
+        chunk->addr = args->addr - tail;
+        chunk->size = size + tail;
+        chunk->ready = 1;
+        args->tail = chunk;
+    }
+    args->addr += size;
+    args->done += size;
+    if (size == rem) {
+        args->range_pos++;
+        if (args->range_pos < args->range_cnt) args->addr = args->ranges[args->range_pos].addr;
+    }
+    return 1;
+}
+
+static void search_read_cache_client(void * x) {
+    MemorySearchArgs * args = *(MemorySearchArgs **)x;
+    uint64_t done = args->done;
+    Context * ctx = NULL;
+    Trap trap;
+
+    if (args->stop) {
+        /* Waiting for the worker thread to finish */
+    }
+    else if (set_trap(&trap)) {
+        if (is_channel_closed(args->channel)) exception(ERR_CHANNEL_CLOSED);
+        if (args->cancelled) exception(ERR_COMMAND_CANCELLED);
+        ctx = id2ctx(args->ctx_id);
+        if (ctx == NULL) exception(ERR_INV_CONTEXT);
+        if (ctx->exited) exception(ERR_ALREADY_EXITED);
+        if (!args->map_done) {
+            if (args->range_cnt == 0) get_search_memory_map(args, ctx);
+            if (args->range_cnt > 0) args->addr = args->ranges[0].addr;
+            args->map_done = 1;
+        }
+        check_all_stopped(ctx);
+        while (args->range_pos < args->range_cnt) {
+            SearchChunk * chunk = args->chunks[0].ready || args->busy == args->chunks ? args->chunks + 1 : args->chunks;
+            if (chunk->ready || args->busy == chunk) break;
+            if (read_search_chunk(args, ctx, chunk) && chunk->ready) break;
+            /* Unreadable memory, don't block the dispatch thread too long */
+            if (args->done - done >= SEARCH_CHUNK_SIZE) break;
+        }
+        clear_trap(&trap);
+    }
+    else if (get_error_code(trap.error) != ERR_CACHE_MISS) {
+        args->err = trap.error;
+        args->stop = 1;
+    }
+
+    cache_exit();
+    args->read_posted = 0;
+    search_step(args);
+}
+
+static void search_read_next(void * x) {
+    MemorySearchArgs * args = (MemorySearchArgs *)x;
+    cache_enter(search_read_cache_client, args->channel, &args, sizeof(args));
+}
+
+static void free_search_args(MemorySearchArgs * args) {
+    list_remove(&args->link);
+    channel_unlock_with_msg(args->channel, MEMORY);
+    loc_free(args->chunks[0].buf);
+    loc_free(args->chunks[1].buf);
+    loc_free(args->ranges);
+    loc_free(args->pattern);
+    loc_free(args->mask);
+    loc_free(args->found);
+    loc_free(args->matches);
+    loc_free(args);
+}
+
+static void search_done(MemorySearchArgs * args) {
+    Channel * c = args->channel;
+    if (!is_channel_closed(c)) {
+        unsigned i;
+        write_stringz(&c->out, "R");
+        write_stringz(&c->out, args->token);
+        write_errno(&c->out, args->err);
+        /* Matches found before an error are reported too */
+        write_stream(&c->out, '[');
+        for (i = 0; i < args->match_cnt; i++) {
+            if (i > 0) write_stream(&c->out, ',');
+            json_write_uint64(&c->out, args->matches[i]);
+        }
+        write_stream(&c->out, ']');
+        write_stream(&c->out, 0);
+        write_stream(&c->out, MARKER_EOM);
+    }
+    free_search_args(args);
+}
+
+static void search_step(MemorySearchArgs * args) {
+    unsigned i;
+    if (args->cancelled && !args->stop) {
+        args->err = ERR_COMMAND_CANCELLED;
+        args->stop = 1;
+    }
+    if (args->busy != NULL) return;
+    if (!args->stop) {
+        for (i = 0; i < 2; i++) {
+            SearchChunk * chunk = args->chunks + i;
+            if (!chunk->ready) continue;
+            if (args->chunks[1 - i].ready && args->chunks[1 - i].addr < chunk->addr) continue;
+            args->busy = chunk;
+            args->req.done = search_chunk_done;
+            args->req.client_data = args;
+            args->req.type = AsyncReqUser;
+            args->req.u.user.func = search_chunk;
+            args->req.u.user.data = args;
+            async_req_post(&args->req);
+            break;
+        }
+    }
+    if (!args->stop && !args->read_posted && args->range_pos < args->range_cnt) {
+        args->read_posted = 1;
+        post_event(search_read_next, args);
+        return;
+    }
+    if (args->busy == NULL && !args->read_posted) search_done(args);
+}
+
+/*
+ * search <context ID> <options>
+ * Options: "Pattern" - bytes to search for, "Mask" - optional bit mask of the pattern,
+ * "Align" - alignment of match addresses, "MaxMatches" - max number of matches,
+ * "Ranges" - array of {"addr", "size"} objects, if omitted all readable regions of the memory map are searched,
+ * "Progress" - enables 'P' messages with {"Done", "Total", "Matches"} object.
+ * Reply data is an array of match addresses.
+ */
+static void command_search(char * token, Channel * c) {
+    MemorySearchArgs * args = (MemorySearchArgs *)loc_alloc_zero(sizeof(MemorySearchArgs));
+    Trap trap;
+
+    list_init(&args->link);
+    args->max_matches = SEARCH_MAX_MATCHES;
+    if (set_trap(&trap)) {
+        json_read_string(&c->inp, args->ctx_id, sizeof(args->ctx_id));
+        json_test_char(&c->inp, MARKER_EOA);
+        json_read_struct(&c->inp, read_search_option, args);
+        json_test_char(&c->inp, MARKER_EOA);
+        json_test_char(&c->inp, MARKER_EOM);
+        clear_trap(&trap);
+    }
+    if (trap.error) {
+        loc_free(args->ranges);
+        loc_free(args->pattern);
+        loc_free(args->mask);
+        loc_free(args);
+        exception(trap.error);
+    }
+
+    strlcpy(args->token, token, sizeof(args->token));
+    channel_lock_with_msg(args->channel = c, MEMORY);
+    list_add_last(&args->link, &searches);
+    if (args->pattern_size == 0 || args->pattern_size > SEARCH_MAX_PATTERN) {
+        args->err = set_errno(ERR_INV_DATA_SIZE, "Invalid search pattern size");
+    }
+    else if (args->mask != NULL && args->mask_size != args->pattern_size) {
+        args->err = set_errno(ERR_INV_DATA_SIZE, "Search mask size must be same as pattern size");
+    }
+    else if (args->mask != NULL) {
+        size_t i;
+        for (i = 0; i < args->pattern_size; i++) args->pattern[i] &= args->mask[i];
+    }
+    if (args->max_matches > SEARCH_MAX_MATCHES_LIMIT) args->max_matches = SEARCH_MAX_MATCHES_LIMIT;
+    if (args->err != 0 || args->max_matches == 0) {
+        search_done(args);
+        return;
+    }
+    args->anchor = get_search_anchor(args);
+    args->chunks[0].buf = (uint8_t *)loc_alloc(SEARCH_CHUNK_SIZE + args->pattern_size);
+    args->chunks[1].buf = (uint8_t *)loc_alloc(SEARCH_CHUNK_SIZE + args->pattern_size);
+    args->found = (ContextAddress *)loc_alloc(sizeof(ContextAddress) * args->max_matches);
+    args->matches = (ContextAddress *)loc_alloc(sizeof(ContextAddress) * args->max_matches);
+    args->read_posted = 1;
+    cache_enter(search_read_cache_client, c, &args, sizeof(args));
+}
+
+/*
+ * cancelSearch <token of search command>
+ * The search command replies with ERR_COMMAND_CANCELLED error and matches found so far.
+ */
+static void command_cancel_search(char * token, Channel * c) {
+    char id[256];
+    int err = 0;
+    LINK * l;
+
+    json_read_string(&c->inp, id, sizeof(id));
+    json_test_char(&c->inp, MARKER_EOA);
+    json_test_char(&c->inp, MARKER_EOM);
+
+    for (l = searches.next; l != &searches; l = l->next) {
+        MemorySearchArgs * args = link2search(l);
+        if (args->channel == c && strcmp(args->token, id) == 0) {
+            args->cancelled = 1;
+            break;
+        }
+    }
+    if (l == &searches) err = set_errno(ERR_OTHER, "No active search with the token");
+
+    write_stringz(&c->out, "R");
+    write_stringz(&c->out, token);
+    write_errno(&c->out, err);
+    write_stream(&c->out, MARKER_EOM);
+}
+
+#endif /* ENABLE_MemorySearch */
+
+#if ENABLE_MemoryTracking
+
+/*
+ * Memory change tracking.
+ * A client registers address ranges of a memory context. Every time the context is suspended,
+ * the ranges are read and hashed page by page, and pages with changed hash are reported
+ * to the client in a single memoryChanged event. Only hashes are kept, not memory contents.
+ */
+
+#define TRACK_PAGE_SIZE     0x100
+#define TRACK_READ_SIZE     0x10000
+#define TRACK_MAX_SIZE      0x1000000
+
+#define PAGE_UNKNOWN        0
+#define PAGE_VALID          1
+#define PAGE_INVALID        2
+
+typedef struct TrackPage {
+    uint64_t hash;
+    int state;
+} TrackPage;
+
+typedef struct TrackRange {
+    ContextAddress addr;
+    ContextAddress size;
+    TrackPage * pages;
+} TrackRange;
+
+typedef struct MemoryTracker {
+    LINK link;
+    char ctx_id[256];
+    Channel * channel;
+    TrackRange * ranges;
+    unsigned range_cnt;
+    unsigned range_max;
+    int posted;
+    int disposed;
+} MemoryTracker;
+
+#define link2tracker(A) ((MemoryTracker *)((char *)(A) - offsetof(MemoryTracker, link)))
+
+static LINK trackers = TCF_LIST_INIT(trackers);
+
+#define HASH_PRIME1 0x9E3779B185EBCA87ull
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4Full
+#define HASH_PRIME3 0x165667B19E3779F9ull
+#define HASH_PRIME4 0x85EBCA77C2B2AE63ull
+#define HASH_PRIME5 0x27D4EB2F165667C5ull
+
+#define hash_rotl(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static uint64_t hash_round(uint64_t acc, uint64_t val) {
+    acc += val * HASH_PRIME2;
+    acc = hash_rotl(acc, 31);
+    return acc * HASH_PRIME1;
+}
+
+static uint64_t hash_merge(uint64_t acc, uint64_t val) {
+    acc ^= hash_round(0, val);
+    return acc * HASH_PRIME1 + HASH_PRIME4;
+}
+
+static uint64_t read_hash_word(const uint8_t * p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* XXH64 hash of a memory page, words are read in host byte order */
+static uint64_t hash_page(const uint8_t * p, size_t size) {
+    const uint8_t * end = p + size;
+    uint64_t h = 0;
+
+    if (size >= 32) {
+        uint64_t v1 = HASH_PRIME1 + HASH_PRIME2;
+        uint64_t v2 = HASH_PRIME2;
+        uint64_t v3 = 0;
+        uint64_t v4 = 0 - HASH_PRIME1;
+        while (p + 32 <= end) {
+            v1 = hash_round(v1, read_hash_word(p));
+            v2 = hash_round(v2, read_hash_word(p + 8));
+            v3 = hash_round(v3, read_hash_word(p + 16));
+            v4 = hash_round(v4, read_hash_word(p + 24));
+            p += 32;
+        }
+        h = hash_rotl(v1, 1) + hash_rotl(v2, 7) + hash_rotl(v3, 12) + hash_rotl(v4, 18);
+        h = hash_merge(h, v1);
+        h = hash_merge(h, v2);
+        h = hash_merge(h, v3);
+        h = hash_merge(h, v4);
+    }
+    else {
+        h = HASH_PRIME5;
+    }
+    h += size;
+    while (p + 8 <= end) {
+        h ^= hash_round(0, read_hash_word(p));
+        h = hash_rotl(h, 27) * HASH_PRIME1 + HASH_PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        uint32_t w;
+        memcpy(&w, p, sizeof(w));
+        h ^= (uint64_t)w * HASH_PRIME1;
+        h = hash_rotl(h, 23) * HASH_PRIME2 + HASH_PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= *p++ * HASH_PRIME5;
+        h = hash_rotl(h, 11) * HASH_PRIME1;
+    }
+    h ^= h >> 33;
+    h *= HASH_PRIME2;
+    h ^= h >> 29;
+    h *= HASH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+static unsigned get_track_page_cnt(TrackRange * r) {
+    return (unsigned)((r->size + TRACK_PAGE_SIZE - 1) / TRACK_PAGE_SIZE);
+}
+
+static void free_track_ranges(MemoryTracker * t) {
+    unsigned i;
+    for (i = 0; i < t->range_cnt; i++) loc_free(t->ranges[i].pages);
+    loc_free(t->ranges);
+    t->ranges = NULL;
+    t->range_cnt = 0;
+    t->range_max = 0;
+}
+
+static void free_tracker(MemoryTracker * t) {
+    list_remove(&t->link);
+    channel_unlock_with_msg(t->channel, MEMORY);
+    free_track_ranges(t);
+    loc_free(t);
+}
+
+/* Read and hash the pages of a range, new page states are stored in 'pages' */
+static void hash_track_range(Context * ctx, TrackRange * r, TrackPage * pages, uint8_t * buf) {
+    ContextAddress offs = 0;
+    while (offs < r->size) {
+        size_t size = TRACK_READ_SIZE;
+        size_t pos = 0;
+        int ok = 0;
+        if (size > r->size - offs) size = (size_t)(r->size - offs);
+        ok = context_read_mem(ctx, r->addr + offs, buf, size) == 0;
+        if (!ok && get_error_code(errno) == ERR_CACHE_MISS) exception(errno);
+        while (pos < size) {
+            TrackPage * p = pages + (size_t)((offs + pos) / TRACK_PAGE_SIZE);
+            size_t n = size - pos < TRACK_PAGE_SIZE ? size - pos : TRACK_PAGE_SIZE;
+            if (!ok) {
+                /* Part of the block is not readable, find readable pages */
+                if (context_read_mem(ctx, r->addr + offs + pos, buf + pos, n) < 0) {
+                    if (get_error_code(errno) == ERR_CACHE_MISS) exception(errno);
+                    p->hash = 0;
+                    p->state = PAGE_INVALID;
+                    pos += n;
+                    continue;
+                }
+            }
+            p->hash = hash_page(buf + pos, n);
+            p->state = PAGE_VALID;
+            pos += n;
+        }
+        offs += size;
+    }
+}
+
+static void track_changes_cache_client(void * x) {
+    MemoryTracker * t = *(MemoryTracker **)x;
+    Channel * c = t->channel;
+    Context * ctx = NULL;
+    TrackPage ** pages = NULL;
+    int changed = 0;
+    unsigned i;
+
+    if (!t->disposed && !is_channel_closed(c)) {
+        ctx = id2ctx(t->ctx_id);
+        /* Changes are checked when all threads are stopped, the tracking does not suspend the target */
+        if (ctx != NULL && !ctx->exited && is_all_stopped(ctx)) {
+            uint8_t * buf = (uint8_t *)tmp_alloc(TRACK_READ_SIZE);
+            /* Page hashes are updated after all ranges are read, in case the client is restarted by a cache miss */
+            pages = (TrackPage **)tmp_alloc_zero(sizeof(TrackPage *) * t->range_cnt);
+            for (i = 0; i < t->range_cnt; i++) {
+                TrackRange * r = t->ranges + i;
+                pages[i] = (TrackPage *)tmp_alloc_zero(sizeof(TrackPage) * get_track_page_cnt(r));
+                hash_track_range(ctx, r, pages[i], buf);
+            }
+        }
+    }
+
+    cache_exit();
+
+    t->posted = 0;
+    if (t->disposed || is_channel_closed(c)) {
+        free_tracker(t);
+        return;
+    }
+    if (pages == NULL) return;
+    for (i = 0; i < t->range_cnt; i++) {
+        TrackRange * r = t->ranges + i;
+        unsigned cnt = get_track_page_cnt(r);
+        unsigned j = 0;
+        while (j < cnt) {
+            unsigned k = j;
+            while (k < cnt) {
+                TrackPage * p0 = r->pages + k;
+                TrackPage * p1 = pages[i] + k;
+                if (p0->state == PAGE_UNKNOWN) break;
+                if (p0->state == p1->state && p0->hash == p1->hash) break;
+                k++;
+            }
+            if (k > j) {
+                /* Pages [j, k) changed, report them as one span */
+                ContextAddress addr = r->addr + (ContextAddress)j * TRACK_PAGE_SIZE;
+                ContextAddress size = (ContextAddress)(k - j) * TRACK_PAGE_SIZE;
+                if (size > r->size - (addr - r->addr)) size = r->size - (addr - r->addr);
+                if (changed++ == 0) write_event_memory_changed_start(&c->out, ctx);
+                else write_stream(&c->out, ',');
+                write_event_memory_changed_range(&c->out, addr, (unsigned long)size);
+                j = k;
+            }
+            else {
+                j++;
+            }
+        }
+        memcpy(r->pages, pages[i], sizeof(TrackPage) * cnt);
+    }
+    if (changed) write_event_memory_changed_end(&c->out);
+}
+
+static void track_changes_event(void * x) {
+    MemoryTracker * t = (MemoryTracker *)x;
+    cache_enter(track_changes_cache_client, t->channel, &t, sizeof(t));
+}
+
+static void post_track_changes(MemoryTracker * t) {
+    if (t->posted) return;
+    t->posted = 1;
+    post_event(track_changes_event, t);
+}
+
+static void read_track_range(InputStream * inp, const char * name, void * x) {
+    TrackRange * r = (TrackRange *)x;
+    if (strcmp(name, "addr") == 0) r->addr = (ContextAddress)json_read_uint64(inp);
+    else if (strcmp(name, "size") == 0) r->size = (ContextAddress)json_read_uint64(inp);
+    else json_skip_object(inp);
+}
+
+static void read_track_range_array(InputStream * inp, void * x) {
+    MemoryTracker * t = (MemoryTracker *)x;
+    TrackRange r;
+    memset(&r, 0, sizeof(r));
+    json_read_struct(inp, read_track_range, &r);
+    if (r.size == 0) return;
+    if (t->range_cnt >= t->range_max) {
+        t->range_max = t->range_max == 0 ? 8 : t->range_max * 2;
+        t->ranges = (TrackRange *)loc_realloc(t->ranges, sizeof(TrackRange) * t->range_max);
+    }
+    t->ranges[t->range_cnt++] = r;
+}
+
+/*
+ * trackChanges <context ID> <array of {"addr", "size"} objects>
+ * Replaces the set of address ranges tracked for the channel and the context.
+ * An empty array stops the tracking.
+ * When the context is suspended, changed parts of the ranges are reported with memoryChanged event,
+ * which is sent to this channel only.
+ */
+static void command_track_changes(char * token, Channel * c) {
+    char id[256];
+    MemoryTracker * t = NULL;
+    MemoryTracker buf;
+    ContextAddress total = 0;
+    int err = 0;
+    Trap trap;
+    LINK * l;
+    unsigned i;
+
+    memset(&buf, 0, sizeof(buf));
+    json_read_string(&c->inp, id, sizeof(id));
+    json_test_char(&c->inp, MARKER_EOA);
+    if (set_trap(&trap)) {
+        json_read_array(&c->inp, read_track_range_array, &buf);
+        json_test_char(&c->inp, MARKER_EOA);
+        json_test_char(&c->inp, MARKER_EOM);
+        clear_trap(&trap);
+    }
+    if (trap.error) {
+        loc_free(buf.ranges);
+        exception(trap.error);
+    }
+
+    for (i = 0; i < buf.range_cnt; i++) {
+        TrackRange * r = buf.ranges + i;
+        if (r->addr + r->size < r->addr || r->size > TRACK_MAX_SIZE || (total += r->size) > TRACK_MAX_SIZE) {
+            err = set_errno(ERR_INV_DATA_SIZE, "Tracked memory size exceeds the limit");
+            break;
+        }
+    }
+    if (err == 0) {
+        Context * ctx = id2ctx(id);
+        if (ctx == NULL) err = ERR_INV_CONTEXT;
+        else if (ctx->exited) err = ERR_ALREADY_EXITED;
+    }
+    if (err != 0) {
+        loc_free(buf.ranges);
+    }
+    else {
+        for (l = trackers.next; l != &trackers; l = l->next) {
+            MemoryTracker * x = link2tracker(l);
+            if (x->channel == c && !x->disposed && strcmp(x->ctx_id, id) == 0) {
+                t = x;
+                break;
+            }
+        }
+        if (t == NULL && buf.range_cnt > 0) {
+            t = (MemoryTracker *)loc_alloc_zero(sizeof(MemoryTracker));
+            strlcpy(t->ctx_id, id, sizeof(t->ctx_id));
+            channel_lock_with_msg(t->channel = c, MEMORY);
+            list_add_last(&t->link, &trackers);
+        }
+        if (t != NULL) {
+            free_track_ranges(t);
+            t->ranges = buf.ranges;
+            t->range_cnt = buf.range_cnt;
+            t->range_max = buf.range_cnt;
+            for (i = 0; i < t->range_cnt; i++) {
+                TrackRange * r = t->ranges + i;
+                r->pages = (TrackPage *)loc_alloc_zero(sizeof(TrackPage) * get_track_page_cnt(r));
+            }
+            if (t->range_cnt == 0) {
+                if (t->posted) t->disposed = 1;
+                else free_tracker(t);
+            }
+            else {
+                /* Compute initial page hashes, no changes are reported for pages with unknown state */
+                post_track_changes(t);
+            }
+        }
+        else {
+            loc_free(buf.ranges);
+        }
+    }
+
+    write_stringz(&c->out, "R");
+    write_stringz(&c->out, token);
+    write_errno(&c->out, err);
+    write_stream(&c->out, MARKER_EOM);
+}
+
+static void event_track_context_stopped(Context * ctx) {
+    LINK * l;
+    for (l = trackers.next; l != &trackers; l = l->next) {
+        MemoryTracker * t = link2tracker(l);
+        Context * x = NULL;
+        if (t->posted || t->disposed) continue;
+        x = id2ctx(t->ctx_id);
+        if (x == NULL || x->mem != ctx->mem) continue;
+        post_track_changes(t);
+    }
+}
+
+static void channel_close_listener(Channel * c) {
+    LINK * l = trackers.next;
+    while (l != &trackers) {
+        MemoryTracker * t = link2tracker(l);
+        l = l->next;
+        if (t->channel != c) continue;
+        if (t->posted) t->disposed = 1;
+        else free_tracker(t);
+    }
+}
+
+#endif /* ENABLE_MemoryTracking */
+
 static void send_event_context_added(Context * ctx) {
     OutputStream * out = &broadcast_group->out;
 
@@ -713,21 +1615,37 @@ static void event_context_exited(Context * ctx, void * args) {
     send_event_context_removed(ctx);
 }
 
+static void event_context_stopped(Context * ctx, void * args) {
+#if ENABLE_MemoryTracking
+    event_track_context_stopped(ctx);
+#endif
+}
+
 void ini_memory_service(Protocol * proto, TCFBroadcastGroup * bcg) {
     static ContextEventListener listener = {
         event_context_created,
         event_context_exited,
-        NULL,
+        event_context_stopped,
         NULL,
         event_context_changed
     };
     broadcast_group = bcg;
     add_context_event_listener(&listener, NULL);
+#if ENABLE_MemoryTracking
+    add_channel_close_listener(channel_close_listener);
+#endif
     add_command_handler(proto, MEMORY, "getContext", command_get_context);
     add_command_handler(proto, MEMORY, "getChildren", command_get_children);
     add_command_handler(proto, MEMORY, "set", command_set);
     add_command_handler(proto, MEMORY, "get", command_get);
     add_command_handler(proto, MEMORY, "fill", command_fill);
+#if ENABLE_MemorySearch
+    add_command_handler(proto, MEMORY, "search", command_search);
+    add_command_handler(proto, MEMORY, "cancelSearch", command_cancel_search);
+#endif
+#if ENABLE_MemoryTracking
+    add_command_handler(proto, MEMORY, "trackChanges", command_track_changes);
+#endif
 }
 
 #endif /* SERVICE_Memory */
@@ -40,6 +40,7 @@
 #include <tcf/services/stacktrace.h>
 #include <tcf/services/diagnostics.h>
 #include <tcf/services/symbols.h>
+#include <tcf/services/disassembly.h>
 #include <tcf/main/cmdline.h>
 
 #ifndef EN_STEP_OVER
@@ -48,6 +49,9 @@
 #ifndef EN_STEP_LINE
 #  define EN_STEP_LINE (ENABLE_LineNumbers)
 #endif
+#ifndef EN_STEP_RANGE
+#  define EN_STEP_RANGE (EN_STEP_OVER && SERVICE_Disassembly)
+#endif
 
 #define STOP_ALL_TIMEOUT 1000000
 #define STOP_ALL_MAX_CNT 20
@@ -60,6 +64,15 @@
 #define SKIP_PROLOGUE_MAX_STEPS 50
 #endif
 
+/* Max size of a step range and max number of its exits for stepping with range breakpoints */
+#ifndef STEP_RANGE_MAX_SIZE
+#define STEP_RANGE_MAX_SIZE 0x1000
+#endif
+#ifndef STEP_RANGE_MAX_EXITS
+#define STEP_RANGE_MAX_EXITS 64
+#endif
+#define STEP_RANGE_CODE_PAD 16
+
 typedef struct Listener {
     RunControlEventListener * listener;
     void * args;
@@ -89,6 +102,13 @@ typedef struct ContextExtensionRC {
     ContextAddress step_frame_fp;
     ContextAddress step_bp_addr;
     BreakpointInfo * step_bp_info;
+    ContextAddress step_range_bp_start; /* Step range of the range breakpoints */
+    ContextAddress step_range_bp_end;
+    int step_range_bp_over;
+    int step_range_bp_used;
+    ContextAddress * step_range_bp_addr;
+    BreakpointInfo ** step_range_bp_info;
+    unsigned step_range_bp_cnt;
     char * step_func_id;
     char * step_func_id_out;
     int step_inlined;
@@ -810,6 +830,21 @@ static void free_code_area(CodeArea * area) {
     loc_free(area);
 }
 
+#if EN_STEP_RANGE
+static void remove_step_range_breakpoints(Context * ctx) {
+    unsigned i;
+    ContextExtensionRC * ext = EXT(ctx);
+    for (i = 0; i < ext->step_range_bp_cnt; i++) destroy_eventpoint(ext->step_range_bp_info[i]);
+    loc_free(ext->step_range_bp_addr);
+    loc_free(ext->step_range_bp_info);
+    ext->step_range_bp_addr = NULL;
+    ext->step_range_bp_info = NULL;
+    ext->step_range_bp_cnt = 0;
+    ext->step_range_bp_start = 0;
+    ext->step_range_bp_end = 0;
+}
+#endif
+
 static void cancel_step_mode(Context * ctx) {
     ContextExtensionRC * ext = EXT(ctx);
 
@@ -822,6 +857,9 @@ static void cancel_step_mode(Context * ctx) {
         destroy_eventpoint(ext->step_bp_info);
         ext->step_bp_info = NULL;
     }
+#endif
+#if EN_STEP_RANGE
+    remove_step_range_breakpoints(ctx);
 #endif
     if (ext->step_code_area != NULL) {
         free_code_area(ext->step_code_area);
@@ -1584,6 +1622,106 @@ static BreakpointInfo * create_step_machine_breakpoint(ContextAddress addr, Cont
 }
 #endif
 
+#if EN_STEP_RANGE
+static int add_step_range_exit(ContextAddress * exits, unsigned * cnt, ContextAddress addr) {
+    unsigned i;
+    for (i = 0; i < *cnt; i++) {
+        if (exits[i] == addr) return 0;
+    }
+    if (*cnt >= STEP_RANGE_MAX_EXITS) return -1;
+    exits[(*cnt)++] = addr;
+    return 0;
+}
+
+/*
+ * Step range execution: instead of single-stepping through the range,
+ * plant breakpoints at every instruction that can leave the range and run at full speed.
+ * The exits are branch targets outside of the range, the end of the range, and instructions with
+ * targets not known statically (e.g. return), those instructions are single-stepped.
+ * Return 1 if the context can be resumed, 0 if it should be single-stepped.
+ */
+static int step_range_breakpoints(Context * ctx, int step_over) {
+    ContextExtensionRC * ext = EXT(ctx);
+    ContextAddress start = ext->step_range_start;
+    ContextAddress end = ext->step_range_end;
+    ContextAddress pc = ext->pc;
+    ContextAddress * exits = NULL;
+    ContextAddress offs = 0;
+    unsigned exit_cnt = 0;
+    unsigned insn_cnt = 0;
+    int single_step = 0;
+    int fall_through = 1;
+    int pc_ok = 0;
+    uint8_t * buf = NULL;
+    size_t buf_size = 0;
+    unsigned i;
+
+    ext->step_range_bp_used = 0;
+    if (end <= start || end - start > STEP_RANGE_MAX_SIZE) return 0;
+    if (pc < start || pc >= end) return 0;
+
+    buf_size = (size_t)(end - start) + STEP_RANGE_CODE_PAD;
+    buf = (uint8_t *)tmp_alloc(buf_size);
+    if (context_read_mem(ctx, start, buf, buf_size) < 0) {
+        /* The range can end at the end of a memory region */
+        buf_size = (size_t)(end - start);
+        if (context_read_mem(ctx, start, buf, buf_size) < 0) return 0;
+    }
+
+    exits = (ContextAddress *)tmp_alloc(sizeof(ContextAddress) * STEP_RANGE_MAX_EXITS);
+    while (offs < end - start) {
+        ContextAddress addr = start + offs;
+        DisassemblyResult * dr = disassemble_instruction(ctx, addr, buf + offs, buf_size - offs);
+        ContextAddress exit = 0;
+        if (dr == NULL || dr->flow == DISASM_FLOW_UNKNOWN) return 0;
+        if (addr == pc) pc_ok = 1;
+        fall_through = 1;
+        switch (dr->flow) {
+        case DISASM_FLOW_JUMP:
+            fall_through = 0;
+            /* fall through */
+        case DISASM_FLOW_BRANCH:
+            if (dr->target < start || dr->target >= end) exit = dr->target;
+            break;
+        case DISASM_FLOW_CALL:
+            /* Step over: the call returns into the range */
+            if (step_over) break;
+            if (dr->target == 0) exit = addr;
+            else if (dr->target < start || dr->target >= end) exit = dr->target;
+            break;
+        case DISASM_FLOW_INDIRECT:
+            fall_through = 0;
+            exit = addr;
+            break;
+        }
+        if (exit == addr && addr == pc) single_step = 1;
+        if (exit != 0 && add_step_range_exit(exits, &exit_cnt, exit) < 0) return 0;
+        offs += dr->size;
+        insn_cnt++;
+    }
+    /* Single instruction range: single-step is cheaper than planting breakpoints */
+    if (!pc_ok || insn_cnt < 2) return 0;
+    if (fall_through && add_step_range_exit(exits, &exit_cnt, start + offs) < 0) return 0;
+
+    if (ext->step_range_bp_info == NULL || ext->step_range_bp_start != start ||
+            ext->step_range_bp_end != end || ext->step_range_bp_over != step_over) {
+        remove_step_range_breakpoints(ctx);
+        ext->step_range_bp_addr = (ContextAddress *)loc_alloc(sizeof(ContextAddress) * exit_cnt);
+        ext->step_range_bp_info = (BreakpointInfo **)loc_alloc(sizeof(BreakpointInfo *) * exit_cnt);
+        for (i = 0; i < exit_cnt; i++) {
+            ext->step_range_bp_addr[i] = exits[i];
+            ext->step_range_bp_info[i] = create_step_machine_breakpoint(exits[i], ctx);
+        }
+        ext->step_range_bp_cnt = exit_cnt;
+        ext->step_range_bp_start = start;
+        ext->step_range_bp_end = end;
+        ext->step_range_bp_over = step_over;
+    }
+    ext->step_range_bp_used = 1;
+    return !single_step;
+}
+#endif
+
 static int update_step_machine_state(Context * ctx) {
     ContextExtensionRC * ext = EXT(ctx);
     ContextAddress addr = ext->pc;
@@ -2112,6 +2250,16 @@ static int update_step_machine_state(Context * ctx) {
         break;
     }
 
+#if EN_STEP_RANGE
+    if (!do_reverse && ext->step_continue_mode == RM_STEP_INTO_RANGE) {
+        int step_over = ext->step_mode == RM_STEP_OVER_LINE || ext->step_mode == RM_STEP_OVER_RANGE;
+        if (step_range_breakpoints(ctx, step_over)) {
+            ext->step_continue_mode = RM_RESUME;
+            return 0;
+        }
+    }
+#endif
+
     switch (ext->step_continue_mode) {
     case RM_STEP_INTO_RANGE:
         if (context_can_resume(ctx, ext->step_continue_mode = RM_STEP_INTO)) return 0;
@@ -2127,6 +2275,9 @@ static int update_step_machine_state(Context * ctx) {
 
 static int update_step_machine_state_inlined(Context * ctx) {
     ContextExtensionRC * ext = EXT(ctx);
+#if EN_STEP_RANGE
+    ext->step_range_bp_used = 0;
+#endif
     for (;;) {
         if (update_step_machine_state(ctx) < 0) return -1;
         if (ext->step_done == NULL) break;
@@ -2141,6 +2292,9 @@ static int update_step_machine_state_inlined(Context * ctx) {
             break;
         }
     }
+#if EN_STEP_RANGE
+    if (!ext->step_range_bp_used) remove_step_range_breakpoints(ctx);
+#endif
     if (ctx->pending_intercept && ext->step_set_frame_level) {
         StackFrame * info = NULL;
         if (get_frame_info(ctx, STACK_TOP_FRAME, &info) < 0) return -1;
@@ -2207,11 +2361,23 @@ static int check_step_breakpoint(Context * ctx) {
     ByteArrayInputStream buf;
     InputStream * inp = NULL;
     ContextExtensionRC * ext = EXT(ctx);
-    if (ext->step_bp_info == NULL) return 0;
-    status = get_breakpoint_status(ext->step_bp_info);
-    inp = create_byte_array_input_stream(&buf, status, strlen(status));
-    json_read_struct(inp, check_step_breakpoint_status, &error);
-    loc_free(status);
+    if (ext->step_bp_info != NULL) {
+        status = get_breakpoint_status(ext->step_bp_info);
+        inp = create_byte_array_input_stream(&buf, status, strlen(status));
+        json_read_struct(inp, check_step_breakpoint_status, &error);
+        loc_free(status);
+    }
+#if EN_STEP_RANGE
+    {
+        unsigned i;
+        for (i = 0; !error && i < ext->step_range_bp_cnt; i++) {
+            status = get_breakpoint_status(ext->step_range_bp_info[i]);
+            inp = create_byte_array_input_stream(&buf, status, strlen(status));
+            json_read_struct(inp, check_step_breakpoint_status, &error);
+            loc_free(status);
+        }
+    }
+#endif
     if (!error) return 0;
     errno = error;
     return -1;
@@ -31,14 +31,25 @@
 #include <tcf/framework/json.h>
 #include <tcf/framework/cache.h>
 #include <tcf/framework/exceptions.h>
+#include <tcf/framework/events.h>
 #include <tcf/services/registers.h>
 #include <tcf/services/symbols.h>
 #include <tcf/services/linenumbers.h>
 #include <tcf/services/memorymap.h>
+#include <tcf/services/contextquery.h>
 #include <tcf/services/stacktrace.h>
 
 #define MAX_FRAMES  1000
 
+/*
+ * When a context is resumed, its stack trace is kept and, after next stop, outer frames that are not changed
+ * are reused instead of being unwound again.
+ * Frames that contain register locations instead of register values cannot be reused.
+ */
+#if !defined(ENABLE_StackTraceReuse)
+#  define ENABLE_StackTraceReuse (!ENABLE_StackRegisterLocations)
+#endif
+
 static const char * STACKTRACE = "StackTrace";
 
 typedef struct StackTrace {
@@ -47,6 +58,16 @@ typedef struct StackTrace {
     int frame_cnt;
     int frame_max;
     StackFrame * frames; /* ordered top (current) to bottom */
+#if ENABLE_StackTraceReuse
+    /* Stack trace before the context was resumed */
+    int prev_complete;
+    int prev_cnt;
+    int prev_max;
+    StackFrame * prev_frames;
+    /* Frame that matches a frame of the previous stack trace, it is verified by unwinding it */
+    int match_frame;
+    int match_prev;
+#endif
 } StackTrace;
 
 static size_t context_extension_offset = 0;
@@ -246,8 +267,103 @@ static void invalidate_stack_trace(StackTrace * stack) {
     }
     stack->frame_cnt = 0;
     stack->complete = 0;
+#if ENABLE_StackTraceReuse
+    stack->match_frame = 0;
+#endif
+}
+
+static int cmp_frame_registers(Context * ctx, StackFrame * x, StackFrame * y) {
+    /* Return 1 if all registers are same in both frames */
+    size_t buf_size = 8;
+    uint8_t * buf0 = (uint8_t *)tmp_alloc(buf_size);
+    uint8_t * buf1 = (uint8_t *)tmp_alloc(buf_size);
+    RegisterDefinition * def;
+    for (def = get_reg_definitions(ctx); def->name != NULL; def++) {
+        int f0, f1;
+        if (buf_size < def->size) {
+            buf_size = def->size;
+            buf0 = (uint8_t *)tmp_realloc(buf0, buf_size);
+            buf1 = (uint8_t *)tmp_realloc(buf1, buf_size);
+        }
+        f0 = read_reg_bytes(x, def, 0, def->size, buf0) == 0;
+        f1 = read_reg_bytes(y, def, 0, def->size, buf1) == 0;
+        if (f0 != f1 || (f0 && memcmp(buf0, buf1, def->size) != 0)) return 0;
+    }
+    return 1;
+}
+
+#if ENABLE_StackTraceReuse
+
+static void free_prev_stack_trace(StackTrace * stack) {
+    int i;
+    for (i = 0; i < stack->prev_cnt; i++) {
+        free_frame(stack->prev_frames + i);
+    }
+    stack->prev_cnt = 0;
+    stack->prev_complete = 0;
+    stack->match_frame = 0;
+}
+
+static void save_stack_trace(StackTrace * stack) {
+    if (stack->frame_cnt > 1) {
+        StackFrame * frames = stack->prev_frames;
+        int max = stack->prev_max;
+        free_prev_stack_trace(stack);
+        stack->prev_frames = stack->frames;
+        stack->prev_max = stack->frame_max;
+        stack->prev_cnt = stack->frame_cnt;
+        stack->prev_complete = stack->complete;
+        stack->frames = frames;
+        stack->frame_max = max;
+        stack->frame_cnt = 0;
+        stack->complete = 0;
+    }
+    invalidate_stack_trace(stack);
+}
+
+static int reuse_stack_trace(Context * ctx, StackTrace * stack, int frame_idx, StackFrame * down, int max_frames) {
+    /* Check if 'down' is a frame of the previous stack trace.
+     * A frame is matched by CFA of the callee frame and register values.
+     * The match is verified by unwinding one more frame, then the rest of the previous stack trace is reused.
+     * Return 1 if the frames are reused. */
+    StackFrame * frame = stack->frames + frame_idx;
+    int i;
+
+    if (stack->prev_cnt == 0) return 0;
+    if (stack->match_frame == frame_idx) {
+        StackFrame * p = stack->prev_frames + stack->match_prev;
+        int n = stack->match_prev + (stack->frame_cnt - frame_idx);
+        stack->match_frame = 0;
+        if (frame->fp == p->fp && frame->is_walked == p->is_walked && frame->inlined == p->inlined &&
+                n < stack->prev_cnt && stack->prev_frames[n].area == NULL &&
+                cmp_frame_registers(ctx, stack->prev_frames + n, down)) {
+            int cnt = 0;
+            for (i = n; i < stack->prev_cnt && stack->frame_cnt < max_frames; i++) {
+                add_frame(stack, stack->prev_frames + i);
+                memset(stack->prev_frames + i, 0, sizeof(StackFrame));
+                cnt++;
+            }
+            stack->complete = i == stack->prev_cnt && stack->prev_complete;
+            free_prev_stack_trace(stack);
+            free_frame(down);
+            trace(LOG_STACK, "  reused %d frames of previous stack trace", cnt);
+            return 1;
+        }
+    }
+    for (i = 1; i + 1 < stack->prev_cnt; i++) {
+        StackFrame * p = stack->prev_frames + i;
+        if (p->area != NULL) continue;
+        if (p[-1].fp != frame->fp) continue;
+        if (!cmp_frame_registers(ctx, p, down)) continue;
+        stack->match_frame = stack->frame_cnt;
+        stack->match_prev = i;
+        break;
+    }
+    return 0;
 }
 
+#endif /* ENABLE_StackTraceReuse */
+
 static void trace_stack(Context * ctx, StackTrace * stack, int max_frames) {
     StackFrame down;
 
@@ -301,26 +417,7 @@ static void trace_stack(Context * ctx, StackTrace * stack, int max_frames) {
         }
         if (stack->frame_cnt > 1 && frame->fp == stack->frames[stack->frame_cnt - 2].fp) {
             /* Compare registers in current and next frame */
-            int equ = 1;
-            size_t buf_size = 8;
-            uint8_t * buf0 = (uint8_t *)tmp_alloc(buf_size);
-            uint8_t * buf1 = (uint8_t *)tmp_alloc(buf_size);
-            RegisterDefinition * def;
-            for (def = get_reg_definitions(ctx); def->name != NULL; def++) {
-                int f0, f1;
-                if (buf_size < def->size) {
-                    buf_size = def->size;
-                    buf0 = (uint8_t *)tmp_realloc(buf0, buf_size);
-                    buf1 = (uint8_t *)tmp_realloc(buf1, buf_size);
-                }
-                f0 = read_reg_bytes(frame, def, 0, def->size, buf0) == 0;
-                f1 = read_reg_bytes(&down, def, 0, def->size, buf1) == 0;
-                if (f0 != f1 || (f0 && memcmp(buf0, buf1, def->size) != 0)) {
-                    equ = 0;
-                    break;
-                }
-            }
-            if (equ) {
+            if (cmp_frame_registers(ctx, frame, &down)) {
                 /* All registers are same - stop tracing */
                 stack->complete = 1;
                 free_frame(&down);
@@ -329,6 +426,9 @@ static void trace_stack(Context * ctx, StackTrace * stack, int max_frames) {
         }
 #ifdef TRACE_STACK_BOTTOM_CHECK
         TRACE_STACK_BOTTOM_CHECK;
+#endif
+#if ENABLE_StackTraceReuse
+        if (reuse_stack_trace(ctx, stack, frame_idx, &down, max_frames)) break;
 #endif
         add_frame(stack, &down);
     }
@@ -359,85 +459,111 @@ typedef struct CommandGetContextData {
     int rp_error;
 } CommandGetContextData;
 
-static void write_context(OutputStream * out, char * id, CommandGetContextData * d) {
+/* Stack frame properties, bit numbers are indexes in frame_prop_names[] */
+#define FRAME_PROP_PARENT_ID    0x0001
+#define FRAME_PROP_PROCESS_ID   0x0002
+#define FRAME_PROP_INDEX        0x0004
+#define FRAME_PROP_LEVEL        0x0008
+#define FRAME_PROP_TOP_FRAME    0x0010
+#define FRAME_PROP_WALK         0x0020
+#define FRAME_PROP_FP           0x0040
+#define FRAME_PROP_INLINED      0x0080
+#define FRAME_PROP_FUNC_ID      0x0100
+#define FRAME_PROP_CODE_AREA    0x0200
+#define FRAME_PROP_IP           0x0400
+#define FRAME_PROP_RP           0x0800
+#define FRAME_PROP_ALL          0x0fff
+
+static const char * frame_prop_names[] = {
+    "ParentID", "ProcessID", "Index", "Level", "TopFrame", "Walk",
+    "FP", "Inlined", "FuncID", "CodeArea", "IP", "RP", NULL
+};
+
+static void write_context(OutputStream * out, const char * id, CommandGetContextData * d, unsigned props) {
     write_stream(out, '{');
 
     json_write_string(out, "ID");
     write_stream(out, ':');
     json_write_string(out, id);
 
-    write_stream(out, ',');
-    json_write_string(out, "ParentID");
-    write_stream(out, ':');
-    json_write_string(out, d->ctx->id);
+    if (props & FRAME_PROP_PARENT_ID) {
+        write_stream(out, ',');
+        json_write_string(out, "ParentID");
+        write_stream(out, ':');
+        json_write_string(out, d->ctx->id);
+    }
 
-    write_stream(out, ',');
-    json_write_string(out, "ProcessID");
-    write_stream(out, ':');
-    json_write_string(out, context_get_group(d->ctx, CONTEXT_GROUP_PROCESS)->id);
+    if (props & FRAME_PROP_PROCESS_ID) {
+        write_stream(out, ',');
+        json_write_string(out, "ProcessID");
+        write_stream(out, ':');
+        json_write_string(out, context_get_group(d->ctx, CONTEXT_GROUP_PROCESS)->id);
+    }
 
-    write_stream(out, ',');
-    json_write_string(out, "Index");
-    write_stream(out, ':');
-    json_write_long(out, d->frame);
+    if (props & FRAME_PROP_INDEX) {
+        write_stream(out, ',');
+        json_write_string(out, "Index");
+        write_stream(out, ':');
+        json_write_long(out, d->frame);
+    }
 
-    if (d->stack->complete) {
+    if ((props & FRAME_PROP_LEVEL) && d->stack->complete) {
         write_stream(out, ',');
         json_write_string(out, "Level");
         write_stream(out, ':');
         json_write_long(out, d->stack->frame_cnt - d->frame - 1);
     }
 
-    if (d->info->is_top_frame) {
+    if ((props & FRAME_PROP_TOP_FRAME) && d->info->is_top_frame) {
         write_stream(out, ',');
         json_write_string(out, "TopFrame");
         write_stream(out, ':');
         json_write_boolean(out, 1);
     }
 
-    if (d->info->is_walked) {
+    if ((props & FRAME_PROP_WALK) && d->info->is_walked) {
         write_stream(out, ',');
         json_write_string(out, "Walk");
         write_stream(out, ':');
         json_write_boolean(out, 1);
     }
 
-    if (d->info->fp) {
+    if ((props & FRAME_PROP_FP) && d->info->fp) {
         write_stream(out, ',');
         json_write_string(out, "FP");
         write_stream(out, ':');
         json_write_uint64(out, d->info->fp);
     }
 
-    if (d->info->inlined) {
+    if ((props & FRAME_PROP_INLINED) && d->info->inlined) {
         write_stream(out, ',');
         json_write_string(out, "Inlined");
         write_stream(out, ':');
         json_write_long(out, d->info->inlined);
     }
 
-    if (d->info->func_id != NULL) {
+    if ((props & FRAME_PROP_FUNC_ID) && d->info->func_id != NULL) {
         write_stream(out, ',');
         json_write_string(out, "FuncID");
         write_stream(out, ':');
         json_write_string(out, d->info->func_id);
     }
 
-    if (d->info->area != NULL) {
+    if ((props & FRAME_PROP_CODE_AREA) && d->info->area != NULL) {
         write_stream(out, ',');
         json_write_string(out, "CodeArea");
         write_stream(out, ':');
         write_code_area(out, d->info->area, NULL);
     }
 
-    if (d->ip_error == 0) {
+    if ((props & FRAME_PROP_IP) && d->ip_error == 0) {
         write_stream(out, ',');
         json_write_string(out, "IP");
         write_stream(out, ':');
         json_write_uint64(out, d->ip);
     }
 
-    if (d->rp_error == 0) {
+    if ((props & FRAME_PROP_RP) && d->rp_error == 0) {
         write_stream(out, ',');
         json_write_string(out, "RP");
         write_stream(out, ':');
@@ -447,6 +573,14 @@ static void write_context(OutputStream * out, char * id, CommandGetContextData *
     write_stream(out, '}');
 }
 
+static void read_frame_ip_rp(CommandGetContextData * d) {
+    RegisterDefinition * reg_ip = get_PC_definition(d->ctx);
+    if (reg_ip == NULL || d->info == NULL) d->ip_error = ERR_OTHER;
+    else if (read_reg_value(d->info, reg_ip, &d->ip) < 0) d->ip_error = errno;
+    if (reg_ip == NULL || d->down == NULL) d->rp_error = ERR_OTHER;
+    else if (read_reg_value(d->down, reg_ip, &d->rp) < 0) d->rp_error = errno;
+}
+
 typedef struct CommandGetContextArgs {
     char token[256];
     int id_cnt;
@@ -464,7 +598,6 @@ static void command_get_context_cache_client(void * x) {
     for (i = 0; i < args->id_cnt; i++) {
         StackTrace * stack = NULL;
         CommandGetContextData * d = data + i;
-        RegisterDefinition * reg_ip = NULL;
         if (id2frame(args->ids[i], &d->ctx, &d->frame) < 0) {
             err = errno;
             break;
@@ -488,11 +621,7 @@ static void command_get_context_cache_client(void * x) {
         d->info = stack->frames + d->frame;
         d->down = d->frame < stack->frame_cnt - 1 ? d->info + 1 : NULL;
 
-        reg_ip = get_PC_definition(d->ctx);
-        if (reg_ip == NULL || d->info == NULL) d->ip_error = ERR_OTHER;
-        else if (read_reg_value(d->info, reg_ip, &d->ip) < 0) d->ip_error = errno;
-        if (reg_ip == NULL || d->down == NULL) d->rp_error = ERR_OTHER;
-        else if (read_reg_value(d->down, reg_ip, &d->rp) < 0) d->rp_error = errno;
+        read_frame_ip_rp(d);
     }
 
     cache_exit();
@@ -507,7 +636,7 @@ static void command_get_context_cache_client(void * x) {
             write_string(&c->out, "null");
         }
         else {
-            write_context(&c->out, args->ids[i], d);
+            write_context(&c->out, args->ids[i], d, FRAME_PROP_ALL);
         }
     }
     write_stream(&c->out, ']');
@@ -625,6 +754,322 @@ static void command_get_children_range(char * token, Channel * c) {
     cache_enter(command_get_children_cache_client, c, &args, sizeof(args));
 }
 
+/* Max number of threads processed by getTraces command in one dispatch event */
+#define GET_TRACES_CHUNK 32
+
+typedef struct GetTracesArgs {
+    char token[256];
+    Channel * channel;
+    char ** ids;
+    int id_cnt;
+    int pos;
+    int max_frames;
+    unsigned props;
+    int progress;
+    ByteArrayOutputStream buf;
+    int buf_cnt;
+} GetTracesArgs;
+
+typedef struct GetTracesOptions {
+    GetTracesArgs * args;
+    char * parent;
+    char * query;
+} GetTracesOptions;
+
+static void read_frame_prop_name(InputStream * inp, void * x) {
+    GetTracesArgs * args = (GetTracesArgs *)x;
+    char name[64];
+    unsigned i;
+
+    json_read_string(inp, name, sizeof(name));
+    for (i = 0; frame_prop_names[i] != NULL; i++) {
+        if (strcmp(frame_prop_names[i], name) == 0) args->props |= 1u << i;
+    }
+}
+
+static void read_get_traces_option(InputStream * inp, const char * name, void * x) {
+    GetTracesOptions * opts = (GetTracesOptions *)x;
+    GetTracesArgs * args = opts->args;
+
+    if (strcmp(name, "Parent") == 0) {
+        loc_free(opts->parent);
+        opts->parent = json_read_alloc_string(inp);
+    }
+    else if (strcmp(name, "Query") == 0) {
+        loc_free(opts->query);
+        opts->query = json_read_alloc_string(inp);
+    }
+    else if (strcmp(name, "MaxFrames") == 0) {
+        args->max_frames = (int)json_read_long(inp);
+    }
+    else if (strcmp(name, "Properties") == 0) {
+        args->props = 0;
+        if (!json_read_array(inp, read_frame_prop_name, args)) args->props = FRAME_PROP_ALL;
+    }
+    else if (strcmp(name, "Progress") == 0) {
+        args->progress = json_read_boolean(inp);
+    }
+    else {
+        json_skip_object(inp);
+    }
+}
+
+/* Collect IDs of contexts that have stack trace, are descendants of 'parent' and match the query */
+static int get_traces_context_ids(GetTracesArgs * args, GetTracesOptions * opts) {
+    LINK * l;
+    Context * parent = NULL;
+    Context ** list = NULL;
+    unsigned list_cnt = 0;
+    unsigned list_max = 0;
+    size_t size = 0;
+    char * str = NULL;
+    unsigned i;
+
+    if (opts->parent != NULL) {
+        parent = id2ctx(opts->parent);
+        if (parent == NULL) {
+            errno = ERR_INV_CONTEXT;
+            return -1;
+        }
+    }
+    if (opts->query != NULL && parse_context_query(opts->query) < 0) return -1;
+    for (l = context_root.next; l != &context_root; l = l->next) {
+        Context * ctx = ctxl2ctxp(l);
+        if (ctx->exited) continue;
+        if (!context_has_state(ctx)) continue;
+        if (parent != NULL) {
+            Context * p = ctx;
+            while (p != NULL && p != parent) p = p->parent;
+            if (p == NULL) continue;
+        }
+        if (opts->query != NULL && !run_context_query(ctx)) continue;
+        if (list_cnt >= list_max) {
+            list_max = list_max == 0 ? 64 : list_max * 2;
+            list = (Context **)tmp_realloc(list, sizeof(Context *) * list_max);
+        }
+        list[list_cnt++] = ctx;
+        size += strlen(ctx->id) + 1;
+    }
+    args->ids = (char **)loc_alloc(sizeof(char *) * list_cnt + size);
+    args->id_cnt = list_cnt;
+    str = (char *)(args->ids + list_cnt);
+    for (i = 0; i < list_cnt; i++) {
+        size_t len = strlen(list[i]->id) + 1;
+        memcpy(str, list[i]->id, len);
+        args->ids[i] = str;
+        str += len;
+    }
+    return 0;
+}
+
+static void free_get_traces_args(GetTracesArgs * args) {
+    if (args->buf_cnt > 0) {
+        char * data = NULL;
+        size_t size = 0;
+        get_byte_array_output_stream_data(&args->buf, &data, &size);
+        loc_free(data);
+    }
+    channel_unlock_with_msg(args->channel, STACKTRACE);
+    loc_free(args->ids);
+    loc_free(args);
+}
+
+static void write_get_traces_data(OutputStream * out, GetTracesArgs * args) {
+    write_stream(out, '[');
+    if (args->buf_cnt > 0) {
+        char * data = NULL;
+        size_t size = 0;
+        get_byte_array_output_stream_data(&args->buf, &data, &size);
+        write_block_stream(out, data, size);
+        args->buf_cnt = 0;
+        loc_free(data);
+    }
+    write_stream(out, ']');
+    write_stream(out, 0);
+}
+
+static void send_get_traces_progress(GetTracesArgs * args) {
+    OutputStream * out = &args->channel->out;
+    if (!args->progress || args->buf_cnt == 0) return;
+    write_stringz(out, "P");
+    write_stringz(out, args->token);
+    write_get_traces_data(out, args);
+    write_stream(out, MARKER_EOM);
+}
+
+/* Unwind stack of a thread and append the trace to the reply buffer. Return 0 if cache miss. */
+static int get_trace(GetTracesArgs * args, const char * id) {
+    int i;
+    int n = 0;
+    int err = 0;
+    int inlined = 0;
+    StackTrace * stack = NULL;
+    CommandGetContextData * data = NULL;
+    Context * ctx = id2ctx(id);
+    OutputStream * out = &args->buf.out;
+
+    if (ctx == NULL || ctx->exited || !context_has_state(ctx)) {
+        err = ERR_INV_CONTEXT;
+    }
+    else if (!ctx->stopped) {
+        err = ERR_IS_RUNNING;
+    }
+    else {
+        inlined = EXT(ctx)->inlined;
+        stack = create_stack_trace(ctx, inlined + args->max_frames);
+        if (stack == NULL) {
+            if (cache_miss_count() > 0) return 0;
+            err = errno;
+        }
+    }
+
+    if (stack != NULL) {
+        n = stack->frame_cnt - inlined;
+        if (n > args->max_frames) n = args->max_frames;
+        if (n < 0) n = 0;
+        data = (CommandGetContextData *)tmp_alloc_zero(sizeof(CommandGetContextData) * (n + 1));
+        for (i = 0; i < n; i++) {
+            CommandGetContextData * d = data + i;
+            d->ctx = ctx;
+            d->frame = inlined + i;
+            d->stack = stack;
+            d->info = stack->frames + d->frame;
+            d->down = d->frame < stack->frame_cnt - 1 ? d->info + 1 : NULL;
+            if (args->props & (FRAME_PROP_IP | FRAME_PROP_RP)) read_frame_ip_rp(d);
+        }
+        if (cache_miss_count() > 0) return 0;
+    }
+
+    if (args->buf_cnt++ == 0) create_byte_array_output_stream(&args->buf);
+    else write_stream(out, ',');
+    write_stream(out, '{');
+    json_write_string(out, "ID");
+    write_stream(out, ':');
+    json_write_string(out, id);
+    if (stack == NULL) {
+        write_stream(out, ',');
+        json_write_string(out, "Error");
+        write_stream(out, ':');
+        write_error_object(out, err);
+    }
+    else {
+        write_stream(out, ',');
+        json_write_string(out, "Frames");
+        write_stream(out, ':');
+        write_stream(out, '[');
+        for (i = 0; i < n; i++) {
+            CommandGetContextData * d = data + i;
+            if (i > 0) write_stream(out, ',');
+            write_context(out, frame2id(ctx, d->frame), d, args->props);
+        }
+        write_stream(out, ']');
+        write_stream(out, ',');
+        json_write_string(out, "Complete");
+        write_stream(out, ':');
+        json_write_boolean(out, stack->complete && inlined + n >= stack->frame_cnt);
+    }
+    write_stream(out, '}');
+    return 1;
+}
+
+static void get_traces_next(void * x);
+
+static void get_traces_cache_client(void * x) {
+    Trap trap;
+    GetTracesArgs * args = *(GetTracesArgs **)x;
+    Channel * c = args->channel;
+    int end = args->pos + GET_TRACES_CHUNK;
+
+    if (is_channel_closed(c)) {
+        cache_exit();
+        free_get_traces_args(args);
+        return;
+    }
+
+    if (end > args->id_cnt) end = args->id_cnt;
+    /* Threads of same process often share stack pages, memory is not changing while the threads are stopped */
+    set_location_memory_cache(1);
+    if (set_trap(&trap)) {
+        while (args->pos < end && get_trace(args, args->ids[args->pos])) args->pos++;
+        clear_trap(&trap);
+    }
+    set_location_memory_cache(0);
+
+    if (cache_miss_count() > 0) send_get_traces_progress(args);
+    cache_exit();
+
+    if (trap.error == 0 && args->pos < args->id_cnt) {
+        send_get_traces_progress(args);
+        post_event(get_traces_next, args);
+        return;
+    }
+
+    write_stringz(&c->out, "R");
+    write_stringz(&c->out, args->token);
+    write_errno(&c->out, trap.error);
+    if (trap.error) write_stringz(&c->out, "null");
+    else write_get_traces_data(&c->out, args);
+    write_stream(&c->out, MARKER_EOM);
+    free_get_traces_args(args);
+}
+
+static void get_traces_next(void * x) {
+    GetTracesArgs * args = (GetTracesArgs *)x;
+    cache_enter(get_traces_cache_client, args->channel, &args, sizeof(args));
+}
+
+/*
+ * getTraces <context IDs or null> <options>
+ * Options: "Parent" and "Query" select contexts when the IDs are null, "MaxFrames" limits number of frames,
+ * "Properties" is a list of frame properties to return, "Progress" enables 'P' messages with partial results.
+ * Reply data is an array of {"ID", "Frames", "Complete"} or {"ID", "Error"} objects, frames are ordered top first.
+ */
+static void command_get_traces(char * token, Channel * c) {
+    int err = 0;
+    GetTracesOptions opts;
+    GetTracesArgs * args = (GetTracesArgs *)loc_alloc_zero(sizeof(GetTracesArgs));
+    Trap trap;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.args = args;
+    args->max_frames = MAX_FRAMES;
+    args->props = FRAME_PROP_ALL;
+    if (set_trap(&trap)) {
+        args->ids = json_read_alloc_string_array(&c->inp, &args->id_cnt);
+        json_test_char(&c->inp, MARKER_EOA);
+        json_read_struct(&c->inp, read_get_traces_option, &opts);
+        json_test_char(&c->inp, MARKER_EOA);
+        json_test_char(&c->inp, MARKER_EOM);
+        clear_trap(&trap);
+    }
+    if (trap.error) {
+        loc_free(opts.parent);
+        loc_free(opts.query);
+        loc_free(args->ids);
+        loc_free(args);
+        exception(trap.error);
+    }
+
+    if (args->ids == NULL && get_traces_context_ids(args, &opts) < 0) err = errno;
+    if (args->max_frames > MAX_FRAMES) args->max_frames = MAX_FRAMES;
+    if (args->max_frames < 0) args->max_frames = 0;
+    loc_free(opts.parent);
+    loc_free(opts.query);
+
+    strlcpy(args->token, token, sizeof(args->token));
+    channel_lock_with_msg(args->channel = c, STACKTRACE);
+    if (err) {
+        write_stringz(&c->out, "R");
+        write_stringz(&c->out, token);
+        write_errno(&c->out, err);
+        write_stringz(&c->out, "null");
+        write_stream(&c->out, MARKER_EOM);
+        free_get_traces_args(args);
+        return;
+    }
+    cache_enter(get_traces_cache_client, c, &args, sizeof(args));
+}
+
 int get_top_frame(Context * ctx) {
 
     if (!ctx->stopped) {
@@ -771,17 +1216,36 @@ int get_inlined_frame_level(Context * ctx) {
 
 static void flush_stack_trace(Context * ctx, void * args) {
     invalidate_stack_trace(EXT(ctx));
+#if ENABLE_StackTraceReuse
+    free_prev_stack_trace(EXT(ctx));
+#endif
+    EXT(ctx)->inlined = 0;
+}
+
+static void event_context_started(Context * ctx, void * args) {
+#if ENABLE_StackTraceReuse
+    save_stack_trace(EXT(ctx));
+#else
+    invalidate_stack_trace(EXT(ctx));
+#endif
     EXT(ctx)->inlined = 0;
 }
 
 #if SERVICE_Registers
 static void flush_on_register_change(Context * ctx, int frame, RegisterDefinition * def, void * args) {
     invalidate_stack_trace(EXT(ctx));
+#if ENABLE_StackTraceReuse
+    free_prev_stack_trace(EXT(ctx));
+#endif
 }
 #endif
 
 static void delete_stack_trace(Context * ctx, void * args) {
     invalidate_stack_trace(EXT(ctx));
+#if ENABLE_StackTraceReuse
+    free_prev_stack_trace(EXT(ctx));
+    loc_free(EXT(ctx)->prev_frames);
+#endif
     loc_free(EXT(ctx)->frames);
     memset(EXT(ctx), 0, sizeof(StackTrace));
 }
@@ -798,6 +1262,9 @@ static void event_map_changed(Context * ctx, void * client_data) {
             if (x->exited) continue;
             if (context_get_group(x, CONTEXT_GROUP_PROCESS) != ctx) continue;
             invalidate_stack_trace(EXT(x));
+#if ENABLE_StackTraceReuse
+            free_prev_stack_trace(EXT(x));
+#endif
         }
     }
 }
@@ -807,7 +1274,7 @@ void ini_stack_trace_service(Protocol * proto, TCFBroadcastGroup * bcg) {
         NULL,
         flush_stack_trace,
         NULL,
-        flush_stack_trace,
+        event_context_started,
         flush_stack_trace,
         delete_stack_trace
     };
@@ -834,6 +1301,7 @@ void ini_stack_trace_service(Protocol * proto, TCFBroadcastGroup * bcg) {
     add_command_handler(proto, STACKTRACE, "getContext", command_get_context);
     add_command_handler(proto, STACKTRACE, "getChildren", command_get_children);
     add_command_handler(proto, STACKTRACE, "getChildrenRange", command_get_children_range);
+    add_command_handler(proto, STACKTRACE, "getTraces", command_get_traces);
     context_extension_offset = context_extension(sizeof(StackTrace));
 }
 
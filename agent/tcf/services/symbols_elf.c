@@ -52,6 +52,10 @@
 #include <tcf/services/symbols_mux.h>
 #endif
 
+#if !defined(ENABLE_SymbolFileHandles)
+#  define ENABLE_SymbolFileHandles 1
+#endif
+
 struct Symbol {
 #if ENABLE_SymbolsMux
     SymbolReader * reader;
@@ -414,8 +418,8 @@ static int is_frame_based_object(Symbol * sym) {
                 case TAG_volatile_type:
                 case TAG_restrict_type:
                 case TAG_shared_type:
-                    if (obj->mType == NULL) break;
-                    obj = obj->mType;
+                    if (get_dwarf_type(obj) == NULL) break;
+                    obj = get_dwarf_type(obj);
                     continue;
                 case TAG_base_type:
                 case TAG_fund_type:
@@ -717,11 +721,11 @@ static ObjectInfo * get_object_type(ObjectInfo * obj) {
         case TAG_inheritance:
         case TAG_member:
         case TAG_constant:
-            obj = obj->mType;
+            obj = get_dwarf_type(obj);
             break;
         case TAG_variant_part:
-            if (obj->mType != NULL) {
-                obj = obj->mType;
+            if (get_dwarf_type(obj) != NULL) {
+                obj = get_dwarf_type(obj);
                 break;
             }
             return get_object_type(get_object_ref_prop(obj, AT_discr));
@@ -764,7 +768,7 @@ static void alloc_std_type_pseudo_symbol(Context * ctx, unsigned size, unsigned
 /* Get object original type, skipping typedefs and all modifications like const, volatile, etc. */
 static ObjectInfo * get_original_type(ObjectInfo * obj) {
     obj = get_object_type(obj);
-    while (obj != NULL && obj->mType != NULL && is_modified_type(obj)) obj = obj->mType;
+    while (obj != NULL && get_dwarf_type(obj) != NULL && is_modified_type(obj)) obj = get_dwarf_type(obj);
     return obj;
 }
 
@@ -956,7 +960,7 @@ static int cmp_object_profiles(ObjectInfo * x, ObjectInfo * y) {
         case TAG_typedef:
         case TAG_const_type:
         case TAG_volatile_type:
-            x = x->mType;
+            x = get_dwarf_type(x);
             continue;
         }
         break;
@@ -966,7 +970,7 @@ static int cmp_object_profiles(ObjectInfo * x, ObjectInfo * y) {
         case TAG_typedef:
         case TAG_const_type:
         case TAG_volatile_type:
-            y = y->mType;
+            y = get_dwarf_type(y);
             continue;
         }
         break;
@@ -977,7 +981,7 @@ static int cmp_object_profiles(ObjectInfo * x, ObjectInfo * y) {
         if (x->mName == NULL || y->mName == NULL) return 0;
         if (strcmp(x->mName, y->mName) != 0) return 0;
     }
-    if (!cmp_object_profiles(x->mType, y->mType)) return 0;
+    if (!cmp_object_profiles(get_dwarf_type(x), get_dwarf_type(y))) return 0;
     switch (x->mTag) {
     case TAG_subprogram:
         {
@@ -986,16 +990,16 @@ static int cmp_object_profiles(ObjectInfo * x, ObjectInfo * y) {
             for (;;) {
                 while (px != NULL) {
                     if (px->mTag == TAG_formal_parameter) break;
-                    px = px->mSibling;
+                    px = get_dwarf_sibling(px);
                 }
                 while (py != NULL) {
                     if (py->mTag == TAG_formal_parameter) break;
-                    py = py->mSibling;
+                    py = get_dwarf_sibling(py);
                 }
                 if (px == NULL || py == NULL) break;
-                if (!cmp_object_profiles(px->mType, py->mType)) return 0;
-                px = px->mSibling;
-                py = py->mSibling;
+                if (!cmp_object_profiles(get_dwarf_type(px), get_dwarf_type(py))) return 0;
+                px = get_dwarf_sibling(px);
+                py = get_dwarf_sibling(py);
             }
             if (x->mName != NULL && x->mName[0] == '~') break;
             if (px != NULL || py != NULL) return 0;
@@ -1176,12 +1180,12 @@ static void sort_find_symbol_buf(void) {
 }
 
 static int same_namespace(ObjectInfo * x, ObjectInfo * y) {
-    int xn = x->mParent != NULL && x->mParent->mTag == TAG_namespace;
-    int yn = y->mParent != NULL && y->mParent->mTag == TAG_namespace;
+    int xn = dwarf_ref2obj(x->mParent) != NULL && dwarf_ref2obj(x->mParent)->mTag == TAG_namespace;
+    int yn = dwarf_ref2obj(y->mParent) != NULL && dwarf_ref2obj(y->mParent)->mTag == TAG_namespace;
     if (xn != yn) return 0;
     if (!xn) return 1;
-    x = x->mParent;
-    y = y->mParent;
+    x = dwarf_ref2obj(x->mParent);
+    y = dwarf_ref2obj(y->mParent);
     if (x->mName == y->mName) return 1;
     if (x->mName == NULL) return 0;
     if (y->mName == NULL) return 0;
@@ -1194,8 +1198,8 @@ static ObjectInfo * find_definition(ObjectInfo * decl) {
     while (decl != NULL) {
         int search_pub_names = 0;
         int search_ext_only = 0;
-        if (decl->mDefinition != NULL) {
-            decl = decl->mDefinition;
+        if (get_dwarf_definition(decl) != NULL) {
+            decl = get_dwarf_definition(decl);
             continue;
         }
         if (decl->mName == NULL) return decl;
@@ -1216,17 +1220,20 @@ static ObjectInfo * find_definition(ObjectInfo * decl) {
             ObjectInfo * def = NULL;
             DWARFCache * cache = get_dwarf_cache(get_dwarf_file(decl->mCompUnit->mFile));
             PubNamesTable * tbl = &cache->mPubNames;
+            load_pub_names_by_name(cache, decl->mName);
             if (tbl->mHash != NULL) {
                 unsigned n = tbl->mHash[calc_symbol_name_hash(decl->mName) % tbl->mHashSize];
                 while (n != 0) {
-                    ObjectInfo * obj = tbl->mNext[n].mObject;
-                    n = tbl->mNext[n].mNext;
+                    PubNamesInfo * info = tbl->mNext + n;
+                    ObjectInfo * obj = NULL;
+                    n = info->mNext;
+                    if (!equ_symbol_names(info->mName, decl->mName)) continue;
+                    obj = get_pub_names_object(info);
                     if (obj == decl) continue;
                     if (obj->mTag != decl->mTag) continue;
                     if (obj->mFlags & DOIF_declaration) continue;
                     if (obj->mFlags & DOIF_specification) continue;
                     if (search_ext_only && (obj->mFlags & DOIF_external) == 0) continue;
-                    if (!equ_symbol_names(obj->mName, decl->mName)) continue;
                     if (!cmp_object_profiles(decl, obj)) continue;
                     if (!cmp_object_linkage_names(decl, obj)) continue;
                     if (!same_namespace(decl, obj)) continue;
@@ -1235,7 +1242,7 @@ static ObjectInfo * find_definition(ObjectInfo * decl) {
                 }
             }
             if (def != NULL) {
-                decl->mDefinition = def;
+                decl->mDefinition = def->mRef;
                 decl = def;
                 continue;
             }
@@ -1247,15 +1254,17 @@ static ObjectInfo * find_definition(ObjectInfo * decl) {
 
 static void find_by_name_in_pub_names(DWARFCache * cache, const char * name) {
     PubNamesTable * tbl = &cache->mPubNames;
+    load_pub_names_by_name(cache, name);
     if (tbl->mHash != NULL) {
         unsigned n = tbl->mHash[calc_symbol_name_hash(name) % tbl->mHashSize];
         while (n != 0) {
-            ObjectInfo * obj = tbl->mNext[n].mObject;
-            int ns = obj->mParent != NULL && obj->mParent->mTag == TAG_namespace;
-            if (!ns && equ_symbol_names(obj->mName, name)) {
-                add_obj_to_find_symbol_buf(obj, 1);
+            PubNamesInfo * info = tbl->mNext + n;
+            if (equ_symbol_names(info->mName, name)) {
+                ObjectInfo * obj = get_pub_names_object(info);
+                int ns = dwarf_ref2obj(obj->mParent) != NULL && dwarf_ref2obj(obj->mParent)->mTag == TAG_namespace;
+                if (!ns) add_obj_to_find_symbol_buf(obj, 1);
             }
-            n = tbl->mNext[n].mNext;
+            n = info->mNext;
         }
     }
     if (cache->mFile->dwz_file != NULL) {
@@ -1315,7 +1324,7 @@ static int find_in_object_tree(ObjectInfo * parent, unsigned level,
                 if (find_in_object_tree(obj, level + 1, ip, name)) found = 1;
                 break;
             }
-            obj = obj->mSibling;
+            obj = get_dwarf_sibling(obj);
         }
         if (!found && check_in_range(parent, ip)) found = 1;
         if (!found && ip->unit->mObject != parent) return 0;
@@ -1342,19 +1351,19 @@ static int find_in_object_tree(ObjectInfo * parent, unsigned level,
                 }
             }
         }
-        obj = obj->mSibling;
+        obj = get_dwarf_sibling(obj);
     }
 
     if (sym_this != NULL) {
         /* Search in 'this' pointer */
         ObjectInfo * type = get_original_type(sym_this);
-        if ((type->mTag == TAG_pointer_type || type->mTag == TAG_mod_pointer) && type->mType != NULL) {
+        if ((type->mTag == TAG_pointer_type || type->mTag == TAG_mod_pointer) && get_dwarf_type(type) != NULL) {
             Trap trap;
             Symbol * this_list = NULL;
             Symbol * find_list = find_symbol_list;
             if (set_trap(&trap)) {
                 find_symbol_list = NULL;
-                type = get_original_type(type->mType);
+                type = get_original_type(get_dwarf_type(type));
                 find_in_object_tree(type, level, NULL, name);
                 sort_find_symbol_buf();
                 this_list = find_symbol_list;
@@ -1389,7 +1398,7 @@ static int find_in_object_tree(ObjectInfo * parent, unsigned level,
             find_in_object_tree(obj, level, NULL, name);
             break;
         case TAG_inheritance:
-            find_in_object_tree(obj->mType, level, NULL, name);
+            find_in_object_tree(get_dwarf_type(obj), level, NULL, name);
             break;
         case TAG_imported_declaration:
             if (obj->mName != NULL && equ_symbol_names(obj->mName, name)) {
@@ -1421,7 +1430,7 @@ static int find_in_object_tree(ObjectInfo * parent, unsigned level,
             }
             break;
         }
-        obj = obj->mSibling;
+        obj = get_dwarf_sibling(obj);
     }
     return 1;
 }
@@ -1485,7 +1494,7 @@ static void find_by_name_in_sym_table(ELF_File * file, const char * name, int gl
                                     break;
                                 }
                             }
-                            obj = obj->mSibling;
+                            obj = get_dwarf_sibling(obj);
                         }
                     }
                 }
@@ -1755,7 +1764,7 @@ int find_symbol_in_scope(Context * ctx, int frame, ContextAddress ip, Symbol * s
                 ObjectInfo * obj = get_dwarf_children(scope->obj);
                 while (obj != NULL) {
                     if (obj->mTag == TAG_lexical_block) find_in_object_tree(obj, 3, NULL, name);
-                    obj = obj->mSibling;
+                    obj = get_dwarf_sibling(obj);
                 }
             }
             clear_trap(&trap);
@@ -1786,8 +1795,19 @@ int find_symbol_in_scope(Context * ctx, int frame, ContextAddress ip, Symbol * s
 }
 
 static int find_by_addr_in_unit(ObjectInfo * parent, int level, UnitAddress * addr, UnitAddress * ip, Symbol ** res) {
-    int in_range = ip != NULL && check_in_range(parent, ip);
-    ObjectInfo * obj = get_dwarf_children(parent);
+    int in_range = 0;
+    ObjectInfo * obj = NULL;
+    if (level == 0) {
+        /* Code addresses are found in the unit scope index,
+         * the object tree is searched for other addresses, like addresses of variables */
+        obj = find_comp_unit_scope(parent->mCompUnit, addr->section, addr->lt_addr);
+        if (obj != NULL) {
+            elf_object2symbol(NULL, obj, res);
+            return 1;
+        }
+    }
+    in_range = ip != NULL && check_in_range(parent, ip);
+    obj = get_dwarf_children(parent);
     while (obj != NULL) {
         switch (obj->mTag) {
         case TAG_namespace:
@@ -1832,7 +1852,7 @@ static int find_by_addr_in_unit(ObjectInfo * parent, int level, UnitAddress * ad
             }
             break;
         }
-        obj = obj->mSibling;
+        obj = get_dwarf_sibling(obj);
     }
     return 0;
 }
@@ -1994,7 +2014,7 @@ static void enumerate_local_vars(ObjectInfo * parent, int level,
             }
             break;
         }
-        obj = obj->mSibling;
+        obj = get_dwarf_sibling(obj);
     }
 }
 
@@ -2064,6 +2084,91 @@ static void tmp_app_hex(char ch, uint64_t n) {
     }
 }
 
+#if ENABLE_SymbolFileHandles
+
+/*
+ * Symbol IDs refer to ELF files by short agent-local handles instead of file inode, device and
+ * modification time, e.g. "@S3%H1.12.6A4F.P123" instead of "@S3%803.1A2B3C.5F0E4D21.12.6A4F.P123".
+ * A handle table entry keeps the file identity and a pointer to the open ELF file,
+ * so decoding of an ID does not need to search ELF files.
+ * The pointers are dropped when the memory map changes or an ELF file is closed,
+ * and the file is looked up again on next use.
+ * When the table is full, the verbose form of file identity is used.
+ */
+
+#define FILE_HANDLES_MAX    0x10000
+#define FILE_HANDLES_HASH   0x100
+
+typedef struct FileHandle {
+    dev_t dev;
+    ino_t ino;
+    int64_t mtime;
+    ELF_File * file;            /* valid if 'generation' == file_handles_generation */
+    unsigned generation;
+    unsigned next;              /* next handle + 1 in the hash chain */
+} FileHandle;
+
+static FileHandle * file_handles = NULL;
+static unsigned file_handles_cnt = 0;
+static unsigned file_handles_max = 0;
+static unsigned file_handles_hash[FILE_HANDLES_HASH];
+static unsigned file_handles_generation = 1;
+
+static unsigned calc_file_hash(dev_t dev, ino_t ino, int64_t mtime) {
+    return (unsigned)(((uint64_t)dev * 31 + (uint64_t)ino * 7 + (uint64_t)mtime) % FILE_HANDLES_HASH);
+}
+
+static void elf_file_closed(ELF_File * file) {
+    file_handles_generation++;
+}
+
+/* Return file handle + 1, or 0 if the table is full */
+static unsigned get_file_handle(ELF_File * file) {
+    unsigned h = calc_file_hash(file->dev, file->ino, file->mtime);
+    unsigned i = file_handles_hash[h];
+    FileHandle * f = NULL;
+
+    while (i != 0) {
+        f = file_handles + i - 1;
+        if (f->dev == file->dev && f->ino == file->ino && f->mtime == file->mtime) return i;
+        i = f->next;
+    }
+    if (file_handles_cnt >= FILE_HANDLES_MAX) return 0;
+    if (file_handles_cnt >= file_handles_max) {
+        if (file_handles_max == 0) elf_add_close_listener(elf_file_closed);
+        file_handles_max = file_handles_max == 0 ? 16 : file_handles_max * 2;
+        file_handles = (FileHandle *)loc_realloc(file_handles, sizeof(FileHandle) * file_handles_max);
+    }
+    f = file_handles + file_handles_cnt++;
+    memset(f, 0, sizeof(FileHandle));
+    f->dev = file->dev;
+    f->ino = file->ino;
+    f->mtime = file->mtime;
+    f->next = file_handles_hash[h];
+    file_handles_hash[h] = file_handles_cnt;
+    return file_handles_cnt;
+}
+
+#endif /* ENABLE_SymbolFileHandles */
+
+static void tmp_app_file_id(char ch, ELF_File * file, unsigned sec, uint64_t id) {
+#if ENABLE_SymbolFileHandles
+    unsigned h = get_file_handle(file);
+    if (h != 0) {
+        tmp_app_char(ch);
+        tmp_app_hex('H', h - 1);
+    }
+    else
+#endif
+    {
+        tmp_app_hex(ch, file->dev);
+        tmp_app_hex('.', file->ino);
+        tmp_app_hex('.', file->mtime);
+    }
+    tmp_app_hex('.', sec);
+    tmp_app_hex('.', id);
+}
+
 const char * symbol2id(const Symbol * sym) {
     int frame = sym->frame;
     assert(sym->magic == SYMBOL_MAGIC);
@@ -2115,29 +2220,17 @@ const char * symbol2id(const Symbol * sym) {
         tmp_app_char('@');
         tmp_app_hex('S', sym->sym_class);
         if (obj_file != NULL) {
-            tmp_app_hex('%', obj_file->dev);
-            tmp_app_hex('.', obj_file->ino);
-            tmp_app_hex('.', obj_file->mtime);
-            tmp_app_hex('.', obj_sec);
-            tmp_app_hex('.', obj_id);
+            tmp_app_file_id('%', obj_file, obj_sec, obj_id);
         }
         if (var_file != NULL) {
-            tmp_app_hex('^', var_file->dev);
-            tmp_app_hex('.', var_file->ino);
-            tmp_app_hex('.', var_file->mtime);
-            tmp_app_hex('.', var_sec);
-            tmp_app_hex('.', var_id);
+            tmp_app_file_id('^', var_file, var_sec, var_id);
         }
         if (ref_file != NULL) {
             if (ref_file == obj_file && ref_sec == obj_sec && ref_id == obj_id) {
                 tmp_app_char('&');
             }
             else {
-                tmp_app_hex('*', ref_file->dev);
-                tmp_app_hex('.', ref_file->ino);
-                tmp_app_hex('.', ref_file->mtime);
-                tmp_app_hex('.', ref_sec);
-                tmp_app_hex('.', ref_id);
+                tmp_app_file_id('*', ref_file, ref_sec, ref_id);
             }
         }
         if (sym->has_address) tmp_app_hex('$', sym->address);
@@ -2171,6 +2264,7 @@ static uint64_t read_hex(const char ** s) {
 
 typedef struct FileID {
     int valid;
+    unsigned handle;
     dev_t dev;
     ino_t ino;
     int64_t mtime;
@@ -2179,20 +2273,51 @@ typedef struct FileID {
     ELF_File * file;
 } FileID;
 
-static void read_file_id(const char ** s, FileID * id) {
+static int read_file_id(const char ** s, FileID * id) {
     const char * p = *s;
     p++;
-    id->dev = (dev_t)read_hex(&p);
-    if (*p == '.') p++;
-    id->ino = (ino_t)read_hex(&p);
-    if (*p == '.') p++;
-    id->mtime = (int64_t)read_hex(&p);
+#if ENABLE_SymbolFileHandles
+    if (*p == 'H') {
+        FileHandle * f = NULL;
+        p++;
+        id->handle = (unsigned)read_hex(&p) + 1;
+        if (id->handle > file_handles_cnt) return -1;
+        f = file_handles + id->handle - 1;
+        id->dev = f->dev;
+        id->ino = f->ino;
+        id->mtime = f->mtime;
+    }
+    else
+#endif
+    {
+        id->dev = (dev_t)read_hex(&p);
+        if (*p == '.') p++;
+        id->ino = (ino_t)read_hex(&p);
+        if (*p == '.') p++;
+        id->mtime = (int64_t)read_hex(&p);
+    }
     if (*p == '.') p++;
     id->obj_sec = (unsigned)read_hex(&p);
     if (*p == '.') p++;
     id->obj_id = (ContextAddress)read_hex(&p);
     id->valid = 1;
     *s = p;
+    return 0;
+}
+
+static ELF_File * open_file_id(Context * ctx, FileID * id) {
+#if ENABLE_SymbolFileHandles
+    if (id->handle) {
+        FileHandle * f = file_handles + id->handle - 1;
+        if (f->generation != file_handles_generation) {
+            f->file = elf_open_inode(ctx, id->dev, id->ino, id->mtime);
+            if (f->file == NULL) return NULL;
+            f->generation = file_handles_generation;
+        }
+        return f->file;
+    }
+#endif
+    return elf_open_inode(ctx, id->dev, id->ino, id->mtime);
 }
 
 int id2symbol(const char * id, Symbol ** res) {
@@ -2228,9 +2353,12 @@ int id2symbol(const char * id, Symbol ** res) {
         memset(&ref, 0, sizeof(FileID));
         p = id + 2;
         sym->sym_class = (int8_t)read_hex(&p);
-        if (*p == '%') read_file_id(&p, &obj);
-        if (*p == '^') read_file_id(&p, &var);
-        if (*p == '*') read_file_id(&p, &ref);
+        if ((*p == '%' && read_file_id(&p, &obj) < 0) ||
+                (*p == '^' && read_file_id(&p, &var) < 0) ||
+                (*p == '*' && read_file_id(&p, &ref) < 0)) {
+            errno = ERR_INV_CONTEXT;
+            return -1;
+        }
         if (*p == '&') {
             p++;
             ref = obj;
@@ -2275,15 +2403,15 @@ int id2symbol(const char * id, Symbol ** res) {
             return -1;
         }
         if (obj.valid) {
-            obj.file = elf_open_inode(sym->ctx, obj.dev, obj.ino, obj.mtime);
+            obj.file = open_file_id(sym->ctx, &obj);
             if (obj.file == NULL) return -1;
         }
         if (var.valid) {
-            var.file = elf_open_inode(sym->ctx, var.dev, var.ino, var.mtime);
+            var.file = open_file_id(sym->ctx, &var);
             if (var.file == NULL) return -1;
         }
         if (ref.valid) {
-            ref.file = elf_open_inode(sym->ctx, ref.dev, ref.ino, ref.mtime);
+            ref.file = open_file_id(sym->ctx, &ref);
             if (ref.file == NULL) return -1;
         }
         if (set_trap(&trap)) {
@@ -2446,9 +2574,12 @@ static void add_inlined_subroutine(ObjectInfo * o, CompUnit * unit, ContextAddre
                 area.file = file_info->mName;
             }
             else {
-                char buf[FILE_PATH_SIZE];
-                snprintf(buf, sizeof(buf), "%s/%s", file_info->mDir, file_info->mName);
-                area.file = tmp_strdup(buf);
+                if (file_info->mFullName == NULL) {
+                    char buf[FILE_PATH_SIZE];
+                    snprintf(buf, sizeof(buf), "%s/%s", file_info->mDir, file_info->mName);
+                    file_info->mFullName = intern_dwarf_string(get_dwarf_cache(unit->mFile), buf);
+                }
+                area.file = file_info->mFullName;
             }
             area.file_mtime = file_info->mModTime;
             area.file_size = file_info->mSize;
@@ -2570,7 +2701,7 @@ static void search_inlined_subroutine(Context * ctx, ObjectInfo * obj, UnitAddre
             }
             break;
         }
-        o = o->mSibling;
+        o = get_dwarf_sibling(o);
     }
 }
 
@@ -2649,6 +2780,9 @@ int get_symbol_file_info(Context * ctx, ContextAddress addr, SymbolFileInfo ** i
 static void event_map_changed(Context * ctx, void * args) {
     /* Make sure there is no stale data in the ELF cache */
     elf_invalidate();
+#if ENABLE_SymbolFileHandles
+    file_handles_generation++;
+#endif
 }
 
 static MemoryMapEventListener map_listener = {
@@ -2730,7 +2864,7 @@ static U8_T get_array_index_length(ObjectInfo * ref, ObjectInfo * obj) {
         x = 0;
         while (c != NULL) {
             x++;
-            c = c->mSibling;
+            c = get_dwarf_sibling(c);
         }
         return x;
     }
@@ -2812,8 +2946,8 @@ static int get_object_size(ObjectInfo * ref, ObjectInfo * obj, unsigned dimensio
     case TAG_shared_type:
     case TAG_typedef:
     case TAG_subrange_type:
-        if (obj->mType == NULL) return 0;
-        return get_object_size(ref, obj->mType, 0, byte_size, bit_size);
+        if (get_dwarf_type(obj) == NULL) return 0;
+        return get_object_size(ref, get_dwarf_type(obj), 0, byte_size, bit_size);
     case TAG_compile_unit:
     case TAG_partial_unit:
     case TAG_module:
@@ -2841,15 +2975,15 @@ static int get_object_size(ObjectInfo * ref, ObjectInfo * obj, unsigned dimensio
             ObjectInfo * idx = get_dwarf_children(obj);
             while (idx != NULL) {
                 if (i++ >= dimension) length *= get_array_index_length(ref, idx);
-                idx = idx->mSibling;
+                idx = get_dwarf_sibling(idx);
             }
             if (get_num_prop(obj, AT_stride_size, &n)) {
                 *byte_size = (n * length + 7) / 8;
                 *bit_size = n * length;
                 return 1;
             }
-            if (obj->mType == NULL) return 0;
-            if (!get_object_size(ref, obj->mType, 0, &n, &m)) return 0;
+            if (get_dwarf_type(obj) == NULL) return 0;
+            if (!get_object_size(ref, get_dwarf_type(obj), 0, &n, &m)) return 0;
             if (m != 0) {
                 *byte_size = (m * length + 7) / 8;
                 *bit_size = m * length;
@@ -2977,7 +3111,7 @@ int get_symbol_type(const Symbol * sym, Symbol ** type) {
     }
     if (unpack(sym) < 0) return -1;
     if (is_modified_type(obj)) {
-        obj = obj->mType;
+        obj = get_dwarf_type(obj);
     }
     else {
         obj = get_object_type(obj);
@@ -3116,7 +3250,7 @@ static void get_object_type_class(ObjectInfo * obj, int * type_class) {
         case TAG_member:
         case TAG_constant:
         case TAG_template_type_param:
-            obj = obj->mType;
+            obj = get_dwarf_type(obj);
             break;
         default:
             obj = NULL;
@@ -3351,9 +3485,9 @@ int get_symbol_base_type(const Symbol * sym, Symbol ** base_type) {
     assert(sym->magic == SYMBOL_MAGIC);
     if (is_array_type_pseudo_symbol(sym)) {
         if (sym->base->sym_class == SYM_CLASS_FUNCTION) {
-            if (sym->base->obj != NULL && sym->base->obj->mType != NULL) {
+            if (sym->base->obj != NULL && get_dwarf_type(sym->base->obj) != NULL) {
                 if (unpack(sym->base) < 0) return -1;
-                elf_object2symbol(sym->ref, sym->base->obj->mType, base_type);
+                elf_object2symbol(sym->ref, get_dwarf_type(sym->base->obj), base_type);
                 return 0;
             }
             return err_no_info();
@@ -3369,8 +3503,8 @@ int get_symbol_base_type(const Symbol * sym, Symbol ** base_type) {
     }
     if (unpack(sym) < 0) return -1;
     if (sym->sym_class == SYM_CLASS_FUNCTION) {
-        if (sym->obj != NULL && sym->obj->mType != NULL) {
-            elf_object2symbol(sym->ref, sym->obj->mType, base_type);
+        if (sym->obj != NULL && get_dwarf_type(sym->obj) != NULL) {
+            elf_object2symbol(sym->ref, get_dwarf_type(sym->obj), base_type);
             return 0;
         }
         return err_no_info();
@@ -3381,16 +3515,16 @@ int get_symbol_base_type(const Symbol * sym, Symbol ** base_type) {
             int i = sym->dimension;
             ObjectInfo * idx = get_dwarf_children(obj);
             while (i > 0 && idx != NULL) {
-                idx = idx->mSibling;
+                idx = get_dwarf_sibling(idx);
                 i--;
             }
-            if (idx != NULL && idx->mSibling != NULL) {
+            if (idx != NULL && get_dwarf_sibling(idx) != NULL) {
                 elf_object2symbol(sym->ref, obj, base_type);
                 (*base_type)->dimension = sym->dimension + 1;
                 return 0;
             }
         }
-        obj = obj->mType;
+        obj = get_dwarf_type(obj);
         if (obj != NULL) {
             elf_object2symbol(sym->ref, find_definition(obj), base_type);
             (*base_type)->ref = sym->ref;
@@ -3421,7 +3555,7 @@ int get_symbol_index_type(const Symbol * sym, Symbol ** index_type) {
             int i = sym->dimension;
             ObjectInfo * idx = get_dwarf_children(obj);
             while (i > 0 && idx != NULL) {
-                idx = idx->mSibling;
+                idx = get_dwarf_sibling(idx);
                 i--;
             }
             if (idx != NULL) {
@@ -3493,7 +3627,7 @@ int get_symbol_length(const Symbol * sym, ContextAddress * length) {
             int i = sym->dimension;
             ObjectInfo * idx = get_dwarf_children(obj);
             while (i > 0 && idx != NULL) {
-                idx = idx->mSibling;
+                idx = get_dwarf_sibling(idx);
                 i--;
             }
             if (idx != NULL) {
@@ -3536,7 +3670,7 @@ int get_symbol_lower_bound(const Symbol * sym, int64_t * value) {
             int i = sym->dimension;
             ObjectInfo * idx = get_dwarf_children(obj);
             while (i > 0 && idx != NULL) {
-                idx = idx->mSibling;
+                idx = get_dwarf_sibling(idx);
                 i--;
             }
             if (idx != NULL) {
@@ -3619,7 +3753,7 @@ int get_symbol_children(const Symbol * sym, Symbol *** children, int * count) {
                         }
                         buf[n++] = y;
                     }
-                    i = i->mSibling;
+                    i = get_dwarf_sibling(i);
                 }
                 *children = buf;
                 *count = n;
@@ -3665,7 +3799,7 @@ int get_symbol_children(const Symbol * sym, Symbol *** children, int * count) {
                     buf = (Symbol **)tmp_realloc(buf, sizeof(Symbol *) * buf_len);
                 }
                 buf[n++] = x;
-                i = i->mSibling;
+                i = get_dwarf_sibling(i);
             }
         }
         *children = buf;
@@ -3764,7 +3898,7 @@ static void add_member_location_command(LocationInfo * info, ObjectInfo * obj) {
                 if (get_num_prop(obj, AT_byte_size, &byte_size)) {
                     cmd->args.piece.bit_offs = (unsigned)(byte_size * 8 - bit_offs - bit_size);
                 }
-                else if (obj->mType != NULL && get_object_size(obj, obj->mType, 0, &type_byte_size, &type_bit_size)) {
+                else if (get_dwarf_type(obj) != NULL && get_object_size(obj, get_dwarf_type(obj), 0, &type_byte_size, &type_bit_size)) {
                     cmd->args.piece.bit_offs = (unsigned)(type_byte_size * 8 - bit_offs - bit_size);
                 }
                 else {
@@ -3777,7 +3911,7 @@ static void add_member_location_command(LocationInfo * info, ObjectInfo * obj) {
 
 static int add_member_location(LocationInfo * info, ObjectInfo * type, ObjectInfo * member) {
     ObjectInfo * obj = NULL;
-    if (member->mParent == type) {
+    if (dwarf_ref2obj(member->mParent) == type) {
         add_member_location_command(info, member);
         return 1;
     }
@@ -3787,10 +3921,10 @@ static int add_member_location(LocationInfo * info, ObjectInfo * type, ObjectInf
             unsigned cnt = info->value_cmds.cnt;
             add_member_location_command(info, obj);
             add_location_command(info, SFT_CMD_SET_ARG)->args.arg_no = 0;
-            if (add_member_location(info, obj->mType, member)) return 1;
+            if (add_member_location(info, get_dwarf_type(obj), member)) return 1;
             info->value_cmds.cnt = cnt;
         }
-        obj = obj->mSibling;
+        obj = get_dwarf_sibling(obj);
     }
     return 0;
 }
@@ -3823,8 +3957,8 @@ static int read_discriminant_values(ObjectInfo * obj, LocationInfo * info) {
          * that the parent of this object contains the info to the
          * discriminant.
          */
-        assert(obj->mParent != NULL);
-        type = get_original_type(obj->mParent);
+        assert(dwarf_ref2obj(obj->mParent) != NULL);
+        type = get_original_type(dwarf_ref2obj(obj->mParent));
         get_object_type_class(type, &type_class);
         discr_signed = type_class == TYPE_CLASS_INTEGER;
 
@@ -3919,7 +4053,7 @@ int get_location_info(const Symbol * sym, LocationInfo ** res) {
 
         obj = find_definition(obj);
         org_type = obj;
-        while (org_type != NULL && org_type->mType != NULL && is_modified_type(org_type)) org_type = org_type->mType;
+        while (org_type != NULL && get_dwarf_type(org_type) != NULL && is_modified_type(org_type)) org_type = get_dwarf_type(org_type);
         info->big_endian = obj->mCompUnit->mFile->big_endian;
         if ((obj->mFlags & DOIF_external) == 0 && sym->var != NULL) {
             /* The symbol represents a member of a class instance */
@@ -3930,14 +4064,14 @@ int get_location_info(const Symbol * sym, LocationInfo ** res) {
                 set_errno(errno, "Cannot evaluate location of 'this' pointer");
                 return -1;
             }
-            if ((type->mTag != TAG_pointer_type && type->mTag != TAG_mod_pointer) || type->mType == NULL) exception(ERR_INV_CONTEXT);
+            if ((type->mTag != TAG_pointer_type && type->mTag != TAG_mod_pointer) || get_dwarf_type(type) == NULL) exception(ERR_INV_CONTEXT);
             read_dwarf_object_property(sym_ctx, sym_frame, sym->var, AT_location, &v);
             add_dwarf_location_command(info, &v);
             cmd = add_location_command(info, SFT_CMD_LOAD);
             cmd->args.mem.size = obj->mCompUnit->mDesc.mAddressSize;
             cmd->args.mem.big_endian = obj->mCompUnit->mFile->big_endian;
             add_location_command(info, SFT_CMD_SET_ARG)->args.arg_no = 0;
-            type = get_original_type(type->mType);
+            type = get_original_type(get_dwarf_type(type));
             if (!add_member_location(info, type, obj)) exception(ERR_INV_CONTEXT);
             clear_trap(&trap);
             return 0;
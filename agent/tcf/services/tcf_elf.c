@@ -41,6 +41,7 @@
 #include <tcf/services/dwarfcache.h>
 #include <tcf/services/dwarfreloc.h>
 #include <tcf/services/pathmap.h>
+#include <tcf/services/elf-index-cache.h>
 
 #if defined(USE_MMAP)
 #elif defined(_WRS_KERNEL)
@@ -176,6 +177,7 @@ static void elf_dispose(ELF_File * file) {
     loc_free(file->str_pool);
     loc_free(file->debug_info_file_name);
     loc_free(file->dwz_file_name);
+    loc_free(file->name_hashes);
     loc_free(file->name);
     loc_free(file);
 }
@@ -416,6 +418,57 @@ static ELF_File * find_open_file_by_inode(dev_t dev, ino_t ino, int64_t mtime) {
     return NULL;
 }
 
+static int get_build_id_note(ELF_Section * sec, char * id, size_t id_size) {
+    /* Find GNU build ID in a note section, return 1 if found, 0 if not found, -1 on error */
+    unsigned offs = 0;
+    if (elf_load(sec) < 0) return -1;
+    while (offs + 12 <= sec->size) {
+        U4_T name_sz = *(U4_T *)((U1_T *)sec->data + offs);
+        U4_T desc_sz = *(U4_T *)((U1_T *)sec->data + offs + 4);
+        U4_T type = *(U4_T *)((U1_T *)sec->data + offs + 8);
+        char * name = NULL;
+        offs += 12;
+        if (sec->file->byte_swap) {
+            SWAP(name_sz);
+            SWAP(desc_sz);
+            SWAP(type);
+        }
+        name = (char *)((U1_T *)sec->data + offs);
+        offs += name_sz;
+        while (offs % 4 != 0) offs++;
+        if (offs + desc_sz > sec->size) break;
+        if (type == 3 && name_sz == 4 && strcmp(name, "GNU") == 0 && desc_sz * 2 < id_size) {
+            size_t id_pos = 0;
+            U1_T * desc = (U1_T *)sec->data + offs;
+            U4_T i = 0;
+            while (i < desc_sz) {
+                U1_T j = (desc[i] >> 4) & 0xf;
+                U1_T k = desc[i++] & 0xf;
+                id[id_pos++] = j < 10 ? '0' + j : 'a' + j - 10;
+                id[id_pos++] = k < 10 ? '0' + k : 'a' + k - 10;
+            }
+            id[id_pos] = 0;
+            return 1;
+        }
+        offs += desc_sz;
+        while (offs % 4 != 0) offs++;
+    }
+    return 0;
+}
+
+int elf_get_build_id(ELF_File * file, char * id, size_t id_size) {
+    unsigned idx;
+    for (idx = 1; idx < file->section_cnt; idx++) {
+        ELF_Section * sec = file->sections + idx;
+        if (sec->size == 0) continue;
+        if (sec->type == SHT_NOTE && (sec->flags & SHF_ALLOC)) {
+            int r = get_build_id_note(sec, id, id_size);
+            if (r != 0) return r;
+        }
+    }
+    return 0;
+}
+
 static char * get_debug_info_file_name(ELF_File * file, int * error) {
     unsigned idx;
     char fnm[FILE_PATH_SIZE];
@@ -425,47 +478,20 @@ static char * get_debug_info_file_name(ELF_File * file, int * error) {
         ELF_Section * sec = file->sections + idx;
         if (sec->size == 0) continue;
         if (sec->type == SHT_NOTE && (sec->flags & SHF_ALLOC)) {
-            unsigned offs = 0;
-            if (elf_load(sec) < 0) {
+            char id[128];
+            int r = get_build_id_note(sec, id, sizeof(id));
+            if (r < 0) {
                 *error = errno;
                 return NULL;
             }
-            while (offs < sec->size) {
-                U4_T name_sz = *(U4_T *)((U1_T *)sec->data + offs);
-                U4_T desc_sz = *(U4_T *)((U1_T *)sec->data + offs + 4);
-                U4_T type = *(U4_T *)((U1_T *)sec->data + offs + 8);
-                char * name = NULL;
-                offs += 12;
-                if (file->byte_swap) {
-                    SWAP(name_sz);
-                    SWAP(desc_sz);
-                    SWAP(type);
-                }
-                name = (char *)((U1_T *)sec->data + offs);
-                offs += name_sz;
-                while (offs % 4 != 0) offs++;
-                if (type == 3 && strcmp(name, "GNU") == 0) {
-                    char * lnm = fnm;
-                    char id[64];
-                    size_t id_size = 0;
-                    U1_T * desc = (U1_T *)sec->data + offs;
-                    U4_T i = 0;
-                    while (i < desc_sz) {
-                        U1_T j = (desc[i] >> 4) & 0xf;
-                        U1_T k = desc[i++] & 0xf;
-                        id[id_size++] = j < 10 ? '0' + j : 'a' + j - 10;
-                        id[id_size++] = k < 10 ? '0' + k : 'a' + k - 10;
-                    }
-                    id[id_size++] = 0;
-                    trace(LOG_ELF, "Found GNU build ID %s", id);
-                    snprintf(fnm, sizeof(fnm), "/usr/lib/debug/.build-id/%.2s/%s.debug", id, id + 2);
+            if (r > 0) {
+                char * lnm = fnm;
+                trace(LOG_ELF, "Found GNU build ID %s", id);
+                snprintf(fnm, sizeof(fnm), "/usr/lib/debug/.build-id/%.2s/%s.debug", id, id + 2);
 #if SERVICE_PathMap
-                    lnm = apply_path_map(NULL, NULL, lnm, PATH_MAP_TO_LOCAL);
+                lnm = apply_path_map(NULL, NULL, lnm, PATH_MAP_TO_LOCAL);
 #endif
-                    if (stat(lnm, &buf) == 0) return loc_strdup(lnm);
-                }
-                offs += desc_sz;
-                while (offs % 4 != 0) offs++;
+                if (stat(lnm, &buf) == 0) return loc_strdup(lnm);
             }
         }
         else if (sec->name != NULL && strcmp(sec->name, ".gnu_debuglink") == 0) {
@@ -1200,6 +1226,134 @@ ELF_File * get_dwarf_file(ELF_File * file) {
     return file;
 }
 
+static unsigned calc_name_hash(const char * s, size_t len) {
+    unsigned h = 2166136261u;
+    while (len > 0) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+        len--;
+    }
+    return h;
+}
+
+static void add_name_hash(ELF_File * file, unsigned * max, const char * s, size_t len) {
+    if (len == 0) return;
+    if (file->name_hash_cnt >= *max) {
+        *max = *max == 0 ? 0x1000 : *max * 2;
+        file->name_hashes = (unsigned *)loc_realloc(file->name_hashes, sizeof(unsigned) * *max);
+    }
+    file->name_hashes[file->name_hash_cnt++] = calc_name_hash(s, len);
+}
+
+static void add_string_names(ELF_File * file, unsigned * max, const char * s, size_t len) {
+    size_t i;
+    size_t base = 0;
+    /* Skip binary data, e.g. in .debug_line file name entries */
+    while (len > 0 && ((unsigned char)*s < 0x20 || (unsigned char)*s >= 0x7f)) {
+        s++;
+        len--;
+    }
+    add_name_hash(file, max, s, len);
+    for (i = 0; i < len; i++) {
+        if (s[i] == '/' || s[i] == '\\') base = i + 1;
+        else if (s[i] == '@' && i > 0) {
+            /* Versioned symbol name */
+            add_name_hash(file, max, s, i);
+            break;
+        }
+    }
+    if (base > 0 && base < len) add_name_hash(file, max, s + base, len - base);
+    if (len > 2 && s[0] == '_' && s[1] == 'Z') {
+        /* Mangled C++ name: add <length><identifier> components */
+        i = 2;
+        while (i < len) {
+            size_t n = 0;
+            if (s[i] < '1' || s[i] > '9') {
+                i++;
+                continue;
+            }
+            while (i < len && s[i] >= '0' && s[i] <= '9') n = n * 10 + (s[i++] - '0');
+            if (n > len - i) break;
+            add_name_hash(file, max, s + i, n);
+            i += n;
+        }
+    }
+}
+
+static int load_name_hashes(ELF_File * file, unsigned * max, ELF_File * src) {
+    unsigned i;
+    for (i = 1; i < src->section_cnt; i++) {
+        ELF_Section * sec = src->sections + i;
+        const char * p = NULL;
+        const char * e = NULL;
+        if (sec->name == NULL || sec->type == SHT_NOBITS) continue;
+        if (sec->type != SHT_STRTAB && strcmp(sec->name, ".debug_str") != 0 &&
+            strcmp(sec->name, ".debug_line_str") != 0 && strcmp(sec->name, ".debug_line") != 0) continue;
+        if (elf_load(sec) < 0) return -1;
+        if (sec->data == NULL) continue;
+        p = (const char *)sec->data;
+        e = p + (size_t)sec->size;
+        while (p < e) {
+            const char * q = (const char *)memchr(p, 0, e - p);
+            if (q == NULL) q = e;
+            add_string_names(file, max, p, q - p);
+            p = q + 1;
+        }
+    }
+    return 0;
+}
+
+static int cmp_name_hashes(const void * x, const void * y) {
+    unsigned a = *(const unsigned *)x;
+    unsigned b = *(const unsigned *)y;
+    if (a < b) return -1;
+    if (a > b) return +1;
+    return 0;
+}
+
+int elf_may_contain_name(ELF_File * file, const char * name, size_t len) {
+    unsigned h = 0;
+    unsigned l = 0;
+    unsigned u = 0;
+    if (!file->name_hashes_loaded) {
+        unsigned max = 0;
+        ELF_File * dwarf = get_dwarf_file(file);
+        int error = load_name_hashes(file, &max, file) < 0;
+        if (!error && dwarf != file) error = load_name_hashes(file, &max, dwarf) < 0;
+        if (!error && dwarf->dwz_file_name != NULL) {
+            /* Names can be in .debug_str of DWZ common debug info file */
+            if (dwarf->dwz_file == NULL) error = 1;
+            else error = load_name_hashes(file, &max, dwarf->dwz_file) < 0;
+        }
+        file->name_hashes_loaded = 1;
+        file->name_hashes_error = error;
+        if (error || file->name_hash_cnt == 0) {
+            loc_free(file->name_hashes);
+            file->name_hashes = NULL;
+            file->name_hash_cnt = 0;
+        }
+        else {
+            unsigned i, j = 0;
+            qsort(file->name_hashes, file->name_hash_cnt, sizeof(unsigned), cmp_name_hashes);
+            for (i = 1; i < file->name_hash_cnt; i++) {
+                if (file->name_hashes[i] != file->name_hashes[j]) file->name_hashes[++j] = file->name_hashes[i];
+            }
+            file->name_hash_cnt = j + 1;
+            file->name_hashes = (unsigned *)loc_realloc(file->name_hashes, sizeof(unsigned) * file->name_hash_cnt);
+        }
+    }
+    if (file->name_hashes_error) return 1;
+    h = calc_name_hash(name, len);
+    u = file->name_hash_cnt;
+    while (l < u) {
+        unsigned m = (l + u) / 2;
+        if (file->name_hashes[m] < h) l = m + 1;
+        else if (file->name_hashes[m] > h) u = m;
+        else return 1;
+    }
+    return 0;
+}
+
 #if ENABLE_DebugContext
 
 static U8_T get_pheader_file_size(ELF_File * file, ELF_PHeader * p, MemoryRegion * r) {
@@ -2138,6 +2292,54 @@ static int section_symbol_comparator(const void * x, const void * y) {
     return 0;
 }
 
+#if ENABLE_ELF_INDEX_CACHE
+
+typedef struct SymAddrIndexRecord {
+    U4_T section;
+    U4_T index;
+    U8_T address;
+} SymAddrIndexRecord;
+
+static int load_cached_symbol_addr_index(ELF_Section * sec) {
+    ELF_File * file = sec->file;
+    size_t size = 0;
+    unsigned cnt = 0;
+    unsigned i = 0;
+    const SymAddrIndexRecord * r = (const SymAddrIndexRecord *)elf_index_cache_get(
+        file, ELF_INDEX_SYM_ADDR, sec->index, &size);
+    if (r == NULL || size % sizeof(SymAddrIndexRecord) != 0) return 0;
+    cnt = (unsigned)(size / sizeof(SymAddrIndexRecord));
+    for (i = 0; i < cnt; i++) {
+        if (r[i].section >= file->section_cnt) return 0;
+        if (r[i].index >= file->sections[r[i].section].sym_count) return 0;
+    }
+    if (cnt == 0) return 1;
+    sec->sym_addr_table = (ELF_SecSymbol *)loc_alloc(sizeof(ELF_SecSymbol) * cnt);
+    sec->sym_addr_cnt = sec->sym_addr_max = cnt;
+    for (i = 0; i < cnt; i++) {
+        ELF_SecSymbol * s = sec->sym_addr_table + i;
+        s->section = file->sections + r[i].section;
+        s->index = r[i].index;
+        s->address = r[i].address;
+    }
+    return 1;
+}
+
+static void save_symbol_addr_index(ELF_Section * sec) {
+    unsigned i = 0;
+    SymAddrIndexRecord * r = (SymAddrIndexRecord *)loc_alloc(sizeof(SymAddrIndexRecord) * (sec->sym_addr_cnt + 1));
+    for (i = 0; i < sec->sym_addr_cnt; i++) {
+        ELF_SecSymbol * s = sec->sym_addr_table + i;
+        r[i].section = s->section->index;
+        r[i].index = s->index;
+        r[i].address = s->address;
+    }
+    elf_index_cache_put(sec->file, ELF_INDEX_SYM_ADDR, sec->index, r, sizeof(SymAddrIndexRecord) * sec->sym_addr_cnt);
+    loc_free(r);
+}
+
+#endif /* ENABLE_ELF_INDEX_CACHE */
+
 static void create_symbol_addr_search_index(ELF_Section * sec) {
     ELF_File * file = sec->file;
     int elf64 = file->elf64;
@@ -2145,6 +2347,10 @@ static void create_symbol_addr_search_index(ELF_Section * sec) {
     int rel = file->type == ET_REL;
     unsigned m = 0;
 
+#if ENABLE_ELF_INDEX_CACHE
+    /* Addresses in relocatable files depend on section addresses assigned at load time */
+    if (!rel && load_cached_symbol_addr_index(sec)) return;
+#endif
     for (m = 1; m < file->section_cnt; m++) {
         unsigned n = 1;
         ELF_Section * tbl = file->sections + m;
@@ -2232,6 +2438,9 @@ static void create_symbol_addr_search_index(ELF_Section * sec) {
     }
 
     qsort(sec->sym_addr_table, sec->sym_addr_cnt, sizeof(ELF_SecSymbol), section_symbol_comparator);
+#if ENABLE_ELF_INDEX_CACHE
+    if (!rel) save_symbol_addr_index(sec);
+#endif
 }
 
 void elf_find_symbol_by_address(ELF_Section * sec, ContextAddress addr, ELF_SymbolInfo * sym_info) {
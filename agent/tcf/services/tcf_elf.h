@@ -460,6 +460,7 @@ struct ELF_File {
 
     void * dwarf_io_cache;
     void * dwarf_dt_cache;
+    void * index_cache;     /* Persistent index cache state, see elf-index-cache.h */
 
     unsigned age;   /* Seconds since last time the file was accessed */
 
@@ -471,6 +472,12 @@ struct ELF_File {
 
     int vxworks_got;
     unsigned section_opd;    /* PPC64 opd section number */
+
+    /* Sorted hashes of names found in the file string tables, see elf_may_contain_name() */
+    unsigned * name_hashes;
+    unsigned name_hash_cnt;
+    int name_hashes_loaded;
+    int name_hashes_error;
 };
 
 struct ELF_SecSymbol {
@@ -598,6 +605,15 @@ extern void elf_add_open_listener(ELFOpenListener listener);
  */
 extern ELF_File * get_dwarf_file(ELF_File * file);
 
+/*
+ * Check if the file, including its debug info file, can contain a name: a symbol name,
+ * a name component of a mangled C++ symbol, or a source file base name.
+ * The check is based on hashes of the strings found in the file string tables,
+ * it can return false positives, but never false negatives.
+ * Returns 0 if the file definitely does not contain the name, 1 otherwise.
+ */
+extern int elf_may_contain_name(ELF_File * file, const char * name, size_t len);
+
 #if ENABLE_DebugContext
 
 /*
@@ -703,6 +719,13 @@ extern int elf_find_got_entry(ELF_File * file, const char * name, ContextAddress
 extern int elf_find_plt_dynsym(ELF_Section * plt, unsigned entry,
                                ELF_SymbolInfo * sym_info, ContextAddress * offs);
 
+/*
+ * Get GNU build ID of the file as a hex string.
+ * Return 1 if the ID is found, 0 if the file has no build ID.
+ * If error, sets errno and returns -1.
+ */
+extern int elf_get_build_id(ELF_File * file, char * id, size_t id_size);
+
 /*
  * Get size of PLT enries.
  */
@@ -0,0 +1,914 @@
+/*******************************************************************************
+ * Copyright (c) 2026 Wind River Systems, Inc. and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ * The Eclipse Public License is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ * You may elect to redistribute this code under either of these licenses.
+ *
+ * Contributors:
+ *     Wind River Systems - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Breakpoints service stress test.
+ * The test is Linux specific: it uses /proc/<pid>/maps and /proc/<pid>/mem to check target memory.
+ */
+
+#include <tcf/config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <tcf/framework/context.h>
+#include <tcf/framework/events.h>
+#include <tcf/framework/errors.h>
+#include <tcf/framework/myalloc.h>
+#include <tcf/framework/cpudefs.h>
+#include <tcf/services/breakpoints.h>
+#include <tcf/services/memorymap.h>
+#include <tcf/services/symbols.h>
+#include <tcf/services/runctrl.h>
+#include <tcf/services/stacktrace.h>
+#include <tcf/services/fasttrace.h>
+#include <tcf/main/test.h>
+#include <tcf/test/bp-test.h>
+
+/* Number of breakpoints planted by the test */
+#if !defined(BP_TEST_CNT)
+#  define BP_TEST_CNT 100000
+#endif
+
+/* Max time to wait for breakpoints to be planted or removed, seconds */
+#define BP_TEST_TIMEOUT 600
+
+/* Duration of breakpoint condition benchmark phases, seconds */
+#if !defined(BP_COND_TEST_TIME)
+#  define BP_COND_TEST_TIME 2
+#endif
+
+/* Number of loop iterations in the range stepping test function */
+#if !defined(BP_STEP_TEST_CNT)
+#  define BP_STEP_TEST_CNT 10000
+#endif
+
+/* Depth of recursion in the stack trace test function */
+#if !defined(BP_STACK_TEST_DEPTH)
+#  define BP_STACK_TEST_DEPTH 500
+#endif
+
+/* Number of times the stack trace test stops the test process */
+#if !defined(BP_STACK_TEST_CNT)
+#  define BP_STACK_TEST_CNT 20
+#endif
+
+static Context * test_ctx = NULL;
+static pid_t test_pid = 0;
+static ContextAddress text_addr = 0;
+static size_t text_size = 0;
+static uint8_t * text_orig = NULL;
+static uint8_t * text_buf = NULL;
+static ContextAddress * bp_addr = NULL;
+static BreakpointInfo ** bp_info = NULL;
+static unsigned bp_cnt = 0;
+static uint64_t time_start = 0;
+
+static Context * cond_thread = NULL;
+static BreakpointInfo * cond_bp = NULL;
+static int cond_hit_cnt = 0;
+static unsigned cond_hit_value = 0;
+
+/* Breakpoint condition test function, executed by the test process */
+volatile unsigned bp_cond_test_cnt = 0;
+
+void bp_cond_test_func(int i) {
+    bp_cond_test_cnt++;
+}
+
+/* Range stepping test function, called by the test process when bp_step_test_on is set by the agent */
+volatile unsigned bp_step_test_on = 0;
+volatile unsigned bp_step_test_cnt = 0;
+
+void bp_step_test_func(void) {
+    unsigned i;
+    for (i = 0; i < BP_STEP_TEST_CNT; i++) bp_step_test_cnt++;
+}
+
+/* Stack trace test function, called by the test process when bp_stack_test_on is set by the agent */
+volatile unsigned bp_stack_test_on = 0;
+volatile unsigned bp_stack_test_cnt = 0;
+
+void bp_stack_test_func(int depth) {
+    if (depth > 0) bp_stack_test_func(depth - 1);
+    while (bp_stack_test_on) bp_stack_test_cnt++;
+}
+
+#if ENABLE_Symbols
+static BreakpointInfo * step_bp = NULL;
+static int step_hit = 0;
+static ContextAddress step_addr = 0;
+static ContextAddress step_size = 0;
+static unsigned step_cnt = 0;
+#endif
+
+#if ENABLE_FastTracepoints
+
+static FastTracepoint * fast_tp = NULL;
+static uint64_t fast_hit_cnt = 0;
+static uint64_t fast_err_cnt = 0;
+static unsigned fast_call_cnt = 0;
+static int fast_retry_cnt = 0;
+static int fast_overflow = 0;       /* 1 if testing ring buffer overflow */
+static uint64_t fast_hit_mid = 0;
+static uint64_t fast_lost_mid = 0;
+static BreakpointInfo * fast_bp = NULL;
+static int fast_dprintf = 0;        /* 1 if testing dprintf breakpoint with "FastTrace" attribute */
+
+#endif
+
+static uint64_t get_time_usec(void) {
+    struct timespec t;
+    if (clock_gettime(CLOCK_REALTIME, &t) < 0) return 0;
+    return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void test_done(int error) {
+    if (error) fprintf(stderr, "Breakpoints test failed: %s\n", errno_to_str(error));
+    else printf("Breakpoints test passed\n");
+    if (test_pid > 0) kill(test_pid, SIGKILL);
+    exit(error ? 1 : 0);
+}
+
+static void print_stats(const char * name, uint64_t time) {
+    BreakpointsStats * stats = get_breakpoints_stats();
+    printf("%s: %u breakpoints, %.3f sec\n", name, bp_cnt, time / 1e6);
+    printf("  flush: cnt %" PRIu64 ", time %.3f sec\n", stats->flush_cnt, stats->flush_time / 1e6);
+    printf("  plant: cnt %" PRIu64 ", time %.3f sec\n", stats->plant_cnt, stats->plant_time / 1e6);
+    printf("  remove: cnt %" PRIu64 ", time %.3f sec\n", stats->remove_cnt, stats->remove_time / 1e6);
+    printf("  memory: pages %" PRIu64 ", reads %" PRIu64 ", writes %" PRIu64 "\n",
+        stats->page_cnt, stats->mem_read_cnt, stats->mem_write_cnt);
+    printf("  location evaluation: cnt %" PRIu64 ", time %.3f sec, breakpoints %" PRIu64 ", skipped %" PRIu64 "\n",
+        stats->eval_cnt, stats->eval_time / 1e6, stats->eval_bp_cnt, stats->eval_skip_cnt);
+    fflush(stdout);
+    memset(stats, 0, sizeof(BreakpointsStats));
+}
+
+static int read_text(uint8_t * buf) {
+    /* Read target memory bypassing the agent, breakpoint instructions are not hidden */
+    char fnm[64];
+    size_t pos = 0;
+    int fd = -1;
+    snprintf(fnm, sizeof(fnm), "/proc/%d/mem", test_pid);
+    if ((fd = open(fnm, O_RDONLY)) < 0) return -1;
+    while (pos < text_size) {
+        ssize_t rd = pread(fd, buf + pos, text_size - pos, (off_t)(text_addr + pos));
+        if (rd <= 0) {
+            int error = rd < 0 ? errno : ERR_EOF;
+            close(fd);
+            errno = error;
+            return -1;
+        }
+        pos += rd;
+    }
+    close(fd);
+    return 0;
+}
+
+static int find_text_section(void) {
+    /* Find executable code of the test process main module */
+    char fnm[64];
+    char exe[FILE_PATH_SIZE];
+    char line[FILE_PATH_SIZE + 128];
+    ssize_t exe_len = 0;
+    FILE * file = NULL;
+    snprintf(fnm, sizeof(fnm), "/proc/%d/exe", test_pid);
+    if ((exe_len = readlink(fnm, exe, sizeof(exe) - 1)) < 0) return -1;
+    exe[exe_len] = 0;
+    snprintf(fnm, sizeof(fnm), "/proc/%d/maps", test_pid);
+    if ((file = fopen(fnm, "r")) == NULL) return -1;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        uint64_t addr0 = 0;
+        uint64_t addr1 = 0;
+        char perm[8];
+        char * path = strchr(line, '/');
+        if (sscanf(line, "%" SCNx64 "-%" SCNx64 " %7s", &addr0, &addr1, perm) != 3) continue;
+        if (strcmp(perm, "r-xp") != 0 || path == NULL) continue;
+        if (strncmp(path, exe, exe_len) != 0 || path[exe_len] != '\n') continue;
+        text_addr = (ContextAddress)addr0;
+        text_size = (size_t)(addr1 - addr0);
+        break;
+    }
+    fclose(file);
+    if (text_size == 0) {
+        errno = ERR_OTHER;
+        return -1;
+    }
+    return 0;
+}
+
+static size_t cmp_text(void) {
+    /* Compare target memory with original code, ignore break instructions planted by the agent itself, e.g. at "main" */
+    size_t i;
+    size_t cnt = 0;
+    for (i = 0; i < text_size; i++) {
+        if (text_buf[i] == text_orig[i]) continue;
+        if (is_breakpoint_address(test_ctx, text_addr + i)) continue;
+        cnt++;
+    }
+    return cnt;
+}
+
+static unsigned get_planted_cnt(void) {
+    unsigned i;
+    unsigned cnt = 0;
+    for (i = 0; i < bp_cnt; i++) {
+        if (is_breakpoint_address(test_ctx, bp_addr[i])) cnt++;
+    }
+    return cnt;
+}
+
+static void add_attribute(BreakpointAttribute *** ref, const char * name, const char * value) {
+    BreakpointAttribute * attr = (BreakpointAttribute *)loc_alloc_zero(sizeof(BreakpointAttribute));
+    attr->name = loc_strdup(name);
+    attr->value = loc_strdup(value);
+    **ref = attr;
+    *ref = &attr->next;
+}
+
+static void cond_test_hit(Context * ctx, void * args) {
+    if (context_read_mem(ctx, (ContextAddress)(uintptr_t)&bp_cond_test_cnt,
+            &cond_hit_value, sizeof(cond_hit_value)) < 0) test_done(errno);
+    cond_hit_cnt++;
+}
+
+static void create_cond_eventpoint(const char * condition) {
+    char buf[256];
+    BreakpointAttribute * attrs = NULL;
+    BreakpointAttribute ** ref = &attrs;
+    BreakpointsStats * stats = get_breakpoints_stats();
+
+    snprintf(buf, sizeof(buf), "\"%s\"", condition);
+    add_attribute(&ref, BREAKPOINT_ENABLED, "true");
+    add_attribute(&ref, BREAKPOINT_LOCATION, "\"bp_cond_test_func\"");
+    add_attribute(&ref, BREAKPOINT_SKIP_PROLOGUE, "true");
+    add_attribute(&ref, BREAKPOINT_CONDITION, buf);
+    memset(stats, 0, sizeof(BreakpointsStats));
+    cond_hit_cnt = 0;
+    cond_bp = create_eventpoint_ext(attrs, cond_thread, cond_test_hit, NULL);
+    time_start = get_time_usec();
+}
+
+#if ENABLE_Symbols && SERVICE_StackTrace && SERVICE_MemoryMap
+
+static unsigned stack_stop_cnt = 0;
+static uint64_t stack_reuse_time = 0;
+static uint64_t stack_full_time = 0;
+static ContextAddress * stack_buf0 = NULL;
+static ContextAddress * stack_buf1 = NULL;
+
+static int read_stack_trace(ContextAddress * buf) {
+    /* Read frame address and PC of all frames, return number of frames */
+    int cnt = get_bottom_frame(cond_thread) + 1;
+    int i;
+    if (cnt <= 0) return -1;
+    for (i = 0; i < cnt; i++) {
+        StackFrame * info = NULL;
+        uint64_t pc = 0;
+        if (get_frame_info(cond_thread, i, &info) < 0) return -1;
+        if (read_reg_value(info, get_PC_definition(cond_thread), &pc) < 0) pc = 0;
+        buf[i * 2] = info->fp;
+        buf[i * 2 + 1] = (ContextAddress)pc;
+    }
+    return cnt;
+}
+
+static void stack_test_suspend(void * args);
+
+static void stack_test_suspended(void * args) {
+    uint64_t time = 0;
+    int cnt0 = 0;
+    int cnt1 = 0;
+
+    if (!is_intercepted(cond_thread)) {
+        post_event_with_delay(stack_test_suspended, NULL, 1000);
+        return;
+    }
+    /* Stack trace that reuses frames of the previous stop */
+    time = get_time_usec();
+    if ((cnt0 = read_stack_trace(stack_buf0)) < 0) test_done(errno);
+    time = get_time_usec() - time;
+    if (stack_stop_cnt > 0) stack_reuse_time += time;
+    /* Memory map change event invalidates the stack trace, it is unwound from scratch */
+    memory_map_event_mapping_changed(test_ctx);
+    time = get_time_usec();
+    if ((cnt1 = read_stack_trace(stack_buf1)) < 0) test_done(errno);
+    time = get_time_usec() - time;
+    if (stack_stop_cnt > 0) stack_full_time += time;
+    if (cnt1 < BP_STACK_TEST_DEPTH) {
+        fprintf(stderr, "Stack trace is too short: %d frames\n", cnt1);
+        test_done(ERR_OTHER);
+    }
+    if (cnt0 != cnt1 || memcmp(stack_buf0, stack_buf1, sizeof(ContextAddress) * 2 * cnt1) != 0) {
+        fprintf(stderr, "Incremental stack trace does not match full stack trace\n");
+        test_done(ERR_OTHER);
+    }
+    if (++stack_stop_cnt < BP_STACK_TEST_CNT) {
+        if (continue_debug_context(cond_thread, NULL, RM_RESUME, 1, 0, 0) < 0) test_done(errno);
+        post_event_with_delay(stack_test_suspend, NULL, 10000);
+        return;
+    }
+    printf("Stack trace: %d frames, %u stops, full %.3f ms/stop, incremental %.3f ms/stop\n",
+        cnt1, stack_stop_cnt, stack_full_time / 1e3 / (stack_stop_cnt - 1),
+        stack_reuse_time / 1e3 / (stack_stop_cnt - 1));
+    fflush(stdout);
+    test_done(0);
+}
+
+static void stack_test_suspend(void * args) {
+    if (suspend_debug_context(test_ctx) < 0) test_done(errno);
+    post_event(stack_test_suspended, NULL);
+}
+
+static void start_stack_test(void) {
+    /* Stack trace test: the test process runs a deeply recursive function,
+     * the agent stops it a number of times and compares stack trace that reuses frames of the previous stop
+     * with stack trace unwound from scratch */
+    unsigned on = 1;
+    stack_buf0 = (ContextAddress *)loc_alloc(sizeof(ContextAddress) * 2 * (BP_STACK_TEST_DEPTH + 1000));
+    stack_buf1 = (ContextAddress *)loc_alloc(sizeof(ContextAddress) * 2 * (BP_STACK_TEST_DEPTH + 1000));
+    if (context_write_mem(cond_thread, (ContextAddress)(uintptr_t)&bp_stack_test_on, &on, sizeof(on)) < 0) test_done(errno);
+    if (continue_debug_context(cond_thread, NULL, RM_RESUME, 1, 0, 0) < 0) test_done(errno);
+    post_event_with_delay(stack_test_suspend, NULL, 100000);
+}
+
+#else
+
+static void start_stack_test(void) {
+    test_done(0);
+}
+
+#endif
+
+#if ENABLE_Symbols
+
+static void check_step_done(void * args) {
+    uint64_t time = get_time_usec() - time_start;
+    ContextAddress pc = 0;
+    unsigned cnt = 0;
+
+    if (!is_intercepted(cond_thread)) {
+        if (time > (uint64_t)BP_TEST_TIMEOUT * 1000000) test_done(ERR_OTHER);
+        post_event_with_delay(check_step_done, NULL, 1000);
+        return;
+    }
+    pc = get_regs_PC(cond_thread);
+    if (context_read_mem(cond_thread, (ContextAddress)(uintptr_t)&bp_step_test_cnt, &cnt, sizeof(cnt)) < 0) test_done(errno);
+    printf("Range step: %u loop iterations, %.3f sec\n", cnt - step_cnt, time / 1e6);
+    fflush(stdout);
+    /* Stepping over the function range must stop after the function returns */
+    if (pc >= step_addr && pc < step_addr + step_size) {
+        fprintf(stderr, "Range step stopped inside the range at %#" PRIx64 "\n", (uint64_t)pc);
+        test_done(ERR_OTHER);
+    }
+    if (cnt - step_cnt != BP_STEP_TEST_CNT) {
+        fprintf(stderr, "Range step did not complete the loop: %u iterations\n", cnt - step_cnt);
+        test_done(ERR_OTHER);
+    }
+    start_stack_test();
+}
+
+static void check_step_hit(void * args) {
+    uint64_t time = get_time_usec() - time_start;
+    if (!step_hit || !is_intercepted(cond_thread)) {
+        if (time > (uint64_t)BP_TEST_TIMEOUT * 1000000) test_done(ERR_OTHER);
+        post_event_with_delay(check_step_hit, NULL, 1000);
+        return;
+    }
+    destroy_eventpoint(step_bp);
+    step_bp = NULL;
+    if (get_regs_PC(cond_thread) != step_addr) {
+        fprintf(stderr, "Range step test function breakpoint is not hit\n");
+        test_done(ERR_OTHER);
+    }
+    if (context_read_mem(cond_thread, (ContextAddress)(uintptr_t)&bp_step_test_cnt,
+            &step_cnt, sizeof(step_cnt)) < 0) test_done(errno);
+    time_start = get_time_usec();
+    if (continue_debug_context(cond_thread, NULL, RM_STEP_OVER_RANGE, 1,
+            step_addr, step_addr + step_size) < 0) test_done(errno);
+    post_event_with_delay(check_step_done, NULL, 1000);
+}
+
+static void step_test_hit(Context * ctx, void * args) {
+    /* Keep the thread stopped at the function entry */
+    if (step_hit++ == 0 && suspend_debug_context(ctx) < 0) test_done(errno);
+}
+
+static void step_test_suspended(void * args) {
+    char location[64];
+    unsigned on = 1;
+    Symbol * sym = NULL;
+
+    if (!is_intercepted(cond_thread)) {
+        post_event_with_delay(step_test_suspended, NULL, 1000);
+        return;
+    }
+    if (find_symbol_by_name(test_ctx, STACK_NO_FRAME, 0, "bp_step_test_func", &sym) < 0 ||
+        get_symbol_address(sym, &step_addr) < 0 || get_symbol_size(sym, &step_size) < 0) test_done(errno);
+    if (context_write_mem(cond_thread, (ContextAddress)(uintptr_t)&bp_step_test_on, &on, sizeof(on)) < 0) test_done(errno);
+    snprintf(location, sizeof(location), "0x%" PRIx64, (uint64_t)step_addr);
+    step_bp = create_eventpoint(location, cond_thread, step_test_hit, NULL);
+    if (continue_debug_context(cond_thread, NULL, RM_RESUME, 1, 0, 0) < 0) test_done(errno);
+    time_start = get_time_usec();
+    post_event_with_delay(check_step_hit, NULL, 1000);
+}
+
+static void start_step_test(void) {
+    /* Range stepping test: step over the range of a function that contains a loop */
+    if (suspend_debug_context(test_ctx) < 0) test_done(errno);
+    post_event(step_test_suspended, NULL);
+}
+
+#else
+
+static void start_step_test(void) {
+    start_stack_test();
+}
+
+#endif
+
+#if ENABLE_FastTracepoints
+
+static int read_test_mem(void * addr, void * buf, size_t size) {
+    /* Read target memory bypassing the agent: the process can be running, and jumps are not hidden */
+    char fnm[64];
+    int fd = -1;
+    ssize_t rd = 0;
+    snprintf(fnm, sizeof(fnm), "/proc/%d/mem", test_pid);
+    if ((fd = open(fnm, O_RDONLY)) < 0) return -1;
+    rd = pread(fd, buf, size, (off_t)(uintptr_t)addr);
+    close(fd);
+    if (rd != (ssize_t)size) {
+        if (rd >= 0) errno = ERR_EOF;
+        return -1;
+    }
+    return 0;
+}
+
+static int read_test_cnt(unsigned * cnt) {
+    return read_test_mem((void *)&bp_cond_test_cnt, cnt, sizeof(*cnt));
+}
+
+static void fast_trace_hit(FastTracepoint * tp, FastTraceRecord * rec, void * args) {
+    /* RDI is the function argument, which is equal to the number of previous calls */
+    if (!fast_overflow && ((uint32_t)rec->regs[7] % 1000 != 0 || rec->values[0] % 1000 != 0)) fast_err_cnt++;
+    fast_hit_cnt++;
+}
+
+static void start_fast_trace_test(void * args);
+static void start_fast_remove_test(void * args);
+static void start_fast_dprintf_test(void * args);
+
+static void fast_trace_removed(void * args) {
+    /* The jump of the destroyed tracepoint must be removed when the process is stopped */
+    uint8_t buf[16];
+
+    if (!is_intercepted(cond_thread)) {
+        post_event_with_delay(fast_trace_removed, NULL, 1000);
+        return;
+    }
+    if (read_test_mem((void *)(uintptr_t)bp_cond_test_func, buf, sizeof(buf)) < 0) test_done(errno);
+    if (memcmp(buf, (void *)(uintptr_t)bp_cond_test_func, sizeof(buf)) != 0) {
+        if (fast_retry_cnt++ < 100) {
+            /* The thread can be stopped inside the trampoline, try again */
+            if (continue_debug_context(cond_thread, NULL, RM_RESUME, 1, 0, 0) < 0) test_done(errno);
+            post_event_with_delay(start_fast_remove_test, NULL, 1000);
+            return;
+        }
+        fprintf(stderr, "Fast tracepoint jump is not removed\n");
+        test_done(ERR_OTHER);
+    }
+    if (!fast_dprintf) {
+        if (continue_debug_context(cond_thread, NULL, RM_RESUME, 1, 0, 0) < 0) test_done(errno);
+        fast_retry_cnt = 0;
+        start_fast_dprintf_test(NULL);
+        return;
+    }
+    start_step_test();
+}
+
+static void start_fast_remove_test(void * args) {
+    if (suspend_debug_context(test_ctx) < 0) test_done(errno);
+    post_event(fast_trace_removed, NULL);
+}
+
+static void check_fast_dprintf(void * args) {
+    FastTraceStats * stats = get_fast_trace_stats();
+
+    destroy_eventpoint(fast_bp);
+    fast_bp = NULL;
+    printf("Fast trace dprintf breakpoint: %" PRIu64 " records\n", stats->record_cnt);
+    fflush(stdout);
+    if (stats->record_cnt == 0) {
+        fprintf(stderr, "Fast trace dprintf breakpoint records are missing\n");
+        test_done(ERR_OTHER);
+    }
+    fast_dprintf = 1;
+    fast_retry_cnt = 0;
+    start_fast_remove_test(NULL);
+}
+
+static void fast_dprintf_installed(void * args) {
+    FastTraceStats * stats = get_fast_trace_stats();
+
+    if (stats->jump_cnt == 0 && stats->fallback_cnt == 0) {
+        if (get_time_usec() - time_start > (uint64_t)BP_TEST_TIMEOUT * 1000000) test_done(ERR_OTHER);
+        post_event_with_delay(fast_dprintf_installed, NULL, 1000);
+        return;
+    }
+    if (stats->jump_cnt == 0) {
+        /* The breakpoint uses a break instruction, the thread can be stopped inside the displaced instructions */
+        destroy_eventpoint(fast_bp);
+        fast_bp = NULL;
+        if (fast_retry_cnt++ < 100) {
+            post_event_with_delay(start_fast_dprintf_test, NULL, 1000);
+            return;
+        }
+        fprintf(stderr, "Fast trace dprintf breakpoint is not installed\n");
+        test_done(ERR_OTHER);
+    }
+    if (is_breakpoint_address(test_ctx, (ContextAddress)(uintptr_t)bp_cond_test_func)) {
+        fprintf(stderr, "Break instruction is planted at fast trace dprintf breakpoint address\n");
+        test_done(ERR_OTHER);
+    }
+    post_event_with_delay(check_fast_dprintf, NULL, BP_COND_TEST_TIME * 1000000 / 2);
+}
+
+static void start_fast_dprintf_test(void * args) {
+    /* Breakpoints service: dprintf breakpoint with "FastTrace" attribute is implemented as fast tracepoint */
+    BreakpointAttribute * attrs = NULL;
+    BreakpointAttribute ** ref = &attrs;
+
+    add_attribute(&ref, BREAKPOINT_ENABLED, "true");
+    add_attribute(&ref, BREAKPOINT_LOCATION, "\"bp_cond_test_func\"");
+    add_attribute(&ref, BREAKPOINT_CONDITION, "\"$printf(\\\"%u\\\\n\\\", bp_cond_test_cnt)\"");
+    add_attribute(&ref, BREAKPOINT_FAST_TRACE, "true");
+    set_fast_trace_buffer_size(test_ctx, 0);
+    memset(get_fast_trace_stats(), 0, sizeof(FastTraceStats));
+    fast_bp = create_eventpoint_ext(attrs, NULL, cond_test_hit, NULL);
+    time_start = get_time_usec();
+    post_event_with_delay(fast_dprintf_installed, NULL, 1000);
+}
+
+static void check_fast_overflow(void * args) {
+    FastTraceStats * stats = get_fast_trace_stats();
+    uint64_t time = get_time_usec() - time_start;
+
+    if (time < (uint64_t)BP_COND_TEST_TIME * 1000000) {
+        /* Half time: the buffer must be overflowed already, records must keep arriving */
+        fast_hit_mid = fast_hit_cnt;
+        fast_lost_mid = stats->lost_cnt;
+        post_event_with_delay(check_fast_overflow, NULL, BP_COND_TEST_TIME * 1000000 / 2);
+        return;
+    }
+    destroy_fast_tracepoint(fast_tp);
+    fast_tp = NULL;
+    fast_retry_cnt = 0;
+    printf("Fast tracepoint overflow: %" PRIu64 " records, lost %" PRIu64 ", records after overflow %" PRIu64 "\n",
+        fast_hit_cnt, stats->lost_cnt, fast_hit_cnt - fast_hit_mid);
+    fflush(stdout);
+    if (fast_lost_mid == 0) {
+        fprintf(stderr, "Fast trace buffer is not overflowed\n");
+        test_done(ERR_OTHER);
+    }
+    if (fast_hit_cnt == fast_hit_mid) {
+        fprintf(stderr, "Fast tracepoint records are missing after buffer overflow\n");
+        test_done(ERR_OTHER);
+    }
+    start_fast_remove_test(NULL);
+}
+
+static void check_fast_trace(void * args) {
+    FastTraceStats * stats = get_fast_trace_stats();
+    uint64_t time = get_time_usec() - time_start;
+    unsigned cnt = 0;
+
+    if (read_test_cnt(&cnt) < 0) test_done(errno);
+    destroy_fast_tracepoint(fast_tp);
+    fast_tp = NULL;
+    cnt -= fast_call_cnt;
+    printf("Fast tracepoint: %u calls, %.0f calls/sec, %" PRIu64 " records, %.0f records/sec, lost %" PRIu64 "\n",
+        cnt, cnt * 1e6 / time, fast_hit_cnt, fast_hit_cnt * 1e6 / time, stats->lost_cnt);
+    printf("  ring buffer reads: cnt %" PRIu64 ", time %.3f sec\n", stats->drain_cnt, stats->drain_time / 1e6);
+    fflush(stdout);
+    if (fast_hit_cnt == 0) {
+        fprintf(stderr, "Fast tracepoint records are missing\n");
+        test_done(ERR_OTHER);
+    }
+    if (fast_err_cnt != 0) {
+        fprintf(stderr, "Invalid fast tracepoint records: %" PRIu64 "\n", fast_err_cnt);
+        test_done(ERR_OTHER);
+    }
+    /* Ring buffer overflow test: unconditional tracepoint, small buffer */
+    fast_overflow = 1;
+    fast_hit_cnt = 0;
+    fast_retry_cnt = 0;
+    start_fast_trace_test(NULL);
+}
+
+static void fast_trace_installed(void * args) {
+    int error = 0;
+    switch (get_fast_tracepoint_mode(fast_tp)) {
+    case FAST_TRACE_PENDING:
+        post_event_with_delay(fast_trace_installed, NULL, 1000);
+        return;
+    case FAST_TRACE_JUMP:
+        break;
+    default:
+        error = set_error_report_errno(get_fast_tracepoint_error(fast_tp));
+        if (get_error_code(error) == ERR_UNSUPPORTED && fast_retry_cnt++ < 100) {
+            /* The thread can be stopped inside instructions that are replaced by the jump, try again */
+            destroy_fast_tracepoint(fast_tp);
+            fast_tp = NULL;
+            post_event_with_delay(start_fast_trace_test, NULL, 1000);
+            return;
+        }
+        fprintf(stderr, "Fast tracepoint is not installed: %s\n", errno_to_str(error));
+        test_done(ERR_OTHER);
+    }
+    if (!fast_overflow) {
+        /* The jump must be in target memory, must be hidden from memory reads done by the agent,
+         * and must be protected from break instructions. The process is running,
+         * apply the memory read hook of context_read_mem() to raw memory contents */
+        ContextAddress addr = (ContextAddress)(uintptr_t)bp_cond_test_func;
+        uint8_t buf[16];
+        if (read_test_mem((void *)(uintptr_t)addr, buf, sizeof(buf)) < 0) test_done(errno);
+        if (memcmp(buf, (void *)(uintptr_t)addr, sizeof(buf)) == 0) {
+            fprintf(stderr, "Fast tracepoint jump not found in target memory\n");
+            test_done(ERR_OTHER);
+        }
+        if (check_breakpoints_on_memory_read(test_ctx, addr, buf, sizeof(buf)) < 0) test_done(errno);
+        if (memcmp(buf, (void *)(uintptr_t)addr, sizeof(buf)) != 0) {
+            fprintf(stderr, "Fast tracepoint jump is visible in target memory reads\n");
+            test_done(ERR_OTHER);
+        }
+        if (is_fast_trace_patch_address(test_ctx, addr) || !is_fast_trace_patch_address(test_ctx, addr + 1)) {
+            fprintf(stderr, "Invalid fast tracepoint patch address range\n");
+            test_done(ERR_OTHER);
+        }
+    }
+    if (read_test_cnt(&fast_call_cnt) < 0) test_done(errno);
+    memset(get_fast_trace_stats(), 0, sizeof(FastTraceStats));
+    time_start = get_time_usec();
+    if (fast_overflow) post_event_with_delay(check_fast_overflow, NULL, BP_COND_TEST_TIME * 1000000 / 2);
+    else post_event_with_delay(check_fast_trace, NULL, BP_COND_TEST_TIME * 1000000);
+}
+
+static void start_fast_trace_test(void * args) {
+    /* Fast tracepoint test: the tracepoint is installed while the process is running,
+     * trampolines and the ring buffer are allocated by the agent */
+    if (fast_overflow) {
+        set_fast_trace_buffer_size(test_ctx, 16);
+        fast_tp = create_fast_tracepoint(test_ctx, (ContextAddress)(uintptr_t)bp_cond_test_func,
+            NULL, fast_trace_hit, NULL);
+    }
+    else {
+        const char * values[] = { "bp_cond_test_cnt" };
+        fast_tp = create_fast_tracepoint_ext(test_ctx, (ContextAddress)(uintptr_t)bp_cond_test_func,
+            "bp_cond_test_cnt % 1000 == 0", values, 1, fast_trace_hit, NULL, NULL);
+    }
+    post_event(fast_trace_installed, NULL);
+}
+
+#else
+
+static void start_fast_trace_test(void * args) {
+    start_step_test();
+}
+
+#endif
+
+static void check_cond_rate(void * args) {
+    int phase = (int)(uintptr_t)args;
+    BreakpointsStats * stats = get_breakpoints_stats();
+    uint64_t time = get_time_usec() - time_start;
+
+    destroy_eventpoint(cond_bp);
+    cond_bp = NULL;
+    printf("Condition %s: %" PRIu64 " hits, %.0f hits/sec, evaluation time %.3f usec/hit, compiled %" PRIu64 "/%" PRIu64 "\n",
+        phase == 0 ? "compiled" : "interpreted", stats->cond_cnt, stats->cond_cnt * 1e6 / time,
+        stats->cond_cnt ? (double)stats->cond_time / stats->cond_cnt : 0.0,
+        stats->cond_compiled_cnt, stats->cond_cnt);
+    fflush(stdout);
+    if (stats->cond_cnt == 0) {
+        fprintf(stderr, "Breakpoint condition was not evaluated\n");
+        test_done(ERR_OTHER);
+    }
+    if (phase == 0) {
+        if (stats->cond_compiled_cnt == 0) {
+            fprintf(stderr, "Breakpoint condition was not compiled\n");
+            test_done(ERR_OTHER);
+        }
+        /* Type cast is not supported by the compiler, the condition is evaluated by the interpreter */
+        create_cond_eventpoint("(int)i == 1000000");
+        post_event_with_delay(check_cond_rate, (void *)(uintptr_t)1, BP_COND_TEST_TIME * 1000000);
+        return;
+    }
+    if (stats->cond_compiled_cnt != 0) {
+        fprintf(stderr, "Unexpected compiled breakpoint condition\n");
+        test_done(ERR_OTHER);
+    }
+    start_fast_trace_test(NULL);
+}
+
+static void check_cond_hit(void * args) {
+    uint64_t time = get_time_usec() - time_start;
+    if (cond_hit_cnt == 0) {
+        if (time > (uint64_t)BP_TEST_TIMEOUT * 1000000) test_done(ERR_OTHER);
+        /* Resume the test process if it was intercepted by the attach SIGSTOP */
+        if (is_intercepted(cond_thread) && continue_debug_context(cond_thread, NULL, RM_RESUME, 1, 0, 0) < 0) test_done(errno);
+        post_event_with_delay(check_cond_hit, NULL, 1000);
+        return;
+    }
+    destroy_eventpoint(cond_bp);
+    cond_bp = NULL;
+    /* The condition is evaluated at function entry, bp_cond_test_cnt is the number of previous calls */
+    if (cond_hit_cnt != 1 || cond_hit_value != 100) {
+        fprintf(stderr, "Invalid breakpoint condition hit: count %d, value %u\n", cond_hit_cnt, cond_hit_value);
+        test_done(ERR_OTHER);
+    }
+    if (get_breakpoints_stats()->cond_compiled_cnt == 0) {
+        fprintf(stderr, "Breakpoint condition was not compiled\n");
+        test_done(ERR_OTHER);
+    }
+    /* Measure condition evaluation rate, the condition is never true */
+    create_cond_eventpoint("i == 1000000");
+    post_event_with_delay(check_cond_rate, (void *)(uintptr_t)0, BP_COND_TEST_TIME * 1000000);
+}
+
+static void cond_test_attached(int error, Context * ctx, void * args) {
+    if (error) test_done(error);
+    context_unlock(test_ctx);
+    test_ctx = ctx;
+    context_lock(ctx);
+    cond_thread = cldl2ctxp(ctx->children.next);
+    create_cond_eventpoint("bp_cond_test_cnt == 100");
+    post_event(check_cond_hit, NULL);
+}
+
+static void start_cond_test(void) {
+    /* Breakpoint condition test: the test process calls bp_cond_test_func() in a loop */
+    int pid = 0;
+    kill(test_pid, SIGKILL);
+    test_pid = 0;
+    pid = fork();
+    if (pid < 0) test_done(errno);
+    if (pid == 0) {
+        int i;
+        int fd = sysconf(_SC_OPEN_MAX);
+        while (fd > 3) close(--fd);
+        if (context_attach_self() < 0) exit(1);
+        if (tkill(getpid(), SIGSTOP) < 0) exit(1);
+        for (i = 0;; i++) {
+            bp_cond_test_func(i);
+            if (bp_step_test_on) bp_step_test_func();
+            if (bp_stack_test_on) bp_stack_test_func(BP_STACK_TEST_DEPTH);
+        }
+    }
+    test_pid = pid;
+    if (context_attach(pid, cond_test_attached, NULL, CONTEXT_ATTACH_SELF) < 0) test_done(errno);
+}
+
+static void check_removed(void * args) {
+    uint64_t time = get_time_usec() - time_start;
+    if (get_planted_cnt() > 0) {
+        if (time > (uint64_t)BP_TEST_TIMEOUT * 1000000) test_done(ERR_OTHER);
+        post_event_with_delay(check_removed, NULL, 1000);
+        return;
+    }
+    print_stats("Remove", time);
+
+    /* Target memory must be restored */
+    if (read_text(text_buf) < 0) test_done(errno);
+    if (cmp_text() != 0) {
+        fprintf(stderr, "Target memory is not restored\n");
+        test_done(ERR_OTHER);
+    }
+    start_cond_test();
+}
+
+static void remove_breakpoints(void) {
+    unsigned i;
+    time_start = get_time_usec();
+    for (i = 0; i < bp_cnt; i++) destroy_eventpoint(bp_info[i]);
+    post_event(check_removed, NULL);
+}
+
+static void check_replanted(void * args) {
+    BreakpointsStats * stats = get_breakpoints_stats();
+    uint64_t time = get_time_usec() - time_start;
+    if (stats->eval_cnt == 0 || get_planted_cnt() < bp_cnt) {
+        if (time > (uint64_t)BP_TEST_TIMEOUT * 1000000) test_done(ERR_OTHER);
+        post_event_with_delay(check_replanted, NULL, 1000);
+        return;
+    }
+    /* Memory map did not change, breakpoint locations should not be re-evaluated */
+    if (stats->eval_bp_cnt > 0) {
+        fprintf(stderr, "Unexpected breakpoint location evaluations after memory map change event\n");
+        test_done(ERR_OTHER);
+    }
+    print_stats("Replant", time);
+    remove_breakpoints();
+}
+
+static void check_planted(void * args) {
+    unsigned i;
+    unsigned changed_cnt = 0;
+    uint64_t time = get_time_usec() - time_start;
+    if (get_planted_cnt() < bp_cnt) {
+        if (time > (uint64_t)BP_TEST_TIMEOUT * 1000000) test_done(ERR_OTHER);
+        post_event_with_delay(check_planted, NULL, 1000);
+        return;
+    }
+    print_stats("Plant", time);
+
+    /* Break instructions must be in target memory, and must be hidden from memory reads done by the agent */
+    if (read_text(text_buf) < 0) test_done(errno);
+    for (i = 0; i < bp_cnt; i++) {
+        size_t offs = (size_t)(bp_addr[i] - text_addr);
+        if (text_buf[offs] != text_orig[offs]) changed_cnt++;
+    }
+    if (changed_cnt == 0) {
+        fprintf(stderr, "Break instructions not found in target memory\n");
+        test_done(ERR_OTHER);
+    }
+    if (context_read_mem(test_ctx, text_addr, text_buf, text_size) < 0) test_done(errno);
+    if (memcmp(text_buf, text_orig, text_size) != 0) {
+        fprintf(stderr, "Break instructions are visible in target memory reads\n");
+        test_done(ERR_OTHER);
+    }
+
+#if SERVICE_MemoryMap
+    time_start = get_time_usec();
+    memory_map_event_mapping_changed(test_ctx);
+    post_event(check_replanted, NULL);
+#else
+    remove_breakpoints();
+#endif
+}
+
+static void test_process_attached(int error, Context * ctx, void * args) {
+    unsigned i;
+    size_t step = 0;
+    ContextAddress main_addr = 0;
+
+    if (error) test_done(error);
+    test_ctx = ctx;
+    context_lock(ctx);
+    test_pid = id2pid(ctx->id, NULL);
+    if (find_text_section() < 0) test_done(errno);
+
+    bp_cnt = BP_TEST_CNT;
+    if (bp_cnt > text_size) bp_cnt = (unsigned)text_size;
+    step = text_size / bp_cnt;
+    text_orig = (uint8_t *)loc_alloc(text_size);
+    text_buf = (uint8_t *)loc_alloc(text_size);
+    bp_addr = (ContextAddress *)loc_alloc(sizeof(ContextAddress) * bp_cnt);
+    bp_info = (BreakpointInfo **)loc_alloc(sizeof(BreakpointInfo *) * bp_cnt);
+    if (read_text(text_orig) < 0) test_done(errno);
+
+#if ENABLE_Symbols
+    {
+        /* The agent plants its own eventpoint at "main", the test should not use that address */
+        Symbol * sym = NULL;
+        if (find_symbol_by_name(ctx, STACK_NO_FRAME, 0, "main", &sym) < 0 ||
+            get_symbol_address(sym, &main_addr) < 0) main_addr = 0;
+    }
+#endif
+
+    time_start = get_time_usec();
+    for (i = 0; i < bp_cnt; i++) {
+        char location[64];
+        bp_addr[i] = text_addr + i * step;
+        if (bp_addr[i] == main_addr) bp_addr[i]++;
+        snprintf(location, sizeof(location), "0x%" PRIx64, (uint64_t)bp_addr[i]);
+        bp_info[i] = create_eventpoint(location, ctx, NULL, NULL);
+    }
+    post_event(check_planted, NULL);
+}
+
+static void start_test(void * args) {
+    if (run_test_process(test_process_attached, NULL) < 0) test_done(errno);
+}
+
+void ini_bp_test(void) {
+    post_event(start_test, NULL);
+}
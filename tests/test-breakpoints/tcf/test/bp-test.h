@@ -0,0 +1,28 @@
+/*******************************************************************************
+ * Copyright (c) 2026 Wind River Systems, Inc. and others.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ * The Eclipse Public License is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ * You may elect to redistribute this code under either of these licenses.
+ *
+ * Contributors:
+ *     Wind River Systems - initial API and implementation
+ *******************************************************************************/
+
+/*
+ * Breakpoints service stress test.
+ * The test starts the agent test process, plants a large number of software breakpoints,
+ * checks target memory and removes the breakpoints.
+ * Then it measures breakpoint condition evaluation rate for compiled and interpreted conditions, and exits.
+ */
+
+#ifndef D_bp_test
+#define D_bp_test
+
+extern void ini_bp_test(void);
+
+#endif /* D_bp_test */
@@ -18,6 +18,7 @@
 #include <tcf/config.h>
 
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <assert.h>
 #include <stdio.h>
 #include <fcntl.h>
@@ -39,6 +40,9 @@
 #include <tcf/services/stacktrace.h>
 #include <tcf/services/expressions.h>
 #include <tcf/services/dwarf.h>
+#if defined(__x86_64__)
+#include <machine/x86_64/tcf/disassembler-x86_64.h>
+#endif
 
 #include <tcf/backend/backend.h>
 
@@ -72,6 +76,7 @@ static unsigned line_info_cnt = 0;
 static ContextAddress pc = 0;
 static unsigned pass_cnt = 0;
 static int test_posted = 0;
+static int first_query = 0;
 static struct timespec time_start;
 
 static char ** files = NULL;
@@ -81,6 +86,8 @@ static unsigned files_cnt = 0;
 static int line_area_ok = 0;
 
 #define AREA_BUF_SIZE 0x100
+
+#define PC_LOOKUP_CNT 10000000
 static CodeArea area_buf[AREA_BUF_SIZE];
 static unsigned area_cnt = 0;
 
@@ -276,11 +283,11 @@ static void print_symbol(Symbol * sym) {
         if (obj->mName != NULL) {
             printf("  Name  : %s\n", obj->mName);
         }
-        if (obj->mType != NULL) {
-            printf("  Type  : 0x%" PRIX64 "\n", (uint64_t)obj->mType->mID);
+        if (obj->mType != 0) {
+            printf("  Type  : 0x%" PRIX64 "\n", (uint64_t)get_dwarf_type(obj)->mID);
         }
-        if (obj->mDefinition != NULL) {
-            printf("  Def   : 0x%" PRIX64 "\n", (uint64_t)obj->mDefinition->mID);
+        if (obj->mDefinition != 0) {
+            printf("  Def   : 0x%" PRIX64 "\n", (uint64_t)get_dwarf_definition(obj)->mID);
         }
     }
 }
@@ -365,6 +372,29 @@ static void print_time(struct timespec time_start, int cnt) {
     fflush(stdout);
 }
 
+static void print_elapsed_time(const char * name, struct timespec time_start) {
+    struct timespec time_now;
+    struct timespec time_diff;
+    clock_gettime(CLOCK_REALTIME, &time_now);
+    time_diff.tv_sec = time_now.tv_sec - time_start.tv_sec;
+    if (time_now.tv_nsec < time_start.tv_nsec) {
+        time_diff.tv_sec--;
+        time_diff.tv_nsec = time_now.tv_nsec + 1000000000 - time_start.tv_nsec;
+    }
+    else {
+        time_diff.tv_nsec = time_now.tv_nsec - time_start.tv_nsec;
+    }
+    printf("%s: %ld.%06ld\n", name, (long)time_diff.tv_sec, time_diff.tv_nsec / 1000);
+    fflush(stdout);
+}
+
+static void print_peak_rss(const char * name) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0) return;
+    printf("%s: %ld KB\n", name, (long)usage.ru_maxrss);
+    fflush(stdout);
+}
+
 static int symcmp(Symbol * x, Symbol * y) {
     char id[256];
     strcpy(id, symbol2id(x));
@@ -853,7 +883,7 @@ static void loc_var_func(void * args, Symbol * sym) {
         error_sym("get_symbol_name", sym);
     }
     /* Check for out-of-body definition */
-    out_of_body = sym_container != NULL && get_symbol_object(sym)->mParent != get_symbol_object(sym_container);
+    out_of_body = sym_container != NULL && get_symbol_object(sym)->mParent != dwarf_obj2ref(get_symbol_object(sym_container));
     if (!out_of_body && name != NULL) {
         int found_next = 0;
         int search_in_scope = 0;
@@ -1586,8 +1616,8 @@ static void test_public_names(void) {
     unsigned m = 0;
     time_t time_start = time(0);
     while (n < cache->mPubNames.mCnt) {
-        ObjectInfo * obj = cache->mPubNames.mNext[n++].mObject;
-        if (obj != NULL && (obj->mParent == NULL || obj->mParent->mTag != TAG_namespace)) {
+        ObjectInfo * obj = get_pub_names_object(cache->mPubNames.mNext + n++);
+        if (obj != NULL && (obj->mParent == 0 || dwarf_ref2obj(obj->mParent)->mTag != TAG_namespace)) {
             Symbol * sym1 = NULL;
             Symbol * sym2 = NULL;
             ContextAddress addr = 0;
@@ -1705,13 +1735,291 @@ static void check_addr_ranges(void) {
     }
 }
 
+static U8_T pc_lookup_rand(void) {
+    return ((U8_T)rand() << 32) ^ ((U8_T)rand() << 16) ^ (U8_T)rand();
+}
+
+static void test_pc_lookup_time(void) {
+    /* Benchmark PC to function lookup: compilation unit address index, then unit scope index */
+    DWARFCache * cache = get_dwarf_cache(get_dwarf_file(elf_file));
+    unsigned i;
+    unsigned found = 0;
+    ContextAddress code_size = 0;
+    struct timespec time_start;
+    struct timespec time_now;
+    U8_T time_ns = 0;
+
+    for (i = 0; i < mem_map.region_cnt; i++) {
+        MemoryRegion * r = mem_map.regions + i;
+        if (r->flags & MM_FLAG_X) code_size += r->size;
+    }
+    if (code_size == 0) return;
+    /* Don't count loading of DWARF objects and creation of the indexes */
+    for (i = 0; i < cache->mAddrRangesCnt; i++) {
+        UnitAddressRange * range = cache->mAddrRanges + i;
+        ELF_Section * sec = NULL;
+        if (range->mSection) sec = range->mUnit->mFile->sections + range->mSection;
+        find_comp_unit_scope(range->mUnit, sec, range->mAddr);
+    }
+    clock_gettime(CLOCK_REALTIME, &time_start);
+    for (i = 0; i < PC_LOOKUP_CNT; i++) {
+        unsigned j = 0;
+        ContextAddress rt_addr = 0;
+        ContextAddress addr = (ContextAddress)(pc_lookup_rand() % code_size);
+        UnitAddressRange * range = NULL;
+        for (j = 0; j < mem_map.region_cnt; j++) {
+            MemoryRegion * r = mem_map.regions + j;
+            if ((r->flags & MM_FLAG_X) == 0) continue;
+            if (addr < r->size) {
+                addr += r->addr;
+                break;
+            }
+            addr -= r->size;
+        }
+        range = elf_find_unit(elf_ctx, addr, addr, &rt_addr);
+        if (range != NULL) {
+            ELF_Section * sec = NULL;
+            if (range->mSection) sec = range->mUnit->mFile->sections + range->mSection;
+            if (find_comp_unit_scope(range->mUnit, sec, addr - rt_addr + range->mAddr) != NULL) found++;
+        }
+    }
+    clock_gettime(CLOCK_REALTIME, &time_now);
+    time_ns = (U8_T)(time_now.tv_sec - time_start.tv_sec) * 1000000000 + time_now.tv_nsec - time_start.tv_nsec;
+    printf("PC lookup time: %u ns, %u lookups, %u found\n",
+        (unsigned)(time_ns / PC_LOOKUP_CNT), PC_LOOKUP_CNT, found);
+    fflush(stdout);
+}
+
+#define FRAME_INFO_PC_CNT   256
+#define FRAME_INFO_THREADS  5000
+#define FRAME_INFO_DEPTH    16
+
+static void test_frame_info_time(void) {
+    /* Benchmark stack frame info lookup: unwind FRAME_INFO_THREADS stacks
+     * of FRAME_INFO_DEPTH frames, taken from a set of FRAME_INFO_PC_CNT code addresses */
+    static ELF_File * pc_file[FRAME_INFO_PC_CNT];
+    static ELF_Section * pc_sec[FRAME_INFO_PC_CNT];
+    static U8_T pc_addr[FRAME_INFO_PC_CNT];
+    U4_T seed = 12345;
+    unsigned pc_cnt = 0;
+    unsigned found = 0;
+    unsigned i;
+    ContextAddress code_size = 0;
+    struct timespec time_start;
+    struct timespec time_now;
+    U8_T time_ns = 0;
+
+    for (i = 0; i < mem_map.region_cnt; i++) {
+        MemoryRegion * r = mem_map.regions + i;
+        if (r->flags & MM_FLAG_X) code_size += r->size;
+    }
+    if (code_size == 0) return;
+    /* Don't use rand(): other tests depend on its sequence */
+    for (i = 0; i < FRAME_INFO_PC_CNT; i++) {
+        unsigned j = 0;
+        ContextAddress addr = 0;
+        seed = seed * 1103515245 + 12345;
+        addr = (ContextAddress)(seed % code_size);
+        for (j = 0; j < mem_map.region_cnt; j++) {
+            MemoryRegion * r = mem_map.regions + j;
+            if ((r->flags & MM_FLAG_X) == 0) continue;
+            if (addr < r->size) {
+                addr += r->addr;
+                break;
+            }
+            addr -= r->size;
+        }
+        pc_file[pc_cnt] = NULL;
+        pc_sec[pc_cnt] = NULL;
+        pc_addr[pc_cnt] = elf_map_to_link_time_address(elf_ctx, addr, 0, pc_file + pc_cnt, pc_sec + pc_cnt);
+        if (errno == 0 && pc_file[pc_cnt] != NULL) pc_cnt++;
+    }
+    if (pc_cnt == 0) return;
+    clock_gettime(CLOCK_REALTIME, &time_start);
+    for (i = 0; i < FRAME_INFO_THREADS * FRAME_INFO_DEPTH; i++) {
+        Trap trap;
+        unsigned n = 0;
+        seed = seed * 1103515245 + 12345;
+        n = (seed >> 8) % pc_cnt;
+        if (set_trap(&trap)) {
+            get_dwarf_stack_frame_info(elf_ctx, pc_file[n], pc_sec[n], pc_addr[n]);
+            if (dwarf_stack_trace_fp->cmds_cnt > 0) found++;
+            clear_trap(&trap);
+        }
+    }
+    clock_gettime(CLOCK_REALTIME, &time_now);
+    time_ns = (U8_T)(time_now.tv_sec - time_start.tv_sec) * 1000000000 + time_now.tv_nsec - time_start.tv_nsec;
+    printf("frame info time: %u us, %u threads, %u frames, %u found\n",
+        (unsigned)(time_ns / 1000), FRAME_INFO_THREADS, FRAME_INFO_THREADS * FRAME_INFO_DEPTH, found);
+    fflush(stdout);
+}
+
+#define SYMBOL_ID_CNT       256
+#define SYMBOL_ID_DECODES   200000
+
+static void test_symbol_id_time(void) {
+    /* Benchmark symbol ID decoding: IDs of functions and their types at random code addresses */
+    static char * ids[SYMBOL_ID_CNT];
+    U4_T seed = 54321;
+    unsigned id_cnt = 0;
+    size_t id_len = 0;
+    unsigned found = 0;
+    unsigned i;
+    ContextAddress code_size = 0;
+    struct timespec time_start;
+    struct timespec time_now;
+    U8_T time_ns = 0;
+
+    for (i = 0; i < mem_map.region_cnt; i++) {
+        MemoryRegion * r = mem_map.regions + i;
+        if (r->flags & MM_FLAG_X) code_size += r->size;
+    }
+    if (code_size == 0) return;
+    for (i = 0; i < SYMBOL_ID_CNT * 4 && id_cnt + 1 < SYMBOL_ID_CNT; i++) {
+        unsigned j = 0;
+        Symbol * sym = NULL;
+        Symbol * type = NULL;
+        ContextAddress addr = 0;
+        seed = seed * 1103515245 + 12345;
+        addr = (ContextAddress)(seed % code_size);
+        for (j = 0; j < mem_map.region_cnt; j++) {
+            MemoryRegion * r = mem_map.regions + j;
+            if ((r->flags & MM_FLAG_X) == 0) continue;
+            if (addr < r->size) {
+                addr += r->addr;
+                break;
+            }
+            addr -= r->size;
+        }
+        if (find_symbol_by_addr(elf_ctx, STACK_NO_FRAME, addr, &sym) < 0) continue;
+        ids[id_cnt++] = loc_strdup(symbol2id(sym));
+        if (get_symbol_type(sym, &type) == 0 && type != NULL) ids[id_cnt++] = loc_strdup(symbol2id(type));
+    }
+    tmp_gc();
+    if (id_cnt == 0) return;
+    for (i = 0; i < id_cnt; i++) id_len += strlen(ids[i]);
+    clock_gettime(CLOCK_REALTIME, &time_start);
+    for (i = 0; i < SYMBOL_ID_DECODES; i++) {
+        Symbol * sym = NULL;
+        if (id2symbol(ids[i % id_cnt], &sym) == 0) found++;
+        if (i % 1000 == 999) tmp_gc();
+    }
+    clock_gettime(CLOCK_REALTIME, &time_now);
+    time_ns = (U8_T)(time_now.tv_sec - time_start.tv_sec) * 1000000000 + time_now.tv_nsec - time_start.tv_nsec;
+    printf("symbol ID decode time: %u ns, %u IDs, avg length %u, %u decoded\n",
+        (unsigned)(time_ns / SYMBOL_ID_DECODES), id_cnt, (unsigned)(id_len / id_cnt), found);
+    fflush(stdout);
+    for (i = 0; i < id_cnt; i++) loc_free(ids[i]);
+}
+
+#if defined(__x86_64__) && ENABLE_DisassemblerX86_64
+
+#define DISASM_DIFF_MAX 10
+
+static void test_disassembler_time(void) {
+    /* Benchmark x86_64 instruction decoding: text disassembler vs structure decoder,
+     * and check that both agree on size, flow and target of instructions known to the text disassembler */
+    DisassemblerParams params;
+    unsigned text_cnt = 0;
+    unsigned struct_cnt = 0;
+    unsigned cmp_cnt = 0;
+    unsigned diff_cnt = 0;
+    U8_T text_ns = 0;
+    U8_T struct_ns = 0;
+    unsigned i;
+
+    if (elf_file->machine != EM_X86_64) return;
+    memset(&params, 0, sizeof(params));
+    for (i = 0; i < elf_file->section_cnt; i++) {
+        ELF_Section * sec = elf_file->sections + i;
+        struct timespec time_start;
+        struct timespec time_now;
+        uint8_t * code = NULL;
+        ContextAddress offs = 0;
+
+        if (sec->type != SHT_PROGBITS || (sec->flags & SHF_EXECINSTR) == 0 || sec->size == 0) continue;
+        if (elf_load(sec) < 0) error("elf_load");
+        code = (uint8_t *)sec->data;
+
+        clock_gettime(CLOCK_REALTIME, &time_start);
+        for (offs = 0; offs < sec->size; text_cnt++) {
+            DisassemblyResult * dr = disassemble_x86_64(code + offs, sec->addr + offs, sec->size - offs, &params);
+            offs += dr->size;
+        }
+        clock_gettime(CLOCK_REALTIME, &time_now);
+        text_ns += (U8_T)(time_now.tv_sec - time_start.tv_sec) * 1000000000 + time_now.tv_nsec - time_start.tv_nsec;
+
+        clock_gettime(CLOCK_REALTIME, &time_start);
+        for (offs = 0; offs < sec->size; struct_cnt++) {
+            InstructionStructX86 info;
+            if (decode_x86_instruction_struct(code + offs, sec->addr + offs, sec->size - offs, 1, &info) < 0) offs++;
+            else offs += info.size;
+        }
+        clock_gettime(CLOCK_REALTIME, &time_now);
+        struct_ns += (U8_T)(time_now.tv_sec - time_start.tv_sec) * 1000000000 + time_now.tv_nsec - time_start.tv_nsec;
+
+        for (offs = 0; offs < sec->size;) {
+            InstructionStructX86 info;
+            DisassemblyResult * dr = NULL;
+            if (decode_x86_instruction_struct(code + offs, sec->addr + offs, sec->size - offs, 1, &info) < 0) {
+                offs++;
+                continue;
+            }
+            dr = disassemble_x86_64(code + offs, sec->addr + offs, sec->size - offs, &params);
+            if (dr->flow != DISASM_FLOW_UNKNOWN) {
+                cmp_cnt++;
+                if (dr->size != info.size || dr->flow != info.flow ||
+                        (dr->flow != DISASM_FLOW_INDIRECT && dr->target != info.target)) {
+                    if (diff_cnt < DISASM_DIFF_MAX) {
+                        unsigned j;
+                        printf("Disassembler mismatch at %s+0x%" PRIX64 ":", sec->name, (uint64_t)offs);
+                        for (j = 0; j < info.size; j++) printf(" %02x", code[offs + j]);
+                        printf(", '%s' size %u flow %d, structure size %u flow %d\n",
+                            dr->text, (unsigned)dr->size, dr->flow, info.size, info.flow);
+                    }
+                    diff_cnt++;
+                }
+            }
+            offs += info.size;
+        }
+    }
+    if (text_cnt == 0) return;
+    printf("disassembler time: text %u ns, structure %u ns, %u instructions, %u compared\n",
+        (unsigned)(text_ns / text_cnt), (unsigned)(struct_ns / struct_cnt), struct_cnt, cmp_cnt);
+    fflush(stdout);
+    if (diff_cnt > 0) {
+        printf("Disassembler mismatch count: %u\n", diff_cnt);
+        exit(1);
+    }
+}
+
+#endif /* ENABLE_DisassemblerX86_64 */
+
+#define LINE_LOOKUP_CNT 100000
+
+static CodeArea * line_lookup_buf = NULL;
+static unsigned line_lookup_cnt = 0;
+
 static void check_line_info_cb(CodeArea * area, void * args) {
-    area_cnt++;
+    if (area_cnt++ % 16 == 0 && line_lookup_cnt < LINE_LOOKUP_CNT) {
+        line_lookup_buf[line_lookup_cnt++] = *area;
+    }
+}
+
+static void line_lookup_cb(CodeArea * area, void * args) {
+    (*(unsigned *)args)++;
 }
 
 static void check_line_info(void) {
+    /* Also measure time of address_to_line() and line_to_address() over the whole line info */
+    struct timespec time_start;
+    unsigned found = 0;
+    unsigned i;
     assert(file_has_line_info);
     area_cnt = 0;
+    line_lookup_cnt = 0;
+    if (line_lookup_buf == NULL) line_lookup_buf = (CodeArea *)loc_alloc(sizeof(CodeArea) * LINE_LOOKUP_CNT);
+    clock_gettime(CLOCK_REALTIME, &time_start);
     if (address_to_line(elf_ctx, 0, 0xffffffffffffffff, check_line_info_cb, NULL) < 0) {
         error("address_to_line");
     }
@@ -1719,6 +2027,20 @@ static void check_line_info(void) {
         set_errno(ERR_OTHER, "address_to_line(elf_ctx, 0, 0xffffffffffffffff,...) does not work");
         error("address_to_line");
     }
+    print_elapsed_time("address to line time", time_start);
+    clock_gettime(CLOCK_REALTIME, &time_start);
+    for (i = 0; i < line_lookup_cnt; i++) {
+        CodeArea * area = line_lookup_buf + i;
+        if (line_to_address(elf_ctx, area->file, area->start_line, area->start_column, line_lookup_cb, &found) < 0) {
+            error("line_to_address");
+        }
+    }
+    print_elapsed_time("line to address time", time_start);
+    print_peak_rss("line info peak RSS");
+    if (found < line_lookup_cnt) {
+        set_errno(ERR_OTHER, "line_to_address() does not find line areas");
+        error("line_to_address");
+    }
 }
 
 static void next_region(void) {
@@ -1788,6 +2110,18 @@ static void next_region(void) {
             }
         }
 
+        if (first_query) {
+            /* First query latency includes loading of debug info that is needed to answer the query */
+            first_query = 0;
+            if (find_symbol_by_addr(elf_ctx, STACK_NO_FRAME, pc, &sym) < 0) {
+                if (get_error_code(errno) != ERR_SYM_NOT_FOUND) {
+                    error("find_symbol_by_addr");
+                }
+            }
+            print_elapsed_time("first query time", time_start);
+            print_peak_rss("first query peak RSS");
+        }
+
         func_name = NULL;
         func_object = NULL;
         if (find_symbol_by_addr(elf_ctx, STACK_NO_FRAME, pc, &sym) < 0) {
@@ -1904,7 +2238,7 @@ static void next_region(void) {
                         }
                         if (flags & SYM_FLAG_EXTERNAL) {
                             if (find_symbol_by_name(elf_ctx, STACK_NO_FRAME, 0, func_name, &fnd_sym) < 0) {
-                                if (get_error_code(errno) == ERR_SYM_NOT_FOUND && func_object != NULL && func_object->mParent->mTag == TAG_namespace) {
+                                if (get_error_code(errno) == ERR_SYM_NOT_FOUND && func_object != NULL && dwarf_ref2obj(func_object->mParent)->mTag == TAG_namespace) {
                                     /* OK - not visible in the global name space */
                                 }
                                 else {
@@ -2155,6 +2489,12 @@ static void next_region(void) {
             printf("pub names time: %ld.%06ld\n", (long)time_diff.tv_sec, time_diff.tv_nsec / 1000);
             fflush(stdout);
             check_addr_ranges();
+            test_pc_lookup_time();
+            test_frame_info_time();
+            test_symbol_id_time();
+#if defined(__x86_64__) && ENABLE_DisassemblerX86_64
+            test_disassembler_time();
+#endif
             time_start = time_now;
         }
         else if (test_cnt >= 10000) {
@@ -2182,6 +2522,7 @@ static void next_file(void) {
     }
 
     clock_gettime(CLOCK_REALTIME, &time_start);
+    first_query = 1;
 
     f = elf_open(elf_file_name);
     if (f == NULL) {
@@ -2355,6 +2696,7 @@ static void test(void * args) {
             }
             check_line_info();
         }
+        if (elf_file_name != NULL) print_peak_rss("peak RSS");
         next_file();
     }
     else {
@@ -98,6 +98,7 @@
 #define ENABLE_ProfilerSST                      0
 #define ENABLE_ContextIdHashTable               0
 #define ENABLE_SignalHandlers                   0
+#define ENABLE_DisassemblerX86_64               1
 
 #include <tcf/framework/config.h>
 